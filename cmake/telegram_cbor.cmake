@@ -0,0 +1,34 @@
+# CBOR encoder and decoder generated from the telegram schema, added to the
+# app target of the including project. The schema is expanded from
+# DSMR_P1_SCHEMA by the C preprocessor before zcbor reads it.
+set(cbor_cddl_in ${CMAKE_CURRENT_LIST_DIR}/../src/telegram.cddl.in)
+set(cbor_schema_h
+  ${CMAKE_CURRENT_LIST_DIR}/../modules/dsmr_p1/include/dsmr_p1/schema.h)
+set(cbor_gen_dir ${CMAKE_CURRENT_BINARY_DIR}/telegram_cbor)
+set(cbor_cddl ${cbor_gen_dir}/telegram.cddl)
+set(cbor_gen_sources
+  ${cbor_gen_dir}/src/telegram_encode.c
+  ${cbor_gen_dir}/src/telegram_decode.c
+)
+add_custom_command(
+  OUTPUT ${cbor_cddl}
+  COMMAND ${CMAKE_COMMAND} -E make_directory ${cbor_gen_dir}
+  COMMAND ${CMAKE_C_COMPILER} -E -P -undef -x c
+          -I${CMAKE_CURRENT_LIST_DIR}/../modules/dsmr_p1/include
+          ${cbor_cddl_in} -o ${cbor_cddl}
+  DEPENDS ${cbor_cddl_in} ${cbor_schema_h}
+)
+add_custom_command(
+  OUTPUT ${cbor_gen_sources}
+  COMMAND ${PYTHON_EXECUTABLE} ${ZEPHYR_ZCBOR_MODULE_DIR}/zcbor/zcbor.py code
+          --cddl ${cbor_cddl}
+          --encode --decode
+          --entry-types p1_telegram
+          --file-header "Generated from telegram.cddl.in, do not edit"
+          --output-c ${cbor_gen_dir}/src/telegram.c
+          --output-h ${cbor_gen_dir}/include/telegram.h
+          --output-h-types ${cbor_gen_dir}/include/telegram_types.h
+  DEPENDS ${cbor_cddl}
+)
+target_sources(app PRIVATE ${cbor_gen_sources})
+target_include_directories(app PRIVATE ${cbor_gen_dir}/include)
@@ -0,0 +1,535 @@
+/**
+ * @file dsmr_p1_bench.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Host benchmark of the DSMR P1 library
+ *
+ * Times the CRC, the OBIS index (tokenize) and the schema parse of every
+ * telegram of the given files, the bundled DSMR 2.2/4.2/5.0 corpus by default.
+ * A file can hold any number of telegrams, such as a capture of a port.
+ *
+ * The lookup phases time a single value as /obis/ serves it, on the index of
+ * the frame and on an index built for the lookup alone, against the full
+ * parse of the total phase.
+ *
+ *   dsmr_p1_bench [-n iterations] [file...]
+ *   DSMR_P1_DEVICE=/dev/pts/3 dsmr_p1_bench -s
+ *   dsmr_p1_bench -d
+ *
+ * With -s the telegrams are read through the Linux backend instead, from
+ * DSMR_P1_DEVICE or stdin, and the received rate and the reception counters
+ * are reported at the end of the input.
+ *
+ * With -d a day of DSMR 5 telegrams at 1 Hz of a household with solar panels
+ * is rendered, parsed and passed through the delta codec of diff.h like the
+ * bus does. Every delta is decoded again and checked against the telegram.
+ * The bytes of the raw telegrams, of the JSON of every field as
+ * /api/v1/telegram serves it, of full encodings and of deltas are reported.
+ */
+
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/linux.h>
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#ifndef DSMR_P1_BENCH_CORPUS_DIR
+#define DSMR_P1_BENCH_CORPUS_DIR "corpus"
+#endif
+
+#define DEFAULT_ITERATIONS 10000
+#define MAX_TELEGRAMS 4096
+#define MAX_FILE_SIZE (MAX_TELEGRAMS * DSMR_P1_TELEGRAM_MAX_SIZE)
+
+static const char *const default_corpus[] = {
+    DSMR_P1_BENCH_CORPUS_DIR "/dsmr22.txt",
+    DSMR_P1_BENCH_CORPUS_DIR "/dsmr42.txt",
+    DSMR_P1_BENCH_CORPUS_DIR "/dsmr50.txt",
+    DSMR_P1_BENCH_CORPUS_DIR "/dsmr50_be.txt",
+    DSMR_P1_BENCH_CORPUS_DIR "/dsmr50_mbus.txt",
+};
+
+// Present in every version, the lookup phases time it
+#define LOOKUP_CODE "1-0:1.7.0"
+
+#define DAY_SECONDS 86400
+#define DAY_START 1767225600 // 2026-01-01 00:00:00 UTC
+#define DAY_PHASES 3
+#define DAY_GAS_INTERVAL 300 // seconds between M-Bus readings
+// Key and value of every field, as the API sizes its JSON
+#define DAY_JSON_MAX_LEN                                                       \
+    (2 + DSMR_P1_FIELD_COUNT * 64 + DSMR_P1_EQUIPMENT_ID_MAX_LEN)
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct telegram {
+    const uint8_t *data;
+    size_t len;
+    size_t crc_len; // up to and including the '!'
+};
+
+// State of the simulated meter of -d
+struct household {
+    uint64_t rng;
+    uint32_t second;
+    double energy[4]; // kWh delivered T1 and T2, received T1 and T2
+    double load;      // kW
+    double gas;       // m3
+    int64_t gas_time;
+};
+
+enum bench_phase {
+    PHASE_CRC,
+    PHASE_TOKENIZE,
+    PHASE_PARSE,
+    PHASE_LOOKUP,
+    PHASE_TOKENIZE_LOOKUP,
+    PHASE_TOTAL,
+    PHASE_COUNT,
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int bench_file(const char *path, unsigned int iterations);
+static size_t split_telegrams(const uint8_t *data, size_t len,
+                              struct telegram *telegrams, size_t max);
+static uint64_t run_phase(enum bench_phase phase,
+                          const struct telegram *telegrams, size_t count,
+                          unsigned int iterations);
+static uint64_t now_ns(void);
+static int stream(void);
+static int day(void);
+static size_t day_render(struct household *h, char *buf, size_t len);
+static int day_json(const struct dsmr_p1_telegram *t, char *buf, size_t len);
+static double day_noise(struct household *h);
+static size_t cosem_time(int64_t timestamp, char *buf, size_t len);
+static void stream_cb(const uint8_t *data, size_t len, void *user_data);
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_CRC] = "crc",
+    [PHASE_TOKENIZE] = "tokenize",
+    [PHASE_PARSE] = "parse",
+    [PHASE_LOOKUP] = "lookup",
+    [PHASE_TOKENIZE_LOOKUP] = "tok+look",
+    [PHASE_TOTAL] = "total",
+};
+
+static struct telegram telegrams[MAX_TELEGRAMS];
+static struct dsmr_p1_index indexes[MAX_TELEGRAMS];
+
+// Keeps the compiler from dropping the work being timed
+static volatile uint64_t sink;
+
+static atomic_uint_fast64_t stream_telegrams;
+static atomic_uint_fast64_t stream_bytes;
+
+/******************************************************************************
+ * Public Function Implementation
+ *****************************************************************************/
+
+int main(int argc, char **argv) {
+    unsigned int iterations = DEFAULT_ITERATIONS;
+    int opt;
+    int ret = 0;
+
+    while ((opt = getopt(argc, argv, "n:sd")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            return stream() < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        case 'd':
+            return day() < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s] [-d] [file...]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    printf("%-24s %5s %6s %-8s %12s %12s\n", "file", "count", "bytes",
+           "phase", "ns/telegram", "telegrams/s");
+    if (optind == argc) {
+        for (size_t i = 0; i < sizeof(default_corpus) / sizeof(*default_corpus);
+             i++) {
+            ret |= bench_file(default_corpus[i], iterations);
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        ret |= bench_file(argv[i], iterations);
+    }
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+static int bench_file(const char *path, unsigned int iterations) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    uint8_t *data = malloc(MAX_FILE_SIZE);
+    if (!data) {
+        fclose(file);
+        return -ENOMEM;
+    }
+    const size_t len = fread(data, 1, MAX_FILE_SIZE, file);
+    fclose(file);
+
+    const size_t count = split_telegrams(data, len, telegrams, MAX_TELEGRAMS);
+    if (count == 0) {
+        fprintf(stderr, "no telegram in %s\n", path);
+        free(data);
+        return -EBADMSG;
+    }
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += telegrams[i].len;
+    }
+
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    for (enum bench_phase phase = 0; phase < PHASE_COUNT; phase++) {
+        const uint64_t ns = run_phase(phase, telegrams, count, iterations);
+        const double per_telegram = (double)ns / ((double)count * iterations);
+        printf("%-24s %5zu %6zu %-8s %12.1f %12.0f\n", name, count,
+               bytes / count, phase_names[phase], per_telegram,
+               per_telegram > 0 ? 1e9 / per_telegram : 0);
+    }
+    free(data);
+    return 0;
+}
+
+// A telegram runs from '/' up to the end of the line of its '!'
+static size_t split_telegrams(const uint8_t *data, size_t len,
+                              struct telegram *out, size_t max) {
+    size_t count = 0;
+    size_t start = 0;
+
+    while (count < max) {
+        const uint8_t *begin = memchr(&data[start], '/', len - start);
+        if (!begin) {
+            break;
+        }
+        start = begin - data;
+        const uint8_t *end = memchr(begin, '!', len - start);
+        if (!end) {
+            break;
+        }
+        const uint8_t *eol = memchr(end, '\n', len - (end - data));
+        const size_t stop = eol ? (size_t)(eol - data) + 1 : len;
+        if (stop - start <= DSMR_P1_TELEGRAM_MAX_SIZE) {
+            out[count++] = (struct telegram){
+                .data = begin,
+                .len = stop - start,
+                .crc_len = (size_t)(end - begin) + 1,
+            };
+        }
+        start = stop;
+    }
+    return count;
+}
+
+static uint64_t run_phase(enum bench_phase phase, const struct telegram *t,
+                          size_t count, unsigned int iterations) {
+    // Parse and lookup time the index alone, on indexes built beforehand
+    const uint8_t *value;
+    size_t value_len;
+    for (size_t i = 0; i < count; i++) {
+        (void)dsmr_p1_index_build(t[i].data, t[i].len, &indexes[i]);
+    }
+
+    const uint64_t start = now_ns();
+    for (unsigned int n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < count; i++) {
+            switch (phase) {
+            case PHASE_CRC:
+                sink += dsmr_p1_crc(t[i].data, t[i].crc_len);
+                break;
+            case PHASE_TOKENIZE:
+                sink += dsmr_p1_index_build(t[i].data, t[i].len, &indexes[i]);
+                break;
+            case PHASE_PARSE:
+                sink += dsmr_p1_parse_index(t[i].data, &indexes[i]).timestamp;
+                break;
+            case PHASE_LOOKUP:
+                sink += dsmr_p1_index_lookup(&indexes[i], t[i].data,
+                                             LOOKUP_CODE, &value, &value_len);
+                sink += value_len;
+                break;
+            case PHASE_TOKENIZE_LOOKUP:
+                sink += dsmr_p1_index_build(t[i].data, t[i].len, &indexes[i]);
+                sink += dsmr_p1_index_lookup(&indexes[i], t[i].data,
+                                             LOOKUP_CODE, &value, &value_len);
+                sink += value_len;
+                break;
+            default:
+                sink += dsmr_p1_crc(t[i].data, t[i].crc_len);
+                sink += dsmr_p1_parse_telegram(t[i].data, t[i].len).timestamp;
+                break;
+            }
+        }
+    }
+    return now_ns() - start;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int stream(void) {
+    int ret = dsmr_p1_set_callback(stream_cb, NULL);
+    if (ret == 0) {
+        ret = dsmr_p1_init();
+    }
+    if (ret < 0) {
+        fprintf(stderr, "could not start the backend: %d\n", ret);
+        return ret;
+    }
+    const uint64_t start = now_ns();
+    (void)dsmr_p1_enable();
+    ret = dsmr_p1_linux_join();
+    const uint64_t ns = now_ns() - start;
+
+    const uint64_t count = atomic_load(&stream_telegrams);
+    printf("telegrams %llu bytes %llu seconds %.3f telegrams/s %.1f\n",
+           (unsigned long long)count,
+           (unsigned long long)atomic_load(&stream_bytes), ns / 1e9,
+           ns ? count * 1e9 / ns : 0);
+
+    struct dsmr_p1_rx_stats stats;
+    dsmr_p1_get_rx_stats(&stats);
+    printf("received %u overflow %u framing %u crc %u gaps %u missed %u\n",
+           stats.received, stats.lost[DSMR_P1_LOSS_OVERFLOW],
+           stats.lost[DSMR_P1_LOSS_FRAMING], stats.lost[DSMR_P1_LOSS_CRC],
+           stats.gaps, stats.missed);
+    return ret;
+}
+
+static void stream_cb(const uint8_t *data, size_t len, void *user_data) {
+    static struct dsmr_p1_telegram prev;
+    (void)user_data;
+
+    const struct dsmr_p1_telegram telegram = dsmr_p1_parse_telegram(data, len);
+    (void)dsmr_p1_check_gap(&prev, &telegram);
+    prev = telegram;
+    sink += telegram.timestamp;
+    atomic_fetch_add(&stream_telegrams, 1);
+    atomic_fetch_add(&stream_bytes, len);
+}
+
+static int day(void) {
+    static char raw[DSMR_P1_TELEGRAM_MAX_SIZE];
+    static char json[DAY_JSON_MAX_LEN];
+    uint8_t delta[DSMR_P1_DELTA_MAX_LEN];
+    struct household h = {
+        .rng = 0x9e3779b97f4a7c15ULL,
+        .energy = {4321.0, 5432.0, 1234.0, 2345.0},
+        .load = 0.4,
+        .gas = 1234.5,
+    };
+    struct dsmr_p1_telegram prev = {0};
+    struct dsmr_p1_telegram decoded = {0};
+    uint64_t raw_bytes = 0, json_bytes = 0, full_bytes = 0, delta_bytes = 0;
+    uint64_t changed_fields = 0, encode_ns = 0;
+
+    for (uint32_t n = 0; n < DAY_SECONDS; n++) {
+        const size_t raw_len = day_render(&h, raw, sizeof(raw));
+        const struct dsmr_p1_telegram cur =
+            dsmr_p1_parse_telegram((const uint8_t *)raw, raw_len);
+        const int json_len = day_json(&cur, json, sizeof(json));
+        const int full_len = dsmr_p1_delta_encode(&cur, DSMR_P1_FIELDS_ALL,
+                                                  delta, sizeof(delta));
+
+        // The first telegram is a full one, like the first frame of a port
+        const uint64_t start = now_ns();
+        const uint32_t changed =
+            n == 0 ? DSMR_P1_FIELDS_ALL : dsmr_p1_diff(&prev, &cur);
+        const int delta_len =
+            dsmr_p1_delta_encode(&cur, changed, delta, sizeof(delta));
+        encode_ns += now_ns() - start;
+
+        if (json_len < 0 || full_len < 0 || delta_len < 0 ||
+            dsmr_p1_delta_decode(delta, delta_len, &decoded) < 0 ||
+            dsmr_p1_diff(&decoded, &cur) != 0) {
+            fprintf(stderr, "telegram %u does not round trip\n", n);
+            return -EBADMSG;
+        }
+        raw_bytes += raw_len;
+        json_bytes += json_len;
+        full_bytes += full_len;
+        delta_bytes += delta_len;
+        changed_fields += __builtin_popcount(changed);
+        prev = cur;
+    }
+
+    printf("telegrams %u raw %.1f json %.1f full %.1f delta %.1f "
+           "bytes/telegram\n",
+           DAY_SECONDS, (double)raw_bytes / DAY_SECONDS,
+           (double)json_bytes / DAY_SECONDS, (double)full_bytes / DAY_SECONDS,
+           (double)delta_bytes / DAY_SECONDS);
+    printf("delta %.2f%% of raw %.2f%% of json %.2f%% of full, "
+           "%.1f fields/telegram %.1f ns/telegram\n",
+           100.0 * delta_bytes / raw_bytes, 100.0 * delta_bytes / json_bytes,
+           100.0 * delta_bytes / full_bytes,
+           (double)changed_fields / DAY_SECONDS,
+           (double)encode_ns / DAY_SECONDS);
+    return 0;
+}
+
+// The next second of the household as a DSMR 5 telegram with its CRC
+static size_t day_render(struct household *h, char *buf, size_t len) {
+    const int64_t timestamp = DAY_START + h->second;
+    const double hour = (h->second % DAY_SECONDS) / 3600.0;
+    char now[16], gas_time[16];
+    size_t n = 0;
+
+    // A parabola of sunshine from 6 to 18, a random walk of the load
+    const double sun = 1.0 - (hour - 12.0) * (hour - 12.0) / 36.0;
+    const double solar = sun > 0 ? 3.5 * sun : 0.0;
+    h->load += 0.05 * day_noise(h);
+    h->load = h->load < 0.1 ? 0.1 : h->load > 8.0 ? 8.0 : h->load;
+    const double delivered = h->load > solar ? h->load - solar : 0.0;
+    const double received = solar > h->load ? solar - h->load : 0.0;
+    const int tariff = hour < 7.0 || hour >= 23.0 ? 1 : 2;
+    h->energy[tariff - 1] += delivered / 3600;
+    h->energy[tariff + 1] += received / 3600;
+    if (h->second % DAY_GAS_INTERVAL == 0) {
+        h->gas += hour < 8.0 || hour >= 17.0 ? 0.05 : 0.005;
+        h->gas_time = timestamp;
+    }
+    h->second++;
+
+    cosem_time(timestamp, now, sizeof(now));
+    cosem_time(h->gas_time, gas_time, sizeof(gas_time));
+    n += snprintf(&buf[n], len - n,
+                  "/ISk5\\2MT382-1000\r\n"
+                  "\r\n"
+                  "1-3:0.2.8(50)\r\n"
+                  "0-0:1.0.0(%s)\r\n"
+                  "0-0:96.1.1(4B384547303034303436333935353037)\r\n"
+                  "1-0:1.8.1(%010.3f*kWh)\r\n"
+                  "1-0:1.8.2(%010.3f*kWh)\r\n"
+                  "1-0:2.8.1(%010.3f*kWh)\r\n"
+                  "1-0:2.8.2(%010.3f*kWh)\r\n"
+                  "0-0:96.14.0(%04d)\r\n"
+                  "1-0:1.7.0(%06.3f*kW)\r\n"
+                  "1-0:2.7.0(%06.3f*kW)\r\n"
+                  "0-0:96.7.21(00004)\r\n"
+                  "0-0:96.7.9(00002)\r\n"
+                  "1-0:99.97.0(1)(0-0:96.7.19)(251208152415W)(0000000240*s)"
+                  "\r\n"
+                  "1-0:32.32.0(00002)\r\n"
+                  "1-0:52.32.0(00001)\r\n"
+                  "1-0:72.32.0(00000)\r\n"
+                  "1-0:32.36.0(00000)\r\n"
+                  "1-0:52.36.0(00003)\r\n"
+                  "1-0:72.36.0(00000)\r\n"
+                  "0-0:96.13.0()\r\n",
+                  now, h->energy[0], h->energy[1], h->energy[2], h->energy[3],
+                  tariff, delivered, received);
+    for (int phase = 0; phase < DAY_PHASES; phase++) {
+        const int code = 32 + 20 * phase;
+        const double voltage = 230.0 + 1.5 * day_noise(h);
+        const int current =
+            (int)((delivered + received) * 1000 / DAY_PHASES / voltage + 0.5);
+        n += snprintf(&buf[n], len - n,
+                      "1-0:%d.7.0(%05.1f*V)\r\n"
+                      "1-0:%d.7.0(%03d*A)\r\n"
+                      "1-0:%d.7.0(%06.3f*kW)\r\n"
+                      "1-0:%d.7.0(%06.3f*kW)\r\n",
+                      code, voltage, code - 1, current, code - 11,
+                      delivered / DAY_PHASES, code - 10, received / DAY_PHASES);
+    }
+    n += snprintf(&buf[n], len - n,
+                  "0-1:24.1.0(003)\r\n"
+                  "0-1:96.1.0(3232323241424344313233343536373839)\r\n"
+                  "0-1:24.2.1(%s)(%09.3f*m3)\r\n"
+                  "!",
+                  gas_time, h->gas);
+    n += snprintf(&buf[n], len - n, "%04X\r\n",
+                  dsmr_p1_crc((const uint8_t *)buf, n));
+    return n;
+}
+
+// Every field under its key, numbers in the unit sent by the meter
+static int day_json(const struct dsmr_p1_telegram *t, char *buf, size_t len) {
+    char value[DSMR_P1_FIELD_FORMAT_MAX_LEN];
+    size_t n = 0;
+
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        const struct dsmr_p1_field_info *info = &dsmr_p1_fields[field];
+        const char *sep = field == 0 ? "{" : ",";
+        int ret;
+
+        if (info->type == DSMR_P1_TYPE_STRING) {
+            ret = snprintf(&buf[n], len - n, "%s\"%s\":\"%s\"", sep,
+                           info->key, dsmr_p1_field_string(t, field));
+        } else if (dsmr_p1_field_format(value, sizeof(value),
+                                        dsmr_p1_field_value(t, field),
+                                        info->scale) < 0) {
+            return -ENOMEM;
+        } else {
+            ret = snprintf(&buf[n], len - n, "%s\"%s\":%s", sep, info->key,
+                           value);
+        }
+        if (ret < 0 || (size_t)ret >= len - n) {
+            return -ENOMEM;
+        }
+        n += ret;
+    }
+    if (n + 1 >= len) {
+        return -ENOMEM;
+    }
+    buf[n++] = '}';
+    return n;
+}
+
+// Roughly normal around 0 with a deviation of 1, from a xorshift generator
+static double day_noise(struct household *h) {
+    double sum = 0;
+
+    for (int i = 0; i < 4; i++) {
+        h->rng ^= h->rng << 13;
+        h->rng ^= h->rng >> 7;
+        h->rng ^= h->rng << 17;
+        sum += (double)(h->rng >> 11) / (double)(1ULL << 53);
+    }
+    return (sum - 2.0) * 1.732;
+}
+
+// YYMMDDhhmmssX in UTC, reported as winter time
+static size_t cosem_time(int64_t timestamp, char *buf, size_t len) {
+    const time_t t = timestamp;
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    return strftime(buf, len, "%y%m%d%H%M%SW", &tm);
+}
@@ -0,0 +1,158 @@
+/**
+ * @file bus.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Fan-out of received telegrams to multiple subscribers
+ *
+ * Every valid telegram is parsed once into a reference counted frame from a
+ * fixed pool, which all subscribers of its port share without copying.
+ *
+ * Listeners are called on the P1 receive thread and must return quickly.
+ * Subscribers have their own queue and thread, a subscriber whose queue is
+ * full loses its oldest frame rather than holding up the others, which is
+ * counted in its dropped counter.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_BUS_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_BUS_H__
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/iterable_sections.h>
+
+// Number of ports, one for every enabled dsmr,p1 devicetree node
+#define DSMR_P1_NUM_PORTS DT_NUM_INST_STATUS_OKAY(dsmr_p1)
+
+// Subscribe to the frames of every port
+#define DSMR_P1_PORT_ANY -1
+
+struct dsmr_p1_frame {
+    atomic_t refs;
+    uint8_t port;       // index of the port the telegram was received on
+    uint32_t sequence;  // incremented for every published frame
+    uint32_t rx_cycles; // cycle counter at the end of the trailer
+    int64_t rx_uptime;  // uptime in ms at the end of the trailer
+    struct dsmr_p1_telegram telegram;
+    struct dsmr_p1_index index; // OBIS codes of data
+    // DSMR_P1_FIELD_* bits that differ from the previous telegram of the
+    // port, all for the first one
+    uint32_t changed;
+    size_t len;
+    uint8_t data[DSMR_P1_TELEGRAM_MAX_SIZE];
+};
+
+typedef void (*dsmr_p1_subscriber_cb_t)(const struct dsmr_p1_frame *frame,
+                                        void *user_data);
+
+struct dsmr_p1_subscriber {
+    const char *name;
+    int port; // port to receive the frames of or DSMR_P1_PORT_ANY
+    dsmr_p1_subscriber_cb_t cb;
+    void *user_data;
+    struct k_msgq *queue; // NULL for listeners
+    atomic_t delivered;   // frames handed to the callback
+    atomic_t dropped;     // frames dropped from the full queue
+};
+
+struct dsmr_p1_bus_stats {
+    uint32_t published;   // frames published
+    uint32_t no_frame;    // telegrams lost as the pool was empty
+    uint32_t free;        // frames currently free in the pool
+    // With CONFIG_DSMR_P1_BUS_DELTA_STATS, zero otherwise
+    uint32_t full_bytes;  // published telegrams as full delta encodings
+    uint32_t delta_bytes; // published telegrams as deltas of the previous
+};
+
+/**
+ * @brief Define a listener called on the P1 receive thread
+ *
+ * @param _name name of the listener
+ * @param _port index of the port to listen to or DSMR_P1_PORT_ANY
+ * @param _cb dsmr_p1_subscriber_cb_t called for every frame
+ * @param _user_data passed to _cb
+ */
+#define DSMR_P1_LISTENER_DEFINE(_name, _port, _cb, _user_data)                 \
+    STRUCT_SECTION_ITERABLE(dsmr_p1_subscriber, _name) = {                    \
+        .name = #_name,                                                        \
+        .port = _port,                                                         \
+        .cb = _cb,                                                             \
+        .user_data = _user_data,                                               \
+    }
+
+/**
+ * @brief Define a subscriber with its own queue and thread
+ *
+ * Every frame in the queue holds a frame of the pool, CONFIG_DSMR_P1_BUS_FRAMES
+ * must account for the depth of every subscriber.
+ *
+ * @param _name name of the subscriber
+ * @param _port index of the port to subscribe to or DSMR_P1_PORT_ANY
+ * @param _cb dsmr_p1_subscriber_cb_t called for every frame
+ * @param _user_data passed to _cb
+ * @param _depth number of frames the queue holds
+ * @param _stack_size stack size of the thread calling _cb
+ * @param _prio priority of the thread calling _cb
+ */
+#define DSMR_P1_SUBSCRIBER_DEFINE(_name, _port, _cb, _user_data, _depth,       \
+                                  _stack_size, _prio)                          \
+    K_MSGQ_DEFINE(_name##_queue, sizeof(struct dsmr_p1_frame *), _depth,      \
+                  sizeof(void *));                                             \
+    STRUCT_SECTION_ITERABLE(dsmr_p1_subscriber, _name) = {                    \
+        .name = #_name,                                                        \
+        .port = _port,                                                         \
+        .cb = _cb,                                                             \
+        .user_data = _user_data,                                               \
+        .queue = &_name##_queue,                                               \
+    };                                                                         \
+    K_THREAD_DEFINE(_name##_thread, _stack_size, dsmr_p1_subscriber_thread,    \
+                    &_name, NULL, NULL, _prio, 0, 0)
+
+/**
+ * @brief Take a reference to a frame, to keep it beyond the callback
+ */
+void dsmr_p1_frame_ref(const struct dsmr_p1_frame *frame);
+
+/**
+ * @brief Release a reference to a frame, the last one returns it to the pool
+ */
+void dsmr_p1_frame_unref(const struct dsmr_p1_frame *frame);
+
+/**
+ * @brief Time of the telegram in seconds
+ *
+ * Telegrams without a timestamp (DSMR 2.2) fall back to the uptime.
+ */
+static inline int64_t dsmr_p1_frame_time(const struct dsmr_p1_frame *frame) {
+    return frame->telegram.timestamp > 0 ? frame->telegram.timestamp
+                                         : frame->rx_uptime / 1000;
+}
+
+/**
+ * @brief Look up the value of an OBIS code in the raw telegram of a frame
+ *
+ * See dsmr_p1_index_lookup(), the value points into the frame data.
+ */
+static inline int dsmr_p1_frame_value(const struct dsmr_p1_frame *frame,
+                                      const char *code, const uint8_t **value,
+                                      size_t *value_len) {
+    return dsmr_p1_index_lookup(&frame->index, frame->data, code, value,
+                                value_len);
+}
+
+/**
+ * @brief Get the statistics of the bus, the subscribers keep their own
+ */
+void dsmr_p1_bus_get_stats(struct dsmr_p1_bus_stats *stats);
+
+/**
+ * @brief Thread of a subscriber, used by DSMR_P1_SUBSCRIBER_DEFINE
+ */
+void dsmr_p1_subscriber_thread(void *subscriber, void *p2, void *p3);
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_BUS_H__
@@ -0,0 +1,101 @@
+/**
+ * @file diff.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Change detection and delta encoding of parsed telegrams
+ *
+ * Fields are compared at the resolution of the meter given by the scale of
+ * DSMR_P1_SCHEMA: energy in Wh, power in W, voltage in 0.1 V, so a change is
+ * something a consumer can observe.
+ *
+ * A delta holds the changed field bitmask followed by the changed fields in
+ * field order, as LEB128 varints at the resolution above. Timestamps are
+ * zigzag encoded, the equipment id is its length followed by its characters.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_DIFF_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_DIFF_H__
+
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/schema.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DSMR_P1_FIELDS_ALL ((uint32_t)((1ULL << DSMR_P1_FIELD_COUNT) - 1))
+
+// Upper bound of a delta holding every field
+#define DSMR_P1_DELTA_MAX_LEN                                                  \
+    (5 + DSMR_P1_FIELD_COUNT * 10 + DSMR_P1_EQUIPMENT_ID_MAX_LEN)
+
+// Upper bound of a formatted value, sign, decimal point and NUL included
+#define DSMR_P1_FIELD_FORMAT_MAX_LEN 24
+
+/**
+ * @brief Get a field at the resolution of the meter
+ *
+ * @return the value times the scale of the field, the timestamp for
+ * timestamps and 0 for strings
+ */
+int64_t dsmr_p1_field_value(const struct dsmr_p1_telegram *telegram,
+                            enum dsmr_p1_field field);
+
+/**
+ * @brief Get a string field
+ *
+ * @return the NUL terminated string or NULL when the field is not a string
+ */
+const char *dsmr_p1_field_string(const struct dsmr_p1_telegram *telegram,
+                                 enum dsmr_p1_field field);
+
+/**
+ * @brief Set a field from its value at the resolution of the meter
+ *
+ * The inverse of dsmr_p1_field_value(), strings are left untouched.
+ */
+void dsmr_p1_field_set(struct dsmr_p1_telegram *telegram,
+                       enum dsmr_p1_field field, int64_t value);
+
+/**
+ * @brief Format a value at the resolution of the meter in the unit sent
+ *
+ * Prints as many decimals as the scale has zeros without going through a
+ * float, e.g. 1193 with a scale of 1000 as "1.193".
+ *
+ * @return length of the text or -ENOMEM when it does not fit buf
+ */
+int dsmr_p1_field_format(char *buf, size_t len, int64_t value, uint32_t scale);
+
+/**
+ * @brief Get the fields that differ between two telegrams
+ *
+ * @return bitmask of BIT(enum dsmr_p1_field)
+ */
+uint32_t dsmr_p1_diff(const struct dsmr_p1_telegram *prev,
+                      const struct dsmr_p1_telegram *cur);
+
+/**
+ * @brief Encode the changed fields of a telegram
+ *
+ * @param cur telegram to take the fields from
+ * @param changed fields to encode, DSMR_P1_FIELDS_ALL for a key frame
+ * @param buf output buffer, DSMR_P1_DELTA_MAX_LEN is always enough
+ * @param len size of buf
+ * @return length of the delta or -ENOMEM
+ */
+int dsmr_p1_delta_encode(const struct dsmr_p1_telegram *cur, uint32_t changed,
+                         uint8_t *buf, size_t len);
+
+/**
+ * @brief Apply a delta onto the telegram it was encoded against
+ *
+ * @param buf delta
+ * @param len length of buf
+ * @param telegram previous telegram, updated to the encoded one
+ * @return bitmask of the fields the delta changed or -EBADMSG
+ */
+int64_t dsmr_p1_delta_decode(const uint8_t *buf, size_t len,
+                             struct dsmr_p1_telegram *telegram);
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_DIFF_H__
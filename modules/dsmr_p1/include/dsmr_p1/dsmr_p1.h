@@ -11,40 +11,61 @@
 #define _DSMR_P1_INCLUDE_DSMR_P1_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
+#include <dsmr_p1/schema.h>
+
 #define DSMR_P1_TELEGRAM_MAX_SIZE 1024
 
 #define DSMR_P1_TRAILER_LEN 7U // ! CRC16 CR LF (1+4+1+1)
 #define DSMR_P1_EQUIPMENT_ID_MAX_LEN 64
 
-struct tarrif {
-    long double tarrif_1; // kWh
-    long double tarrif_2; // kWh
+#define DSMR_P1_INDEX_MAX_ENTRIES 48 // COSEM objects indexed per telegram
+#define DSMR_P1_INDEX_SLOTS 64       // power of two above the entries
+
+// A member for every row of DSMR_P1_SCHEMA, named by its key
+struct dsmr_p1_telegram {
+    DSMR_P1_SCHEMA(DSMR_P1_MEMBER)
 };
 
-struct phase {
-    float voltage;
-    uint32_t nr_voltage_sags;
-    uint32_t nr_voltage_swells;
-    uint32_t current;
+struct dsmr_p1_index_entry {
+    uint32_t hash; // of the code, see DSMR_P1_OBIS_HASH()
+    uint16_t code_offset;
+    uint16_t value_offset; // contents of the last parenthesised group
+    uint16_t value_len;
+    uint8_t code_len;
 };
 
-struct dsmr_p1_telegram {
-    uint8_t version;
-    int64_t timestamp;
-    char equipment_id[DSMR_P1_EQUIPMENT_ID_MAX_LEN];
-    uint32_t device_type;
-    struct tarrif elec_to_client;
-    struct tarrif elec_by_client;
-    uint32_t tarrif_indicator;
-    float power_delivered;
-    float power_received;
-    uint32_t nr_power_failures;
-    struct phase pl1;
-    struct phase pl2;
-    struct phase pl3;
+/**
+ * @brief Offsets of the COSEM objects of a raw telegram by OBIS code
+ *
+ * Built in a single pass over the telegram, lookups hash the OBIS code and
+ * return the value as it appears in the telegram without parsing or copying.
+ * The parser switches on the hash of the code kept in the entry.
+ */
+struct dsmr_p1_index {
+    uint8_t count;
+    uint8_t slots[DSMR_P1_INDEX_SLOTS]; // entry + 1 by hash of the code
+    struct dsmr_p1_index_entry entries[DSMR_P1_INDEX_MAX_ENTRIES];
+};
+
+// Causes of telegrams lost before they reached the telegram callback
+enum dsmr_p1_loss {
+    DSMR_P1_LOSS_OVERFLOW,    // longer than DSMR_P1_TELEGRAM_MAX_SIZE
+    DSMR_P1_LOSS_FRAMING,     // cut short by the '/' of the next telegram
+    DSMR_P1_LOSS_CRC,         // CRC mismatch
+    DSMR_P1_LOSS_BUSY,        // no buffer free to hand the telegram over in
+    DSMR_P1_LOSS_RX_DISABLED, // started while reception was disabled
+    DSMR_P1_LOSS_COUNT,
+};
+
+struct dsmr_p1_rx_stats {
+    uint32_t received; // telegrams with a valid CRC
+    uint32_t lost[DSMR_P1_LOSS_COUNT];
+    uint32_t gaps;   // timestamp steps above the interval of the meter
+    uint32_t missed; // telegrams missing in those steps
 };
 
 typedef void (*dsmr_p1_telegram_received_callback_t)(
@@ -59,6 +80,92 @@ int dsmr_p1_disable(void);
 int dsmr_p1_set_callback(dsmr_p1_telegram_received_callback_t cb,
                          void *user_data);
 
-struct dsmr_p1_telegram dsmr_p1_parse_telegram(uint8_t *data, size_t len);
+/**
+ * @brief Parse the fields of DSMR_P1_SCHEMA out of a raw telegram
+ *
+ * Fields the telegram does not hold are left zero.
+ */
+struct dsmr_p1_telegram dsmr_p1_parse_telegram(const uint8_t *data,
+                                               size_t len);
+
+/**
+ * @brief Calculate the telegram CRC, from the leading '/' up to and including
+ * the '!'
+ */
+uint16_t dsmr_p1_crc(const uint8_t *data, size_t len);
+
+/**
+ * @brief Index the COSEM objects of a raw telegram
+ *
+ * Objects beyond DSMR_P1_INDEX_MAX_ENTRIES and repeated OBIS codes are left
+ * out.
+ *
+ * @return 0, or -ENOMEM when objects were left out for lack of entries
+ */
+int dsmr_p1_index_build(const uint8_t *data, size_t len,
+                        struct dsmr_p1_index *index);
+
+/**
+ * @brief Look up the value of an OBIS code in an indexed telegram
+ *
+ * The value is the contents of the last parenthesised group of the object,
+ * for M-Bus readings and the maximum demand the reading following the
+ * timestamp, e.g. "00.193*kW" for 1-0:1.7.0(00.193*kW).
+ *
+ * @param index index built from data
+ * @param data raw telegram
+ * @param code OBIS code, e.g. "1-0:1.7.0"
+ * @param value set to the value within data, which is not terminated
+ * @param value_len set to the length of the value
+ * @return 0 or -ENOENT
+ */
+int dsmr_p1_index_lookup(const struct dsmr_p1_index *index,
+                         const uint8_t *data, const char *code,
+                         const uint8_t **value, size_t *value_len);
+
+/**
+ * @brief Parse the fields of DSMR_P1_SCHEMA out of an indexed telegram
+ *
+ * Saves indexing the telegram again when the caller already holds its index.
+ *
+ * @param data raw telegram
+ * @param index index built from data
+ */
+struct dsmr_p1_telegram dsmr_p1_parse_index(const uint8_t *data,
+                                            const struct dsmr_p1_index *index);
+
+/**
+ * @brief Count a telegram lost before the telegram callback
+ *
+ * Called by the platform, from any context including interrupts.
+ */
+void dsmr_p1_count_loss(enum dsmr_p1_loss cause);
+
+/**
+ * @brief Count the telegrams missing between two telegrams of a meter
+ *
+ * The meter sends a telegram every second from DSMR 5 on and every 10
+ * seconds before. A step of the timestamp of more than one and a half times
+ * that is counted as a gap. Telegrams without a timestamp (DSMR 2.2) are not
+ * checked.
+ *
+ * @param prev previous telegram of the meter
+ * @param telegram telegram following prev
+ * @return the number of telegrams missing in between
+ */
+uint32_t dsmr_p1_check_gap(const struct dsmr_p1_telegram *prev,
+                           const struct dsmr_p1_telegram *telegram);
+
+/**
+ * @brief Get the reception counters, summed over the ports
+ */
+void dsmr_p1_get_rx_stats(struct dsmr_p1_rx_stats *stats);
+
+/**
+ * @brief Number of P1 ports, one per enabled dsmr,p1 devicetree node
+ *
+ * Ports are indexed from 0 in devicetree instance order.
+ */
+size_t dsmr_p1_port_count(void);
 
 #endif // _DSMR_P1_INCLUDE_DSMR_P1_H__
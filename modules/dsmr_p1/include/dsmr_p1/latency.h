@@ -0,0 +1,116 @@
+/**
+ * @file latency.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Latency histograms of the telegram pipeline
+ *
+ * With CONFIG_DSMR_P1_LATENCY every telegram is timed between the points it
+ * passes on its way from the UART to an HTTP client, each stage feeding a
+ * histogram of the time since the previous point:
+ *
+ * - receive: first byte to the '!' of the trailer, at line speed
+ * - wakeup: end of the trailer in the ISR to the receive thread running
+ * - crc: thread running to the CRC checked
+ * - publish: CRC checked to the parsed frame handed to every subscriber
+ * - http: published to the first response carrying the frame being sent, in
+ *   ms resolution
+ * - multicast: end of the trailer to the datagrams handed to the network
+ *   stack, recorded by the app when it multicasts telegrams
+ *
+ * Bucket 0 counts latencies below 1 us, bucket i latencies from 2^(i-1) up to
+ * 2^i us and the last bucket everything above. The counters are atomics, so
+ * recording takes no lock and is safe from any thread.
+ *
+ * Without CONFIG_DSMR_P1_LATENCY the functions are empty and the timestamps
+ * are not taken.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_LATENCY_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_LATENCY_H__
+
+#include <dsmr_p1/bus.h>
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#define DSMR_P1_LATENCY_BUCKETS 28
+
+enum dsmr_p1_latency_stage {
+    DSMR_P1_LATENCY_RECEIVE,
+    DSMR_P1_LATENCY_WAKEUP,
+    DSMR_P1_LATENCY_CRC,
+    DSMR_P1_LATENCY_PUBLISH,
+    DSMR_P1_LATENCY_HTTP,
+    DSMR_P1_LATENCY_MULTICAST,
+    DSMR_P1_LATENCY_STAGE_COUNT,
+};
+
+struct dsmr_p1_latency_histogram {
+    uint32_t count;  // latencies recorded
+    uint32_t max_us; // highest latency recorded
+    uint32_t buckets[DSMR_P1_LATENCY_BUCKETS];
+};
+
+#ifdef CONFIG_DSMR_P1_LATENCY
+
+/**
+ * @brief Record a latency of a stage
+ */
+void dsmr_p1_latency_record(enum dsmr_p1_latency_stage stage, uint32_t us);
+
+/**
+ * @brief Record the time since a k_cycle_get_32() timestamp
+ *
+ * The cycle counter wraps, which limits this to latencies of some seconds.
+ *
+ * @return the current cycle count, the start of the next stage
+ */
+uint32_t dsmr_p1_latency_record_since(enum dsmr_p1_latency_stage stage,
+                                      uint32_t start_cycles);
+
+/**
+ * @brief Record the http stage for a frame that was sent to a client
+ *
+ * Only the first response carrying a frame is recorded, later ones are
+ * ignored.
+ */
+void dsmr_p1_latency_sent(const struct dsmr_p1_frame *frame);
+
+/**
+ * @brief Get a snapshot of the histogram of a stage
+ *
+ * The buckets are read one by one while they may be updated, count is their
+ * sum and max_us may already include a latency that is not counted yet.
+ */
+void dsmr_p1_latency_get(enum dsmr_p1_latency_stage stage,
+                         struct dsmr_p1_latency_histogram *histogram);
+
+/**
+ * @brief Name of a stage, as in the list above
+ */
+const char *dsmr_p1_latency_stage_name(enum dsmr_p1_latency_stage stage);
+
+#else
+
+static inline void dsmr_p1_latency_record(enum dsmr_p1_latency_stage stage,
+                                          uint32_t us) {
+    ARG_UNUSED(stage);
+    ARG_UNUSED(us);
+}
+
+static inline uint32_t
+dsmr_p1_latency_record_since(enum dsmr_p1_latency_stage stage,
+                             uint32_t start_cycles) {
+    ARG_UNUSED(stage);
+    ARG_UNUSED(start_cycles);
+    return 0;
+}
+
+static inline void dsmr_p1_latency_sent(const struct dsmr_p1_frame *frame) {
+    ARG_UNUSED(frame);
+}
+
+#endif // CONFIG_DSMR_P1_LATENCY
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_LATENCY_H__
@@ -0,0 +1,27 @@
+/**
+ * @file linux.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Linux backend of the DSMR P1 library
+ *
+ * The host build reads a single port from the file, fifo or pty named by the
+ * DSMR_P1_DEVICE environment variable, or from stdin, e.g.
+ *
+ *   DSMR_P1_DEVICE=/dev/pts/3 ./app
+ *
+ * The telegram callback runs on the reader thread of the backend.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_LINUX_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_LINUX_H__
+
+/**
+ * @brief Wait for the input of the port to end
+ *
+ * @return 0 at the end of the input, -ESRCH when the library was not
+ * initialised or a negative errno of the failed read
+ */
+int dsmr_p1_linux_join(void);
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_LINUX_H__
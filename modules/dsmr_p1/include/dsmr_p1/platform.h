@@ -15,12 +15,14 @@ typedef enum platform_log_level {
     PLATFORM_LOG_FATAL,
 } platform_log_level_t;
 
-typedef void (*data_received_callback_t)(uint8_t *data, size_t len);
+typedef int (*data_received_callback_t)(uint8_t *data, size_t len);
 
 int platform_init(data_received_callback_t cb);
 
 int platform_write_data_req(bool high);
 
+size_t platform_port_count(void);
+
 int platform_log(platform_log_level_t log_level, const char *aFormat, ...);
 
 #endif // _DSMR_P1_INCLUDE_DSMR_PLATFORM_H__
\ No newline at end of file
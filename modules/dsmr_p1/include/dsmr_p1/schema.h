@@ -0,0 +1,147 @@
+/**
+ * @file schema.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief The COSEM objects of a telegram parsed into struct dsmr_p1_telegram
+ *
+ * DSMR_P1_SCHEMA is the single list of parsed fields. The members of struct
+ * dsmr_p1_telegram, the parser, the field numbering, change detection, the
+ * delta encoding and the field descriptions are all expanded from it, and so
+ * are the outputs of the application: the JSON and CBOR API, the CBOR schema,
+ * the metrics, MQTT, the upload, the CoAP OBIS resources, the Modbus
+ * registers and the sensor channels. A new OBIS code is a row here.
+ *
+ * X(name, key, obis, ctype, type, unit, scale)
+ *   name   suffix of DSMR_P1_FIELD_
+ *   key    member of struct dsmr_p1_telegram holding the value, and the name
+ *          of the field in outputs such as metrics
+ *   obis   OBIS reference of the object as (A, B, C, D, E), see
+ *          DSMR_P1_OBIS_STRING() and DSMR_P1_OBIS_HASH()
+ *   ctype  C type of the member, see DSMR_P1_MEMBER()
+ *   type   NUMBER: decimal value, of the last group for M-Bus style objects
+ *          HEX: hexadecimal value
+ *          TIMESTAMP: YYMMDDhhmmssX, of the first group
+ *          STRING: value as sent
+ *   unit   unit of the value as sent
+ *   scale  factor to the integer resolution of the meter, e.g. 1000 for kWh
+ *          sent with three decimals
+ *
+ * An object can be the source of several fields, such as the timestamp and
+ * the value of the maximum demand. The rows of the other fields follow the
+ * row of the first directly and are marked with DSMR_P1_SHARED_<name>.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_SCHEMA_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_SCHEMA_H__
+
+// clang-format off
+#define DSMR_P1_SCHEMA(X)                                                                                        \
+    X(VERSION,                  version,                  (1, 3, 0, 2, 8),   UINT8,   HEX,       "",    1)       \
+    X(TIMESTAMP,                timestamp,                (0, 0, 1, 0, 0),   INT64,   TIMESTAMP, "",    1)       \
+    X(EQUIPMENT_ID,             equipment_id,             (0, 0, 96, 1, 1),  CHARS,   STRING,    "",    1)       \
+    X(ENERGY_DELIVERED_T1,      energy_delivered_t1,      (1, 0, 1, 8, 1),   LDOUBLE, NUMBER,    "kWh", 1000)    \
+    X(ENERGY_DELIVERED_T2,      energy_delivered_t2,      (1, 0, 1, 8, 2),   LDOUBLE, NUMBER,    "kWh", 1000)    \
+    X(ENERGY_RECEIVED_T1,       energy_received_t1,       (1, 0, 2, 8, 1),   LDOUBLE, NUMBER,    "kWh", 1000)    \
+    X(ENERGY_RECEIVED_T2,       energy_received_t2,       (1, 0, 2, 8, 2),   LDOUBLE, NUMBER,    "kWh", 1000)    \
+    X(TARIFF_INDICATOR,         tariff_indicator,         (0, 0, 96, 14, 0), UINT32,  NUMBER,    "",    1)       \
+    X(POWER_DELIVERED,          power_delivered,          (1, 0, 1, 7, 0),   FLOAT,   NUMBER,    "kW",  1000)    \
+    X(POWER_RECEIVED,           power_received,           (1, 0, 2, 7, 0),   FLOAT,   NUMBER,    "kW",  1000)    \
+    X(AVERAGE_DEMAND,           average_demand,           (1, 0, 1, 4, 0),   FLOAT,   NUMBER,    "kW",  1000)    \
+    X(MAXIMUM_DEMAND,           maximum_demand,           (1, 0, 1, 6, 0),   FLOAT,   NUMBER,    "kW",  1000)    \
+    X(MAXIMUM_DEMAND_TIMESTAMP, maximum_demand_timestamp, (1, 0, 1, 6, 0),   INT64,   TIMESTAMP, "",    1)       \
+    X(POWER_FAILURES,           power_failures,           (0, 0, 96, 7, 21), UINT32,  NUMBER,    "",    1)       \
+    X(L1_VOLTAGE,               l1_voltage,               (1, 0, 32, 7, 0),  FLOAT,   NUMBER,    "V",   10)      \
+    X(L1_CURRENT,               l1_current,               (1, 0, 31, 7, 0),  UINT32,  NUMBER,    "A",   1)       \
+    X(L1_SAGS,                  l1_sags,                  (1, 0, 32, 32, 0), UINT32,  NUMBER,    "",    1)       \
+    X(L1_SWELLS,                l1_swells,                (1, 0, 32, 36, 0), UINT32,  NUMBER,    "",    1)       \
+    X(L2_VOLTAGE,               l2_voltage,               (1, 0, 52, 7, 0),  FLOAT,   NUMBER,    "V",   10)      \
+    X(L2_CURRENT,               l2_current,               (1, 0, 51, 7, 0),  UINT32,  NUMBER,    "A",   1)       \
+    X(L2_SAGS,                  l2_sags,                  (1, 0, 52, 32, 0), UINT32,  NUMBER,    "",    1)       \
+    X(L2_SWELLS,                l2_swells,                (1, 0, 52, 36, 0), UINT32,  NUMBER,    "",    1)       \
+    X(L3_VOLTAGE,               l3_voltage,               (1, 0, 72, 7, 0),  FLOAT,   NUMBER,    "V",   10)      \
+    X(L3_CURRENT,               l3_current,               (1, 0, 71, 7, 0),  UINT32,  NUMBER,    "A",   1)       \
+    X(L3_SAGS,                  l3_sags,                  (1, 0, 72, 32, 0), UINT32,  NUMBER,    "",    1)       \
+    X(L3_SWELLS,                l3_swells,                (1, 0, 72, 36, 0), UINT32,  NUMBER,    "",    1)
+// clang-format on
+
+// Rows parsed from the object of the row above them
+#define DSMR_P1_SHARED_MAXIMUM_DEMAND_TIMESTAMP ~, 1
+
+// 1 for a row marked shared, 0 otherwise
+#define DSMR_P1_IS_SHARED(name) DSMR_P1_SECOND(DSMR_P1_SHARED_##name, 0, ~)
+#define DSMR_P1_SECOND(...) DSMR_P1_SECOND_(__VA_ARGS__)
+#define DSMR_P1_SECOND_(a, b, ...) b
+
+// "A-B:C.D.E" of an obis column
+#define DSMR_P1_OBIS_STRING(obis) DSMR_P1_OBIS_STRING_ obis
+#define DSMR_P1_OBIS_STRING_(a, b, c, d, e) #a "-" #b ":" #c "." #d "." #e
+
+// Templates expanded by the preprocessor alone, such as telegram.cddl.in of
+// the application, only take the list
+#ifndef DSMR_P1_SCHEMA_ONLY
+
+#include <stdint.h>
+
+// Hash of the text of an obis column, a constant expression for switch
+// cases: h * 31 + c over the characters from 0, wrapping at 32 bits
+#define DSMR_P1_OBIS_HASH(obis) DSMR_P1_OBIS_HASH_ obis
+#define DSMR_P1_OBIS_HASH_(a, b, c, d, e)                                      \
+    DSMR_P1_HASH_GROUP(                                                        \
+        DSMR_P1_HASH_GROUP(                                                    \
+            DSMR_P1_HASH_GROUP(                                                \
+                DSMR_P1_HASH_GROUP(DSMR_P1_HASH_NUM(0U, a), '-', b), ':', c),  \
+            '.', d),                                                           \
+        '.', e)
+#define DSMR_P1_HASH_GROUP(h, sep, n) DSMR_P1_HASH_NUM((h) * 31U + (sep), n)
+
+// The decimal digits of n below 1000 appended to the hash h
+#define DSMR_P1_HASH_NUM(h, n)                                                 \
+    ((uint32_t)(h) * ((n) < 10 ? 31U : (n) < 100 ? 961U : 29791U) +            \
+     ((n) < 10    ? DSMR_P1_HASH_DIGIT(n, 1)                                   \
+      : (n) < 100 ? DSMR_P1_HASH_DIGIT(n, 10) * 31U + DSMR_P1_HASH_DIGIT(n, 1) \
+                  : DSMR_P1_HASH_DIGIT(n, 100) * 961U +                        \
+                        DSMR_P1_HASH_DIGIT(n, 10) * 31U +                      \
+                        DSMR_P1_HASH_DIGIT(n, 1)))
+#define DSMR_P1_HASH_DIGIT(n, place) ((uint32_t)'0' + (n) / (place) % 10U)
+
+// Member of struct dsmr_p1_telegram, by ctype
+#define DSMR_P1_MEMBER(name, key, obis, ctype, type, unit, scale)              \
+    DSMR_P1_MEMBER_##ctype(key);
+#define DSMR_P1_MEMBER_UINT8(key) uint8_t key
+#define DSMR_P1_MEMBER_UINT32(key) uint32_t key
+#define DSMR_P1_MEMBER_INT64(key) int64_t key
+#define DSMR_P1_MEMBER_FLOAT(key) float key
+#define DSMR_P1_MEMBER_LDOUBLE(key) long double key
+#define DSMR_P1_MEMBER_CHARS(key) char key[DSMR_P1_EQUIPMENT_ID_MAX_LEN]
+
+#define DSMR_P1_SCHEMA_FIELD_ENUM(name, key, obis, ctype, type, unit, scale)   \
+    DSMR_P1_FIELD_##name,
+
+enum dsmr_p1_field {
+    DSMR_P1_SCHEMA(DSMR_P1_SCHEMA_FIELD_ENUM) DSMR_P1_FIELD_COUNT,
+};
+
+enum dsmr_p1_field_type {
+    DSMR_P1_TYPE_NUMBER,
+    DSMR_P1_TYPE_HEX,
+    DSMR_P1_TYPE_TIMESTAMP,
+    DSMR_P1_TYPE_STRING,
+};
+
+struct dsmr_p1_field_info {
+    const char *key; // e.g. "power_delivered"
+    const char *obis;
+    const char *unit;
+    enum dsmr_p1_field_type type;
+    uint32_t scale;
+};
+
+/**
+ * @brief Description of every field, indexed by enum dsmr_p1_field
+ */
+extern const struct dsmr_p1_field_info dsmr_p1_fields[DSMR_P1_FIELD_COUNT];
+
+#endif // DSMR_P1_SCHEMA_ONLY
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_SCHEMA_H__
@@ -0,0 +1,35 @@
+/**
+ * @file sensor.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Sensor channels of the P1 ports
+ *
+ * With CONFIG_DSMR_P1_SENSOR every dsmr,p1 node is a sensor device serving
+ * the last parsed telegram of its port through the sensor API:
+ *
+ * - SENSOR_CHAN_POWER: power delivered to the client in W
+ * - SENSOR_CHAN_VOLTAGE: voltage in V, the channel index selects the phase
+ * - SENSOR_CHAN_CURRENT: current in A, the channel index selects the phase
+ * - the channels below, which have no standard counterpart
+ *
+ * A SENSOR_TRIG_DATA_READY trigger fires for every telegram of the port, its
+ * handler runs on the P1 receive thread and must return quickly.
+ */
+
+#ifndef _DSMR_P1_INCLUDE_DSMR_P1_SENSOR_H__
+#define _DSMR_P1_INCLUDE_DSMR_P1_SENSOR_H__
+
+#include <zephyr/drivers/sensor.h>
+
+enum dsmr_p1_sensor_channel {
+    // Energy delivered to the client in kWh, the channel index selects the
+    // tariff starting at 0 for tariff 1
+    DSMR_P1_CHAN_ENERGY_DELIVERED = SENSOR_CHAN_PRIV_START,
+    // Energy received from the client in kWh, indexed like the above
+    DSMR_P1_CHAN_ENERGY_RECEIVED,
+    // Power received from the client in W
+    DSMR_P1_CHAN_POWER_RECEIVED,
+};
+
+#endif // _DSMR_P1_INCLUDE_DSMR_P1_SENSOR_H__
@@ -0,0 +1,281 @@
+/**
+ * @file diff.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Change detection and delta encoding of parsed telegrams
+ *
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "dsmr_p1/diff.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Fixed point value of a member, by schema type
+#define FIXED_NUMBER(v, s) (int64_t)to_fixed(v, s)
+#define FIXED_HEX(v, s) (int64_t)(v)
+#define FIXED_TIMESTAMP(v, s) (int64_t)(v)
+#define FIXED_STRING(v, s) 0
+
+// Member from its fixed point value, by schema type
+#define SET_NUMBER(dst, v, s) (dst) = (long double)(v) / (s)
+#define SET_HEX(dst, v, s) (dst) = (v)
+#define SET_TIMESTAMP(dst, v, s) (dst) = (v)
+#define SET_STRING(dst, v, s)
+
+#define GET_FIELD(n, k, o, c, t, u, s)                                         \
+    case DSMR_P1_FIELD_##n:                                                    \
+        return FIXED_##t(telegram->k, s);
+
+#define SET_FIELD(n, k, o, c, t, u, s)                                         \
+    case DSMR_P1_FIELD_##n:                                                    \
+        SET_##t(telegram->k, value, s);                                        \
+        break;
+
+// Location of a string member, nothing for the other types
+#define OFFSET_NUMBER(n, k)
+#define OFFSET_HEX(n, k)
+#define OFFSET_TIMESTAMP(n, k)
+#define OFFSET_STRING(n, k)                                                    \
+    case DSMR_P1_FIELD_##n:                                                    \
+        *size = sizeof(((struct dsmr_p1_telegram *)0)->k);                     \
+        return offsetof(struct dsmr_p1_telegram, k);
+
+#define STRING_FIELD(n, k, o, c, t, u, s) OFFSET_##t(n, k)
+
+_Static_assert(DSMR_P1_FIELD_COUNT <= 32, "fields must fit the bitmask");
+
+/******************************************************************************
+ * Local Function Interface
+ *****************************************************************************/
+
+static uint64_t encoded_value(const struct dsmr_p1_telegram *telegram,
+                              enum dsmr_p1_field field);
+static void set_field_value(struct dsmr_p1_telegram *telegram,
+                            enum dsmr_p1_field field, uint64_t value);
+static size_t string_offset(enum dsmr_p1_field field, size_t *size);
+static uint64_t to_fixed(long double value, unsigned int scale);
+static uint64_t zigzag(int64_t value);
+static int64_t unzigzag(uint64_t value);
+static int put_varint(uint8_t *buf, size_t len, size_t *offs, uint64_t value);
+static int get_varint(const uint8_t *buf, size_t len, size_t *offs,
+                      uint64_t *value);
+
+/******************************************************************************
+ * Public Function Implementation
+ *****************************************************************************/
+
+int64_t dsmr_p1_field_value(const struct dsmr_p1_telegram *telegram,
+                            enum dsmr_p1_field field) {
+    switch (field) {
+        DSMR_P1_SCHEMA(GET_FIELD)
+    default:
+        return 0;
+    }
+}
+
+const char *dsmr_p1_field_string(const struct dsmr_p1_telegram *telegram,
+                                 enum dsmr_p1_field field) {
+    size_t size;
+    const size_t offs = string_offset(field, &size);
+
+    return size ? (const char *)telegram + offs : NULL;
+}
+
+void dsmr_p1_field_set(struct dsmr_p1_telegram *telegram,
+                       enum dsmr_p1_field field, int64_t value) {
+    switch (field) {
+        DSMR_P1_SCHEMA(SET_FIELD)
+    default:
+        break;
+    }
+}
+
+int dsmr_p1_field_format(char *buf, size_t len, int64_t value,
+                         uint32_t scale) {
+    const uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    int decimals = 0;
+    int ret;
+
+    for (uint32_t s = scale; s > 1; s /= 10) {
+        decimals++;
+    }
+    if (decimals == 0) {
+        ret = snprintf(buf, len, "%lld", (long long)value);
+    } else {
+        ret = snprintf(buf, len, "%s%llu.%0*llu", value < 0 ? "-" : "",
+                       (unsigned long long)(magnitude / scale), decimals,
+                       (unsigned long long)(magnitude % scale));
+    }
+    return ret < 0 || (size_t)ret >= len ? -ENOMEM : ret;
+}
+
+uint32_t dsmr_p1_diff(const struct dsmr_p1_telegram *prev,
+                      const struct dsmr_p1_telegram *cur) {
+    uint32_t changed = 0;
+    size_t offs;
+    size_t size;
+
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (dsmr_p1_fields[field].type == DSMR_P1_TYPE_STRING) {
+            offs = string_offset(field, &size);
+            if (strncmp((const char *)prev + offs, (const char *)cur + offs,
+                        size) != 0) {
+                changed |= 1U << field;
+            }
+        } else if (dsmr_p1_field_value(prev, field) !=
+                   dsmr_p1_field_value(cur, field)) {
+            changed |= 1U << field;
+        }
+    }
+    return changed;
+}
+
+int dsmr_p1_delta_encode(const struct dsmr_p1_telegram *cur, uint32_t changed,
+                         uint8_t *buf, size_t len) {
+    size_t offs = 0;
+    size_t str_offs;
+    size_t size;
+
+    changed &= DSMR_P1_FIELDS_ALL;
+    if (put_varint(buf, len, &offs, changed) < 0) {
+        return -ENOMEM;
+    }
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (!(changed & (1U << field))) {
+            continue;
+        }
+        if (dsmr_p1_fields[field].type == DSMR_P1_TYPE_STRING) {
+            str_offs = string_offset(field, &size);
+            const char *str = (const char *)cur + str_offs;
+            const size_t str_len = strnlen(str, size);
+            if (put_varint(buf, len, &offs, str_len) < 0 ||
+                len - offs < str_len) {
+                return -ENOMEM;
+            }
+            memcpy(&buf[offs], str, str_len);
+            offs += str_len;
+        } else if (put_varint(buf, len, &offs, encoded_value(cur, field)) <
+                   0) {
+            return -ENOMEM;
+        }
+    }
+    return offs;
+}
+
+int64_t dsmr_p1_delta_decode(const uint8_t *buf, size_t len,
+                             struct dsmr_p1_telegram *telegram) {
+    size_t offs = 0;
+    size_t str_offs;
+    size_t size;
+    uint64_t changed;
+    uint64_t value;
+
+    if (get_varint(buf, len, &offs, &changed) < 0 ||
+        (changed & ~(uint64_t)DSMR_P1_FIELDS_ALL)) {
+        return -EBADMSG;
+    }
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (!(changed & (1U << field))) {
+            continue;
+        }
+        if (get_varint(buf, len, &offs, &value) < 0) {
+            return -EBADMSG;
+        }
+        if (dsmr_p1_fields[field].type == DSMR_P1_TYPE_STRING) {
+            str_offs = string_offset(field, &size);
+            char *str = (char *)telegram + str_offs;
+            if (value >= size || len - offs < value) {
+                return -EBADMSG;
+            }
+            memset(str, 0, size);
+            memcpy(str, &buf[offs], value);
+            offs += value;
+        } else {
+            set_field_value(telegram, field, value);
+        }
+    }
+    return offs == len ? (int64_t)changed : -EBADMSG;
+}
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+// Timestamps are the only signed values
+static uint64_t encoded_value(const struct dsmr_p1_telegram *telegram,
+                              enum dsmr_p1_field field) {
+    const int64_t value = dsmr_p1_field_value(telegram, field);
+
+    return dsmr_p1_fields[field].type == DSMR_P1_TYPE_TIMESTAMP
+               ? zigzag(value)
+               : (uint64_t)value;
+}
+
+static void set_field_value(struct dsmr_p1_telegram *telegram,
+                            enum dsmr_p1_field field, uint64_t value) {
+    dsmr_p1_field_set(telegram, field,
+                      dsmr_p1_fields[field].type == DSMR_P1_TYPE_TIMESTAMP
+                          ? unzigzag(value)
+                          : (int64_t)value);
+}
+
+static size_t string_offset(enum dsmr_p1_field field, size_t *size) {
+    switch (field) {
+        DSMR_P1_SCHEMA(STRING_FIELD)
+    default:
+        *size = 0;
+        return 0;
+    }
+}
+
+static uint64_t to_fixed(long double value, unsigned int scale) {
+    return value > 0 ? (uint64_t)(value * scale + 0.5L) : 0;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int put_varint(uint8_t *buf, size_t len, size_t *offs, uint64_t value) {
+    do {
+        if (*offs >= len) {
+            return -ENOMEM;
+        }
+        buf[*offs] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+        (*offs)++;
+        value >>= 7;
+    } while (value);
+    return 0;
+}
+
+static int get_varint(const uint8_t *buf, size_t len, size_t *offs,
+                      uint64_t *value) {
+    *value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (*offs >= len) {
+            return -EBADMSG;
+        }
+        const uint8_t byte = buf[(*offs)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -EBADMSG;
+}
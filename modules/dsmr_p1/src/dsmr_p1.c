@@ -5,8 +5,9 @@
 
 #include "dsmr_p1/dsmr_p1.h"
 #include "dsmr_p1/platform.h"
-#include "obis.h"
+#include "dsmr_p1/schema.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,25 +15,104 @@
 /******************************************************************************
  * Constants
  *****************************************************************************/
+
+_Static_assert(DSMR_P1_INDEX_MAX_ENTRIES < DSMR_P1_INDEX_SLOTS &&
+                   DSMR_P1_INDEX_MAX_ENTRIES <= UINT8_MAX,
+               "the index needs a free slot and fits its entries in a byte");
+
+// Longest number or timestamp value
+#define VALUE_MAX_LEN 31
+
+// First slot of a hash, the Fibonacci product mixes the hash into the middle
+// bits that pick the slot
+#define INDEX_SLOT(hash) (((hash) * 2654435761U) >> 16)
+
+// Seconds between telegrams, from DSMR 5 on and before
+#define INTERVAL_DSMR5 1
+#define INTERVAL_DSMR4 10
+
+// The version is sent as two digits and parsed as hex, 5.0 is 0x50
+#define VERSION_DSMR5 0x50
+
+// Parsers of the value of an indexed object, by schema type
+#define PARSE_NUMBER(dst, data, entry)                                         \
+    (dst) = parse_number(&(data)[(entry)->value_offset], (entry)->value_len)
+#define PARSE_HEX(dst, data, entry)                                            \
+    (dst) = parse_hex(&(data)[(entry)->value_offset], (entry)->value_len)
+#define PARSE_TIMESTAMP(dst, data, entry) (dst) = parse_timestamp(data, entry)
+#define PARSE_STRING(dst, data, entry)                                         \
+    parse_string(dst, sizeof(dst), &(data)[(entry)->value_offset],             \
+                 (entry)->value_len)
+
+// Codes of other objects of the telegram can have the same hash
+#define CODE_IS(data, entry, code)                                             \
+    ((entry)->code_len == sizeof(code) - 1 &&                                  \
+     memcmp(&(data)[(entry)->code_offset], code, sizeof(code) - 1) == 0)
+
+// A case for the hash of the object of every row, the rows of a shared
+// object are parsed in the case of the row above them. Two rows with the
+// same object that are not marked shared, or with objects of the same hash,
+// are a duplicate case.
+#define PARSE_CASE(n, k, o, c, t, u, s)                                        \
+    PARSE_CASE_(DSMR_P1_IS_SHARED(n), k, o, t)
+#define PARSE_CASE_(shared, k, o, t) PARSE_CASE__(shared, k, o, t)
+#define PARSE_CASE__(shared, k, o, t) PARSE_CASE_##shared(k, o, t)
+#define PARSE_CASE_0(k, o, t)                                                  \
+    break;                                                                     \
+    case DSMR_P1_OBIS_HASH(o):                                                 \
+        if (!CODE_IS(data, entry, DSMR_P1_OBIS_STRING(o))) {                   \
+            break;                                                             \
+        }                                                                      \
+        PARSE_##t(telegram.k, data, entry);
+#define PARSE_CASE_1(k, o, t) PARSE_##t(telegram.k, data, entry);
+
+#define FIELD_INFO(n, k, o, c, t, u, s)                                        \
+    [DSMR_P1_FIELD_##n] = {                                                    \
+        .key = #k,                                                             \
+        .obis = DSMR_P1_OBIS_STRING(o),                                        \
+        .unit = u,                                                             \
+        .type = DSMR_P1_TYPE_##t,                                              \
+        .scale = s,                                                            \
+    },
+
 /******************************************************************************
  * Local Function Interface
  *****************************************************************************/
 
-static void telegram_received_cb(uint8_t *telegram, size_t len);
+static int telegram_received_cb(uint8_t *telegram, size_t len);
 static uint16_t calc_p1_telegram_crc(const uint8_t *src, size_t len);
-static struct dsmr_p1_telegram parse_p1_telegram(uint8_t *telegram,
-                                                 size_t telegram_len);
-static void parse_cosem_object(struct dsmr_p1_telegram *telegram, char *cosem,
-                               size_t len);
-static int64_t parse_cosem_timestamp(char *value);
+static long double parse_number(const uint8_t *value, size_t len);
+static uint32_t parse_hex(const uint8_t *value, size_t len);
+static int64_t parse_timestamp(const uint8_t *data,
+                               const struct dsmr_p1_index_entry *entry);
+static void parse_string(char *dst, size_t dst_len, const uint8_t *value,
+                         size_t len);
+static int64_t parse_cosem_timestamp(const char *value);
+static const struct dsmr_p1_index_entry *
+index_find(const struct dsmr_p1_index *index, const uint8_t *data,
+           const char *code, size_t code_len);
+static int index_add(struct dsmr_p1_index *index, const uint8_t *data,
+                     size_t code_offset, size_t code_len, size_t value_offset,
+                     size_t value_len);
+static uint32_t hash_code(const uint8_t *code, size_t len);
+static void count(uint32_t *counter, uint32_t n);
 
 /******************************************************************************
  * Local Variables
  *****************************************************************************/
 
+const struct dsmr_p1_field_info dsmr_p1_fields[DSMR_P1_FIELD_COUNT] = {
+    DSMR_P1_SCHEMA(FIELD_INFO)};
+
 static dsmr_p1_telegram_received_callback_t user_cb;
 static void *user_data;
 
+// Updated from the platform interrupts and threads, see count()
+static uint32_t rx_received;
+static uint32_t rx_lost[DSMR_P1_LOSS_COUNT];
+static uint32_t rx_gaps;
+static uint32_t rx_missed;
+
 /******************************************************************************
  * Public Function Implementation
  *****************************************************************************/
@@ -50,18 +130,127 @@ int dsmr_p1_set_callback(dsmr_p1_telegram_received_callback_t a_cb,
     return 0;
 }
 
-struct dsmr_p1_telegram dsmr_p1_parse_telegram(uint8_t *data, size_t len) {
-    return parse_p1_telegram(data, len);
+struct dsmr_p1_telegram dsmr_p1_parse_telegram(const uint8_t *data,
+                                               size_t len) {
+    struct dsmr_p1_index index;
+
+    (void)dsmr_p1_index_build(data, len, &index);
+    return dsmr_p1_parse_index(data, &index);
+}
+
+struct dsmr_p1_telegram dsmr_p1_parse_index(const uint8_t *data,
+                                            const struct dsmr_p1_index *index) {
+    struct dsmr_p1_telegram telegram = {0};
+
+    // Repeated codes are not indexed, so every case runs at most once
+    for (size_t i = 0; i < index->count; i++) {
+        const struct dsmr_p1_index_entry *entry = &index->entries[i];
+        switch (entry->hash) {
+        case 0:
+            DSMR_P1_SCHEMA(PARSE_CASE)
+            break;
+        default:
+            break;
+        }
+    }
+    return telegram;
+}
+
+uint16_t dsmr_p1_crc(const uint8_t *data, size_t len) {
+    return calc_p1_telegram_crc(data, len);
 }
 
+int dsmr_p1_index_build(const uint8_t *data, size_t len,
+                        struct dsmr_p1_index *index) {
+    int ret = 0;
+
+    memset(index->slots, 0, sizeof(index->slots));
+    index->count = 0;
+
+    size_t line = 0;
+    while (line < len) {
+        // code(value)...(value), the code ends at the first parenthesis
+        size_t code_end = 0, open = 0, close = 0;
+        size_t i;
+        for (i = line; i < len && data[i] != '\n'; i++) {
+            if (data[i] == '(') {
+                code_end = code_end ? code_end : i;
+                open = i;
+            } else if (data[i] == ')') {
+                close = i;
+            }
+        }
+        if (code_end > line && close > open) {
+            if (index_add(index, data, line, code_end - line, open + 1,
+                          close - open - 1) == -ENOMEM) {
+                ret = -ENOMEM;
+            }
+        }
+        line = i + 1;
+    }
+    return ret;
+}
+
+int dsmr_p1_index_lookup(const struct dsmr_p1_index *index,
+                         const uint8_t *data, const char *code,
+                         const uint8_t **value, size_t *value_len) {
+    const struct dsmr_p1_index_entry *entry =
+        index_find(index, data, code, strlen(code));
+    if (!entry) {
+        return -ENOENT;
+    }
+    *value = &data[entry->value_offset];
+    *value_len = entry->value_len;
+    return 0;
+}
+
+void dsmr_p1_count_loss(enum dsmr_p1_loss cause) {
+    if (cause < DSMR_P1_LOSS_COUNT) {
+        count(&rx_lost[cause], 1);
+    }
+}
+
+uint32_t dsmr_p1_check_gap(const struct dsmr_p1_telegram *prev,
+                           const struct dsmr_p1_telegram *telegram) {
+    if (prev->timestamp <= 0 || telegram->timestamp <= prev->timestamp) {
+        return 0;
+    }
+
+    // Belgian meters have no DSMR version but send every second
+    const bool dsmr5 =
+        telegram->version == 0 || telegram->version >= VERSION_DSMR5;
+    const int64_t interval = dsmr5 ? INTERVAL_DSMR5 : INTERVAL_DSMR4;
+    const int64_t step = telegram->timestamp - prev->timestamp;
+    if (step * 2 <= interval * 3) {
+        return 0;
+    }
+    const int64_t missed = (step + interval / 2) / interval - 1;
+    const uint32_t n = missed > UINT32_MAX ? UINT32_MAX : (uint32_t)missed;
+    count(&rx_gaps, 1);
+    count(&rx_missed, n);
+    return n;
+}
+
+void dsmr_p1_get_rx_stats(struct dsmr_p1_rx_stats *stats) {
+    stats->received = __atomic_load_n(&rx_received, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < DSMR_P1_LOSS_COUNT; i++) {
+        stats->lost[i] = __atomic_load_n(&rx_lost[i], __ATOMIC_RELAXED);
+    }
+    stats->gaps = __atomic_load_n(&rx_gaps, __ATOMIC_RELAXED);
+    stats->missed = __atomic_load_n(&rx_missed, __ATOMIC_RELAXED);
+}
+
+size_t dsmr_p1_port_count(void) { return platform_port_count(); }
+
 /******************************************************************************
  * Local Function Implementation
  *****************************************************************************/
 
-static void telegram_received_cb(uint8_t *data, size_t len) {
+static int telegram_received_cb(uint8_t *data, size_t len) {
     if (data[len - DSMR_P1_TRAILER_LEN] != '!') {
         platform_log(PLATFORM_LOG_ERROR, "received bad telegram");
-        return;
+        dsmr_p1_count_loss(DSMR_P1_LOSS_FRAMING);
+        return -EBADMSG;
     }
     platform_log(PLATFORM_LOG_INFO, "telegram received");
 
@@ -78,11 +267,16 @@ static void telegram_received_cb(uint8_t *data, size_t len) {
         platform_log(PLATFORM_LOG_ERROR, "received bad crc");
         platform_log(PLATFORM_LOG_DEBUG, "calculated: 0x%04X, received 0x%04X",
                      calc_crc, rx_crc);
-        return;
+        dsmr_p1_count_loss(DSMR_P1_LOSS_CRC);
+        return -EBADMSG;
     }
     platform_log(PLATFORM_LOG_DEBUG, "crc ok");
+    count(&rx_received, 1);
 
-    user_cb(data, len, user_data);
+    if (user_cb) {
+        user_cb(data, len, user_data);
+    }
+    return 0;
 }
 
 /**
@@ -110,149 +304,151 @@ static uint16_t calc_p1_telegram_crc(const uint8_t *src, size_t len) {
     return crc;
 }
 
-static struct dsmr_p1_telegram parse_p1_telegram(uint8_t *telegram,
-                                                 size_t telegram_len) {
-    struct dsmr_p1_telegram ret = {0};
+static long double parse_number(const uint8_t *value, size_t len) {
+    char buf[VALUE_MAX_LEN + 1];
 
-    char *token, *next_token = telegram;
-    while (next_token < (char *)(telegram + telegram_len)) {
-        char *saveptr;
-        token = strtok_r(next_token, DSMR_P1_COSEM_DELIM, &saveptr);
-        if (token == NULL) {
-            break;
-        }
-        platform_log(PLATFORM_LOG_INFO, "%s", token);
-        size_t len = strlen(token);
-        next_token = token + len + 1;
-        parse_cosem_object(&ret, token, len);
-    }
+    len = len < VALUE_MAX_LEN ? len : VALUE_MAX_LEN;
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+    // Stops at the unit
+    return strtold(buf, NULL);
+}
 
-    return ret;
+static uint32_t parse_hex(const uint8_t *value, size_t len) {
+    char buf[VALUE_MAX_LEN + 1];
+
+    len = len < VALUE_MAX_LEN ? len : VALUE_MAX_LEN;
+    memcpy(buf, value, len);
+    buf[len] = '\0';
+    return strtoul(buf, NULL, 16);
 }
 
-static void parse_cosem_object(struct dsmr_p1_telegram *telegram, char *cosem,
-                               size_t len) {
-    char *saveptr;
-    const char *obis_delim = "()";
-    char *obis_code = strtok_r(cosem, obis_delim, &saveptr);
-    if (obis_code == NULL || strnlen(obis_code, len) == len) {
-        platform_log(PLATFORM_LOG_DEBUG, "not a cosem object");
-        return;
-    }
-    platform_log(PLATFORM_LOG_DEBUG, "cosem object: %s", cosem);
-    platform_log(PLATFORM_LOG_DEBUG, "parsing cosem object %p, %s", obis_code,
-                 obis_code);
-    char *value = strtok_r(NULL, obis_delim, &saveptr);
-    if (value == NULL) {
-        return;
+// Timestamps are the first group, e.g. 1-0:1.6.0(200509134558S)(02.589*kW)
+static int64_t parse_timestamp(const uint8_t *data,
+                               const struct dsmr_p1_index_entry *entry) {
+    char buf[VALUE_MAX_LEN + 1] = {0};
+    const size_t start = entry->code_offset + entry->code_len + 1;
+    const uint8_t *end =
+        memchr(&data[start], ')', entry->value_offset + entry->value_len -
+                                      start);
+    const size_t len = end ? (size_t)(end - &data[start]) : entry->value_len;
+
+    // YYMMDDhhmmssX
+    if (len < 13 || len > VALUE_MAX_LEN) {
+        return 0;
     }
+    memcpy(buf, &data[start], len);
+    return parse_cosem_timestamp(buf);
+}
 
-    const char *value_delim = "*";
-    if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_VERSION) == 0) {
-        telegram->version = strtol(value, NULL, 16);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_DATE_TIME) == 0) {
-        telegram->timestamp = parse_cosem_timestamp(value);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_DELIVERED_TO_CLIENT_T1) == 0) {
-        value = strtok(value, value_delim);
-        telegram->elec_to_client.tarrif_1 = strtold(value, NULL);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_DELIVERED_BY_CLIENT_T1) == 0) {
-        value = strtok(value, value_delim);
-        telegram->elec_by_client.tarrif_1 = strtold(value, NULL);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_DELIVERED_TO_CLIENT_T2) == 0) {
-        value = strtok(value, value_delim);
-        telegram->elec_to_client.tarrif_2 = strtold(value, NULL);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_DELIVERED_BY_CLIENT_T2) == 0) {
-        value = strtok(value, value_delim);
-        telegram->elec_by_client.tarrif_2 = strtold(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_ELEC_DELIVERED) == 0) {
-        value = strtok(value, value_delim);
-        telegram->power_delivered = strtold(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_ELEC_RECEIVED) == 0) {
-        value = strtok(value, value_delim);
-        telegram->power_received = strtold(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_TARRIF_INDICATOR) ==
-               0) {
-        value = strtok(value, value_delim);
-        telegram->tarrif_indicator = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_FAILURE_NR) == 0) {
-        telegram->nr_power_failures = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_FAILURE_NR_LONG) == 0) {
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL1) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl1.voltage = strtof(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL2) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl2.voltage = strtof(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL3) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl3.voltage = strtof(value, NULL);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL1_NR_SAGS) ==
-               0) {
-        telegram->pl1.nr_voltage_sags = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL2_NR_SAGS) ==
-               0) {
-        telegram->pl2.nr_voltage_sags = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL3_NR_SAGS) ==
-               0) {
-        telegram->pl3.nr_voltage_sags = strtol(value, NULL, 10);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL1_NR_SWELLS) == 0) {
-        telegram->pl1.nr_voltage_swells = strtol(value, NULL, 10);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL2_NR_SWELLS) == 0) {
-        telegram->pl2.nr_voltage_swells = strtol(value, NULL, 10);
-    } else if (strcmp(cosem,
-                      DSMR_P1_OBIS_REF_STR_POWER_VOLTAGE_PL3_NR_SWELLS) == 0) {
-        telegram->pl3.nr_voltage_swells = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_CURRENT_PL1) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl1.current = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_CURRENT_PL2) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl2.current = strtol(value, NULL, 10);
-    } else if (strcmp(cosem, DSMR_P1_OBIS_REF_STR_POWER_CURRENT_PL3) == 0) {
-        value = strtok(value, value_delim);
-        telegram->pl3.current = strtol(value, NULL, 10);
-    }
+static void parse_string(char *dst, size_t dst_len, const uint8_t *value,
+                         size_t len) {
+    len = len < dst_len - 1 ? len : dst_len - 1;
+    memcpy(dst, value, len);
+    dst[len] = '\0';
 }
 
-static int64_t parse_cosem_timestamp(char *value) {
-    int64_t ret = 0;
-    struct tm tm = {0};
-    char sub_value[3] = {0};
-    int offset = 0;
+static const struct dsmr_p1_index_entry *
+index_find(const struct dsmr_p1_index *index, const uint8_t *data,
+           const char *code, size_t code_len) {
+    const uint32_t hash = hash_code((const uint8_t *)code, code_len);
+    uint32_t slot = INDEX_SLOT(hash);
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_year = strtol(sub_value, NULL, 10);
-    offset += 2;
+    for (size_t probe = 0; probe < DSMR_P1_INDEX_SLOTS; probe++) {
+        slot &= DSMR_P1_INDEX_SLOTS - 1;
+        if (index->slots[slot] == 0) {
+            break;
+        }
+        const struct dsmr_p1_index_entry *entry =
+            &index->entries[index->slots[slot] - 1];
+        if (entry->hash == hash && entry->code_len == code_len &&
+            memcmp(&data[entry->code_offset], code, code_len) == 0) {
+            return entry;
+        }
+        slot++;
+    }
+    return NULL;
+}
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_mon = strtol(sub_value, NULL, 10);
-    offset += 2;
+static int index_add(struct dsmr_p1_index *index, const uint8_t *data,
+                     size_t code_offset, size_t code_len, size_t value_offset,
+                     size_t value_len) {
+    if (index->count >= DSMR_P1_INDEX_MAX_ENTRIES) {
+        return -ENOMEM;
+    }
+    if (code_len > UINT8_MAX) {
+        return -EINVAL;
+    }
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_mday = strtol(sub_value, NULL, 10);
-    offset += 2;
+    // Linear probing, the table is never full as it has more slots than
+    // entries
+    const uint32_t hash = hash_code(&data[code_offset], code_len);
+    uint32_t slot = INDEX_SLOT(hash);
+    for (;; slot++) {
+        slot &= DSMR_P1_INDEX_SLOTS - 1;
+        if (index->slots[slot] == 0) {
+            break;
+        }
+        const struct dsmr_p1_index_entry *entry =
+            &index->entries[index->slots[slot] - 1];
+        if (entry->hash == hash && entry->code_len == code_len &&
+            memcmp(&data[entry->code_offset], &data[code_offset], code_len) ==
+                0) {
+            return -EEXIST;
+        }
+    }
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_hour = strtol(sub_value, NULL, 10);
-    offset += 2;
+    index->entries[index->count] = (struct dsmr_p1_index_entry){
+        .hash = hash,
+        .code_offset = code_offset,
+        .value_offset = value_offset,
+        .value_len = value_len,
+        .code_len = code_len,
+    };
+    index->slots[slot] = ++index->count;
+    return 0;
+}
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_min = strtol(sub_value, NULL, 10);
-    offset += 2;
+// The hash of DSMR_P1_OBIS_HASH()
+static uint32_t hash_code(const uint8_t *code, size_t len) {
+    uint32_t hash = 0;
+    for (size_t i = 0; i < len; i++) {
+        hash = hash * 31U + code[i];
+    }
+    return hash;
+}
 
-    memcpy(sub_value, &value[offset], 2);
-    tm.tm_sec = strtol(sub_value, NULL, 10);
-    offset += 2;
+// YYMMDDhhmmssX as seconds since the epoch, counting the wall clock time of
+// the meter as UTC like the rest of the firmware does. The fields are
+// converted directly, mktime() would apply the local time zone and with
+// tm_isdst taken from X search for a DST rule the zone may not have.
+static int64_t parse_cosem_timestamp(const char *value) {
+    int fields[6];
+
+    for (size_t i = 0; i < 6; i++) {
+        const char hi = value[2 * i];
+        const char lo = value[2 * i + 1];
+        if (hi < '0' || hi > '9' || lo < '0' || lo > '9') {
+            return 0;
+        }
+        fields[i] = (hi - '0') * 10 + (lo - '0');
+    }
+    const int year = 2000 + fields[0];
+    const int month = fields[1];
+    const int day = fields[2];
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
 
-    memcpy(sub_value, &value[offset], 1);
-    tm.tm_isdst = sub_value[0] == 'S';
+    // Days from civil, counting years from March so the leap day is last
+    const int y = year - (month <= 2);
+    const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t days = 365LL * y + y / 4 - y / 100 + y / 400 + doy - 719468;
+    return days * 86400 + fields[3] * 3600 + fields[4] * 60 + fields[5];
+}
 
-    ret = (int64_t)mktime(&tm);
-    return ret;
+// Counted from interrupts as well as threads, the builtins are lock free for
+// 32 bits on the Zephyr targets and on Linux
+static void count(uint32_t *counter, uint32_t n) {
+    (void)__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
 }
@@ -0,0 +1,228 @@
+/**
+ * @file platform.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Linux platform integration for the DSMR P1 library
+ *
+ * Reads the P1 byte stream of a single port from the file, fifo or pty named
+ * by DSMR_P1_DEVICE, or from stdin when it is unset. A tty is switched to raw
+ * mode. Telegrams are framed like the Zephyr backend does and handed to the
+ * library on a reader thread. Like a meter, the input is only read while the
+ * data request is high, so a file is not consumed before dsmr_p1_enable().
+ */
+
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // cfmakeraw
+#endif
+
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/linux.h>
+#include <dsmr_p1/platform.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#ifndef DSMR_P1_LOG_LEVEL
+#define DSMR_P1_LOG_LEVEL PLATFORM_LOG_WARNING
+#endif
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int open_input(void);
+static void wait_data_req(void);
+static void *thread_entry(void *arg);
+static const char *log_prefix(platform_log_level_t log_level);
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static data_received_callback_t telegram_received_cb;
+static pthread_t rx_thread;
+static bool rx_thread_started;
+static int rx_fd = -1;
+static pthread_mutex_t data_req_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t data_req_cond = PTHREAD_COND_INITIALIZER;
+static bool data_req;
+static int rx_result;
+
+static uint8_t rx_buf[DSMR_P1_TELEGRAM_MAX_SIZE];
+
+/******************************************************************************
+ * Public Function Implementation
+ *****************************************************************************/
+
+int platform_init(data_received_callback_t cb) {
+    if (cb == NULL) {
+        return -EINVAL;
+    }
+    if (rx_thread_started) {
+        return -EALREADY;
+    }
+
+    rx_fd = open_input();
+    if (rx_fd < 0) {
+        return rx_fd;
+    }
+
+    telegram_received_cb = cb;
+    int ret = pthread_create(&rx_thread, NULL, thread_entry, NULL);
+    if (ret != 0) {
+        platform_log(PLATFORM_LOG_ERROR, "could not start reader: %d", ret);
+        return -ret;
+    }
+    rx_thread_started = true;
+    return 0;
+}
+
+size_t platform_port_count(void) { return 1; }
+
+int platform_write_data_req(bool high) {
+    pthread_mutex_lock(&data_req_mu);
+    data_req = high;
+    pthread_cond_broadcast(&data_req_cond);
+    pthread_mutex_unlock(&data_req_mu);
+    return 0;
+}
+
+int platform_log(platform_log_level_t log_level, const char *format, ...) {
+    va_list param_list;
+
+    if (log_level < DSMR_P1_LOG_LEVEL) {
+        return 0;
+    }
+
+    va_start(param_list, format);
+    fprintf(stderr, "dsmr_p1: %s: ", log_prefix(log_level));
+    vfprintf(stderr, format, param_list);
+    fputc('\n', stderr);
+    va_end(param_list);
+    return 0;
+}
+
+int dsmr_p1_linux_join(void) {
+    if (!rx_thread_started) {
+        return -ESRCH;
+    }
+    pthread_join(rx_thread, NULL);
+    rx_thread_started = false;
+    return rx_result;
+}
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+static int open_input(void) {
+    const char *path = getenv("DSMR_P1_DEVICE");
+    int fd = STDIN_FILENO;
+
+    if (path && path[0] != '\0') {
+        fd = open(path, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            platform_log(PLATFORM_LOG_ERROR, "could not open %s: %d", path,
+                         errno);
+            return -errno;
+        }
+    }
+
+    // P1 is 115200 8N1 from DSMR 4 on, a pty ignores the speed
+    struct termios tio;
+    if (isatty(fd) && tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B115200);
+        (void)tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static void *thread_entry(void *arg) {
+    uint8_t chunk[256];
+    size_t rx_offset = 0;
+    ssize_t n;
+
+    (void)arg;
+    platform_log(PLATFORM_LOG_INFO, "started");
+
+    for (;;) {
+        wait_data_req();
+        n = read(rx_fd, chunk, sizeof(chunk));
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rx_result = -errno;
+            platform_log(PLATFORM_LOG_ERROR, "read failed: %d", errno);
+            break;
+        }
+
+        for (ssize_t i = 0; i < n; i++) {
+            if (chunk[i] == '/' && rx_offset > 0) {
+                dsmr_p1_count_loss(DSMR_P1_LOSS_FRAMING);
+                rx_offset = 0;
+            }
+            rx_buf[rx_offset] = chunk[i];
+            if (rx_buf[0] != '/') {
+                rx_offset = 0;
+                continue;
+            }
+            rx_offset++;
+            if (rx_offset >= sizeof(rx_buf)) {
+                dsmr_p1_count_loss(DSMR_P1_LOSS_OVERFLOW);
+                rx_offset = 0;
+                continue;
+            }
+            if (rx_offset >= DSMR_P1_TRAILER_LEN &&
+                rx_buf[rx_offset - DSMR_P1_TRAILER_LEN] == '!') {
+                (void)telegram_received_cb(rx_buf, rx_offset);
+                rx_offset = 0;
+            }
+        }
+    }
+
+    if (rx_fd != STDIN_FILENO) {
+        close(rx_fd);
+    }
+    rx_fd = -1;
+    return NULL;
+}
+
+static void wait_data_req(void) {
+    pthread_mutex_lock(&data_req_mu);
+    while (!data_req) {
+        pthread_cond_wait(&data_req_cond, &data_req_mu);
+    }
+    pthread_mutex_unlock(&data_req_mu);
+}
+
+static const char *log_prefix(platform_log_level_t log_level) {
+    switch (log_level) {
+    case PLATFORM_LOG_NONE:
+    case PLATFORM_LOG_DEBUG:
+        return "dbg";
+    case PLATFORM_LOG_INFO:
+        return "inf";
+    case PLATFORM_LOG_WARNING:
+        return "wrn";
+    case PLATFORM_LOG_ERROR:
+        return "err";
+    default:
+        return "ftl";
+    }
+}
@@ -0,0 +1,179 @@
+/**
+ * @file bus.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Fan-out of received telegrams to multiple subscribers
+ *
+ */
+
+#include "bus_internal.h"
+#include "trace_internal.h"
+
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(dsmr_p1_bus, CONFIG_DSMR_P1_LOG_LEVEL);
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void deliver(struct dsmr_p1_subscriber *sub,
+                    const struct dsmr_p1_frame *frame);
+#ifdef CONFIG_DSMR_P1_BUS_DELTA_STATS
+static void account_delta(const struct dsmr_p1_frame *frame);
+#endif
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+K_MEM_SLAB_DEFINE_STATIC(frame_slab, sizeof(struct dsmr_p1_frame),
+                         CONFIG_DSMR_P1_BUS_FRAMES,
+                         __alignof__(struct dsmr_p1_frame));
+
+// Only used from the P1 receive thread
+#ifdef CONFIG_DSMR_P1_BUS_DELTA_STATS
+static uint8_t delta_buf[DSMR_P1_DELTA_MAX_LEN];
+#endif
+static uint32_t sequence;
+static struct dsmr_p1_telegram prev[DSMR_P1_NUM_PORTS];
+static bool has_prev[DSMR_P1_NUM_PORTS];
+
+static atomic_t published;
+static atomic_t no_frame;
+static atomic_t full_bytes;
+static atomic_t delta_bytes;
+
+/******************************************************************************
+ * Public Function Implementation
+ *****************************************************************************/
+
+void dsmr_p1_frame_ref(const struct dsmr_p1_frame *frame) {
+    atomic_inc((atomic_t *)&frame->refs);
+}
+
+void dsmr_p1_frame_unref(const struct dsmr_p1_frame *frame) {
+    if (atomic_dec((atomic_t *)&frame->refs) == 1) {
+        k_mem_slab_free(&frame_slab, (void *)frame);
+    }
+}
+
+void dsmr_p1_bus_get_stats(struct dsmr_p1_bus_stats *stats) {
+    stats->published = atomic_get(&published);
+    stats->no_frame = atomic_get(&no_frame);
+    stats->free = k_mem_slab_num_free_get(&frame_slab);
+    stats->full_bytes = atomic_get(&full_bytes);
+    stats->delta_bytes = atomic_get(&delta_bytes);
+}
+
+void dsmr_p1_subscriber_thread(void *p1, void *p2, void *p3) {
+    struct dsmr_p1_subscriber *sub = p1;
+    const struct dsmr_p1_frame *frame;
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        (void)k_msgq_get(sub->queue, &frame, K_FOREVER);
+        sub->cb(frame, sub->user_data);
+        atomic_inc(&sub->delivered);
+        dsmr_p1_frame_unref(frame);
+    }
+}
+
+struct dsmr_p1_frame *bus_frame_alloc(void) {
+    struct dsmr_p1_frame *frame;
+
+    if (k_mem_slab_alloc(&frame_slab, (void **)&frame, K_NO_WAIT) != 0) {
+        atomic_inc(&no_frame);
+        return NULL;
+    }
+    atomic_set(&frame->refs, 1);
+    return frame;
+}
+
+void bus_publish(struct dsmr_p1_frame *frame, uint8_t port, size_t len,
+                 uint32_t rx_cycles) {
+    P1_TRACE_BEGIN("p1_parse", len);
+    if (dsmr_p1_index_build(frame->data, len, &frame->index) < 0) {
+        LOG_WRN("telegram has more objects than the index holds");
+    }
+    frame->telegram = dsmr_p1_parse_index(frame->data, &frame->index);
+    P1_TRACE_END("p1_parse", frame->index.count);
+    frame->changed = DSMR_P1_FIELDS_ALL;
+    if (has_prev[port]) {
+        frame->changed = dsmr_p1_diff(&prev[port], &frame->telegram);
+        (void)dsmr_p1_check_gap(&prev[port], &frame->telegram);
+    }
+    prev[port] = frame->telegram;
+    has_prev[port] = true;
+#ifdef CONFIG_DSMR_P1_BUS_DELTA_STATS
+    account_delta(frame);
+#endif
+    frame->port = port;
+    frame->len = len;
+    frame->rx_cycles = rx_cycles;
+    frame->rx_uptime = k_uptime_get();
+    frame->sequence = ++sequence;
+    atomic_inc(&published);
+
+    P1_TRACE_BEGIN("p1_deliver", frame->sequence);
+    STRUCT_SECTION_FOREACH(dsmr_p1_subscriber, sub) {
+        if (sub->port == DSMR_P1_PORT_ANY || sub->port == port) {
+            deliver(sub, frame);
+        }
+    }
+    P1_TRACE_END("p1_deliver", frame->sequence);
+    dsmr_p1_frame_unref(frame);
+}
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+static void deliver(struct dsmr_p1_subscriber *sub,
+                    const struct dsmr_p1_frame *frame) {
+    if (!sub->queue) {
+        sub->cb(frame, sub->user_data);
+        atomic_inc(&sub->delivered);
+        return;
+    }
+
+    dsmr_p1_frame_ref(frame);
+    while (k_msgq_put(sub->queue, &frame, K_NO_WAIT) != 0) {
+        // Slow subscriber, drop its oldest frame rather than wait for it
+        const struct dsmr_p1_frame *oldest;
+        if (k_msgq_get(sub->queue, &oldest, K_NO_WAIT) == 0) {
+            dsmr_p1_frame_unref(oldest);
+            atomic_inc(&sub->dropped);
+        }
+    }
+}
+
+#ifdef CONFIG_DSMR_P1_BUS_DELTA_STATS
+// Size of every telegram as a full and as a delta encoding, to tell what
+// sending deltas would save
+static void account_delta(const struct dsmr_p1_frame *frame) {
+    int ret = dsmr_p1_delta_encode(&frame->telegram, DSMR_P1_FIELDS_ALL,
+                                   delta_buf, sizeof(delta_buf));
+    if (ret > 0) {
+        atomic_add(&full_bytes, ret);
+    }
+    ret = dsmr_p1_delta_encode(&frame->telegram, frame->changed, delta_buf,
+                               sizeof(delta_buf));
+    if (ret > 0) {
+        atomic_add(&delta_bytes, ret);
+    }
+}
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file bus_internal.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Publishing side of the telegram bus, used by the platform
+ *
+ */
+
+#ifndef _DSMR_P1_SRC_ZEPHYR_BUS_INTERNAL_H__
+#define _DSMR_P1_SRC_ZEPHYR_BUS_INTERNAL_H__
+
+#include <dsmr_p1/bus.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Take a free frame from the pool to receive a telegram into
+ *
+ * Does not wait, called from the UART ISR at the start of every telegram.
+ *
+ * @return the frame or NULL if the pool is empty
+ */
+struct dsmr_p1_frame *bus_frame_alloc(void);
+
+/**
+ * @brief Parse the telegram received into the frame and publish it
+ *
+ * Listeners are called before this returns, the reference of the caller is
+ * handed over to the bus.
+ */
+void bus_publish(struct dsmr_p1_frame *frame, uint8_t port, size_t len,
+                 uint32_t rx_cycles);
+
+#endif // _DSMR_P1_SRC_ZEPHYR_BUS_INTERNAL_H__
@@ -0,0 +1,112 @@
+/**
+ * @file latency.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Latency histograms of the telegram pipeline
+ *
+ */
+
+#include <dsmr_p1/latency.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define NUM_STAGES DSMR_P1_LATENCY_STAGE_COUNT
+#define NUM_BUCKETS DSMR_P1_LATENCY_BUCKETS
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static size_t bucket_of(uint32_t us);
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static atomic_t buckets[NUM_STAGES][NUM_BUCKETS];
+static atomic_t max_us[NUM_STAGES];
+
+// Sequence of the last frame of every port that was sent to a client
+static atomic_t sent_sequence[DSMR_P1_NUM_PORTS];
+
+static const char *const stage_names[NUM_STAGES] = {
+    [DSMR_P1_LATENCY_RECEIVE] = "receive",
+    [DSMR_P1_LATENCY_WAKEUP] = "wakeup",
+    [DSMR_P1_LATENCY_CRC] = "crc",
+    [DSMR_P1_LATENCY_PUBLISH] = "publish",
+    [DSMR_P1_LATENCY_HTTP] = "http",
+    [DSMR_P1_LATENCY_MULTICAST] = "multicast",
+};
+
+/******************************************************************************
+ * Public Function Implementation
+ *****************************************************************************/
+
+void dsmr_p1_latency_record(enum dsmr_p1_latency_stage stage, uint32_t us) {
+    if (stage >= NUM_STAGES) {
+        return;
+    }
+
+    atomic_inc(&buckets[stage][bucket_of(us)]);
+    atomic_val_t max = atomic_get(&max_us[stage]);
+    while ((uint32_t)max < us && !atomic_cas(&max_us[stage], max, us)) {
+        max = atomic_get(&max_us[stage]);
+    }
+}
+
+uint32_t dsmr_p1_latency_record_since(enum dsmr_p1_latency_stage stage,
+                                      uint32_t start_cycles) {
+    const uint32_t now = k_cycle_get_32();
+    dsmr_p1_latency_record(stage, k_cyc_to_us_floor32(now - start_cycles));
+    return now;
+}
+
+void dsmr_p1_latency_sent(const struct dsmr_p1_frame *frame) {
+    atomic_t *sent = &sent_sequence[frame->port];
+    const atomic_val_t last = atomic_get(sent);
+
+    // Later responses with the same frame, or an older one, do not count
+    if ((int32_t)(frame->sequence - (uint32_t)last) <= 0 ||
+        !atomic_cas(sent, last, frame->sequence)) {
+        return;
+    }
+    const int64_t ms = k_uptime_get() - frame->rx_uptime;
+    dsmr_p1_latency_record(DSMR_P1_LATENCY_HTTP,
+                           (uint32_t)CLAMP(ms, 0, UINT32_MAX / 1000) * 1000);
+}
+
+void dsmr_p1_latency_get(enum dsmr_p1_latency_stage stage,
+                         struct dsmr_p1_latency_histogram *histogram) {
+    *histogram = (struct dsmr_p1_latency_histogram){0};
+    if (stage >= NUM_STAGES) {
+        return;
+    }
+
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        histogram->buckets[i] = atomic_get(&buckets[stage][i]);
+        histogram->count += histogram->buckets[i];
+    }
+    histogram->max_us = atomic_get(&max_us[stage]);
+}
+
+const char *dsmr_p1_latency_stage_name(enum dsmr_p1_latency_stage stage) {
+    return stage < NUM_STAGES ? stage_names[stage] : "unknown";
+}
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+static size_t bucket_of(uint32_t us) {
+    if (us == 0) {
+        return 0;
+    }
+    return MIN((size_t)(32 - __builtin_clz(us)), NUM_BUCKETS - 1);
+}
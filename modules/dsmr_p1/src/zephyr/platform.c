@@ -7,7 +7,11 @@
  *
  */
 
+#include "bus_internal.h"
+#include "trace_internal.h"
+
 #include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/latency.h>
 #include <dsmr_p1/platform.h>
 
 #include <zephyr/drivers/gpio.h>
@@ -15,17 +19,48 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/crc.h>
-#include <zephyr/sys/ring_buffer.h>
 
 /******************************************************************************
  * Constants
  *****************************************************************************/
 
+#define DT_DRV_COMPAT dsmr_p1
+
+#define NUM_PORTS DSMR_P1_NUM_PORTS
+
+BUILD_ASSERT(NUM_PORTS > 0, "no enabled dsmr,p1 node in the devicetree");
+BUILD_ASSERT(NUM_PORTS <= UINT8_MAX, "too many dsmr,p1 nodes");
+
 LOG_MODULE_REGISTER(dmsr_p1, CONFIG_DSMR_P1_LOG_LEVEL);
 
-const struct device *p1_uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_p1_uart));
-const struct gpio_dt_spec data_req_gpio =
-    GPIO_DT_SPEC_GET_OR(DT_NODELABEL(zephy_p1_req_gpio), gpios, {0});
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct p1_port {
+    const struct device *uart;
+    struct gpio_dt_spec data_req;
+    // Frame of the pool the telegram is received into, taken at the '/'
+    struct dsmr_p1_frame *rx_frame;
+    size_t rx_offset;
+    // Set when reception is enabled by a data request
+    bool resumed;
+#ifdef CONFIG_DSMR_P1_LATENCY
+    uint32_t first_cycles; // cycle counter at the '/'
+    uint32_t bang_cycles;  // cycle counter at the '!'
+#endif
+};
+
+// A complete telegram handed from the ISR to the thread
+struct rx_msg {
+    struct dsmr_p1_frame *frame;
+    size_t len;
+    uint32_t rx_cycles; // cycle counter at the end of the trailer
+#ifdef CONFIG_DSMR_P1_LATENCY
+    uint32_t receive_us; // '/' to '!'
+#endif
+    uint8_t port;
+};
 
 /******************************************************************************
  * Local Function Prototypes
@@ -33,6 +68,7 @@ const struct gpio_dt_spec data_req_gpio =
 
 static int module_init(void);
 static void uart_irq_cb(const struct device *uart, void *user_data);
+static void uart_irq_rx(const struct device *uart, struct p1_port *port);
 static void thread_entry(void *p1, void *p2, void *p3);
 static int log_translate(platform_log_level_t log_level);
 
@@ -40,15 +76,26 @@ static int log_translate(platform_log_level_t log_level);
  * Local Variables
  *****************************************************************************/
 
+// Indexed by instance, which is the port index of the bus and the sensors
+#define P1_PORT_INIT(inst)                                                     \
+    [inst] = {                                                                 \
+        .uart = DEVICE_DT_GET(DT_INST_BUS(inst)),                              \
+        .data_req = GPIO_DT_SPEC_INST_GET_OR(inst, data_req_gpios, {0}),       \
+    },
+
+static struct p1_port ports[NUM_PORTS] = {
+    DT_INST_FOREACH_STATUS_OKAY(P1_PORT_INIT)};
+
 static struct k_thread dsmr_p1_rx_thread;
-K_THREAD_STACK_DEFINE(dsmr_p1_rx_stack, DSMR_P1_TELEGRAM_MAX_SIZE * 2);
+K_THREAD_STACK_DEFINE(dsmr_p1_rx_stack, CONFIG_DSMR_P1_THREAD_STACK_SIZE);
 
 static data_received_callback_t telegram_received_cb;
 
-static uint8_t rx_buf[DSMR_P1_TELEGRAM_MAX_SIZE];
-static int rx_offset = 0;
-RING_BUF_DECLARE(rx_ring_buf, DSMR_P1_TELEGRAM_MAX_SIZE * 2);
-K_SEM_DEFINE(data_ready_sem, 0, 1)
+// Complete telegrams, each holding its frame. Reception goes on into a new
+// frame meanwhile, so this allows a second telegram per port before the
+// thread has to catch up.
+K_MSGQ_DEFINE(rx_msgq, sizeof(struct rx_msg), 2 * NUM_PORTS,
+              __alignof__(struct rx_msg));
 
 /******************************************************************************
  * Public Function Implementation
@@ -56,43 +103,63 @@ K_SEM_DEFINE(data_ready_sem, 0, 1)
 
 int platform_init(data_received_callback_t cb) {
     int ret;
-    LOG_INF("intialising");
+    LOG_INF("intialising %d port(s)", NUM_PORTS);
     if (cb == NULL) {
         return -EINVAL;
     }
 
-    if (gpio_is_ready_dt(&data_req_gpio)) {
-        ret = gpio_pin_configure_dt(&data_req_gpio, GPIO_OUTPUT_INACTIVE);
+    for (size_t i = 0; i < NUM_PORTS; i++) {
+        struct p1_port *port = &ports[i];
+
+        if (!device_is_ready(port->uart)) {
+            LOG_ERR("uart of port %zu not ready", i);
+            return -ENODEV;
+        }
+        if (gpio_is_ready_dt(&port->data_req)) {
+            ret = gpio_pin_configure_dt(&port->data_req, GPIO_OUTPUT_INACTIVE);
+            if (ret < 0) {
+                LOG_ERR("could not configure data request gpio: %d", ret);
+                return ret;
+            }
+        }
+        uart_irq_rx_disable(port->uart);
+        ret = uart_irq_callback_user_data_set(port->uart, uart_irq_cb, port);
         if (ret < 0) {
-            LOG_ERR("could not configure data request gpio: %d", ret);
             return ret;
         }
     }
-    uart_irq_rx_disable(p1_uart_dev);
-    ret = uart_irq_callback_user_data_set(p1_uart_dev, uart_irq_cb, NULL);
-    if (ret < 0) {
-        return ret;
-    }
 
     telegram_received_cb = cb;
     k_thread_create(&dsmr_p1_rx_thread, dsmr_p1_rx_stack,
                     K_THREAD_STACK_SIZEOF(dsmr_p1_rx_stack), &thread_entry,
                     NULL, NULL, NULL, CONFIG_DSMR_P1_THREAD_PRIORITY, 0, K_NO_WAIT);
+    (void)k_thread_name_set(&dsmr_p1_rx_thread, "dsmr_p1_rx");
     return 0;
 }
 
+size_t platform_port_count(void) { return NUM_PORTS; }
+
 int platform_write_data_req(bool high) {
     int ret = 0;
 
-    high ? uart_irq_rx_enable(p1_uart_dev) : uart_irq_rx_disable(p1_uart_dev);
-    if (gpio_is_ready_dt(&data_req_gpio)) {
-        ret = gpio_pin_set_dt(&data_req_gpio, high ? 1 : 0);
-        if (ret < 0) {
-            LOG_ERR("could not set data request pin: %d", ret);
-            return ret;
+    for (size_t i = 0; i < NUM_PORTS; i++) {
+        struct p1_port *port = &ports[i];
+
+        if (high) {
+            port->resumed = true;
+            uart_irq_rx_enable(port->uart);
+        } else {
+            uart_irq_rx_disable(port->uart);
+        }
+        if (!gpio_is_ready_dt(&port->data_req)) {
+            ret = -ENOTSUP;
+            continue;
+        }
+        int err = gpio_pin_set_dt(&port->data_req, high ? 1 : 0);
+        if (err < 0) {
+            LOG_ERR("could not set data request pin: %d", err);
+            ret = err;
         }
-    } else {
-        ret = -ENOTSUP;
     }
     return ret;
 }
@@ -126,6 +193,14 @@ SYS_INIT(module_init, POST_KERNEL, 90);
 static int module_init(void) { return dsmr_p1_init(); }
 
 static void uart_irq_cb(const struct device *uart_dev, void *user_data) {
+    struct p1_port *port = user_data;
+
+    P1_TRACE_ISR_BEGIN("p1_isr", port->rx_offset);
+    uart_irq_rx(uart_dev, port);
+    P1_TRACE_ISR_END("p1_isr", port->rx_offset);
+}
+
+static void uart_irq_rx(const struct device *uart_dev, struct p1_port *port) {
     if (!uart_irq_update(uart_dev)) {
         LOG_DBG("Unable to process interrupts");
         return;
@@ -136,52 +211,110 @@ static void uart_irq_cb(const struct device *uart_dev, void *user_data) {
         return;
     }
 
-    int ret = uart_fifo_read(uart_dev, rx_buf + rx_offset, 1);
+    uint8_t byte;
+    int ret = uart_fifo_read(uart_dev, &byte, 1);
     if (ret < 0) {
         LOG_ERR("Failed to read UART FIFO (%d)", ret);
-        rx_offset = 0;
+        port->rx_offset = 0;
         return;
-    };
-    if (rx_buf[0] != '/') {
-        rx_offset = 0;
+    }
+    if (ret == 0) {
+        return;
+    }
+    if (port->resumed) {
+        // The meter was already sending when reception was enabled
+        port->resumed = false;
+        if (byte != '/') {
+            dsmr_p1_count_loss(DSMR_P1_LOSS_RX_DISABLED);
+        }
+    }
+    if (byte == '/') {
+        if (port->rx_offset > 0) {
+            // Start over with the next telegram rather than lose it as well
+            dsmr_p1_count_loss(DSMR_P1_LOSS_FRAMING);
+            port->rx_offset = 0;
+        }
+        if (!port->rx_frame) {
+            port->rx_frame = bus_frame_alloc();
+        }
+        if (!port->rx_frame) {
+            // Every frame is held by the subscribers, skip this telegram
+            dsmr_p1_count_loss(DSMR_P1_LOSS_BUSY);
+            return;
+        }
+    } else if (port->rx_offset == 0) {
+        // Not in a telegram
         return;
     }
 
-    rx_offset += ret;
-    if (rx_offset < DSMR_P1_TRAILER_LEN) {
+    uint8_t *data = port->rx_frame->data;
+#ifdef CONFIG_DSMR_P1_LATENCY
+    if (port->rx_offset == 0) {
+        port->first_cycles = k_cycle_get_32();
+    } else if (byte == '!') {
+        port->bang_cycles = k_cycle_get_32();
+    }
+#endif
+    data[port->rx_offset++] = byte;
+    if (port->rx_offset >= DSMR_P1_TELEGRAM_MAX_SIZE) {
+        // The frame is kept for the next telegram
+        dsmr_p1_count_loss(DSMR_P1_LOSS_OVERFLOW);
+        port->rx_offset = 0;
         return;
     }
-    if (rx_offset >= sizeof(rx_buf)) {
-        rx_offset = 0;
+    if (port->rx_offset < DSMR_P1_TRAILER_LEN ||
+        data[port->rx_offset - DSMR_P1_TRAILER_LEN] != '!') {
+        return;
     }
-    if (rx_buf[rx_offset - DSMR_P1_TRAILER_LEN] == '!') {
-        uart_irq_rx_disable(uart_dev);
-        ring_buf_put(&rx_ring_buf, rx_buf, rx_offset);
-        k_sem_give(&data_ready_sem);
-        rx_offset = 0;
+
+    // Hand the frame over as is and go on with the next one at the next '/'
+    const struct rx_msg msg = {
+        .frame = port->rx_frame,
+        .len = port->rx_offset,
+        .rx_cycles = k_cycle_get_32(),
+#ifdef CONFIG_DSMR_P1_LATENCY
+        .receive_us =
+            k_cyc_to_us_floor32(port->bang_cycles - port->first_cycles),
+#endif
+        .port = port - ports,
+    };
+    port->rx_frame = NULL;
+    port->rx_offset = 0;
+    if (k_msgq_put(&rx_msgq, &msg, K_NO_WAIT) != 0) {
+        dsmr_p1_frame_unref(msg.frame);
+        dsmr_p1_count_loss(DSMR_P1_LOSS_BUSY);
     }
 }
 
 static void thread_entry(void *p1, void *p2, void *p3) {
-    int ret;
-    uint8_t buf[DSMR_P1_TELEGRAM_MAX_SIZE];
+    struct rx_msg msg;
     LOG_INF("started");
 
     for (;;) {
-        memset(buf, 0, sizeof(buf));
-        ret = k_sem_take(&data_ready_sem, K_FOREVER);
-        LOG_INF("telegram rx");
-        if (ret != 0) {
-            continue;
-        }
-        ret = ring_buf_get(&rx_ring_buf, buf, sizeof(buf));
-        if (ret < 0) {
-            LOG_ERR("could not get data from ring buf (%d)", ret);
-            continue;
+        (void)k_msgq_get(&rx_msgq, &msg, K_FOREVER);
+        struct dsmr_p1_frame *frame = msg.frame;
+        P1_TRACE_BEGIN("p1_rx", msg.port);
+        uint32_t cycles = dsmr_p1_latency_record_since(DSMR_P1_LATENCY_WAKEUP,
+                                                       msg.rx_cycles);
+#ifdef CONFIG_DSMR_P1_LATENCY
+        dsmr_p1_latency_record(DSMR_P1_LATENCY_RECEIVE, msg.receive_us);
+#endif
+        LOG_INF("telegram rx on port %d", msg.port);
+
+        LOG_HEXDUMP_DBG(frame->data, msg.len, "telegram: ");
+        P1_TRACE_BEGIN("p1_crc", msg.len);
+        const int ret = telegram_received_cb(frame->data, msg.len);
+        P1_TRACE_END("p1_crc", ret == 0);
+        if (ret == 0) {
+            cycles =
+                dsmr_p1_latency_record_since(DSMR_P1_LATENCY_CRC, cycles);
+            bus_publish(frame, msg.port, msg.len, msg.rx_cycles);
+            (void)dsmr_p1_latency_record_since(DSMR_P1_LATENCY_PUBLISH,
+                                               cycles);
+        } else {
+            dsmr_p1_frame_unref(frame);
         }
-        LOG_HEXDUMP_DBG(buf, ret, "telegram: ");
-        telegram_received_cb(buf, ret);
-        uart_irq_rx_enable(p1_uart_dev);
+        P1_TRACE_END("p1_rx", msg.port);
     }
 }
 
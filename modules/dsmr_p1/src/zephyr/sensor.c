@@ -0,0 +1,379 @@
+/**
+ * @file sensor.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Sensor driver serving the last telegram of every P1 port
+ *
+ * The bus listener converts every telegram into a snapshot of q31 values
+ * once, reads copy the snapshot of the port and never reparse. The channels
+ * are fixed by the sensor API, SENSOR_VALUES names the field of the schema
+ * behind every value.
+ */
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/schema.h>
+#include <dsmr_p1/sensor.h>
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define DT_DRV_COMPAT dsmr_p1
+
+LOG_MODULE_REGISTER(dsmr_p1_sensor, CONFIG_DSMR_P1_LOG_LEVEL);
+
+#define NR_PHASES 3
+#define NR_TARIFFS 2
+
+// Values are kept as q31 scaled by 2^shift, covering up to 16.7 GWh,
+// 131 kW, 512 V and 512 A
+#define ENERGY_SHIFT 24
+#define POWER_SHIFT 17
+#define VOLTAGE_SHIFT 9
+#define CURRENT_SHIFT 9
+
+// The fields of the schema behind the values in the order of the channels,
+// by the name of the field, the shift and the multiplier from the unit sent
+// to the unit of the channel. The values of a tariff or phase are in order.
+#define SENSOR_VALUES(X)                                                       \
+    X(POWER_DELIVERED, POWER_SHIFT, 1000)                                      \
+    X(POWER_RECEIVED, POWER_SHIFT, 1000)                                       \
+    X(ENERGY_DELIVERED_T1, ENERGY_SHIFT, 1)                                    \
+    X(ENERGY_DELIVERED_T2, ENERGY_SHIFT, 1)                                    \
+    X(ENERGY_RECEIVED_T1, ENERGY_SHIFT, 1)                                     \
+    X(ENERGY_RECEIVED_T2, ENERGY_SHIFT, 1)                                     \
+    X(L1_VOLTAGE, VOLTAGE_SHIFT, 1)                                            \
+    X(L2_VOLTAGE, VOLTAGE_SHIFT, 1)                                            \
+    X(L3_VOLTAGE, VOLTAGE_SHIFT, 1)                                            \
+    X(L1_CURRENT, CURRENT_SHIFT, 1)                                            \
+    X(L2_CURRENT, CURRENT_SHIFT, 1)                                            \
+    X(L3_CURRENT, CURRENT_SHIFT, 1)
+
+#define VALUE_INDEX(name, shift, multiplier) VALUE_##name,
+#define VALUE_FIELD(name, shift, multiplier)                                   \
+    [VALUE_##name] = {DSMR_P1_FIELD_##name, shift, multiplier},
+
+enum sensor_value_index {
+    SENSOR_VALUES(VALUE_INDEX) NR_VALUES,
+    // The first value of a channel with a value per tariff or phase
+    VALUE_ENERGY_DELIVERED = VALUE_ENERGY_DELIVERED_T1,
+    VALUE_ENERGY_RECEIVED = VALUE_ENERGY_RECEIVED_T1,
+    VALUE_VOLTAGE = VALUE_L1_VOLTAGE,
+    VALUE_CURRENT = VALUE_L1_CURRENT,
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct value_field {
+    enum dsmr_p1_field field;
+    int8_t shift;
+    int16_t multiplier; // from the unit sent to the unit of the channel
+};
+
+// The encoded data of a read as well
+struct dsmr_p1_sensor_snapshot {
+    uint64_t timestamp_ns; // uptime at the end of the trailer
+    q31_t values[NR_VALUES];
+};
+
+struct dsmr_p1_sensor_data {
+    struct k_spinlock lock;
+    bool valid;
+    struct dsmr_p1_sensor_snapshot last;
+    struct dsmr_p1_sensor_snapshot fetched; // for sensor_channel_get()
+    sensor_trigger_handler_t handler;
+    const struct sensor_trigger *trigger;
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int sensor_sample_fetch(const struct device *dev,
+                               enum sensor_channel chan);
+static int sensor_channel_get(const struct device *dev,
+                              enum sensor_channel chan,
+                              struct sensor_value *val);
+static int sensor_trigger_set(const struct device *dev,
+                              const struct sensor_trigger *trig,
+                              sensor_trigger_handler_t handler);
+static void sensor_submit(const struct device *dev,
+                          struct rtio_iodev_sqe *iodev_sqe);
+static int sensor_get_decoder(const struct device *dev,
+                              const struct sensor_decoder_api **decoder);
+
+static int decoder_get_frame_count(const uint8_t *buffer,
+                                   struct sensor_chan_spec chan_spec,
+                                   uint16_t *frame_count);
+static int decoder_get_size_info(struct sensor_chan_spec chan_spec,
+                                 size_t *base_size, size_t *frame_size);
+static int decoder_decode(const uint8_t *buffer,
+                          struct sensor_chan_spec chan_spec, uint32_t *fit,
+                          uint16_t max_count, void *data_out);
+static bool decoder_has_trigger(const uint8_t *buffer,
+                                enum sensor_trigger_type trigger);
+
+static int value_index(struct sensor_chan_spec chan_spec);
+static q31_t to_q31(double value, int8_t shift);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const struct value_field value_fields[NR_VALUES] = {
+    SENSOR_VALUES(VALUE_FIELD)};
+
+static DEVICE_API(sensor, sensor_api) = {
+    .sample_fetch = sensor_sample_fetch,
+    .channel_get = sensor_channel_get,
+    .trigger_set = sensor_trigger_set,
+    .submit = sensor_submit,
+    .get_decoder = sensor_get_decoder,
+};
+
+SENSOR_DECODER_API_DT_DEFINE() = {
+    .get_frame_count = decoder_get_frame_count,
+    .get_size_info = decoder_get_size_info,
+    .decode = decoder_decode,
+    .has_trigger = decoder_has_trigger,
+};
+
+#define DSMR_P1_SENSOR_DEFINE(inst)                                            \
+    static struct dsmr_p1_sensor_data sensor_data_##inst;                      \
+    SENSOR_DEVICE_DT_INST_DEFINE(inst, NULL, NULL, &sensor_data_##inst, NULL,  \
+                                 POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,     \
+                                 &sensor_api);
+
+DT_INST_FOREACH_STATUS_OKAY(DSMR_P1_SENSOR_DEFINE)
+
+#define DSMR_P1_SENSOR_DEVICE(inst) [inst] = DEVICE_DT_INST_GET(inst),
+
+// Device of every port, indexed by the port
+static const struct device *const devices[] = {
+    DT_INST_FOREACH_STATUS_OKAY(DSMR_P1_SENSOR_DEVICE)};
+
+DSMR_P1_LISTENER_DEFINE(dsmr_p1_sensor_listener, DSMR_P1_PORT_ANY,
+                        telegram_listener_cb, NULL);
+
+/******************************************************************************
+ * Local Function Implementation
+ *****************************************************************************/
+
+static int sensor_sample_fetch(const struct device *dev,
+                               enum sensor_channel chan) {
+    struct dsmr_p1_sensor_data *data = dev->data;
+    int ret = 0;
+
+    if (chan != SENSOR_CHAN_ALL &&
+        value_index((struct sensor_chan_spec){.chan_type = chan}) < 0) {
+        return -ENOTSUP;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    if (data->valid) {
+        data->fetched = data->last;
+    } else {
+        ret = -ENODATA;
+    }
+    k_spin_unlock(&data->lock, key);
+    return ret;
+}
+
+static int sensor_channel_get(const struct device *dev,
+                              enum sensor_channel chan,
+                              struct sensor_value *val) {
+    const struct dsmr_p1_sensor_data *data = dev->data;
+
+    // Serves the first phase and tariff, the others are read by index
+    const int index =
+        value_index((struct sensor_chan_spec){.chan_type = chan});
+    if (index < 0) {
+        return index;
+    }
+
+    const int64_t micro = ((int64_t)data->fetched.values[index] * 1000000) >>
+                          (31 - value_fields[index].shift);
+    return sensor_value_from_micro(val, micro);
+}
+
+static int sensor_trigger_set(const struct device *dev,
+                              const struct sensor_trigger *trig,
+                              sensor_trigger_handler_t handler) {
+    struct dsmr_p1_sensor_data *data = dev->data;
+
+    if (trig->type != SENSOR_TRIG_DATA_READY) {
+        return -ENOTSUP;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    data->trigger = trig;
+    data->handler = handler;
+    k_spin_unlock(&data->lock, key);
+    return 0;
+}
+
+static void sensor_submit(const struct device *dev,
+                          struct rtio_iodev_sqe *iodev_sqe) {
+    const struct sensor_read_config *cfg = iodev_sqe->sqe.iodev->data;
+    struct dsmr_p1_sensor_data *data = dev->data;
+    const uint32_t min_len = sizeof(struct dsmr_p1_sensor_snapshot);
+    uint8_t *buf;
+    uint32_t buf_len;
+
+    if (cfg->is_streaming) {
+        rtio_iodev_sqe_err(iodev_sqe, -ENOTSUP);
+        return;
+    }
+
+    int ret = rtio_sqe_rx_buf(iodev_sqe, min_len, min_len, &buf, &buf_len);
+    if (ret < 0) {
+        rtio_iodev_sqe_err(iodev_sqe, ret);
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    const bool valid = data->valid;
+    memcpy(buf, &data->last, sizeof(data->last));
+    k_spin_unlock(&data->lock, key);
+
+    if (!valid) {
+        rtio_iodev_sqe_err(iodev_sqe, -ENODATA);
+        return;
+    }
+    rtio_iodev_sqe_ok(iodev_sqe, 0);
+}
+
+static int sensor_get_decoder(const struct device *dev,
+                              const struct sensor_decoder_api **decoder) {
+    ARG_UNUSED(dev);
+    *decoder = &SENSOR_DECODER_NAME();
+    return 0;
+}
+
+static int decoder_get_frame_count(const uint8_t *buffer,
+                                   struct sensor_chan_spec chan_spec,
+                                   uint16_t *frame_count) {
+    ARG_UNUSED(buffer);
+    if (value_index(chan_spec) < 0) {
+        return -ENOTSUP;
+    }
+    *frame_count = 1;
+    return 0;
+}
+
+static int decoder_get_size_info(struct sensor_chan_spec chan_spec,
+                                 size_t *base_size, size_t *frame_size) {
+    if (value_index(chan_spec) < 0) {
+        return -ENOTSUP;
+    }
+    *base_size = sizeof(struct sensor_q31_data);
+    *frame_size = sizeof(struct sensor_q31_sample_data);
+    return 0;
+}
+
+static int decoder_decode(const uint8_t *buffer,
+                          struct sensor_chan_spec chan_spec, uint32_t *fit,
+                          uint16_t max_count, void *data_out) {
+    const struct dsmr_p1_sensor_snapshot *snapshot =
+        (const struct dsmr_p1_sensor_snapshot *)buffer;
+    struct sensor_q31_data *out = data_out;
+
+    const int index = value_index(chan_spec);
+    if (index < 0) {
+        return index;
+    }
+    // Every read holds a single frame
+    if (*fit != 0 || max_count == 0) {
+        return 0;
+    }
+
+    out->header.base_timestamp_ns = snapshot->timestamp_ns;
+    out->header.reading_count = 1;
+    out->shift = value_fields[index].shift;
+    out->readings[0].timestamp_delta = 0;
+    out->readings[0].value = snapshot->values[index];
+    *fit = 1;
+    return 1;
+}
+
+static bool decoder_has_trigger(const uint8_t *buffer,
+                                enum sensor_trigger_type trigger) {
+    ARG_UNUSED(buffer);
+    ARG_UNUSED(trigger);
+    return false;
+}
+
+static int value_index(struct sensor_chan_spec chan_spec) {
+    const uint16_t idx = chan_spec.chan_idx;
+
+    switch ((int)chan_spec.chan_type) {
+    case SENSOR_CHAN_POWER:
+        return idx == 0 ? VALUE_POWER_DELIVERED : -ENOTSUP;
+    case DSMR_P1_CHAN_POWER_RECEIVED:
+        return idx == 0 ? VALUE_POWER_RECEIVED : -ENOTSUP;
+    case DSMR_P1_CHAN_ENERGY_DELIVERED:
+        return idx < NR_TARIFFS ? VALUE_ENERGY_DELIVERED + idx : -ENOTSUP;
+    case DSMR_P1_CHAN_ENERGY_RECEIVED:
+        return idx < NR_TARIFFS ? VALUE_ENERGY_RECEIVED + idx : -ENOTSUP;
+    case SENSOR_CHAN_VOLTAGE:
+        return idx < NR_PHASES ? VALUE_VOLTAGE + idx : -ENOTSUP;
+    case SENSOR_CHAN_CURRENT:
+        return idx < NR_PHASES ? VALUE_CURRENT + idx : -ENOTSUP;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static q31_t to_q31(double value, int8_t shift) {
+    const double scaled = value * (double)(1LL << (31 - shift));
+    const int64_t q = (int64_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    return (q31_t)CLAMP(q, INT32_MIN, INT32_MAX);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    struct dsmr_p1_sensor_snapshot snapshot;
+
+    if (frame->port >= ARRAY_SIZE(devices)) {
+        return;
+    }
+    const struct device *dev = devices[frame->port];
+    struct dsmr_p1_sensor_data *data = dev->data;
+
+    snapshot.timestamp_ns = (uint64_t)frame->rx_uptime * NSEC_PER_MSEC;
+    for (size_t i = 0; i < NR_VALUES; i++) {
+        const struct value_field *v = &value_fields[i];
+        const double value =
+            (double)dsmr_p1_field_value(&frame->telegram, v->field) *
+            v->multiplier / dsmr_p1_fields[v->field].scale;
+        snapshot.values[i] = to_q31(value, v->shift);
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    data->last = snapshot;
+    data->valid = true;
+    const sensor_trigger_handler_t handler = data->handler;
+    const struct sensor_trigger *trigger = data->trigger;
+    k_spin_unlock(&data->lock, key);
+
+    if (handler) {
+        handler(dev, trigger);
+    }
+}
@@ -0,0 +1,37 @@
+/**
+ * @file trace_internal.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Named spans of the receive path in the Zephyr trace
+ *
+ * With CONFIG_DSMR_P1_TRACING a span is a pair of named events of the same
+ * name, arg0 is 0 at the begin and 1 at the end and arg1 is given per span.
+ * Otherwise the macros only evaluate arg.
+ */
+
+#ifndef _DSMR_P1_SRC_ZEPHYR_TRACE_INTERNAL_H__
+#define _DSMR_P1_SRC_ZEPHYR_TRACE_INTERNAL_H__
+
+#include <zephyr/sys/util.h>
+
+#ifdef CONFIG_DSMR_P1_TRACING
+#include <zephyr/tracing/tracing.h>
+
+#define P1_TRACE_BEGIN(name, arg) sys_trace_named_event(name, 0, (arg))
+#define P1_TRACE_END(name, arg) sys_trace_named_event(name, 1, (arg))
+#else
+#define P1_TRACE_BEGIN(name, arg) ARG_UNUSED(arg)
+#define P1_TRACE_END(name, arg) ARG_UNUSED(arg)
+#endif
+
+// Every byte raises an interrupt, which makes its span the bulk of a trace
+#ifdef CONFIG_DSMR_P1_TRACING_ISR
+#define P1_TRACE_ISR_BEGIN(name, arg) P1_TRACE_BEGIN(name, arg)
+#define P1_TRACE_ISR_END(name, arg) P1_TRACE_END(name, arg)
+#else
+#define P1_TRACE_ISR_BEGIN(name, arg) ARG_UNUSED(arg)
+#define P1_TRACE_ISR_END(name, arg) ARG_UNUSED(arg)
+#endif
+
+#endif // _DSMR_P1_SRC_ZEPHYR_TRACE_INTERNAL_H__
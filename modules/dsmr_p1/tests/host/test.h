@@ -0,0 +1,80 @@
+/**
+ * @file test.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Minimal assertions of the host tests of the DSMR P1 library
+ *
+ * Every test binary is a single source file registered with add_test(). A
+ * failed check is reported with its location and the test goes on, main()
+ * returns TEST_RESULT() so ctest sees the failure.
+ */
+
+#ifndef _DSMR_P1_TESTS_HOST_TEST_H__
+#define _DSMR_P1_TESTS_HOST_TEST_H__
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef DSMR_P1_TEST_CORPUS_DIR
+#define DSMR_P1_TEST_CORPUS_DIR "corpus"
+#endif
+
+static int test_failures;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,  \
+                    #cond);                                                    \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+    do {                                                                       \
+        const long long _a = (long long)(a);                                   \
+        const long long _b = (long long)(b);                                   \
+        if (_a != _b) {                                                        \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n",          \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                       \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define RUN_TEST(fn)                                                           \
+    do {                                                                       \
+        const int _before = test_failures;                                     \
+        fn();                                                                  \
+        printf("%s %s\n", test_failures == _before ? "PASS" : "FAIL", #fn);    \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+/**
+ * @brief Read a file of the corpus, the caller frees the data
+ *
+ * @return the length of the file or a negative errno
+ */
+static inline long test_read_corpus(const char *name, uint8_t **data) {
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", DSMR_P1_TEST_CORPUS_DIR, name);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    *data = malloc(DSMR_P1_TELEGRAM_MAX_SIZE);
+    const long len =
+        *data ? (long)fread(*data, 1, DSMR_P1_TELEGRAM_MAX_SIZE, file) : 0;
+    fclose(file);
+    return *data ? len : -ENOMEM;
+}
+
+#endif // _DSMR_P1_TESTS_HOST_TEST_H__
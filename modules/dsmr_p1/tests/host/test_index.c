@@ -0,0 +1,366 @@
+/**
+ * @file test_index.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief The OBIS index and the schema parser against brute-force references
+ *
+ * The references scan the whole telegram line by line for every lookup, the
+ * way the parser worked before the index, so they are slow but plainly right.
+ * They run over the corpus and over random telegrams holding repeated codes,
+ * empty values and more objects than the index has entries.
+ */
+
+#define _DEFAULT_SOURCE // timegm()
+
+#include "test.h"
+
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <stdbool.h>
+#include <time.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define RANDOM_TELEGRAMS 2000
+#define RANDOM_MAX_LINES 64
+#define RANDOM_FILLER_CODES 40 // codes outside the schema
+#define RANDOM_SEED 1
+
+// Assigns the brute-force value of a field to its member, so the reference
+// goes through the same conversion to the member type as the parser
+#define REF_NUMBER(dst, obj) (dst) = ref_number(obj)
+#define REF_HEX(dst, obj) (dst) = ref_hex(obj)
+#define REF_TIMESTAMP(dst, obj) (dst) = ref_timestamp(obj)
+#define REF_STRING(dst, obj) ref_string(dst, sizeof(dst), obj)
+
+#define REF_FIELD(n, k, o, c, t, u, s)                                         \
+    if (ref_find(data, len, DSMR_P1_OBIS_STRING(o), limit, &obj)) {            \
+        REF_##t(telegram.k, &obj);                                             \
+    }
+
+static const char *const corpus[] = {
+    "dsmr22.txt",
+    "dsmr42.txt",
+    "dsmr50.txt",
+    "dsmr50_be.txt",
+    "dsmr50_mbus.txt",
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+// A COSEM object as the reference sees it
+struct ref_object {
+    const uint8_t *first; // contents of the first parenthesised group
+    size_t first_len;
+    const uint8_t *last; // contents of the last parenthesised group
+    size_t last_len;
+};
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// Split the line starting at offset into its code and groups, false when it
+// holds no object
+static bool ref_line(const uint8_t *data, size_t len, size_t *offset,
+                     size_t *code_len, struct ref_object *obj) {
+    const size_t start = *offset;
+    size_t end = start;
+    while (end < len && data[end] != '\n') {
+        end++;
+    }
+    *offset = end + 1;
+
+    const uint8_t *open = memchr(&data[start], '(', end - start);
+    if (!open || open == &data[start]) {
+        return false;
+    }
+    const uint8_t *first_close = memchr(open, ')', &data[end] - open);
+    const uint8_t *last_open = NULL;
+    const uint8_t *last_close = NULL;
+    for (size_t i = start; i < end; i++) {
+        if (data[i] == '(') {
+            last_open = &data[i];
+        } else if (data[i] == ')') {
+            last_close = &data[i];
+        }
+    }
+    if (!first_close || last_close < last_open) {
+        return false;
+    }
+    *code_len = open - &data[start];
+    *obj = (struct ref_object){
+        .first = open + 1,
+        .first_len = first_close - open - 1,
+        .last = last_open + 1,
+        .last_len = last_close - last_open - 1,
+    };
+    return true;
+}
+
+// Find the first object of code among the first limit distinct codes
+static bool ref_find(const uint8_t *data, size_t len, const char *code,
+                     size_t limit, struct ref_object *obj) {
+    const size_t code_len = strlen(code);
+    size_t distinct = 0;
+    size_t offset = 0;
+
+    while (offset < len && distinct < limit) {
+        const size_t start = offset;
+        size_t len_i;
+        if (!ref_line(data, len, &offset, &len_i, obj)) {
+            continue;
+        }
+        if (len_i == code_len && memcmp(&data[start], code, code_len) == 0) {
+            return true;
+        }
+        // Count the code unless an earlier line held it already
+        bool seen = false;
+        for (size_t prev = 0; prev < start && !seen;) {
+            const size_t prev_start = prev;
+            size_t prev_len;
+            struct ref_object prev_obj;
+            if (ref_line(data, start, &prev, &prev_len, &prev_obj) &&
+                prev_len == len_i &&
+                memcmp(&data[prev_start], &data[start], len_i) == 0) {
+                seen = true;
+            }
+        }
+        distinct += !seen;
+    }
+    return false;
+}
+
+static long double ref_number(const struct ref_object *obj) {
+    char buf[64] = {0};
+    memcpy(buf, obj->last, obj->last_len < 31 ? obj->last_len : 31);
+    return strtold(buf, NULL);
+}
+
+static uint32_t ref_hex(const struct ref_object *obj) {
+    char buf[64] = {0};
+    memcpy(buf, obj->last, obj->last_len < 31 ? obj->last_len : 31);
+    return strtoul(buf, NULL, 16);
+}
+
+static int64_t ref_timestamp(const struct ref_object *obj) {
+    struct tm tm = {0};
+    char buf[64] = {0};
+
+    if (obj->first_len < 13 || obj->first_len > 31) {
+        return 0;
+    }
+    memcpy(buf, obj->first, obj->first_len);
+    if (sscanf(buf, "%2d%2d%2d%2d%2d%2d", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    tm.tm_year += 100;
+    tm.tm_mon -= 1;
+    return (int64_t)timegm(&tm);
+}
+
+static void ref_string(char *dst, size_t size, const struct ref_object *obj) {
+    const size_t len = obj->last_len < size - 1 ? obj->last_len : size - 1;
+    memcpy(dst, obj->last, len);
+    dst[len] = '\0';
+}
+
+static struct dsmr_p1_telegram ref_parse(const uint8_t *data, size_t len,
+                                         size_t limit) {
+    struct dsmr_p1_telegram telegram = {0};
+    struct ref_object obj;
+
+    DSMR_P1_SCHEMA(REF_FIELD)
+    return telegram;
+}
+
+// Every line of the telegram looked up through the index, and every field of
+// the parse against the reference
+static void check_telegram(const uint8_t *data, size_t len) {
+    struct dsmr_p1_index index;
+    size_t distinct = 0;
+    bool overflow = false;
+    size_t offset = 0;
+
+    const int ret = dsmr_p1_index_build(data, len, &index);
+    while (offset < len) {
+        const size_t start = offset;
+        size_t code_len;
+        struct ref_object obj;
+        if (!ref_line(data, len, &offset, &code_len, &obj)) {
+            continue;
+        }
+
+        char code[256] = {0};
+        memcpy(code, &data[start], code_len < 255 ? code_len : 255);
+        struct ref_object first;
+        struct ref_object earlier;
+        const bool indexed =
+            ref_find(data, len, code, DSMR_P1_INDEX_MAX_ENTRIES, &first);
+        if (!ref_find(data, start, code, SIZE_MAX, &earlier)) {
+            // First occurrence of the code
+            distinct++;
+            if (distinct > DSMR_P1_INDEX_MAX_ENTRIES) {
+                overflow = true;
+            }
+        } else if (distinct >= DSMR_P1_INDEX_MAX_ENTRIES) {
+            // Once the index is full a repeat is refused for lack of entries
+            // before it is found to be a repeat
+            overflow = true;
+        }
+
+        const uint8_t *value = NULL;
+        size_t value_len = 0;
+        const int found =
+            dsmr_p1_index_lookup(&index, data, code, &value, &value_len);
+        if (!indexed) {
+            CHECK_EQ(found, -ENOENT);
+            continue;
+        }
+        CHECK_EQ(found, 0);
+        CHECK(value == first.last);
+        CHECK_EQ(value_len, first.last_len);
+    }
+    CHECK_EQ(ret, overflow ? -ENOMEM : 0);
+
+    const uint8_t *value;
+    size_t value_len;
+    CHECK_EQ(dsmr_p1_index_lookup(&index, data, "9-9:99.99.99", &value,
+                                  &value_len),
+             -ENOENT);
+    CHECK_EQ(dsmr_p1_index_lookup(&index, data, "", &value, &value_len),
+             -ENOENT);
+
+    const struct dsmr_p1_telegram parsed = dsmr_p1_parse_index(data, &index);
+    const struct dsmr_p1_telegram expected =
+        ref_parse(data, len, DSMR_P1_INDEX_MAX_ENTRIES);
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (dsmr_p1_field_value(&parsed, field) !=
+            dsmr_p1_field_value(&expected, field)) {
+            fprintf(stderr, "field %s differs\n", dsmr_p1_fields[field].key);
+        }
+        CHECK_EQ(dsmr_p1_field_value(&parsed, field),
+                 dsmr_p1_field_value(&expected, field));
+    }
+    CHECK(strcmp(parsed.equipment_id, expected.equipment_id) == 0);
+}
+
+// A value for an object of the code, of its type when it is in the schema
+static int random_value(char *buf, size_t size, const char *code) {
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (strcmp(dsmr_p1_fields[field].obis, code) != 0) {
+            continue;
+        }
+        switch (dsmr_p1_fields[field].type) {
+        case DSMR_P1_TYPE_NUMBER:
+            if (rand() % 2) {
+                // Timestamped like the maximum demand
+                return snprintf(buf, size, "(%02d%02d%02d%02d%02d%02dW)"
+                                           "(%03d.%03d*kW)",
+                                rand() % 100, 1 + rand() % 12, 1 + rand() % 28,
+                                rand() % 24, rand() % 60, rand() % 60,
+                                rand() % 1000, rand() % 1000);
+            }
+            return snprintf(buf, size, "(%06d.%03d*kWh)", rand() % 1000000,
+                            rand() % 1000);
+        case DSMR_P1_TYPE_HEX:
+            return snprintf(buf, size, "(%02X)", rand() % 256);
+        case DSMR_P1_TYPE_TIMESTAMP:
+            return snprintf(buf, size, "(%02d%02d%02d%02d%02d%02d%c)",
+                            rand() % 100, 1 + rand() % 12, 1 + rand() % 28,
+                            rand() % 24, rand() % 60, rand() % 60,
+                            rand() % 2 ? 'S' : 'W');
+        case DSMR_P1_TYPE_STRING:
+            return snprintf(buf, size, "(%08X%08X)", rand(), rand());
+        }
+    }
+    switch (rand() % 4) {
+    case 0:
+        return snprintf(buf, size, "()");
+    case 1:
+        return snprintf(buf, size, "(%d)(%d*m3)", rand() % 10, rand());
+    default:
+        return snprintf(buf, size, "(%d)", rand());
+    }
+}
+
+static size_t random_telegram(uint8_t *buf, size_t size) {
+    size_t len = (size_t)snprintf((char *)buf, size, "/XMX5LGF0000000000\r\n");
+    const int lines = rand() % RANDOM_MAX_LINES;
+
+    for (int i = 0; i < lines; i++) {
+        char code[32];
+        char value[96];
+        const int pick = rand() % (DSMR_P1_FIELD_COUNT + RANDOM_FILLER_CODES);
+
+        if (pick < DSMR_P1_FIELD_COUNT) {
+            snprintf(code, sizeof(code), "%s", dsmr_p1_fields[pick].obis);
+        } else {
+            snprintf(code, sizeof(code), "0-%d:96.%d.0", pick % 3, pick);
+        }
+        random_value(value, sizeof(value), code);
+        len += (size_t)snprintf((char *)&buf[len], size - len, "%s%s\r\n",
+                                rand() % 16 ? code : "", value);
+    }
+    len += (size_t)snprintf((char *)&buf[len], size - len, "!0000\r\n");
+    return len;
+}
+
+static void test_corpus(void) {
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+        uint8_t *data = NULL;
+        const long len = test_read_corpus(corpus[i], &data);
+        CHECK(len > 0);
+        if (len > 0) {
+            check_telegram(data, (size_t)len);
+        }
+        free(data);
+    }
+}
+
+static void test_random(void) {
+    static uint8_t buf[8192];
+
+    srand(RANDOM_SEED);
+    for (int i = 0; i < RANDOM_TELEGRAMS; i++) {
+        check_telegram(buf, random_telegram(buf, sizeof(buf)));
+    }
+}
+
+// More distinct objects than entries, the index keeps the first ones
+static void test_full(void) {
+    static uint8_t buf[4096];
+    size_t len = 0;
+
+    for (int i = 0; i <= DSMR_P1_INDEX_MAX_ENTRIES; i++) {
+        len += (size_t)snprintf((char *)&buf[len], sizeof(buf) - len,
+                                "0-0:96.%d.0(%d)\r\n", i, i);
+    }
+    struct dsmr_p1_index index;
+    CHECK_EQ(dsmr_p1_index_build(buf, len, &index), -ENOMEM);
+    CHECK_EQ(index.count, DSMR_P1_INDEX_MAX_ENTRIES);
+
+    const uint8_t *value;
+    size_t value_len;
+    CHECK_EQ(dsmr_p1_index_lookup(&index, buf, "0-0:96.0.0", &value,
+                                  &value_len),
+             0);
+    CHECK_EQ(dsmr_p1_index_lookup(&index, buf, "0-0:96.48.0", &value,
+                                  &value_len),
+             -ENOENT);
+    check_telegram(buf, len);
+}
+
+int main(void) {
+    RUN_TEST(test_corpus);
+    RUN_TEST(test_random);
+    RUN_TEST(test_full);
+    return TEST_RESULT();
+}
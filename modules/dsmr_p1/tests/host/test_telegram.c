@@ -0,0 +1,363 @@
+/**
+ * @file test_telegram.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Parser, CRC, delta codec and gap detection of the DSMR P1 library
+ *
+ * The reception cases feed a byte stream holding good, corrupted and cut
+ * short telegrams through the Linux backend, the way the bench does with -s,
+ * and check what reached the telegram callback and the reception counters.
+ */
+
+#include "test.h"
+
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/linux.h>
+#include <dsmr_p1/schema.h>
+
+#include <stdbool.h>
+#include <unistd.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define RANDOM_ROUNDS 1000
+#define RANDOM_SEED 1
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static int received;
+static uint8_t last_data[DSMR_P1_TELEGRAM_MAX_SIZE];
+static size_t last_len;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// Length up to and including the '!', 0 when it has none
+static size_t crc_len(const uint8_t *data, size_t len) {
+    const uint8_t *bang = memchr(data, '!', len);
+    return bang ? (size_t)(bang - data) + 1 : 0;
+}
+
+static void telegram_cb(const uint8_t *data, size_t len, void *user_data) {
+    (void)user_data;
+    received++;
+    last_len = len < sizeof(last_data) ? len : sizeof(last_data);
+    memcpy(last_data, data, last_len);
+}
+
+static void test_parse(void) {
+    uint8_t *data = NULL;
+    const long len = test_read_corpus("dsmr50.txt", &data);
+    CHECK(len > 0);
+    if (len <= 0) {
+        free(data);
+        return;
+    }
+
+    const struct dsmr_p1_telegram t = dsmr_p1_parse_telegram(data, len);
+    CHECK_EQ(t.version, 0x50);
+    CHECK_EQ(t.timestamp, 1291894220); // 2010-12-09 11:30:20
+    CHECK(strcmp(t.equipment_id, "4B384547303034303436333935353037") == 0);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_ENERGY_DELIVERED_T1),
+             123456789);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_ENERGY_RECEIVED_T2),
+             123456789);
+    CHECK_EQ(t.tariff_indicator, 2);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_POWER_DELIVERED), 1193);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_POWER_RECEIVED), 0);
+    CHECK_EQ(t.power_failures, 4);
+    CHECK_EQ(t.l1_sags, 2);
+    CHECK_EQ(t.l2_swells, 3);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_L1_VOLTAGE), 2201);
+    CHECK_EQ(dsmr_p1_field_value(&t, DSMR_P1_FIELD_L3_VOLTAGE), 2203);
+    CHECK_EQ(t.l2_current, 2);
+    // Not sent by this meter
+    CHECK_EQ(t.maximum_demand_timestamp, 0);
+    free(data);
+
+    // The maximum demand object holds both a timestamp and a value
+    const long be_len = test_read_corpus("dsmr50_be.txt", &data);
+    CHECK(be_len > 0);
+    if (be_len > 0) {
+        const struct dsmr_p1_telegram be = dsmr_p1_parse_telegram(data, be_len);
+        CHECK_EQ(be.version, 0);
+        CHECK_EQ(dsmr_p1_field_value(&be, DSMR_P1_FIELD_MAXIMUM_DEMAND), 2589);
+        CHECK_EQ(be.maximum_demand_timestamp, 1589031958); // 2020-05-09
+        CHECK_EQ(dsmr_p1_field_value(&be, DSMR_P1_FIELD_AVERAGE_DEMAND), 2351);
+    }
+    free(data);
+
+    // Malformed values leave their field zero
+    static const char bad[] = "/X\r\n"
+                              "0-0:1.0.0(101309113020W)\r\n"
+                              "1-0:1.8.1()\r\n"
+                              "1-0:1.7.0\r\n"
+                              "!0000\r\n";
+    const struct dsmr_p1_telegram b =
+        dsmr_p1_parse_telegram((const uint8_t *)bad, sizeof(bad) - 1);
+    CHECK_EQ(b.timestamp, 0);
+    CHECK_EQ(dsmr_p1_field_value(&b, DSMR_P1_FIELD_ENERGY_DELIVERED_T1), 0);
+    CHECK_EQ(dsmr_p1_field_value(&b, DSMR_P1_FIELD_POWER_DELIVERED), 0);
+}
+
+static void test_field_format(void) {
+    struct dsmr_p1_telegram t = {0};
+    char buf[DSMR_P1_FIELD_FORMAT_MAX_LEN];
+
+    CHECK_EQ(dsmr_p1_field_format(buf, sizeof(buf), 1193, 1000), 5);
+    CHECK(strcmp(buf, "1.193") == 0);
+    CHECK_EQ(dsmr_p1_field_format(buf, sizeof(buf), 2301, 10), 5);
+    CHECK(strcmp(buf, "230.1") == 0);
+    CHECK_EQ(dsmr_p1_field_format(buf, sizeof(buf), 7, 1000), 5);
+    CHECK(strcmp(buf, "0.007") == 0);
+    CHECK_EQ(dsmr_p1_field_format(buf, sizeof(buf), -1500, 1000), 6);
+    CHECK(strcmp(buf, "-1.500") == 0);
+    CHECK_EQ(dsmr_p1_field_format(buf, sizeof(buf), 42, 1), 2);
+    CHECK(strcmp(buf, "42") == 0);
+    CHECK_EQ(dsmr_p1_field_format(buf, 5, 1193, 1000), -ENOMEM);
+
+    strcpy(t.equipment_id, "4530303334");
+    CHECK(dsmr_p1_field_string(&t, DSMR_P1_FIELD_EQUIPMENT_ID) ==
+          t.equipment_id);
+    CHECK(dsmr_p1_field_string(&t, DSMR_P1_FIELD_POWER_DELIVERED) == NULL);
+
+    // Setting a field is the inverse of getting it
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        if (dsmr_p1_fields[field].type != DSMR_P1_TYPE_STRING) {
+            dsmr_p1_field_set(&t, field, 2 * dsmr_p1_fields[field].scale + 7);
+            CHECK_EQ(dsmr_p1_field_value(&t, field),
+                     2 * dsmr_p1_fields[field].scale + 7);
+        }
+    }
+}
+
+static void test_crc(void) {
+    static const struct {
+        const char *name;
+        uint16_t crc;
+    } sent[] = {
+        {"dsmr42.txt", 0xF9DC},
+        {"dsmr50.txt", 0x4BE0},
+        {"dsmr50_be.txt", 0x32A8},
+    };
+
+    for (size_t i = 0; i < sizeof(sent) / sizeof(sent[0]); i++) {
+        uint8_t *data = NULL;
+        const long len = test_read_corpus(sent[i].name, &data);
+        CHECK(len > 0);
+        if (len > 0) {
+            const size_t n = crc_len(data, len);
+            CHECK_EQ(dsmr_p1_crc(data, n), sent[i].crc);
+            // Any flipped bit changes the CRC
+            data[n / 2] ^= 0x01;
+            CHECK(dsmr_p1_crc(data, n) != sent[i].crc);
+        }
+        free(data);
+    }
+    // CRC-16/ARC check value
+    CHECK_EQ(dsmr_p1_crc((const uint8_t *)"123456789", 9), 0xBB3D);
+}
+
+static void check_roundtrip(const struct dsmr_p1_telegram *prev,
+                            const struct dsmr_p1_telegram *cur) {
+    uint8_t buf[DSMR_P1_DELTA_MAX_LEN];
+    const uint32_t changed = dsmr_p1_diff(prev, cur);
+
+    const int len = dsmr_p1_delta_encode(cur, changed, buf, sizeof(buf));
+    CHECK(len > 0);
+    if (len <= 0) {
+        return;
+    }
+    struct dsmr_p1_telegram decoded = *prev;
+    CHECK_EQ(dsmr_p1_delta_decode(buf, len, &decoded), changed);
+    CHECK_EQ(dsmr_p1_diff(&decoded, cur), 0);
+
+    // Every cut short delta is refused
+    for (int cut = 0; cut < len; cut++) {
+        struct dsmr_p1_telegram partial = *prev;
+        CHECK_EQ(dsmr_p1_delta_decode(buf, cut, &partial), -EBADMSG);
+    }
+    CHECK_EQ(dsmr_p1_delta_encode(cur, changed, buf, len - 1), -ENOMEM);
+}
+
+static void test_delta(void) {
+    static const char *const names[] = {
+        "dsmr22.txt",
+        "dsmr42.txt",
+        "dsmr50.txt",
+        "dsmr50_be.txt",
+    };
+    struct dsmr_p1_telegram telegrams[4] = {0};
+    const struct dsmr_p1_telegram empty = {0};
+
+    for (size_t i = 0; i < 4; i++) {
+        uint8_t *data = NULL;
+        const long len = test_read_corpus(names[i], &data);
+        CHECK(len > 0);
+        if (len > 0) {
+            telegrams[i] = dsmr_p1_parse_telegram(data, len);
+        }
+        free(data);
+        // Key frame and the deltas between every pair of meters
+        check_roundtrip(&empty, &telegrams[i]);
+        for (size_t j = 0; j < i; j++) {
+            check_roundtrip(&telegrams[j], &telegrams[i]);
+            check_roundtrip(&telegrams[i], &telegrams[j]);
+        }
+    }
+    check_roundtrip(&telegrams[2], &telegrams[2]);
+
+    // Small steps of a few fields, as between consecutive telegrams
+    srand(RANDOM_SEED);
+    struct dsmr_p1_telegram prev = telegrams[2];
+    for (int i = 0; i < RANDOM_ROUNDS; i++) {
+        struct dsmr_p1_telegram cur = prev;
+        cur.timestamp += 1 + rand() % 20;
+        cur.energy_delivered_t1 += (rand() % 10) / 1000.0L;
+        cur.power_delivered = (float)(rand() % 10000) / 1000;
+        cur.l1_voltage = (float)(2200 + rand() % 100) / 10;
+        cur.l3_current = rand() % 40;
+        if (rand() % 50 == 0) {
+            cur.tariff_indicator = 1 + rand() % 2;
+            snprintf(cur.equipment_id, sizeof(cur.equipment_id), "%08X",
+                     rand());
+        }
+        check_roundtrip(&prev, &cur);
+        prev = cur;
+    }
+
+    // A field beyond the schema is refused
+    uint8_t bogus[8];
+    size_t bogus_len = 0;
+    for (uint64_t v = 1ULL << DSMR_P1_FIELD_COUNT; v; v >>= 7) {
+        bogus[bogus_len++] = (v & 0x7F) | (v >> 7 ? 0x80 : 0);
+    }
+    struct dsmr_p1_telegram t = {0};
+    CHECK_EQ(dsmr_p1_delta_decode(bogus, bogus_len, &t), -EBADMSG);
+}
+
+static void test_gap(void) {
+    struct dsmr_p1_rx_stats before;
+    struct dsmr_p1_rx_stats after;
+    struct dsmr_p1_telegram prev = {.version = 0x42, .timestamp = 1000};
+    struct dsmr_p1_telegram cur = prev;
+
+    dsmr_p1_get_rx_stats(&before);
+
+    // DSMR 4 sends every 10 s, half an interval of jitter is no gap
+    cur.timestamp = prev.timestamp + 10;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 0);
+    cur.timestamp = prev.timestamp + 15;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 0);
+    cur.timestamp = prev.timestamp + 30;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 2);
+    cur.timestamp = prev.timestamp + 34;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 2);
+
+    // DSMR 5 and meters without a version send every second
+    prev.version = cur.version = 0x50;
+    cur.timestamp = prev.timestamp + 1;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 0);
+    cur.timestamp = prev.timestamp + 4;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 3);
+    prev.version = cur.version = 0;
+    cur.timestamp = prev.timestamp + 2;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 1);
+
+    // Clock steps back and the first telegram are no gap
+    cur.timestamp = prev.timestamp - 100;
+    CHECK_EQ(dsmr_p1_check_gap(&prev, &cur), 0);
+    const struct dsmr_p1_telegram none = {0};
+    CHECK_EQ(dsmr_p1_check_gap(&none, &prev), 0);
+
+    dsmr_p1_get_rx_stats(&after);
+    CHECK_EQ(after.gaps - before.gaps, 4);
+    CHECK_EQ(after.missed - before.missed, 8);
+}
+
+static size_t append(uint8_t *buf, size_t offs, const uint8_t *data,
+                     size_t len) {
+    memcpy(&buf[offs], data, len);
+    return offs + len;
+}
+
+// Good, corrupted and cut short telegrams through the Linux backend
+static void test_receive(void) {
+    static uint8_t stream[8 * DSMR_P1_TELEGRAM_MAX_SIZE];
+    uint8_t *data = NULL;
+    size_t offs = 0;
+
+    const long len = test_read_corpus("dsmr50.txt", &data);
+    CHECK(len > 0);
+    if (len <= 0) {
+        free(data);
+        return;
+    }
+
+    // Noise before the first telegram is skipped
+    offs = append(stream, offs, (const uint8_t *)"\r\n\x00garbage", 10);
+    offs = append(stream, offs, data, len);
+    // A flipped bit in a value
+    offs = append(stream, offs, data, len);
+    stream[offs - len / 2] ^= 0x02;
+    // Cut short by the next telegram, the line ending is lost
+    offs = append(stream, offs, data, len / 2);
+    offs = append(stream, offs, data, len);
+    // Longer than a telegram can be, without a trailer
+    stream[offs++] = '/';
+    memset(&stream[offs], 'x', DSMR_P1_TELEGRAM_MAX_SIZE);
+    offs += DSMR_P1_TELEGRAM_MAX_SIZE;
+    offs = append(stream, offs, data, len);
+    // Cut short at the end of the input
+    offs = append(stream, offs, data, len - DSMR_P1_TRAILER_LEN);
+
+    char path[] = "/tmp/dsmr_p1_test_XXXXXX";
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        free(data);
+        return;
+    }
+    CHECK_EQ(write(fd, stream, offs), offs);
+    close(fd);
+
+    struct dsmr_p1_rx_stats before;
+    struct dsmr_p1_rx_stats after;
+    dsmr_p1_get_rx_stats(&before);
+    setenv("DSMR_P1_DEVICE", path, 1);
+    CHECK_EQ(dsmr_p1_set_callback(telegram_cb, NULL), 0);
+    CHECK_EQ(dsmr_p1_init(), 0);
+    CHECK_EQ(dsmr_p1_enable(), 0);
+    CHECK_EQ(dsmr_p1_linux_join(), 0);
+    dsmr_p1_get_rx_stats(&after);
+    unlink(path);
+
+    CHECK_EQ(received, 3);
+    CHECK_EQ(after.received - before.received, 3);
+    CHECK_EQ(after.lost[DSMR_P1_LOSS_CRC] - before.lost[DSMR_P1_LOSS_CRC], 1);
+    CHECK_EQ(after.lost[DSMR_P1_LOSS_FRAMING] -
+                 before.lost[DSMR_P1_LOSS_FRAMING],
+             1);
+    CHECK_EQ(after.lost[DSMR_P1_LOSS_OVERFLOW] -
+                 before.lost[DSMR_P1_LOSS_OVERFLOW],
+             1);
+    CHECK_EQ(last_len, len);
+    CHECK(memcmp(last_data, data, len) == 0);
+    free(data);
+}
+
+int main(void) {
+    RUN_TEST(test_parse);
+    RUN_TEST(test_field_format);
+    RUN_TEST(test_crc);
+    RUN_TEST(test_delta);
+    RUN_TEST(test_gap);
+    RUN_TEST(test_receive);
+    return TEST_RESULT();
+}
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""HTTP load and latency benchmark for the firmware web server.
+
+Runs a number of concurrent clients against a set of endpoints for a fixed
+duration, then prints a JSON summary with the request rate, the latency
+percentiles and the errors per endpoint:
+
+    scripts/http_load.py http://192.0.2.1 --concurrency 4 --duration 30 \\
+        --endpoint GET:/ --endpoint GET:/data --endpoint GET:/metrics
+
+An endpoint is METHOD:PATH, optionally followed by @FILE to send the file as
+the request body. The requests are spread round robin over the endpoints.
+
+With --keep-alive a client reuses its connection, and reconnects when the
+server closed it, which is counted. --probe fetches a path after the run and
+embeds its JSON in the summary, e.g. --probe /bus/stats.
+
+The exit status is 1 when a --max-* or --min-* threshold is exceeded, so the
+script can gate a CI run against a firmware on native_sim or hardware.
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+import urllib.parse
+
+DEFAULT_ENDPOINTS = ("GET:/", "GET:/data", "GET:/config")
+
+
+class Endpoint:
+    def __init__(self, spec: str) -> None:
+        method, _, rest = spec.partition(":")
+        path, _, body_file = rest.partition("@")
+        if not method or not path.startswith("/"):
+            raise ValueError(f"bad endpoint {spec!r}, expected METHOD:/path")
+        self.name = f"{method.upper()} {path}"
+        self.method = method.upper()
+        self.path = path
+        self.body = None
+        if body_file:
+            with open(body_file, "rb") as f:
+                self.body = f.read()
+        self.requests = 0
+        self.latencies = []
+        self.errors = 0
+        self.statuses = {}
+        self.bytes = 0
+
+
+class Client(threading.Thread):
+    def __init__(self, args, endpoints, offset, deadline, lock) -> None:
+        super().__init__(daemon=True)
+        self.url = urllib.parse.urlsplit(args.url)
+        self.keep_alive = args.keep_alive
+        self.timeout = args.timeout
+        self.endpoints = endpoints
+        self.index = offset
+        self.deadline = deadline
+        self.lock = lock
+        self.conn = None
+        self.reconnects = 0
+
+    def connect(self):
+        cls = (http.client.HTTPSConnection if self.url.scheme == "https"
+               else http.client.HTTPConnection)
+        return cls(self.url.hostname, self.url.port, timeout=self.timeout)
+
+    def run(self) -> None:
+        while time.monotonic() < self.deadline:
+            endpoint = self.endpoints[self.index % len(self.endpoints)]
+            self.index += 1
+            self.request(endpoint)
+        if self.conn:
+            self.conn.close()
+
+    def request(self, endpoint: Endpoint) -> None:
+        if self.conn is None:
+            self.conn = self.connect()
+        headers = {"Connection": "keep-alive" if self.keep_alive else "close"}
+        start = time.monotonic()
+        try:
+            self.conn.request(endpoint.method, endpoint.path,
+                              body=endpoint.body, headers=headers)
+            res = self.conn.getresponse()
+            body = res.read()
+            latency = time.monotonic() - start
+            status = res.status
+            closed = res.will_close
+        except (OSError, http.client.HTTPException):
+            with self.lock:
+                endpoint.requests += 1
+                endpoint.errors += 1
+            self.conn.close()
+            self.conn = None
+            if self.keep_alive:
+                self.reconnects += 1
+            return
+
+        with self.lock:
+            endpoint.requests += 1
+            endpoint.latencies.append(latency)
+            endpoint.statuses[status] = endpoint.statuses.get(status, 0) + 1
+            endpoint.bytes += len(body)
+            if status >= 500:
+                endpoint.errors += 1
+        if closed or not self.keep_alive:
+            self.conn.close()
+            self.conn = None
+            if self.keep_alive:
+                self.reconnects += 1
+
+
+def percentile(values: list, pct: float) -> float:
+    if not values:
+        return 0.0
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+
+def latency_summary(latencies: list) -> dict:
+    latencies = sorted(latencies)
+    return {
+        "p50": round(percentile(latencies, 50) * 1000, 2),
+        "p99": round(percentile(latencies, 99) * 1000, 2),
+        "p999": round(percentile(latencies, 99.9) * 1000, 2),
+        "max": round(latencies[-1] * 1000, 2) if latencies else 0.0,
+    }
+
+
+def probe(args, path: str):
+    url = urllib.parse.urlsplit(args.url)
+    conn = http.client.HTTPConnection(url.hostname, url.port,
+                                      timeout=args.timeout)
+    try:
+        conn.request("GET", path)
+        res = conn.getresponse()
+        body = res.read()
+        if res.status != 200:
+            return {"status": res.status}
+        return json.loads(body)
+    except (OSError, http.client.HTTPException, ValueError) as e:
+        return {"error": str(e)}
+    finally:
+        conn.close()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter
+    )
+    parser.add_argument("url", help="base URL of the firmware")
+    parser.add_argument("--endpoint", action="append", default=[],
+                        help="METHOD:PATH[@FILE], repeatable")
+    parser.add_argument("--concurrency", type=int, default=1)
+    parser.add_argument("--duration", type=float, default=10.0,
+                        help="seconds to run")
+    parser.add_argument("--warmup", type=float, default=1.0,
+                        help="seconds to run before measuring")
+    parser.add_argument("--keep-alive", action="store_true")
+    parser.add_argument("--timeout", type=float, default=5.0)
+    parser.add_argument("--probe", action="append", default=[],
+                        help="JSON path to fetch after the run, repeatable")
+    parser.add_argument("--min-rps", type=float,
+                        help="fail below this many requests per second")
+    parser.add_argument("--max-p99", type=float,
+                        help="fail above this p99 latency in ms")
+    parser.add_argument("--max-p999", type=float,
+                        help="fail above this p99.9 latency in ms")
+    parser.add_argument("--max-error-rate", type=float,
+                        help="fail above this fraction of failed requests")
+    args = parser.parse_args()
+
+    try:
+        specs = args.endpoint or list(DEFAULT_ENDPOINTS)
+        endpoints = [Endpoint(spec) for spec in specs]
+    except (ValueError, OSError) as e:
+        parser.error(str(e))
+
+    lock = threading.Lock()
+    if args.warmup > 0:
+        warmup = [Endpoint(spec) for spec in specs]
+        clients = [
+            Client(args, warmup, i, time.monotonic() + args.warmup, lock)
+            for i in range(args.concurrency)
+        ]
+        for client in clients:
+            client.start()
+        for client in clients:
+            client.join()
+
+    start = time.monotonic()
+    deadline = start + args.duration
+    clients = [Client(args, endpoints, i, deadline, lock)
+               for i in range(args.concurrency)]
+    for client in clients:
+        client.start()
+    for client in clients:
+        client.join()
+    elapsed = time.monotonic() - start
+
+    all_latencies = [l for e in endpoints for l in e.latencies]
+    requests = sum(e.requests for e in endpoints)
+    errors = sum(e.errors for e in endpoints)
+    summary = {
+        "url": args.url,
+        "concurrency": args.concurrency,
+        "keep_alive": args.keep_alive,
+        "seconds": round(elapsed, 3),
+        "requests": requests,
+        "requests_per_second": round(requests / elapsed, 1),
+        "errors": errors,
+        "error_rate": round(errors / requests, 4) if requests else 0.0,
+        "reconnects": sum(c.reconnects for c in clients),
+        "latency_ms": latency_summary(all_latencies),
+        "endpoints": {
+            e.name: {
+                "requests": e.requests,
+                "errors": e.errors,
+                "statuses": {str(s): n for s, n in sorted(e.statuses.items())},
+                "bytes_per_response": (round(e.bytes / len(e.latencies))
+                                       if e.latencies else 0),
+                "latency_ms": latency_summary(e.latencies),
+            }
+            for e in endpoints
+        },
+        "probes": {path: probe(args, path) for path in args.probe},
+    }
+
+    failures = []
+    if args.min_rps is not None and \
+            summary["requests_per_second"] < args.min_rps:
+        failures.append("requests_per_second")
+    if args.max_p99 is not None and \
+            summary["latency_ms"]["p99"] > args.max_p99:
+        failures.append("p99")
+    if args.max_p999 is not None and \
+            summary["latency_ms"]["p999"] > args.max_p999:
+        failures.append("p999")
+    if args.max_error_rate is not None and \
+            summary["error_rate"] > args.max_error_rate:
+        failures.append("error_rate")
+    summary["failed"] = failures
+
+    print(json.dumps(summary, indent=2))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
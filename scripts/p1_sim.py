@@ -0,0 +1,394 @@
+#!/usr/bin/env python3
+"""P1 meter simulator and capture replay.
+
+Writes DSMR telegrams with valid CRCs to a serial port, pty, fifo or stdout,
+to load test the firmware without a meter. On native_sim the P1 port of
+boards/native_sim.overlay is a pty, --exec starts the firmware and attaches
+to it:
+
+    scripts/p1_sim.py --exec build/zephyr/zephyr.exe --rate 10 --count 1000 \\
+        --http http://192.0.2.1
+
+Telegrams are generated from a simple household model, or replayed from a
+capture with --replay. The timestamp of generated telegrams advances a second
+per telegram, which lets the latency be measured through the HTTP API.
+
+With --http the bus and reception statistics are read before and after the
+run, and /api/v1/telegram is polled during the run. A JSON summary with the
+drop rate, the losses by cause and the ingestion to HTTP latency is printed
+at the end.
+"""
+
+import argparse
+import json
+import random
+import re
+import subprocess
+import sys
+import threading
+import time
+import urllib.request
+
+P1_BAUD = 115200
+BITS_PER_BYTE = 10  # 8N1
+BASE_TIMESTAMP = 1767225600  # 2026-01-01 00:00:00 UTC
+PTY_RE = re.compile(rb"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+CORRUPTIONS = ("crc", "byte", "truncate", "noise")
+
+
+def crc16(data: bytes) -> int:
+    """CRC16/ARC as sent in the trailer, polynomial 0x8005 reflected."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def finish(body: str, with_crc: bool = True) -> bytes:
+    """Append the trailer to a telegram ending with '!'."""
+    data = body.replace("\n", "\r\n").encode()
+    if with_crc:
+        data += b"%04X" % crc16(data)
+    return data + b"\r\n"
+
+
+def cosem_time(timestamp: int) -> str:
+    """YYMMDDhhmmssX in UTC, reported as winter time."""
+    return time.strftime("%y%m%d%H%M%S", time.gmtime(timestamp)) + "W"
+
+
+def hex_str(text: str) -> str:
+    return text.encode().hex().upper()
+
+
+class Meter:
+    """Household model producing one telegram per step."""
+
+    def __init__(self, args: argparse.Namespace) -> None:
+        self.rng = random.Random(args.seed)
+        self.dsmr = args.dsmr
+        self.phases = args.phases
+        self.mbus = args.mbus
+        self.overrides = dict(o.split("=", 1) for o in args.set)
+        self.timestamp = BASE_TIMESTAMP
+        self.energy = [self.rng.uniform(1000, 9000) for _ in range(4)]
+        self.power = 0.4
+        self.solar = 0.0
+        self.failures = 3
+        self.mbus_values = [self.rng.uniform(100, 5000) for _ in range(4)]
+
+    def step(self) -> bytes:
+        rng = self.rng
+        self.timestamp += 1
+        self.power = min(max(self.power + rng.gauss(0, 0.15), 0.05), 11.0)
+        self.solar = min(max(self.solar + rng.gauss(0, 0.05), 0.0), 4.0)
+        delivered = max(self.power - self.solar, 0.0)
+        received = max(self.solar - self.power, 0.0)
+        tariff = 1 if time.gmtime(self.timestamp).tm_hour < 7 else 2
+        self.energy[tariff - 1] += delivered / 3600
+        self.energy[tariff + 1] += received / 3600
+        for i in range(self.mbus):
+            self.mbus_values[i] += rng.uniform(0, 0.001)
+
+        lines = [
+            "/ISK5\\2M550T-1012",
+            "",
+            f"1-3:0.2.8({self.dsmr})",
+            f"0-0:1.0.0({cosem_time(self.timestamp)})",
+            f"0-0:96.1.1({hex_str('E0043007052870318')})",
+            f"1-0:1.8.1({self.energy[0]:010.3f}*kWh)",
+            f"1-0:1.8.2({self.energy[1]:010.3f}*kWh)",
+            f"1-0:2.8.1({self.energy[2]:010.3f}*kWh)",
+            f"1-0:2.8.2({self.energy[3]:010.3f}*kWh)",
+            f"0-0:96.14.0({tariff:04d})",
+            f"1-0:1.7.0({delivered:06.3f}*kW)",
+            f"1-0:2.7.0({received:06.3f}*kW)",
+            f"0-0:96.7.21({self.failures:05d})",
+            "0-0:96.7.9(00001)",
+            "1-0:99.97.0(1)(0-0:96.7.19)(251105081512W)(0000001234*s)",
+        ]
+        for phase in range(self.phases):
+            code = 32 + 20 * phase
+            lines += [
+                f"1-0:{code}.32.0(00002)",
+                f"1-0:{code}.36.0(00000)",
+            ]
+        lines.append("0-0:96.13.0()")
+        for phase in range(self.phases):
+            code = 32 + 20 * phase
+            voltage = rng.gauss(230.0, 1.5)
+            current = int(delivered * 1000 / self.phases / voltage + 0.5)
+            lines += [
+                f"1-0:{code}.7.0({voltage:05.1f}*V)",
+                f"1-0:{code - 1}.7.0({current:03d}*A)",
+                f"1-0:{code - 11}.7.0({delivered / self.phases:06.3f}*kW)",
+                f"1-0:{code - 10}.7.0({received / self.phases:06.3f}*kW)",
+            ]
+        for i in range(self.mbus):
+            channel = i + 1
+            device_type = (3, 7, 4, 3)[i]  # gas, water, heat, gas
+            unit = "GJ" if device_type == 4 else "m3"
+            lines += [
+                f"0-{channel}:24.1.0({device_type:03d})",
+                f"0-{channel}:96.1.0({hex_str(f'G00{channel}1234567890123')})",
+                f"0-{channel}:24.2.1({cosem_time(self.timestamp - 5)})"
+                f"({self.mbus_values[i]:09.3f}*{unit})",
+            ]
+
+        for code, value in self.overrides.items():
+            line = f"{code}({value})"
+            for n, existing in enumerate(lines):
+                if existing.startswith(code + "("):
+                    lines[n] = line
+                    break
+            else:
+                lines.append(line)
+        lines.append("!")
+        return finish("\n".join(lines), with_crc=self.dsmr != "22")
+
+
+def split_capture(data: bytes) -> list:
+    """Split a capture into telegrams running from '/' to the end of '!'."""
+    telegrams = []
+    start = data.find(b"/")
+    while start >= 0:
+        end = data.find(b"!", start)
+        if end < 0:
+            break
+        eol = data.find(b"\n", end)
+        stop = len(data) if eol < 0 else eol + 1
+        telegrams.append(data[start:stop])
+        start = data.find(b"/", stop)
+    return telegrams
+
+
+def corrupt(telegram: bytes, kind: str, rng: random.Random) -> bytes:
+    data = bytearray(telegram)
+    if kind == "crc":
+        bang = data.rfind(b"!")
+        data[bang + 1] = ord("0") if data[bang + 1] != ord("0") else ord("1")
+    elif kind == "byte":
+        pos = rng.randrange(1, data.rfind(b"!"))
+        data[pos] ^= 1 << rng.randrange(7)
+    elif kind == "truncate":
+        data = data[: rng.randrange(1, len(data) - 1)]
+    else:
+        # Line noise ahead of an intact telegram, which must resynchronise
+        noise = rng.randbytes(rng.randrange(1, 64))
+        data = bytearray(noise.replace(b"/", b"?")) + data
+    return bytes(data)
+
+
+class Poller(threading.Thread):
+    """Polls the API for new telegram timestamps to measure latency."""
+
+    def __init__(self, url: str, sent: dict, interval: float) -> None:
+        super().__init__(daemon=True)
+        self.url = url + "/api/v1/telegram"
+        self.sent = sent
+        self.interval = interval
+        self.latencies = []
+        self.errors = 0
+        self.stop = threading.Event()
+
+    def run(self) -> None:
+        last = None
+        while not self.stop.is_set():
+            try:
+                with urllib.request.urlopen(self.url, timeout=2) as res:
+                    timestamp = json.load(res).get("timestamp")
+            except (OSError, ValueError):
+                self.errors += 1
+                timestamp = None
+            now = time.monotonic()
+            if timestamp is not None and timestamp != last:
+                last = timestamp
+                sent_at = self.sent.get(timestamp)
+                if sent_at is not None:
+                    self.latencies.append(now - sent_at)
+            self.stop.wait(self.interval)
+
+
+def get_json(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as res:
+        return json.load(res)
+
+
+def percentile(values: list, pct: float) -> float:
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+
+def open_output(args: argparse.Namespace):
+    """Return the output file and the firmware process, if started."""
+    if args.exec:
+        proc = subprocess.Popen(
+            [args.exec] + args.exec_args,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.STDOUT,
+        )
+        deadline = time.monotonic() + 10
+        while time.monotonic() < deadline:
+            line = proc.stdout.readline()
+            if not line:
+                break
+            match = PTY_RE.search(line)
+            if match:
+                # Keep draining the console so the firmware never blocks on it
+                threading.Thread(
+                    target=lambda: [None for _ in proc.stdout], daemon=True
+                ).start()
+                return open(match.group(1).decode(), "wb", buffering=0), proc
+        proc.kill()
+        sys.exit("no P1 pty found in the native_sim output")
+    if args.device == "-":
+        return sys.stdout.buffer, None
+    return open(args.device, "wb", buffering=0), None
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter
+    )
+    out = parser.add_mutually_exclusive_group()
+    out.add_argument("--device", default="-", help="output, - for stdout")
+    out.add_argument("--exec", help="native_sim executable to start")
+    parser.add_argument(
+        "--exec-args", nargs=argparse.REMAINDER, default=[],
+        help="arguments of the native_sim executable",
+    )
+    parser.add_argument(
+        "--rate", default="1",
+        help="telegrams per second, 'line' for back to back at 115200 baud "
+        "or 0 for as fast as the output takes them",
+    )
+    parser.add_argument("--count", type=int, default=0, help="0 is forever")
+    parser.add_argument("--replay", help="capture to replay instead")
+    parser.add_argument("--loop", action="store_true", help="loop the capture")
+    parser.add_argument("--dsmr", choices=("22", "42", "50"), default="50")
+    parser.add_argument("--phases", type=int, choices=(1, 3), default=3)
+    parser.add_argument("--mbus", type=int, choices=range(5), default=1)
+    parser.add_argument(
+        "--set", action="append", default=[], metavar="OBIS=VALUE",
+        help="fixed object value, e.g. 1-0:1.7.0=01.500*kW",
+    )
+    parser.add_argument(
+        "--corrupt", type=float, default=0.0,
+        help="fraction of telegrams to corrupt",
+    )
+    parser.add_argument(
+        "--corruptions", default=",".join(CORRUPTIONS),
+        help="comma separated kinds: " + ", ".join(CORRUPTIONS),
+    )
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--http", help="firmware base URL to measure against")
+    parser.add_argument("--poll", type=float, default=0.05,
+                        help="API poll interval in seconds")
+    parser.add_argument("--settle", type=float, default=2.0,
+                        help="seconds to wait for the firmware after the run")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    kinds = [k for k in args.corruptions.split(",") if k]
+    if any(k not in CORRUPTIONS for k in kinds):
+        parser.error("unknown corruption")
+
+    if args.replay:
+        with open(args.replay, "rb") as f:
+            capture = split_capture(f.read())
+        if not capture:
+            parser.error("no telegram in the capture")
+        meter = None
+    else:
+        meter = Meter(args)
+
+    output, proc = open_output(args)
+    sent_at = {}
+    poller = None
+    before = None
+    if args.http:
+        before = get_json(args.http + "/bus/stats")
+        rx_before = get_json(args.http + "/rx/stats")
+        poller = Poller(args.http, sent_at, args.poll)
+        poller.start()
+
+    sent = corrupted = nbytes = 0
+    start = time.monotonic()
+    next_at = start
+    try:
+        while not args.count or sent < args.count:
+            if meter:
+                telegram = meter.step()
+                timestamp = meter.timestamp
+            else:
+                if sent >= len(capture) and not args.loop:
+                    break
+                telegram = capture[sent % len(capture)]
+                timestamp = None
+            valid = True
+            if kinds and rng.random() < args.corrupt:
+                kind = rng.choice(kinds)
+                telegram = corrupt(telegram, kind, rng)
+                valid = kind == "noise"
+                corrupted += not valid
+
+            if args.rate == "line":
+                next_at += len(telegram) * BITS_PER_BYTE / P1_BAUD
+            elif float(args.rate) > 0:
+                next_at += 1 / float(args.rate)
+            output.write(telegram)
+            if hasattr(output, "flush"):
+                output.flush()
+            if valid and timestamp is not None:
+                sent_at[timestamp] = time.monotonic()
+            sent += 1
+            nbytes += len(telegram)
+            delay = next_at - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+    except (KeyboardInterrupt, BrokenPipeError):
+        pass
+    duration = time.monotonic() - start
+
+    summary = {
+        "sent": sent,
+        "corrupted": corrupted,
+        "bytes": nbytes,
+        "seconds": round(duration, 3),
+        "telegrams_per_second": round(sent / duration, 1) if duration else 0,
+    }
+    if args.http:
+        time.sleep(args.settle)
+        poller.stop.set()
+        poller.join()
+        after = get_json(args.http + "/bus/stats")
+        rx_after = get_json(args.http + "/rx/stats")
+        published = after["published"] - before["published"]
+        expected = sent - corrupted
+        summary.update({
+            "published": published,
+            "no_frame": after["no_frame"] - before["no_frame"],
+            "rx": {key: rx_after[key] - rx_before[key] for key in rx_after},
+            "drop_rate": round(1 - published / expected, 4) if expected else 0,
+            "poll_errors": poller.errors,
+            "latency_samples": len(poller.latencies),
+            "latency_ms": {
+                f"p{p}": round(percentile(poller.latencies, p) * 1000, 1)
+                for p in (50, 99, 99.9)
+            },
+        })
+    print(json.dumps(summary), file=sys.stderr if args.device == "-" and
+          not args.exec else sys.stdout)
+
+    if proc:
+        proc.terminate()
+        proc.wait()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
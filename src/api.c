@@ -0,0 +1,350 @@
+/**
+ * @file api.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Versioned API serving the last parsed telegram
+ *
+ * /api/v1/telegram serves the last parsed telegram as JSON, or as the CBOR
+ * encoding defined by telegram.cddl when the client sends
+ * `Accept: application/cbor`. Every meter is served, selected with `?meter=N`
+ * and defaulting to the first. Both carry every field of DSMR_P1_SCHEMA under
+ * its key: the JSON in the unit sent by the meter, formatted from the value at
+ * the resolution of the meter without floats, the CBOR as that integer. The
+ * size and encode time of both formats are accounted on
+ * /api/v1/telegram/stats.
+ *
+ * /metrics serves every numeric field of DSMR_P1_SCHEMA for every meter in
+ * the Prometheus text format, at the resolution of the meter.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "api.h"
+#include "http.h"
+#include "telegram_cbor.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define API_STATS_MAX_LEN 256
+// HELP and TYPE lines plus a sample per meter for every field
+#define API_METRICS_MAX_LEN                                                    \
+    (DSMR_P1_FIELD_COUNT * (160 + 80 * DSMR_P1_NUM_PORTS))
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int encode_metrics(const struct dsmr_p1_telegram *telegrams,
+                          const bool *valid, char *buf, size_t len);
+static int encode_metric_value(http_encoder_ctx_t *enc, int64_t value,
+                               uint32_t scale);
+static int meter_from_request(const struct server_request *req);
+static void account(struct api_format_stats *stats, int len, uint32_t cycles);
+static void api_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(api, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(api_listener, DSMR_P1_PORT_ANY,
+                        telegram_listener_cb, NULL);
+
+// Protects the telegram and the statistics
+static K_MUTEX_DEFINE(api_mu);
+static struct dsmr_p1_telegram last[DSMR_P1_NUM_PORTS];
+static bool has_telegram[DSMR_P1_NUM_PORTS];
+static struct api_stats stats;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void api_update(size_t meter, const struct dsmr_p1_telegram *telegram) {
+    if (meter >= DSMR_P1_NUM_PORTS) {
+        return;
+    }
+    k_mutex_lock(&api_mu, K_FOREVER);
+    last[meter] = *telegram;
+    has_telegram[meter] = true;
+    k_mutex_unlock(&api_mu);
+}
+
+void api_get_stats(struct api_stats *out) {
+    k_mutex_lock(&api_mu, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&api_mu);
+}
+
+int api_encode_json(const struct dsmr_p1_telegram *t, char *buf, size_t len) {
+    http_encoder_ctx_t enc = {
+        .buf = buf,
+        .len = len,
+    };
+    char value[DSMR_P1_FIELD_FORMAT_MAX_LEN];
+    int ret = 0;
+
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT && ret == 0; field++) {
+        const struct dsmr_p1_field_info *info = &dsmr_p1_fields[field];
+        const char *sep = field == 0 ? "{" : ",";
+
+        if (info->type == DSMR_P1_TYPE_STRING) {
+            // Strings are meter supplied, leave them out rather than escape
+            const char *str = dsmr_p1_field_string(t, field);
+            ret = http_encoder_appendf(&enc, "%s\"%s\":\"%s\"", sep, info->key,
+                                       strpbrk(str, "\"\\") ? "" : str);
+            continue;
+        }
+        ret = dsmr_p1_field_format(value, sizeof(value),
+                                   dsmr_p1_field_value(t, field), info->scale);
+        if (ret >= 0) {
+            ret = http_encoder_appendf(&enc, "%s\"%s\":%s", sep, info->key,
+                                       value);
+        }
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "}");
+    }
+    return ret < 0 ? ret : enc.offs;
+}
+
+int api_handle_telegram_request(const struct server_request *req,
+                                struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    const int meter = meter_from_request(req);
+    if (meter < 0) {
+        res->status = HTTP_404_NOT_FOUND;
+        return 0;
+    }
+
+    struct dsmr_p1_telegram telegram;
+    k_mutex_lock(&api_mu, K_FOREVER);
+    bool valid = has_telegram[meter];
+    telegram = last[meter];
+    k_mutex_unlock(&api_mu);
+
+    if (!valid) {
+        res->status = HTTP_503_SERVICE_UNAVAILABLE;
+        return 0;
+    }
+
+    const bool cbor = strstr(req->accept, "application/cbor") != NULL;
+    const size_t payload_len = cbor ? TELEGRAM_CBOR_MAX_LEN : API_JSON_MAX_LEN;
+    uint8_t *payload = malloc(payload_len);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+
+    const uint32_t start = k_cycle_get_32();
+    int ret = cbor ? telegram_cbor_encode(&telegram, payload, payload_len)
+                   : api_encode_json(&telegram, (char *)payload, payload_len);
+    const uint32_t cycles = k_cycle_get_32() - start;
+    if (ret < 0) {
+        LOG_ERR("failed to encode telegram: %d", ret);
+        free(payload);
+        return ret;
+    }
+
+    k_mutex_lock(&api_mu, K_FOREVER);
+    account(cbor ? &stats.cbor : &stats.json, ret, cycles);
+    k_mutex_unlock(&api_mu);
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       cbor ? (uint64_t)"application/cbor"
+                            : (uint64_t)"application/json",
+                       NULL);
+    res->body = payload;
+    res->body_len = ret;
+    res->on_done = api_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+int api_handle_stats_request(const struct server_request *req,
+                             struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct api_stats s;
+    api_get_stats(&s);
+
+    char *payload = malloc(API_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = API_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"json\":{\"encodes\":%u,\"bytes\":%llu,\"encode_ns\":%llu},"
+        "\"cbor\":{\"encodes\":%u,\"bytes\":%llu,\"encode_ns\":%llu}}",
+        s.json.encodes, s.json.encodes ? s.json.bytes / s.json.encodes : 0,
+        s.json.encodes ? k_cyc_to_ns_floor64(s.json.cycles / s.json.encodes)
+                       : 0,
+        s.cbor.encodes, s.cbor.encodes ? s.cbor.bytes / s.cbor.encodes : 0,
+        s.cbor.encodes ? k_cyc_to_ns_floor64(s.cbor.cycles / s.cbor.encodes)
+                       : 0);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = api_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+int api_handle_metrics_request(const struct server_request *req,
+                               struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    // Too large for the stack of the server thread
+    static struct dsmr_p1_telegram telegrams[DSMR_P1_NUM_PORTS];
+    static bool valid[DSMR_P1_NUM_PORTS];
+    char *payload = malloc(API_METRICS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+
+    k_mutex_lock(&api_mu, K_FOREVER);
+    memcpy(telegrams, last, sizeof(telegrams));
+    memcpy(valid, has_telegram, sizeof(valid));
+    int ret = encode_metrics(telegrams, valid, payload, API_METRICS_MAX_LEN);
+    k_mutex_unlock(&api_mu);
+    if (ret < 0) {
+        LOG_ERR("failed to encode metrics: %d", ret);
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"text/plain; version=0.0.4", NULL);
+    res->body = payload;
+    res->body_len = ret;
+    res->on_done = api_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static int encode_metrics(const struct dsmr_p1_telegram *telegrams,
+                          const bool *valid, char *buf, size_t len) {
+    http_encoder_ctx_t enc = {
+        .buf = buf,
+        .len = len,
+    };
+    int ret = 0;
+
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT && ret == 0; field++) {
+        const struct dsmr_p1_field_info *info = &dsmr_p1_fields[field];
+        if (info->type == DSMR_P1_TYPE_STRING) {
+            continue;
+        }
+        ret = http_encoder_appendf(
+            &enc, "# HELP dsmr_p1_%s OBIS %s%s%s\n# TYPE dsmr_p1_%s gauge\n",
+            info->key, info->obis, info->unit[0] ? " in " : "", info->unit,
+            info->key);
+        for (size_t meter = 0; meter < DSMR_P1_NUM_PORTS && ret == 0;
+             meter++) {
+            if (!valid[meter]) {
+                continue;
+            }
+            ret = http_encoder_appendf(&enc, "dsmr_p1_%s{meter=\"%u\"} ",
+                                       info->key, (unsigned int)meter);
+            if (ret == 0) {
+                ret = encode_metric_value(
+                    &enc, dsmr_p1_field_value(&telegrams[meter], field),
+                    info->scale);
+            }
+        }
+    }
+    return ret < 0 ? ret : enc.offs;
+}
+
+static int encode_metric_value(http_encoder_ctx_t *enc, int64_t value,
+                               uint32_t scale) {
+    char str[DSMR_P1_FIELD_FORMAT_MAX_LEN];
+
+    int ret = dsmr_p1_field_format(str, sizeof(str), value, scale);
+    if (ret < 0) {
+        return ret;
+    }
+    return http_encoder_appendf(enc, "%s\n", str);
+}
+
+static int meter_from_request(const struct server_request *req) {
+    char param[4];
+    if (server_request_get_query_param(req, "meter", param, sizeof(param)) <
+        0) {
+        return 0;
+    }
+    char *end;
+    unsigned long meter = strtoul(param, &end, 10);
+    if (end == param || *end != '\0' || meter >= DSMR_P1_NUM_PORTS) {
+        return -ENOENT;
+    }
+    return meter;
+}
+
+static void account(struct api_format_stats *s, int len, uint32_t cycles) {
+    s->encodes++;
+    s->bytes += len;
+    s->cycles += cycles;
+}
+
+static void api_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    api_update(frame->port, &frame->telegram);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file api.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Versioned API serving the last parsed telegram
+ *
+ */
+
+#ifndef __API_H__
+#define __API_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/schema.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Upper bound of the JSON of a telegram: the key and value of every field
+#define API_JSON_MAX_LEN                                                       \
+    (2 + DSMR_P1_FIELD_COUNT * 64 + DSMR_P1_EQUIPMENT_ID_MAX_LEN)
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct api_format_stats {
+    uint32_t encodes; // telegrams encoded in this format
+    uint64_t bytes;   // total encoded bytes
+    uint64_t cycles;  // total cycles spent encoding
+};
+
+struct api_stats {
+    struct api_format_stats json;
+    struct api_format_stats cbor;
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Store a parsed telegram as the one served by the API for a meter
+ *
+ * @param meter index of the P1 port the telegram was received on
+ * @param telegram parsed telegram
+ */
+void api_update(size_t meter, const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Get a snapshot of the encoding statistics
+ *
+ * @param stats output
+ */
+void api_get_stats(struct api_stats *stats);
+
+/**
+ * Encode a parsed telegram as the JSON served by /api/v1/telegram
+ *
+ * @param telegram telegram to encode
+ * @param buf output buffer, API_JSON_MAX_LEN is always enough
+ * @param len size of buf
+ * @return length of the encoding or negative errno
+ */
+int api_encode_json(const struct dsmr_p1_telegram *telegram, char *buf,
+                    size_t len);
+
+/**
+ * HTTP resource serving the last telegram
+ *
+ * The telegram is encoded as CBOR when the Accept header asks for
+ * application/cbor and as JSON otherwise.
+ */
+int api_handle_telegram_request(const struct server_request *req,
+                                struct server_response *res);
+
+/**
+ * HTTP resource serving the encoding statistics as JSON
+ */
+int api_handle_stats_request(const struct server_request *req,
+                             struct server_response *res);
+
+/**
+ * HTTP resource serving the telegram fields of every meter as Prometheus
+ * metrics
+ */
+int api_handle_metrics_request(const struct server_request *req,
+                               struct server_response *res);
+
+#endif // __API_H__
@@ -0,0 +1,578 @@
+/**
+ * @file capture.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Compressed capture log of raw telegrams
+ *
+ * Consecutive telegrams mostly differ in a few values, so each telegram is
+ * stored as a list of line operations against the previous telegram:
+ *  - 0x00 - 0x7F: copy the next op + 1 lines of the previous telegram
+ *  - PREFIX [prefix len] [suffix len] [suffix]: keep the start of the line of
+ *    the previous telegram, e.g. the OBIS code, and replace the rest
+ *  - LITERAL [len lo] [len hi] [line]: a new line
+ *  - TRAILER: the "!CRC\r\n" line, the CRC is recalculated on decode. Only
+ *    a trailer that decodes to the same bytes is stored as one.
+ *
+ * Every CONFIG_APP_CAPTURE_KEYFRAME_INTERVAL telegrams a keyframe is stored
+ * which does not reference the previous telegram, so decoding any telegram
+ * never has to start further back than that.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "capture.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define CAPTURE_MAX_LINES 64
+#define CAPTURE_ENCODED_MAX_LEN DSMR_P1_TELEGRAM_MAX_SIZE
+#define CAPTURE_MIN_PREFIX_LEN 4
+#define CAPTURE_PARAM_MAX_LEN 16
+#define CAPTURE_STATS_MAX_LEN 256
+
+#define OP_COPY_MAX 0x7F
+#define OP_PREFIX 0x80
+#define OP_LITERAL 0x81
+#define OP_TRAILER 0x82
+
+#define RECORD_FLAG_KEYFRAME BIT(0) // does not reference the previous telegram
+#define RECORD_FLAG_RAW BIT(1)      // payload is the telegram itself
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct record_header {
+    uint16_t len; // length of the payload
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t seq;
+};
+
+struct lines {
+    uint16_t offs[CAPTURE_MAX_LINES + 1]; // offs[n] is the end of line n - 1
+    size_t n;
+};
+
+struct encoder {
+    uint8_t *buf;
+    size_t len;
+    size_t offs;
+    size_t run; // pending number of lines to copy
+};
+
+struct capture_stream {
+    uint32_t seq;       // sequence number of the next record to decode
+    size_t offs;        // ring offset of the next record
+    uint32_t emit_from; // records before this only prime the decoder
+    uint32_t remaining;
+    size_t prev_len;
+    uint8_t prev[DSMR_P1_TELEGRAM_MAX_SIZE];
+    uint8_t payload[CAPTURE_ENCODED_MAX_LEN];
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void split_lines(const uint8_t *buf, size_t len, struct lines *lines);
+static int encode(const uint8_t *data, size_t len, const uint8_t *prev,
+                  const struct lines *prev_lines, uint8_t *out, size_t out_len);
+static bool is_trailer(const uint8_t *data, size_t len, size_t line_len);
+static int encode_put(struct encoder *enc, const void *data, size_t len);
+static int encode_flush_run(struct encoder *enc);
+static int decode(const uint8_t *payload, size_t len, const uint8_t *prev,
+                  size_t prev_len, uint8_t *out, size_t out_len);
+static size_t ring_write(size_t offs, const void *src, size_t len);
+static size_t ring_read(size_t offs, void *dst, size_t len);
+static void ring_evict_oldest(void);
+static ssize_t capture_stream_read(char *buf, size_t len, void *user_data);
+static void capture_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(capture, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(capture_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+// Protects the ring and the statistics
+static K_MUTEX_DEFINE(capture_mu);
+static uint8_t ring[CONFIG_APP_CAPTURE_BUF_SIZE];
+static size_t ring_head; // offset the next record is written to
+static size_t ring_tail; // offset of the oldest record
+static size_t ring_used;
+static struct capture_stats stats;
+
+// Only used by capture_append
+static uint8_t prev[DSMR_P1_TELEGRAM_MAX_SIZE];
+static size_t prev_len;
+static struct lines prev_lines;
+static uint8_t encoded[CAPTURE_ENCODED_MAX_LEN];
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+int capture_append(const uint8_t *data, size_t len) {
+    if (len > sizeof(prev)) {
+        return -E2BIG;
+    }
+
+    struct record_header header = {0};
+    const uint32_t start = k_cycle_get_32();
+    const bool keyframe =
+        prev_len == 0 ||
+        (stats.next_seq % CONFIG_APP_CAPTURE_KEYFRAME_INTERVAL) == 0;
+    int ret = encode(data, len, prev, keyframe ? NULL : &prev_lines, encoded,
+                     sizeof(encoded));
+    const uint8_t *payload = encoded;
+    if (ret < 0) {
+        // Worse than storing it as is
+        header.flags = RECORD_FLAG_RAW;
+        payload = data;
+        ret = len;
+    }
+    const uint32_t cycles = k_cycle_get_32() - start;
+
+    header.len = ret;
+    header.flags |= keyframe ? RECORD_FLAG_KEYFRAME : 0;
+    const size_t total = sizeof(header) + header.len;
+    if (total > sizeof(ring)) {
+        return -E2BIG;
+    }
+
+    k_mutex_lock(&capture_mu, K_FOREVER);
+    while (sizeof(ring) - ring_used < total) {
+        ring_evict_oldest();
+    }
+    header.seq = stats.next_seq++;
+    ring_head = ring_write(ring_head, &header, sizeof(header));
+    ring_head = ring_write(ring_head, payload, header.len);
+    ring_used += total;
+    stats.nr_telegrams++;
+    stats.raw_bytes += len;
+    stats.encoded_bytes += total;
+    stats.encode_cycles += cycles;
+    k_mutex_unlock(&capture_mu);
+
+    memcpy(prev, data, len);
+    prev_len = len;
+    split_lines(prev, prev_len, &prev_lines);
+    return 0;
+}
+
+void capture_get_stats(struct capture_stats *out) {
+    k_mutex_lock(&capture_mu, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&capture_mu);
+}
+
+int capture_handle_request(const struct server_request *req,
+                           struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    char param[CAPTURE_PARAM_MAX_LEN];
+    bool has_from = false;
+    uint32_t from = 0;
+    uint32_t n = UINT32_MAX;
+    if (server_request_get_query_param(req, "from", param, sizeof(param)) >=
+        0) {
+        has_from = true;
+        from = strtoul(param, NULL, 10);
+    }
+    if (server_request_get_query_param(req, "n", param, sizeof(param)) >= 0) {
+        n = strtoul(param, NULL, 10);
+    }
+
+    struct capture_stream *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        LOG_ERR("failed to allocate stream");
+        return -ENOMEM;
+    }
+    memset(stream, 0, sizeof(*stream));
+    stream->remaining = n;
+
+    // Decoding has to start at the last keyframe at or before from
+    k_mutex_lock(&capture_mu, K_FOREVER);
+    if (!has_from || (int32_t)(from - stats.oldest_seq) < 0) {
+        from = stats.oldest_seq;
+    }
+    bool found = false;
+    size_t offs = ring_tail;
+    for (uint32_t seq = stats.oldest_seq; seq != stats.next_seq; seq++) {
+        struct record_header header;
+        ring_read(offs, &header, sizeof(header));
+        if ((header.flags & RECORD_FLAG_KEYFRAME) &&
+            (!found || (int32_t)(seq - from) <= 0)) {
+            found = true;
+            stream->seq = seq;
+            stream->offs = offs;
+        }
+        if ((int32_t)(seq - from) >= 0 && found) {
+            break;
+        }
+        offs = (offs + sizeof(header) + header.len) % sizeof(ring);
+    }
+    k_mutex_unlock(&capture_mu);
+
+    if (!found) {
+        stream->remaining = 0;
+    }
+    stream->emit_from =
+        (int32_t)(from - stream->seq) > 0 ? from : stream->seq;
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"text/plain", NULL);
+    res->body_read = capture_stream_read;
+    res->on_done = capture_handle_request_on_done;
+    res->user_data = stream;
+    return 0;
+}
+
+int capture_handle_stats_request(const struct server_request *req,
+                                 struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct capture_stats s;
+    capture_get_stats(&s);
+
+    char *payload = malloc(CAPTURE_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = CAPTURE_STATS_MAX_LEN,
+    };
+    const uint32_t nr_appended = s.next_seq;
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"oldest\":%u,\"next\":%u,\"telegrams\":%u,\"raw_bytes\":%llu,"
+        "\"encoded_bytes\":%llu,\"ratio_permille\":%llu,"
+        "\"encode_ns\":%llu}",
+        s.oldest_seq, s.next_seq, s.nr_telegrams, s.raw_bytes,
+        s.encoded_bytes,
+        s.raw_bytes ? s.encoded_bytes * 1000 / s.raw_bytes : 0,
+        nr_appended ? k_cyc_to_ns_floor64(s.encode_cycles / nr_appended)
+                    : 0);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = capture_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void split_lines(const uint8_t *buf, size_t len, struct lines *lines) {
+    size_t offs = 0;
+
+    lines->n = 0;
+    lines->offs[0] = 0;
+    while (offs < len && lines->n < CAPTURE_MAX_LINES) {
+        const uint8_t *end = memchr(&buf[offs], '\n', len - offs);
+        offs = end ? (size_t)(end - buf) + 1 : len;
+        lines->offs[++lines->n] = offs;
+    }
+}
+
+static int encode(const uint8_t *data, size_t len, const uint8_t *prev,
+                  const struct lines *prev_lines, uint8_t *out,
+                  size_t out_len) {
+    struct encoder enc = {.buf = out, .len = out_len};
+    size_t line_idx = 0;
+    size_t offs = 0;
+    int ret = 0;
+
+    while (ret == 0 && offs < len) {
+        const uint8_t *line = &data[offs];
+        const uint8_t *end = memchr(line, '\n', len - offs);
+        const size_t line_len = end ? (size_t)(end - line) + 1 : len - offs;
+        offs += line_len;
+
+        if (offs == len && is_trailer(data, len, line_len)) {
+            ret = encode_flush_run(&enc);
+            if (ret == 0) {
+                ret = encode_put(&enc, &(uint8_t){OP_TRAILER}, 1);
+            }
+            break;
+        }
+
+        const uint8_t *prev_line = NULL;
+        size_t prev_line_len = 0;
+        if (prev_lines && line_idx < prev_lines->n) {
+            prev_line = &prev[prev_lines->offs[line_idx]];
+            prev_line_len =
+                prev_lines->offs[line_idx + 1] - prev_lines->offs[line_idx];
+        }
+        line_idx++;
+
+        if (prev_line && prev_line_len == line_len &&
+            memcmp(prev_line, line, line_len) == 0) {
+            if (++enc.run == OP_COPY_MAX + 1) {
+                ret = encode_flush_run(&enc);
+            }
+            continue;
+        }
+
+        ret = encode_flush_run(&enc);
+        if (ret < 0) {
+            break;
+        }
+
+        size_t prefix = 0;
+        const size_t max_prefix = MIN(MIN(line_len, prev_line_len), UINT8_MAX);
+        while (prev_line && prefix < max_prefix &&
+               line[prefix] == prev_line[prefix]) {
+            prefix++;
+        }
+
+        if (prefix >= CAPTURE_MIN_PREFIX_LEN &&
+            line_len - prefix <= UINT8_MAX) {
+            const uint8_t op[] = {OP_PREFIX, prefix, line_len - prefix};
+            ret = encode_put(&enc, op, sizeof(op));
+            if (ret == 0) {
+                ret = encode_put(&enc, &line[prefix], line_len - prefix);
+            }
+        } else {
+            const uint8_t op[] = {OP_LITERAL, line_len & 0xFF, line_len >> 8};
+            ret = encode_put(&enc, op, sizeof(op));
+            if (ret == 0) {
+                ret = encode_put(&enc, line, line_len);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        ret = encode_flush_run(&enc);
+    }
+    if (ret < 0 || enc.offs >= len) {
+        return -ENOMEM;
+    }
+    return enc.offs;
+}
+
+// Whether the last line is the trailer as decode renders it, other trailers
+// such as a CRC in lowercase are kept as sent
+static bool is_trailer(const uint8_t *data, size_t len, size_t line_len) {
+    const uint8_t *line = &data[len - line_len];
+    char trailer[DSMR_P1_TRAILER_LEN + 1];
+
+    if (line_len != DSMR_P1_TRAILER_LEN || line[0] != '!') {
+        return false;
+    }
+    const uint16_t crc = dsmr_p1_crc(data, len - line_len + 1);
+    snprintf(trailer, sizeof(trailer), "!%04X\r\n", crc);
+    return memcmp(line, trailer, line_len) == 0;
+}
+
+static int encode_put(struct encoder *enc, const void *data, size_t len) {
+    if (enc->len - enc->offs < len) {
+        return -ENOMEM;
+    }
+    memcpy(&enc->buf[enc->offs], data, len);
+    enc->offs += len;
+    return 0;
+}
+
+static int encode_flush_run(struct encoder *enc) {
+    if (enc->run == 0) {
+        return 0;
+    }
+    const uint8_t op = enc->run - 1;
+    enc->run = 0;
+    return encode_put(enc, &op, 1);
+}
+
+static int decode(const uint8_t *payload, size_t len, const uint8_t *prev,
+                  size_t prev_len, uint8_t *out, size_t out_len) {
+    struct lines lines;
+    size_t line_idx = 0;
+    size_t offs = 0;
+    size_t i = 0;
+
+    split_lines(prev, prev_len, &lines);
+    while (i < len) {
+        const uint8_t op = payload[i++];
+        if (op <= OP_COPY_MAX) {
+            for (size_t n = 0; n <= op; n++, line_idx++) {
+                if (line_idx >= lines.n) {
+                    return -EILSEQ;
+                }
+                const size_t l =
+                    lines.offs[line_idx + 1] - lines.offs[line_idx];
+                if (out_len - offs < l) {
+                    return -ENOMEM;
+                }
+                memcpy(&out[offs], &prev[lines.offs[line_idx]], l);
+                offs += l;
+            }
+        } else if (op == OP_PREFIX) {
+            if (len - i < 2 || line_idx >= lines.n) {
+                return -EILSEQ;
+            }
+            const size_t prefix = payload[i++];
+            const size_t suffix = payload[i++];
+            if (len - i < suffix || out_len - offs < prefix + suffix ||
+                lines.offs[line_idx + 1] - lines.offs[line_idx] < prefix) {
+                return -EILSEQ;
+            }
+            memcpy(&out[offs], &prev[lines.offs[line_idx]], prefix);
+            memcpy(&out[offs + prefix], &payload[i], suffix);
+            offs += prefix + suffix;
+            i += suffix;
+            line_idx++;
+        } else if (op == OP_LITERAL) {
+            if (len - i < 2) {
+                return -EILSEQ;
+            }
+            const size_t l = payload[i] | (payload[i + 1] << 8);
+            i += 2;
+            if (len - i < l || out_len - offs < l) {
+                return -EILSEQ;
+            }
+            memcpy(&out[offs], &payload[i], l);
+            offs += l;
+            i += l;
+            line_idx++;
+        } else if (op == OP_TRAILER) {
+            if (out_len - offs < DSMR_P1_TRAILER_LEN + 1) {
+                return -ENOMEM;
+            }
+            out[offs++] = '!';
+            const uint16_t crc = dsmr_p1_crc(out, offs);
+            // snprintf terminates, hence the extra byte checked above
+            snprintf((char *)&out[offs], DSMR_P1_TRAILER_LEN, "%04X\r\n", crc);
+            offs += DSMR_P1_TRAILER_LEN - 1;
+        } else {
+            return -EILSEQ;
+        }
+    }
+    return offs;
+}
+
+/* Must be called with capture_mu held */
+static size_t ring_write(size_t offs, const void *src, size_t len) {
+    const size_t first = MIN(len, sizeof(ring) - offs);
+    memcpy(&ring[offs], src, first);
+    memcpy(ring, (const uint8_t *)src + first, len - first);
+    return (offs + len) % sizeof(ring);
+}
+
+/* Must be called with capture_mu held */
+static size_t ring_read(size_t offs, void *dst, size_t len) {
+    const size_t first = MIN(len, sizeof(ring) - offs);
+    memcpy(dst, &ring[offs], first);
+    memcpy((uint8_t *)dst + first, ring, len - first);
+    return (offs + len) % sizeof(ring);
+}
+
+/* Must be called with capture_mu held */
+static void ring_evict_oldest(void) {
+    struct record_header header;
+    ring_read(ring_tail, &header, sizeof(header));
+    const size_t total = sizeof(header) + header.len;
+    ring_tail = (ring_tail + total) % sizeof(ring);
+    ring_used -= total;
+    stats.oldest_seq++;
+    stats.nr_telegrams--;
+}
+
+static ssize_t capture_stream_read(char *buf, size_t len, void *user_data) {
+    struct capture_stream *stream = user_data;
+
+    while (stream->remaining > 0) {
+        struct record_header header;
+
+        k_mutex_lock(&capture_mu, K_FOREVER);
+        // Stop when the end is reached or the record has been evicted
+        if ((int32_t)(stream->seq - stats.oldest_seq) < 0 ||
+            stream->seq == stats.next_seq) {
+            k_mutex_unlock(&capture_mu);
+            return 0;
+        }
+        size_t offs = ring_read(stream->offs, &header, sizeof(header));
+        if (header.seq != stream->seq || header.len > sizeof(stream->payload)) {
+            k_mutex_unlock(&capture_mu);
+            return 0;
+        }
+        stream->offs = ring_read(offs, stream->payload, header.len);
+        k_mutex_unlock(&capture_mu);
+
+        int ret;
+        if (header.flags & RECORD_FLAG_RAW) {
+            ret = MIN(header.len, len);
+            memcpy(buf, stream->payload, ret);
+        } else {
+            ret = decode(stream->payload, header.len, stream->prev,
+                         (header.flags & RECORD_FLAG_KEYFRAME)
+                             ? 0
+                             : stream->prev_len,
+                         buf, len);
+        }
+        if (ret < 0) {
+            LOG_ERR("could not decode telegram %u: %d", header.seq, ret);
+            return ret;
+        }
+
+        stream->prev_len = MIN((size_t)ret, sizeof(stream->prev));
+        memcpy(stream->prev, buf, stream->prev_len);
+        stream->seq++;
+        if ((int32_t)(header.seq - stream->emit_from) >= 0) {
+            stream->remaining--;
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void capture_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    (void)capture_append(frame->data, frame->len);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file capture.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Compressed capture log of raw telegrams
+ *
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct capture_stats {
+    uint32_t oldest_seq;
+    uint32_t next_seq;
+    uint32_t nr_telegrams;  // telegrams currently in the log
+    uint64_t raw_bytes;     // total size of all captured telegrams
+    uint64_t encoded_bytes; // total size of all captured records
+    uint64_t encode_cycles; // total cycles spent encoding
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Append a validated raw telegram to the capture log
+ *
+ * The telegram is stored as a line diff against the previous telegram, the
+ * oldest telegrams are evicted when the log is full.
+ */
+int capture_append(const uint8_t *data, size_t len);
+
+/**
+ * Get the statistics of the capture log
+ */
+void capture_get_stats(struct capture_stats *stats);
+
+/**
+ * HTTP resource streaming byte exact telegrams from the capture log
+ *
+ * Query parameters:
+ *  - from: sequence number of the first telegram (default oldest)
+ *  - n: maximum number of telegrams (default all)
+ */
+int capture_handle_request(const struct server_request *req,
+                           struct server_response *res);
+
+/**
+ * HTTP resource serving the capture statistics as JSON
+ */
+int capture_handle_stats_request(const struct server_request *req,
+                                 struct server_response *res);
+
+#endif // __CAPTURE_H__
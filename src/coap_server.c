@@ -0,0 +1,339 @@
+/**
+ * @file coap_server.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief CoAP server pushing telegrams to observers
+ *
+ * Resources:
+ *  - telegram: the parsed telegram as CBOR, observable
+ *  - telegram/raw: the raw telegram, observable and served block-wise
+ *  - obis/<code>: the value of a single OBIS code as /obis/ serves it, e.g.
+ *    obis/1-0:1.7.0, for every object of DSMR_P1_SCHEMA
+ *
+ * The CBOR encoding and the raw telegram are kept in shared buffers which are
+ * updated once per telegram, every notification only copies them into its
+ * packet. The ETag of both telegram resources changes with every telegram so
+ * block-wise clients can detect a telegram changing between blocks.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "coap_server.h"
+#include "telegram_cbor.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/schema.h>
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/net/coap_service.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define COAP_BLOCK_SZX (LOG2(CONFIG_APP_COAP_BLOCK_SIZE) - 4)
+#define COAP_PACKET_MAX_LEN                                                    \
+    (64 + MAX(CONFIG_APP_COAP_BLOCK_SIZE, TELEGRAM_CBOR_MAX_LEN))
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_COAP_BLOCK_SIZE) &&
+                 CONFIG_APP_COAP_BLOCK_SIZE >= 16 &&
+                 CONFIG_APP_COAP_BLOCK_SIZE <= 1024,
+             "CoAP block size must be a power of two in [16, 1024]");
+
+enum telegram_format {
+    TELEGRAM_FORMAT_CBOR,
+    TELEGRAM_FORMAT_RAW,
+};
+
+#define OBIS_RESOURCE(_name, _code)                                            \
+    static const char *const _name##_path[] = {"obis", _code, NULL};           \
+    COAP_RESOURCE_DEFINE(_name, p1_coap,                                       \
+                         {                                                     \
+                             .get = obis_get,                                  \
+                             .path = _name##_path,                             \
+                             .user_data = (void *)_code,                       \
+                         });
+
+// Fields parsed from the object of another field are served by that field
+#define OBIS_FIELD_RESOURCE(name, key, obis, ctype, type, unit, scale)         \
+    COND_CODE_0(DSMR_P1_IS_SHARED(name),                                       \
+                (OBIS_RESOURCE(obis_##key, DSMR_P1_OBIS_STRING(obis))), ())
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int telegram_get(struct coap_resource *resource,
+                        const struct coap_packet *request,
+                        struct sockaddr *addr, socklen_t addr_len);
+static void telegram_notify(struct coap_resource *resource,
+                            struct coap_observer *observer);
+static int obis_get(struct coap_resource *resource,
+                    const struct coap_packet *request, struct sockaddr *addr,
+                    socklen_t addr_len);
+static int send_telegram(struct coap_resource *resource,
+                         const struct sockaddr *addr, socklen_t addr_len,
+                         uint8_t type, uint16_t id, const uint8_t *token,
+                         uint8_t tkl, int observe, int block2);
+static int append_telegram(struct coap_packet *pkt,
+                           enum telegram_format format, int block2);
+static void notify_work_handler(struct k_work *work);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(coap_server, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(coap_server_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+static const uint16_t coap_port = CONFIG_APP_COAP_PORT;
+COAP_SERVICE_DEFINE(p1_coap, NULL, &coap_port, COAP_SERVICE_AUTOSTART);
+
+static const char *const telegram_path[] = {"telegram", NULL};
+COAP_RESOURCE_DEFINE(telegram_resource, p1_coap,
+                     {
+                         .get = telegram_get,
+                         .notify = telegram_notify,
+                         .path = telegram_path,
+                         .user_data = (void *)TELEGRAM_FORMAT_CBOR,
+                     });
+
+static const char *const telegram_raw_path[] = {"telegram", "raw", NULL};
+COAP_RESOURCE_DEFINE(telegram_raw_resource, p1_coap,
+                     {
+                         .get = telegram_get,
+                         .notify = telegram_notify,
+                         .path = telegram_raw_path,
+                         .user_data = (void *)TELEGRAM_FORMAT_RAW,
+                     });
+
+DSMR_P1_SCHEMA(OBIS_FIELD_RESOURCE)
+
+// Protects the shared payloads
+static K_MUTEX_DEFINE(coap_mu);
+static uint8_t cbor_buf[TELEGRAM_CBOR_MAX_LEN];
+static size_t cbor_len;
+static uint8_t raw_buf[DSMR_P1_TELEGRAM_MAX_SIZE];
+static size_t raw_len;
+static struct dsmr_p1_index raw_index; // index of the frame of raw_buf
+static uint32_t etag;
+
+static K_WORK_DEFINE(notify_work, notify_work_handler);
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void coap_server_update(const struct dsmr_p1_frame *frame) {
+    uint8_t encoded[TELEGRAM_CBOR_MAX_LEN];
+
+    int ret = telegram_cbor_encode(&frame->telegram, encoded, sizeof(encoded));
+    if (ret < 0) {
+        LOG_ERR("could not encode telegram: %d", ret);
+        return;
+    }
+
+    k_mutex_lock(&coap_mu, K_FOREVER);
+    memcpy(cbor_buf, encoded, ret);
+    cbor_len = ret;
+    raw_len = frame->len;
+    memcpy(raw_buf, frame->data, raw_len);
+    raw_index = frame->index;
+    etag++;
+    k_mutex_unlock(&coap_mu);
+
+    // Keep building the notifications off the telegram thread
+    k_work_submit(&notify_work);
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static int telegram_get(struct coap_resource *resource,
+                        const struct coap_packet *request,
+                        struct sockaddr *addr, socklen_t addr_len) {
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    const uint8_t tkl = coap_header_get_token(request, token);
+    const uint16_t id = coap_header_get_id(request);
+    const uint8_t type = coap_header_get_type(request) == COAP_TYPE_CON
+                             ? COAP_TYPE_ACK
+                             : COAP_TYPE_NON_CON;
+
+    // Registers or deregisters the observer
+    int observe = coap_get_option_int(request, COAP_OPTION_OBSERVE);
+    if (observe >= 0) {
+        int ret = coap_resource_parse_observe(resource, request, addr);
+        if (ret < 0) {
+            LOG_WRN("could not register observer: %d", ret);
+        }
+    }
+
+    return send_telegram(resource, addr, addr_len, type, id, token, tkl,
+                         observe == 0 ? (int)resource->age : -1,
+                         coap_get_option_int(request, COAP_OPTION_BLOCK2));
+}
+
+static void telegram_notify(struct coap_resource *resource,
+                            struct coap_observer *observer) {
+    int ret = send_telegram(resource, &observer->addr, sizeof(observer->addr),
+                            COAP_TYPE_NON_CON, coap_next_id(), observer->token,
+                            observer->tkl, resource->age, -1);
+    if (ret < 0) {
+        LOG_WRN("could not notify observer: %d", ret);
+    }
+}
+
+static int obis_get(struct coap_resource *resource,
+                    const struct coap_packet *request, struct sockaddr *addr,
+                    socklen_t addr_len) {
+    uint8_t buf[COAP_PACKET_MAX_LEN];
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    struct coap_packet pkt;
+    const char *code = resource->user_data;
+
+    const uint8_t tkl = coap_header_get_token(request, token);
+    const uint8_t type = coap_header_get_type(request) == COAP_TYPE_CON
+                             ? COAP_TYPE_ACK
+                             : COAP_TYPE_NON_CON;
+
+    k_mutex_lock(&coap_mu, K_FOREVER);
+    // The copy of the telegram keeps the index of its frame, so this is the
+    // lookup of dsmr_p1_frame_value() that /obis/ serves
+    const uint8_t *value;
+    size_t value_len;
+    const bool found =
+        raw_len > 0 && dsmr_p1_index_lookup(&raw_index, raw_buf, code, &value,
+                                            &value_len) == 0;
+
+    int ret = coap_packet_init(&pkt, buf, sizeof(buf), COAP_VERSION_1, type,
+                               tkl, token,
+                               found ? COAP_RESPONSE_CODE_CONTENT
+                                     : COAP_RESPONSE_CODE_NOT_FOUND,
+                               coap_header_get_id(request));
+    if (ret == 0 && found) {
+        value_len = MIN(value_len, sizeof(buf) - pkt.offset - 8);
+        ret = coap_append_option_int(&pkt, COAP_OPTION_CONTENT_FORMAT,
+                                     COAP_CONTENT_FORMAT_TEXT_PLAIN);
+        if (ret == 0) {
+            ret = coap_packet_append_payload_marker(&pkt);
+        }
+        if (ret == 0) {
+            ret = coap_packet_append_payload(&pkt, value, value_len);
+        }
+    }
+    k_mutex_unlock(&coap_mu);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return coap_resource_send(resource, &pkt, addr, addr_len, NULL);
+}
+
+static int send_telegram(struct coap_resource *resource,
+                         const struct sockaddr *addr, socklen_t addr_len,
+                         uint8_t type, uint16_t id, const uint8_t *token,
+                         uint8_t tkl, int observe, int block2) {
+    uint8_t buf[COAP_PACKET_MAX_LEN];
+    struct coap_packet pkt;
+    const enum telegram_format format = (uintptr_t)resource->user_data;
+
+    int ret = coap_packet_init(&pkt, buf, sizeof(buf), COAP_VERSION_1, type,
+                               tkl, token, COAP_RESPONSE_CODE_CONTENT, id);
+    if (ret < 0) {
+        return ret;
+    }
+
+    k_mutex_lock(&coap_mu, K_FOREVER);
+    // Options have to be appended in ascending order
+    const uint32_t tag = sys_cpu_to_be32(etag);
+    ret = coap_packet_append_option(&pkt, COAP_OPTION_ETAG,
+                                    (const uint8_t *)&tag, sizeof(tag));
+    if (ret == 0 && observe >= 0) {
+        ret = coap_append_option_int(&pkt, COAP_OPTION_OBSERVE, observe);
+    }
+    if (ret == 0) {
+        ret = append_telegram(&pkt, format, block2);
+    }
+    k_mutex_unlock(&coap_mu);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return coap_resource_send(resource, &pkt, addr, addr_len, NULL);
+}
+
+/* Must be called with coap_mu held */
+static int append_telegram(struct coap_packet *pkt,
+                           enum telegram_format format, int block2) {
+    int ret;
+
+    if (format == TELEGRAM_FORMAT_CBOR) {
+        ret = coap_append_option_int(pkt, COAP_OPTION_CONTENT_FORMAT,
+                                     COAP_CONTENT_FORMAT_APP_CBOR);
+        if (ret == 0) {
+            ret = coap_packet_append_payload_marker(pkt);
+        }
+        if (ret == 0) {
+            ret = coap_packet_append_payload(pkt, cbor_buf, cbor_len);
+        }
+        return ret;
+    }
+
+    // Serve the block asked for, no larger than our own block size
+    uint32_t num = 0;
+    uint32_t szx = COAP_BLOCK_SZX;
+    if (block2 >= 0) {
+        num = (uint32_t)block2 >> 4;
+        szx = MIN((uint32_t)block2 & 0x7, szx);
+    }
+    const size_t block_size = 1U << (szx + 4);
+    const size_t offs = num * block_size;
+    if (offs > raw_len || (offs == raw_len && offs > 0)) {
+        return -EINVAL;
+    }
+    const size_t len = MIN(block_size, raw_len - offs);
+    const bool more = offs + len < raw_len;
+
+    ret = coap_append_option_int(pkt, COAP_OPTION_CONTENT_FORMAT,
+                                 COAP_CONTENT_FORMAT_TEXT_PLAIN);
+    if (ret == 0) {
+        ret = coap_append_option_int(pkt, COAP_OPTION_BLOCK2,
+                                     (num << 4) | (more << 3) | szx);
+    }
+    if (ret == 0 && num == 0) {
+        ret = coap_append_option_int(pkt, COAP_OPTION_SIZE2, raw_len);
+    }
+    if (ret == 0) {
+        ret = coap_packet_append_payload_marker(pkt);
+    }
+    if (ret == 0) {
+        ret = coap_packet_append_payload(pkt, &raw_buf[offs], len);
+    }
+    return ret;
+}
+
+static void notify_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+    (void)coap_resource_notify(&telegram_resource);
+    (void)coap_resource_notify(&telegram_raw_resource);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    coap_server_update(frame);
+}
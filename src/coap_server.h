@@ -0,0 +1,36 @@
+/**
+ * @file coap_server.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief CoAP server pushing telegrams to observers
+ *
+ */
+
+#ifndef __COAP_SERVER_H__
+#define __COAP_SERVER_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include <dsmr_p1/bus.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Publish a new telegram to the CoAP resources and notify the observers
+ *
+ * The payloads are encoded once here and shared by all observers.
+ *
+ * @param frame frame of the validated telegram, the raw telegram and its
+ * index are copied
+ */
+void coap_server_update(const struct dsmr_p1_frame *frame);
+
+#endif // __COAP_SERVER_H__
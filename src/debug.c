@@ -0,0 +1,220 @@
+/**
+ * @file debug.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Thread, stack, heap and network buffer introspection
+ *
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "debug.h"
+#include "http.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/net/net_mgmt.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/net_stats.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/sys_heap.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define DEBUG_THREADS_MAX_LEN 4096
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct encode_threads_ctx {
+    http_encoder_ctx_t *enc;
+    uint64_t total_cycles;
+    const char *sep;
+    int ret;
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void encode_thread(const struct k_thread *thread, void *user_data);
+static int encode_heap(http_encoder_ctx_t *enc);
+static int encode_net(http_encoder_ctx_t *enc);
+static void debug_handle_request_on_done(int err, void *user_data);
+
+#if defined(CONFIG_COMMON_LIBC_MALLOC) && defined(CONFIG_SYS_HEAP_RUNTIME_STATS)
+// Statistics of the heap behind malloc, from the common libc
+int malloc_runtime_stats_get(struct sys_memory_stats *stats);
+#endif
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(debug, CONFIG_APP_LOG_LEVEL);
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+int debug_handle_threads_request(const struct server_request *req,
+                                 struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    char *payload = malloc(DEBUG_THREADS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = DEBUG_THREADS_MAX_LEN,
+    };
+
+    k_thread_runtime_stats_t all = {0};
+    (void)k_thread_runtime_stats_all_get(&all);
+    struct encode_threads_ctx ctx = {
+        .enc = &enc,
+        .total_cycles = all.execution_cycles,
+        .sep = "",
+    };
+    ctx.ret = http_encoder_appendf(
+        &enc, "{\"uptime_ms\":%lld,\"cycles\":%llu,\"threads\":[",
+        k_uptime_get(), all.execution_cycles);
+    if (ctx.ret == 0) {
+        k_thread_foreach_unlocked(encode_thread, &ctx);
+    }
+    int ret = ctx.ret;
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "],\"heap\":");
+    }
+    if (ret == 0) {
+        ret = encode_heap(&enc);
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, ",\"net\":");
+    }
+    if (ret == 0) {
+        ret = encode_net(&enc);
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "}");
+    }
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = debug_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void encode_thread(const struct k_thread *thread, void *user_data) {
+    struct encode_threads_ctx *ctx = user_data;
+    k_tid_t tid = (k_tid_t)thread;
+
+    if (ctx->ret < 0) {
+        return;
+    }
+
+    k_thread_runtime_stats_t stats = {0};
+    (void)k_thread_runtime_stats_get(tid, &stats);
+    const uint32_t permille =
+        ctx->total_cycles
+            ? (uint32_t)(stats.execution_cycles * 1000 / ctx->total_cycles)
+            : 0;
+
+    size_t unused = 0;
+    const size_t size = thread->stack_info.size;
+    if (k_thread_stack_space_get(thread, &unused) < 0) {
+        unused = size;
+    }
+
+    const char *name = k_thread_name_get(tid);
+    ctx->ret = http_encoder_appendf(
+        ctx->enc,
+        "%s{\"name\":\"%s\",\"priority\":%d,\"cycles\":%llu,"
+        "\"cpu_permille\":%u,\"stack_size\":%u,\"stack_used\":%u}",
+        ctx->sep, name && name[0] ? name : "unnamed",
+        k_thread_priority_get(tid), stats.execution_cycles, permille,
+        (uint32_t)size, (uint32_t)(size - unused));
+    ctx->sep = ",";
+}
+
+static int encode_heap(http_encoder_ctx_t *enc) {
+#if defined(CONFIG_COMMON_LIBC_MALLOC) && defined(CONFIG_SYS_HEAP_RUNTIME_STATS)
+    struct sys_memory_stats stats;
+    if (malloc_runtime_stats_get(&stats) == 0) {
+        return http_encoder_appendf(
+            enc, "{\"free\":%u,\"allocated\":%u,\"max_allocated\":%u}",
+            (uint32_t)stats.free_bytes, (uint32_t)stats.allocated_bytes,
+            (uint32_t)stats.max_allocated_bytes);
+    }
+#endif
+    return http_encoder_appendf(enc, "null");
+}
+
+static int encode_net(http_encoder_ctx_t *enc) {
+    struct k_mem_slab *rx;
+    struct k_mem_slab *tx;
+    struct net_buf_pool *rx_data;
+    struct net_buf_pool *tx_data;
+
+    net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+    int ret = http_encoder_appendf(
+        enc,
+        "{\"pkt_rx\":{\"count\":%u,\"used\":%u},"
+        "\"pkt_tx\":{\"count\":%u,\"used\":%u},"
+        "\"buf_rx\":{\"count\":%u,\"used\":%u},"
+        "\"buf_tx\":{\"count\":%u,\"used\":%u}",
+        k_mem_slab_num_used_get(rx) + k_mem_slab_num_free_get(rx),
+        k_mem_slab_num_used_get(rx),
+        k_mem_slab_num_used_get(tx) + k_mem_slab_num_free_get(tx),
+        k_mem_slab_num_used_get(tx), rx_data->buf_count,
+        rx_data->buf_count - (uint32_t)atomic_get(&rx_data->avail_count),
+        tx_data->buf_count,
+        tx_data->buf_count - (uint32_t)atomic_get(&tx_data->avail_count));
+
+    struct net_stats stats;
+    if (ret == 0 && net_mgmt(NET_REQUEST_STATS_GET_ALL, NULL, &stats,
+                             sizeof(stats)) == 0) {
+        ret = http_encoder_appendf(
+            enc,
+            ",\"ip_recv\":%u,\"ip_sent\":%u,\"ip_drop\":%u,"
+            "\"tcp_drop\":%u,\"errors\":%u",
+            stats.ipv4.recv, stats.ipv4.sent, stats.ipv4.drop, stats.tcp.drop,
+            stats.processing_error);
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(enc, "}");
+    }
+    return ret;
+}
+
+static void debug_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
@@ -0,0 +1,38 @@
+/**
+ * @file debug.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Thread, stack, heap and network buffer introspection
+ *
+ * /debug/threads serves a snapshot as JSON:
+ *
+ * - threads: name, priority, cycles run since boot and their share of all
+ *   cycles in per mille, stack size and the most of it ever used
+ * - heap: bytes free, allocated and the peak allocated of the malloc heap
+ * - net: packets and buffers in use of the network stack pools, and the
+ *   packet and drop counters of CONFIG_NET_STATISTICS
+ *
+ * The threads are walked without locking the scheduler across the walk, so
+ * the snapshot is not atomic but the system keeps running while it is taken.
+ * Measuring the stack usage scans every stack for the INIT_STACKS pattern,
+ * which takes some ms.
+ */
+
+#ifndef __DEBUG_H__
+#define __DEBUG_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+int debug_handle_threads_request(const struct server_request *req,
+                                 struct server_response *res);
+
+#endif // __DEBUG_H__
@@ -0,0 +1,255 @@
+/**
+ * @file demand.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Quarter-hour average demand and monthly peak tracking for capacity
+ * tariffs
+ *
+ * The average demand of a quarter is the imported energy since the start of
+ * the quarter divided by its length. Only the counter value at the start of
+ * the quarter is kept, so each telegram is handled in constant time and
+ * memory.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "demand.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define DEMAND_RESPONSE_MAX_LEN 2048
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static uint32_t close_quarter(uint32_t quarter_start);
+static void get_month(uint32_t timestamp, uint16_t *year, uint8_t *month);
+static void demand_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(demand, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(demand_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+static K_MUTEX_DEFINE(demand_mu);
+
+static struct demand_state state;
+static double quarter_start_energy; // kWh
+static double last_energy;          // kWh
+static bool started;
+
+// Completed months, newest at history_head
+static struct demand_month history[CONFIG_APP_DEMAND_MONTHS];
+static size_t history_head;
+static size_t history_len;
+
+static demand_changed_cb_t user_cb;
+static void *user_data;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void demand_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram) {
+    if (timestamp < 0 || timestamp > UINT32_MAX) {
+        return;
+    }
+
+    const uint32_t now = (uint32_t)timestamp;
+    const uint32_t quarter_start = now - (now % DEMAND_QUARTER_SECONDS);
+    const double energy = (double)(telegram->energy_delivered_t1 +
+                                   telegram->energy_delivered_t2);
+    uint32_t changes = 0;
+
+    k_mutex_lock(&demand_mu, K_FOREVER);
+    if (!started) {
+        // The first quarter is partial, start measuring from here
+        started = true;
+        state.quarter_start = quarter_start;
+        quarter_start_energy = energy;
+        get_month(now, &state.current_month.year, &state.current_month.month);
+    } else if (quarter_start > state.quarter_start) {
+        const bool contiguous =
+            quarter_start == state.quarter_start + DEMAND_QUARTER_SECONDS;
+        changes = close_quarter(quarter_start);
+        // The last sample before the boundary is the best estimate of the
+        // counter at the start, after a gap only a partial quarter is known
+        quarter_start_energy = contiguous ? last_energy : energy;
+        state.quarter_start = quarter_start;
+    } else if (quarter_start < state.quarter_start) {
+        k_mutex_unlock(&demand_mu);
+        return;
+    }
+    last_energy = energy;
+
+    state.elapsed = now - quarter_start;
+    const double quarter_energy = MAX(energy - quarter_start_energy, 0.0);
+    const double remaining_h =
+        (double)(DEMAND_QUARTER_SECONDS - state.elapsed) / 3600.0;
+    // Demand is billed as the average power over the whole quarter
+    state.average = (float)(quarter_energy * 3600.0 / DEMAND_QUARTER_SECONDS);
+    state.predicted =
+        (float)((quarter_energy + telegram->power_delivered * remaining_h) *
+                3600.0 / DEMAND_QUARTER_SECONDS);
+    state.meter_average = telegram->average_demand;
+    state.meter_month_peak = telegram->maximum_demand;
+
+    const struct demand_state snapshot = state;
+    k_mutex_unlock(&demand_mu);
+
+    if (changes && user_cb) {
+        user_cb(changes, &snapshot, user_data);
+    }
+}
+
+int demand_set_callback(demand_changed_cb_t a_cb, void *a_user_data) {
+    k_mutex_lock(&demand_mu, K_FOREVER);
+    user_cb = a_cb;
+    user_data = a_user_data;
+    k_mutex_unlock(&demand_mu);
+    return 0;
+}
+
+void demand_get_state(struct demand_state *out) {
+    k_mutex_lock(&demand_mu, K_FOREVER);
+    *out = state;
+    k_mutex_unlock(&demand_mu);
+}
+
+int demand_handle_request(const struct server_request *req,
+                          struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    char *payload = malloc(DEMAND_RESPONSE_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = DEMAND_RESPONSE_MAX_LEN,
+    };
+
+    // Report in W so the response is free of float formatting
+    k_mutex_lock(&demand_mu, K_FOREVER);
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"quarter_start\":%u,\"elapsed\":%u,\"average\":%d,"
+        "\"predicted\":%d,\"meter_average\":%d,\"meter_month_peak\":%d,"
+        "\"last\":{\"start\":%u,\"demand\":%d},"
+        "\"month\":{\"year\":%u,\"month\":%u,\"start\":%u,\"demand\":%d},"
+        "\"history\":[",
+        state.quarter_start, state.elapsed, (int)(state.average * 1000),
+        (int)(state.predicted * 1000), (int)(state.meter_average * 1000),
+        (int)(state.meter_month_peak * 1000), state.last.start,
+        (int)(state.last.demand * 1000), state.current_month.year,
+        state.current_month.month, state.current_month.peak.start,
+        (int)(state.current_month.peak.demand * 1000));
+    for (size_t i = 0; ret == 0 && i < history_len; i++) {
+        const struct demand_month *m =
+            &history[(history_head + ARRAY_SIZE(history) - i) %
+                     ARRAY_SIZE(history)];
+        ret = http_encoder_appendf(
+            &enc, "%s{\"year\":%u,\"month\":%u,\"start\":%u,\"demand\":%d}",
+            i ? "," : "", m->year, m->month, m->peak.start,
+            (int)(m->peak.demand * 1000));
+    }
+    k_mutex_unlock(&demand_mu);
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "]}");
+    }
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = demand_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+/* Must be called with demand_mu held */
+static uint32_t close_quarter(uint32_t quarter_start) {
+    uint32_t changes = DEMAND_CHANGE_QUARTER;
+
+    state.last.start = state.quarter_start;
+    state.last.demand = state.average;
+
+    struct demand_month *month = &state.current_month;
+    if (state.last.demand > month->peak.demand) {
+        month->peak = state.last;
+        changes |= DEMAND_CHANGE_MONTH_PEAK;
+    }
+
+    uint16_t year;
+    uint8_t mon;
+    get_month(quarter_start, &year, &mon);
+    if (year != month->year || mon != month->month) {
+        LOG_INF("%04u-%02u peak demand: %d W", month->year, month->month,
+                (int)(month->peak.demand * 1000));
+        history_head = (history_head + 1) % ARRAY_SIZE(history);
+        history_len = MIN(history_len + 1, ARRAY_SIZE(history));
+        history[history_head] = *month;
+
+        memset(month, 0, sizeof(*month));
+        month->year = year;
+        month->month = mon;
+        changes |= DEMAND_CHANGE_MONTH;
+    }
+
+    return changes;
+}
+
+static void get_month(uint32_t timestamp, uint16_t *year, uint8_t *month) {
+    const time_t t = timestamp;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    *year = tm.tm_year + 1900;
+    *month = tm.tm_mon + 1;
+}
+
+static void demand_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    demand_update(dsmr_p1_frame_time(frame), &frame->telegram);
+}
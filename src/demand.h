@@ -0,0 +1,98 @@
+/**
+ * @file demand.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Quarter-hour average demand and monthly peak tracking for capacity
+ * tariffs
+ *
+ */
+
+#ifndef __DEMAND_H__
+#define __DEMAND_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define DEMAND_QUARTER_SECONDS (15 * 60)
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct demand_peak {
+    uint32_t start; // unix timestamp of the start of the peak quarter
+    float demand;   // kW
+};
+
+struct demand_month {
+    uint16_t year;
+    uint8_t month; // 1 - 12
+    struct demand_peak peak;
+};
+
+struct demand_state {
+    uint32_t quarter_start;
+    uint32_t elapsed;        // seconds into the current quarter
+    float average;           // kW, average demand of the quarter so far
+    float predicted;         // kW, expected average at the end of the quarter
+    float meter_average;     // kW, 1-0:1.4.0 when the meter reports it
+    float meter_month_peak;  // kW, 1-0:1.6.0 when the meter reports it
+    struct demand_peak last; // last completed quarter
+    struct demand_month current_month;
+};
+
+enum demand_change {
+    DEMAND_CHANGE_QUARTER = BIT(0),    // a quarter completed
+    DEMAND_CHANGE_MONTH_PEAK = BIT(1), // the monthly peak increased
+    DEMAND_CHANGE_MONTH = BIT(2),      // a new month started
+};
+
+typedef void (*demand_changed_cb_t)(uint32_t changes,
+                                    const struct demand_state *state,
+                                    void *user_data);
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Update the demand tracking with a telegram in constant time
+ *
+ * @param timestamp unix timestamp the telegram was sampled at
+ * @param telegram parsed telegram
+ */
+void demand_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Set the callback that is notified when a quarter completes or the monthly
+ * peak changes. Called from the thread that calls demand_update.
+ */
+int demand_set_callback(demand_changed_cb_t cb, void *user_data);
+
+/**
+ * Get a copy of the current demand state
+ */
+void demand_get_state(struct demand_state *state);
+
+/**
+ * HTTP resource serving the demand state and monthly peak history as JSON
+ */
+int demand_handle_request(const struct server_request *req,
+                          struct server_response *res);
+
+#endif // __DEMAND_H__
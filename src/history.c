@@ -0,0 +1,426 @@
+/**
+ * @file history.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Persistent history of completed rollup slots
+ *
+ * Completed slots are collected in a RAM batch which is written as a single
+ * ZMS entry once full. Batch sequence numbers map onto a fixed range of ZMS
+ * IDs, so the oldest batch is overwritten once the range is used and ZMS takes
+ * care of wear levelling and of discarding entries torn by a power loss.
+ *
+ * The daily write budget counts days of telegram time, taken from the end of
+ * the closed slots, and every batch header carries the budget day and the
+ * bytes written on it. A reboot resumes the budget from the newest header
+ * instead of starting a fresh day.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "history.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/zms.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define HISTORY_PARTITION history_partition
+
+#define HISTORY_MAGIC 0x48495354U // "HIST"
+#define HISTORY_ID_BASE 0x1000U
+#define HISTORY_MAX_BATCHES CONFIG_APP_HISTORY_MAX_BATCHES
+#define HISTORY_DAY_S (24U * 60 * 60)
+
+struct history_batch_header {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t day;       // budget day, in days since the epoch
+    uint32_t day_bytes; // bytes written on that day up to this batch
+    uint32_t crc;       // crc32 of the records
+};
+
+#define HISTORY_BATCH_RECORDS                                                  \
+    ((CONFIG_APP_HISTORY_BATCH_SIZE - sizeof(struct history_batch_header)) /   \
+     sizeof(struct history_record))
+
+BUILD_ASSERT(HISTORY_BATCH_RECORDS > 0,
+             "history batch size does not fit a single record");
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct history_batch {
+    struct history_batch_header header;
+    struct history_record records[HISTORY_BATCH_RECORDS];
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int history_init(void);
+static int scan(void);
+static int restore_rollups(void);
+static int read_batch(uint32_t seq, struct history_batch *out);
+static int flush_locked(void);
+static bool budget_allows(size_t len);
+static void slot_closed_cb(enum rollup_resolution res,
+                           const struct rollup_slot *slot, void *user_data);
+static void flush_work_handler(struct k_work *work);
+static void periodic_flush_work_handler(struct k_work *work);
+
+static inline uint32_t batch_id(uint32_t seq) {
+    return HISTORY_ID_BASE + (seq % HISTORY_MAX_BATCHES);
+}
+
+static inline size_t batch_len(const struct history_batch *b) {
+    return sizeof(b->header) + b->header.count * sizeof(b->records[0]);
+}
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(history, CONFIG_APP_LOG_LEVEL);
+
+static struct zms_fs fs;
+
+// Protects everything below and serializes writes
+static K_MUTEX_DEFINE(history_mu);
+static struct history_batch batch;
+static bool batch_stored; // an entry of batch.header.seq exists in flash
+static bool batch_dirty;
+static uint32_t oldest_seq;
+static size_t nr_batches; // batches in flash, including a partial batch
+static uint32_t budget_day;
+static uint32_t bytes_today;
+static uint32_t dropped_records;
+
+// Protects rd_batch, only one range read at a time
+static K_MUTEX_DEFINE(read_mu);
+static struct history_batch rd_batch;
+
+static K_WORK_DEFINE(flush_work, flush_work_handler);
+static K_WORK_DELAYABLE_DEFINE(periodic_flush_work,
+                               periodic_flush_work_handler);
+
+SYS_INIT(history_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+int history_read(enum rollup_resolution res, uint32_t from, uint32_t to,
+                 history_record_cb_t cb, void *user_data) {
+    if (res >= ROLLUP_RES_COUNT || cb == NULL) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&history_mu, K_FOREVER);
+    const uint32_t first = oldest_seq;
+    const uint32_t current = batch.header.seq;
+    k_mutex_unlock(&history_mu);
+
+    k_mutex_lock(&read_mu, K_FOREVER);
+    int nr_records = 0;
+    bool more = true;
+    for (uint32_t seq = first; more && seq - first <= current - first; seq++) {
+        if (seq == current) {
+            // The batch being filled is more recent than its flash copy
+            k_mutex_lock(&history_mu, K_FOREVER);
+            rd_batch = batch;
+            k_mutex_unlock(&history_mu);
+            // Filled up and flushed since the snapshot, use the flash copy
+            if (rd_batch.header.seq != current &&
+                read_batch(seq, &rd_batch) < 0) {
+                break;
+            }
+        } else if (read_batch(seq, &rd_batch) < 0) {
+            continue;
+        }
+
+        for (size_t i = 0; more && i < rd_batch.header.count; i++) {
+            const struct history_record *record = &rd_batch.records[i];
+            if (record->res != res || record->slot.start < from ||
+                record->slot.start > to) {
+                continue;
+            }
+            nr_records++;
+            more = cb(record, user_data);
+        }
+    }
+    k_mutex_unlock(&read_mu);
+
+    return nr_records;
+}
+
+int history_flush(void) {
+    k_mutex_lock(&history_mu, K_FOREVER);
+    int ret = flush_locked();
+    k_mutex_unlock(&history_mu);
+    return ret;
+}
+
+void history_get_stats(struct history_stats *stats) {
+    k_mutex_lock(&history_mu, K_FOREVER);
+    stats->seq = batch.header.seq;
+    stats->nr_batches = nr_batches;
+    stats->pending = batch_dirty ? batch.header.count : 0;
+    stats->bytes_today = bytes_today;
+    stats->dropped_records = dropped_records;
+    k_mutex_unlock(&history_mu);
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static int history_init(void) {
+    int ret;
+    struct flash_pages_info info;
+
+    fs.flash_device = FIXED_PARTITION_DEVICE(HISTORY_PARTITION);
+    if (!device_is_ready(fs.flash_device)) {
+        LOG_ERR("history flash device not ready");
+        return -ENODEV;
+    }
+    fs.offset = FIXED_PARTITION_OFFSET(HISTORY_PARTITION);
+    ret = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+    if (ret < 0) {
+        LOG_ERR("could not get flash page info: %d", ret);
+        return ret;
+    }
+    fs.sector_size = info.size;
+    fs.sector_count = FIXED_PARTITION_SIZE(HISTORY_PARTITION) / info.size;
+
+    ret = zms_mount(&fs);
+    if (ret < 0) {
+        LOG_ERR("could not mount history: %d", ret);
+        return ret;
+    }
+
+    const int64_t start = k_uptime_get();
+    ret = scan();
+    if (ret < 0) {
+        return ret;
+    }
+    ret = restore_rollups();
+    LOG_INF("restored %d records from %u batches in %lld ms", ret,
+            (unsigned int)nr_batches, k_uptime_get() - start);
+
+    rollup_set_callback(slot_closed_cb, NULL);
+    k_work_schedule(&periodic_flush_work,
+                    K_MINUTES(CONFIG_APP_HISTORY_FLUSH_INTERVAL));
+    return 0;
+}
+
+/* Find the oldest and newest batch by reading only the batch headers */
+static int scan(void) {
+    struct history_batch_header header;
+    struct history_batch_header newest = {0};
+    bool found = false;
+    uint32_t newest_seq = 0;
+
+    for (uint32_t i = 0; i < HISTORY_MAX_BATCHES; i++) {
+        ssize_t rc = zms_read(&fs, HISTORY_ID_BASE + i, &header,
+                              sizeof(header));
+        if (rc != sizeof(header) || header.magic != HISTORY_MAGIC ||
+            header.count > HISTORY_BATCH_RECORDS ||
+            batch_id(header.seq) != HISTORY_ID_BASE + i) {
+            continue;
+        }
+        if (!found || (int32_t)(header.seq - newest_seq) > 0) {
+            newest_seq = header.seq;
+            newest = header;
+        }
+        if (!found || (int32_t)(header.seq - oldest_seq) < 0) {
+            oldest_seq = header.seq;
+        }
+        found = true;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    if (!found) {
+        oldest_seq = 0;
+        nr_batches = 0;
+        return 0;
+    }
+    nr_batches = MIN(newest_seq - oldest_seq + 1, HISTORY_MAX_BATCHES);
+    budget_day = newest.day;
+    bytes_today = newest.day_bytes;
+
+    // Keep filling a partial newest batch so no ID is wasted
+    if (read_batch(newest_seq, &batch) == 0 &&
+        batch.header.count < HISTORY_BATCH_RECORDS) {
+        batch_stored = true;
+        return 0;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.header.seq = newest_seq + 1;
+    return 0;
+}
+
+static int restore_rollups(void) {
+    int nr_records = 0;
+
+    k_mutex_lock(&read_mu, K_FOREVER);
+    for (uint32_t seq = oldest_seq; seq - oldest_seq < nr_batches; seq++) {
+        if (read_batch(seq, &rd_batch) < 0) {
+            continue;
+        }
+        for (size_t i = 0; i < rd_batch.header.count; i++) {
+            const struct history_record *record = &rd_batch.records[i];
+            if (rollup_restore(record->res, &record->slot) == 0) {
+                nr_records++;
+            }
+        }
+    }
+    k_mutex_unlock(&read_mu);
+
+    return nr_records;
+}
+
+static int read_batch(uint32_t seq, struct history_batch *out) {
+    ssize_t rc = zms_read(&fs, batch_id(seq), out, sizeof(*out));
+    if (rc < (ssize_t)sizeof(out->header)) {
+        return rc < 0 ? rc : -ENOENT;
+    }
+    if (out->header.magic != HISTORY_MAGIC || out->header.seq != seq ||
+        out->header.count > HISTORY_BATCH_RECORDS || rc != batch_len(out)) {
+        return -ENOENT;
+    }
+    uint32_t crc = crc32_ieee((const uint8_t *)out->records,
+                              out->header.count * sizeof(out->records[0]));
+    if (crc != out->header.crc) {
+        LOG_WRN("batch %u has a bad crc", seq);
+        return -EILSEQ;
+    }
+    return 0;
+}
+
+/* Must be called with history_mu held */
+static int flush_locked(void) {
+    if (!batch_dirty) {
+        return 0;
+    }
+
+    const bool full = batch.header.count == HISTORY_BATCH_RECORDS;
+    const size_t len = batch_len(&batch);
+    if (!budget_allows(len)) {
+        if (!full) {
+            // Retry on the next flush, the records are safe in RAM for now
+            return -EDQUOT;
+        }
+        LOG_WRN("daily write budget exceeded, dropping %u records",
+                batch.header.count);
+        dropped_records += batch.header.count;
+        batch.header.count = 0;
+        batch_dirty = false;
+        return -EDQUOT;
+    }
+
+    batch.header.magic = HISTORY_MAGIC;
+    batch.header.day = budget_day;
+    batch.header.day_bytes = bytes_today + len;
+    batch.header.crc =
+        crc32_ieee((const uint8_t *)batch.records,
+                   batch.header.count * sizeof(batch.records[0]));
+    ssize_t rc = zms_write(&fs, batch_id(batch.header.seq), &batch, len);
+    if (rc < 0) {
+        LOG_ERR("could not write batch %u: %d", batch.header.seq, (int)rc);
+        return rc;
+    }
+    bytes_today += len;
+    batch_dirty = false;
+
+    if (!batch_stored) {
+        // The ID of the oldest batch was just reused
+        batch_stored = true;
+        if (nr_batches == HISTORY_MAX_BATCHES) {
+            oldest_seq++;
+        } else {
+            if (nr_batches == 0) {
+                oldest_seq = batch.header.seq;
+            }
+            nr_batches++;
+        }
+    }
+
+    if (full) {
+        const uint32_t seq = batch.header.seq + 1;
+        memset(&batch, 0, sizeof(batch));
+        batch.header.seq = seq;
+        batch_stored = false;
+    }
+    return 0;
+}
+
+/* Must be called with history_mu held */
+static bool budget_allows(size_t len) {
+    return bytes_today + len <= CONFIG_APP_HISTORY_DAILY_WRITE_BUDGET;
+}
+
+static void slot_closed_cb(enum rollup_resolution res,
+                           const struct rollup_slot *slot, void *user_data) {
+    ARG_UNUSED(user_data);
+    // Minute slots would wear the flash for little value
+    if (res == ROLLUP_RES_1M) {
+        return;
+    }
+
+    // Slots close in time order, a day only ever moves forward
+    const uint32_t day = (slot->start + rollup_period(res)) / HISTORY_DAY_S;
+
+    k_mutex_lock(&history_mu, K_FOREVER);
+    if ((int32_t)(day - budget_day) > 0) {
+        budget_day = day;
+        bytes_today = 0;
+    }
+    if (batch.header.count == HISTORY_BATCH_RECORDS) {
+        // Flush of the full batch has not run or failed
+        dropped_records++;
+    } else {
+        struct history_record *record = &batch.records[batch.header.count++];
+        memset(record, 0, sizeof(*record));
+        record->res = res;
+        record->slot = *slot;
+        batch_dirty = true;
+    }
+    const bool full = batch.header.count == HISTORY_BATCH_RECORDS;
+    k_mutex_unlock(&history_mu);
+
+    if (full) {
+        // Flash writes are slow, keep them off the telegram thread
+        k_work_submit(&flush_work);
+    }
+}
+
+static void flush_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+    (void)history_flush();
+}
+
+static void periodic_flush_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+    (void)history_flush();
+    k_work_schedule(&periodic_flush_work,
+                    K_MINUTES(CONFIG_APP_HISTORY_FLUSH_INTERVAL));
+}
@@ -0,0 +1,76 @@
+/**
+ * @file history.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Persistent history of completed rollup slots
+ *
+ */
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "rollup.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct history_record {
+    uint8_t res; // enum rollup_resolution
+    uint8_t reserved[7];
+    struct rollup_slot slot;
+};
+
+struct history_stats {
+    uint32_t seq;             // sequence number of the batch being filled
+    size_t nr_batches;        // batches stored in flash
+    size_t pending;           // records not yet written to flash
+    uint32_t bytes_today;     // bytes written in the current budget day
+    uint32_t dropped_records; // records dropped due to the write budget
+};
+
+/**
+ * Called for every record read, return false to stop reading
+ */
+typedef bool (*history_record_cb_t)(const struct history_record *record,
+                                    void *user_data);
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Read the records of a resolution with a start in [from, to], oldest first
+ *
+ * Batches are read from flash one at a time so only a single batch is held in
+ * RAM, records which are not flushed yet are included.
+ *
+ * @param res resolution of the records to read
+ * @param from unix timestamp of the first slot start to include
+ * @param to unix timestamp of the last slot start to include
+ * @param cb callback called for each record
+ * @param user_data passed into cb
+ * @return number of records read or negative errno
+ */
+int history_read(enum rollup_resolution res, uint32_t from, uint32_t to,
+                 history_record_cb_t cb, void *user_data);
+
+/**
+ * Write the pending records to flash regardless of the batch being full
+ */
+int history_flush(void);
+
+/**
+ * Get the statistics of the history store
+ */
+void history_get_stats(struct history_stats *stats);
+
+#endif // __HISTORY_H__
@@ -2,6 +2,7 @@
 #include "http.h"
 
 #include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -55,6 +56,20 @@ int http_encoder_append(http_encoder_ctx_t *ctx, const char *data, size_t len) {
     return 0;
 }
 
+int http_encoder_appendf(http_encoder_ctx_t *ctx, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int ret = vsnprintf(&ctx->buf[ctx->offs], ctx->len - ctx->offs, format,
+                        args);
+    va_end(args);
+    if (ret < 0 || (size_t)ret >= ctx->len - ctx->offs) {
+        ctx->buf[ctx->offs] = '\0';
+        return -ENOMEM;
+    }
+    ctx->offs += ret;
+    return 0;
+}
+
 int http_encoder_append_header(http_encoder_ctx_t *ctx, const char *key,
                                             const char *value) {
     int ret =
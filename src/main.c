@@ -8,9 +8,23 @@
  * Includes
  *****************************************************************************/
 
+#include "api.h"
+#include "capture.h"
+#include "debug.h"
+#include "demand.h"
+#include "http.h"
+#include "modbus_server.h"
+#include "mqtt_pub.h"
+#include "multicast.h"
+#include "passthrough.h"
+#include "rollup.h"
 #include "server.h"
+#include "trace.h"
+#include "upload.h"
 
+#include <dsmr_p1/bus.h>
 #include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/latency.h>
 
 #include <sys/errno.h>
 #include <zephyr/app_version.h>
@@ -53,7 +67,39 @@ enum main_event {
 #define LED_ON_TIME K_MSEC(100)
 #define WIFI_AP_DISABLE_TIMEOUT K_MINUTES(2)
 
+#define BUS_STATS_MAX_LEN 1024
+#define RX_STATS_MAX_LEN 256
+// Longest OBIS code looked up by /obis/, such as 0-1:24.2.1
+#define OBIS_CODE_MAX_LEN 32
+#define LATENCY_STATS_MAX_LEN                                                  \
+    (16 + DSMR_P1_LATENCY_STAGE_COUNT * (96 + 11 * DSMR_P1_LATENCY_BUCKETS))
+
+BUILD_ASSERT(CONFIG_APP_MAIN_METER < DSMR_P1_NUM_PORTS,
+             "CONFIG_APP_MAIN_METER has no dsmr,p1 node");
+
+/*
+ * Frames of the bus pool in use at the same time. Per port one is being
+ * received into, two wait in the receive queue of the module and one is the
+ * last telegram served by /data. One is being published, and one is held by
+ * an HTTP response. The MQTT and upload subscribers hold their queue of one
+ * and the frame being handled, a passthrough client the telegram it is
+ * sending on top of the latest one.
+ */
+#ifdef CONFIG_APP_PASSTHROUGH
+#define PASSTHROUGH_FRAMES (CONFIG_APP_PASSTHROUGH_MAX_CLIENTS + 1)
+#else
+#define PASSTHROUGH_FRAMES 0
+#endif
+#define BUS_FRAMES_NEEDED                                                      \
+    (4 * DSMR_P1_NUM_PORTS + 2 + 2 * IS_ENABLED(CONFIG_APP_MQTT) +             \
+     2 * IS_ENABLED(CONFIG_APP_UPLOAD) + PASSTHROUGH_FRAMES)
+
+BUILD_ASSERT(CONFIG_DSMR_P1_BUS_FRAMES >= BUS_FRAMES_NEEDED,
+             "CONFIG_DSMR_P1_BUS_FRAMES is below the frames the app holds");
+
+#ifdef CONFIG_WATCHDOG
 static const struct device *wdt = DEVICE_DT_GET(DT_ALIAS(watchdog0));
+#endif
 static const struct gpio_dt_spec led_gpio =
     GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios);
 
@@ -91,10 +137,13 @@ static const struct json_obj_descr config_descr[] = {
  * Private Function Prototypes
  *****************************************************************************/
 
+#ifdef CONFIG_WATCHDOG
 static int init_wdt(void);
 static void wdt_feed_timeout_cb(struct k_timer *timer);
+#endif
 static void led_disable_timeout_cb(struct k_timer *timer);
 
+#ifdef CONFIG_WIFI
 static void net_mgmt_event_static_handler_cb(uint64_t mgmt_event,
                                              struct net_if *iface, void *info,
                                              size_t info_length,
@@ -110,11 +159,16 @@ static int enable_ap_mode(void);
 static int disable_ap_mode(void);
 static void enable_dhcpv4_server(struct net_if *iface);
 static void disable_dhcpv4_server(struct net_if *iface);
+#endif
 
 static void apply_config(struct config new, int64_t new_fields_bitmap);
+static int meter_from_request(const struct server_request *req);
 
-static void telegram_received_cb(const uint8_t *data, size_t len,
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
                                  void *user_data);
+static void demand_changed_cb(uint32_t changes,
+                              const struct demand_state *state,
+                              void *user_data);
 
 static int resource_handle_index(const struct server_request *req,
                                  struct server_response *res);
@@ -125,6 +179,20 @@ static int resource_handle_favicon(const struct server_request *req,
 static int resource_handle_data(const struct server_request *req,
                                 struct server_response *res);
 static void resource_handle_data_on_done(int err, void *user_data);
+static int resource_handle_obis(const struct server_request *req,
+                                struct server_response *res);
+static void resource_handle_obis_on_done(int err, void *user_data);
+static int resource_handle_bus_stats(const struct server_request *req,
+                                     struct server_response *res);
+static void resource_handle_bus_stats_on_done(int err, void *user_data);
+static int resource_handle_rx_stats(const struct server_request *req,
+                                    struct server_response *res);
+static void resource_handle_rx_stats_on_done(int err, void *user_data);
+#ifdef CONFIG_DSMR_P1_LATENCY
+static int resource_handle_latency_stats(const struct server_request *req,
+                                         struct server_response *res);
+static void resource_handle_latency_stats_on_done(int err, void *user_data);
+#endif
 static int resource_handle_version(const struct server_request *req,
                                    struct server_response *res);
 static int resource_handle_config(const struct server_request *req,
@@ -139,23 +207,34 @@ LOG_MODULE_REGISTER(main, CONFIG_APP_LOG_LEVEL);
 
 static K_EVENT_DEFINE(main_event);
 
-static K_TIMER_DEFINE(wdt_feed_timer, wdt_feed_timeout_cb, NULL);
 static K_TIMER_DEFINE(led_disable_timer, led_disable_timeout_cb, NULL);
+
+#ifdef CONFIG_WATCHDOG
+static K_TIMER_DEFINE(wdt_feed_timer, wdt_feed_timeout_cb, NULL);
+static int wdt_channel_id = 0;
+#endif
+
+#ifdef CONFIG_WIFI
 static K_TIMER_DEFINE(wifi_ap_disable_timer, wifi_ap_disable_timeout_cb, NULL);
 static K_TIMER_DEFINE(wifi_reconnect_timer, wifi_reconnect_timeout_cb, NULL);
 
 NET_MGMT_REGISTER_EVENT_HANDLER(wifi_net_mgmt_cb, NET_MGMT_EVENT_WIFI_SET,
                                 net_mgmt_event_static_handler_cb, NULL);
-static int wdt_channel_id = 0;
+#endif
 
-static size_t last_telegram_len = 0;
-static uint8_t last_telegram[DSMR_P1_TELEGRAM_MAX_SIZE] = {0};
+DSMR_P1_LISTENER_DEFINE(main_listener, DSMR_P1_PORT_ANY,
+                        telegram_listener_cb, NULL);
+
+// Reference to the last frame of every meter, served on /data and /obis/
+static const struct dsmr_p1_frame *last_frames[DSMR_P1_NUM_PORTS];
 static K_MUTEX_DEFINE(telegram_mu);
 
 static struct config config = {};
 
+#ifdef CONFIG_WIFI
 static struct net_if *sta_iface = NULL;
 static struct net_if *ap_iface = NULL;
+#endif
 
 /******************************************************************************
  * Public Functions
@@ -164,12 +243,15 @@ static struct net_if *ap_iface = NULL;
 int main(void) {
     int ret;
 
+#ifdef CONFIG_WATCHDOG
     ret = init_wdt();
     if (ret < 0) {
         LOG_ERR("failed to init wdt");
         return ret;
     }
+#endif
 
+#ifdef CONFIG_WIFI
     sta_iface = net_if_get_wifi_sta();
     if (!sta_iface) {
         LOG_INF("STA iface: not initialized");
@@ -181,6 +263,7 @@ int main(void) {
         LOG_INF("AP iface: not initialized");
         return -EIO;
     }
+#endif
 
     if (!gpio_is_ready_dt(&led_gpio)) {
         LOG_ERR("led0 is not ready");
@@ -192,50 +275,90 @@ int main(void) {
         return ret;
     }
 
+#ifdef CONFIG_WIFI
     if (!wifi_credentials_is_empty()) {
         wifi_credentials_for_each_ssid(&update_config_from_wifi_cred, NULL);
     }
 
     autoconnect_wifi();
+#endif
     server_add_resource("/", &resource_handle_index);
     server_add_resource("/main.js", &resource_handle_main_js);
     server_add_resource("/favicon.ico", &resource_handle_favicon);
     server_add_resource("/data", &resource_handle_data);
+    server_add_resource("/obis/", &resource_handle_obis);
+    server_add_resource("/bus/stats", &resource_handle_bus_stats);
+    server_add_resource("/rx/stats", &resource_handle_rx_stats);
     server_add_resource("/version", &resource_handle_version);
     server_add_resource("/config", &resource_handle_config);
+    server_add_resource("/rollups", &rollup_handle_request);
+    server_add_resource("/demand", &demand_handle_request);
+    server_add_resource("/api/v1/telegram", &api_handle_telegram_request);
+    server_add_resource("/api/v1/telegram/stats", &api_handle_stats_request);
+    server_add_resource("/metrics", &api_handle_metrics_request);
+#ifdef CONFIG_APP_CAPTURE
+    server_add_resource("/capture", &capture_handle_request);
+    server_add_resource("/capture/stats", &capture_handle_stats_request);
+#endif
+#ifdef CONFIG_APP_MQTT
+    server_add_resource("/mqtt/stats", &mqtt_pub_handle_stats_request);
+#endif
+#ifdef CONFIG_APP_UPLOAD
+    server_add_resource("/upload/stats", &upload_handle_stats_request);
+#endif
+#ifdef CONFIG_APP_MODBUS
+    server_add_resource("/modbus/stats", &modbus_server_handle_stats_request);
+#endif
+#ifdef CONFIG_APP_MULTICAST
+    server_add_resource("/multicast/stats", &multicast_handle_stats_request);
+#endif
+#ifdef CONFIG_APP_PASSTHROUGH
+    server_add_resource("/passthrough/stats",
+                        &passthrough_handle_stats_request);
+#endif
+#ifdef CONFIG_DSMR_P1_LATENCY
+    server_add_resource("/stats", &resource_handle_latency_stats);
+#endif
+#ifdef CONFIG_APP_DEBUG_THREADS
+    server_add_resource("/debug/threads", &debug_handle_threads_request);
+#endif
     server_start();
 
+#ifdef CONFIG_WIFI
     ret = enable_ap_mode();
     if (ret < 0) {
         LOG_ERR("failed to enable AP: %d", ret);
         return ret;
     }
+#endif
 
-    ret = dsmr_p1_set_callback(telegram_received_cb, NULL);
-    if (ret < 0) {
-        LOG_ERR("failed to set dsmr p1 callback: %d", ret);
-        return ret;
-    }
+    demand_set_callback(demand_changed_cb, NULL);
     ret = dsmr_p1_enable();
     if (ret < 0) {
         LOG_WRN("failed to enable dsmr p1: %d", ret);
     }
 
+#ifdef CONFIG_WATCHDOG
     k_timer_start(&wdt_feed_timer, WDT_FEED_TIMEOUT, K_FOREVER);
+#endif
 
     uint32_t events;
     while (true) {
         events = k_event_wait(&main_event, UINT32_MAX, true, K_FOREVER);
+        TRACE_BEGIN("main_events", events);
         LOG_DBG("events: 0x%04x", events);
 
+#ifdef CONFIG_WATCHDOG
         if (events & MAIN_EVENT_WDT_FEED) {
             wdt_feed(wdt, wdt_channel_id);
             k_timer_start(&wdt_feed_timer, WDT_FEED_TIMEOUT, K_FOREVER);
         }
+#endif
         if (events & MAIN_EVENT_DSMR_TELEGRAM_RECEIVED) {
             gpio_pin_set_dt(&led_gpio, 1);
             k_timer_start(&led_disable_timer, LED_ON_TIME, K_FOREVER);
         }
+#ifdef CONFIG_WIFI
         if (events & MAIN_EVENT_WIFI_RECONNECT) {
             autoconnect_wifi();
         }
@@ -248,6 +371,8 @@ int main(void) {
         if (events & MAIN_EVENT_WIFI_AP_DISABLE) {
             disable_ap_mode();
         }
+#endif
+        TRACE_END("main_events", events);
     }
 
     return 0;
@@ -257,6 +382,7 @@ int main(void) {
  * Private Functions
  *****************************************************************************/
 
+#ifdef CONFIG_WATCHDOG
 static int init_wdt(void) {
     int ret;
     if (!device_is_ready(wdt)) {
@@ -292,12 +418,14 @@ static void wdt_feed_timeout_cb(struct k_timer *timer) {
     ARG_UNUSED(timer);
     k_event_post(&main_event, MAIN_EVENT_WDT_FEED);
 }
+#endif
 
 static void led_disable_timeout_cb(struct k_timer *timer) {
     ARG_UNUSED(timer);
     gpio_pin_set_dt(&led_gpio, 0);
 }
 
+#ifdef CONFIG_WIFI
 static void net_mgmt_event_static_handler_cb(uint64_t mgmt_event,
                                              struct net_if *iface, void *info,
                                              size_t info_length,
@@ -472,6 +600,7 @@ static void disable_dhcpv4_server(struct net_if *iface) {
     }
     LOG_INF("DHCPv4 server stopped...");
 }
+#endif
 
 static void apply_config(struct config new, int64_t new_fields_bitmap) {
     LOG_INF("config update with 0x%llx", new_fields_bitmap);
@@ -482,18 +611,48 @@ static void apply_config(struct config new, int64_t new_fields_bitmap) {
     }
 }
 
-static void telegram_received_cb(const uint8_t *data, size_t len,
+static int meter_from_request(const struct server_request *req) {
+    char param[4];
+    if (server_request_get_query_param(req, "meter", param, sizeof(param)) <
+        0) {
+        return 0;
+    }
+    char *end;
+    unsigned long meter = strtoul(param, &end, 10);
+    if (end == param || *end != '\0' || meter >= DSMR_P1_NUM_PORTS) {
+        return -ENOENT;
+    }
+    return meter;
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
                                  void *user_data) {
+    ARG_UNUSED(user_data);
     k_event_post(&main_event, MAIN_EVENT_DSMR_TELEGRAM_RECEIVED);
 
-    int ret = k_mutex_lock(&telegram_mu, K_NO_WAIT);
-    if (ret < 0) {
-        LOG_ERR("could not lock telegram mutex: %d", ret);
-        return;
-    }
-    last_telegram_len = MIN(len, sizeof(last_telegram));
-    memcpy(last_telegram, data, last_telegram_len);
+    dsmr_p1_frame_ref(frame);
+    TRACE_BEGIN("telegram_mu", frame->port);
+    k_mutex_lock(&telegram_mu, K_FOREVER);
+    const struct dsmr_p1_frame *old = last_frames[frame->port];
+    last_frames[frame->port] = frame;
     k_mutex_unlock(&telegram_mu);
+    TRACE_END("telegram_mu", frame->port);
+    if (old) {
+        dsmr_p1_frame_unref(old);
+    }
+}
+
+static void demand_changed_cb(uint32_t changes,
+                              const struct demand_state *state,
+                              void *user_data) {
+    ARG_UNUSED(user_data);
+    if (changes & DEMAND_CHANGE_MONTH_PEAK) {
+        LOG_INF("new monthly peak demand: %d W",
+                (int)(state->current_month.peak.demand * 1000));
+    }
+#ifdef CONFIG_APP_MQTT
+    mqtt_pub_demand(changes, state);
+#endif
 }
 
 static int resource_handle_index(const struct server_request *req,
@@ -551,25 +710,267 @@ static int resource_handle_data(const struct server_request *req,
         return 0;
     }
 
-    int ret = k_mutex_lock(&telegram_mu, K_FOREVER);
-    if (ret < 0) {
-        return ret;
+    const int meter = meter_from_request(req);
+    if (meter < 0) {
+        res->status = HTTP_404_NOT_FOUND;
+        return 0;
+    }
+
+    // Hold a reference while sending rather than the lock
+    TRACE_BEGIN("telegram_mu", meter);
+    k_mutex_lock(&telegram_mu, K_FOREVER);
+    const struct dsmr_p1_frame *frame = last_frames[meter];
+    if (frame) {
+        dsmr_p1_frame_ref(frame);
+    }
+    k_mutex_unlock(&telegram_mu);
+    TRACE_END("telegram_mu", meter);
+
+    if (!frame) {
+        // Nothing received from the meter yet
+        res->status = HTTP_503_SERVICE_UNAVAILABLE;
+        return 0;
     }
 
     res->status = HTTP_200_OK;
     sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
                        (uint64_t)"text/plain", NULL);
-    res->body = last_telegram;
-    res->body_len = last_telegram_len;
+    res->body = frame->data;
+    res->body_len = frame->len;
     res->on_done = resource_handle_data_on_done;
+    res->user_data = (void *)frame;
     return 0;
 }
 
 static void resource_handle_data_on_done(int err, void *user_data) {
-    ARG_UNUSED(err);
-    ARG_UNUSED(user_data);
+    if (err == 0) {
+        dsmr_p1_latency_sent(user_data);
+    }
+    dsmr_p1_frame_unref(user_data);
+}
+
+static int resource_handle_obis(const struct server_request *req,
+                                struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    // Routed on the /obis/ prefix, the code follows it and clients escape
+    // its ':' as %3A
+    char code[OBIS_CODE_MAX_LEN];
+    int ret = server_url_decode(strrchr(req->url, '/') + 1, code,
+                                sizeof(code));
+    const int meter = meter_from_request(req);
+    if (ret <= 0 || meter < 0) {
+        res->status = HTTP_404_NOT_FOUND;
+        return 0;
+    }
+
+    TRACE_BEGIN("telegram_mu", meter);
+    k_mutex_lock(&telegram_mu, K_FOREVER);
+    const struct dsmr_p1_frame *frame = last_frames[meter];
+    if (frame) {
+        dsmr_p1_frame_ref(frame);
+    }
     k_mutex_unlock(&telegram_mu);
+    TRACE_END("telegram_mu", meter);
+    if (!frame) {
+        res->status = HTTP_503_SERVICE_UNAVAILABLE;
+        return 0;
+    }
+
+    // The value is sent from the frame, which is held until done
+    const uint8_t *value;
+    size_t value_len;
+    if (dsmr_p1_frame_value(frame, code, &value, &value_len) < 0) {
+        dsmr_p1_frame_unref(frame);
+        res->status = HTTP_404_NOT_FOUND;
+        return 0;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"text/plain", NULL);
+    res->body = (char *)value;
+    res->body_len = value_len;
+    res->on_done = resource_handle_obis_on_done;
+    res->user_data = (void *)frame;
+    return 0;
+}
+
+static void resource_handle_obis_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    dsmr_p1_frame_unref(user_data);
+}
+
+static int resource_handle_bus_stats(const struct server_request *req,
+                                     struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct dsmr_p1_bus_stats stats;
+    dsmr_p1_bus_get_stats(&stats);
+
+    char *payload = malloc(BUS_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = BUS_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(&enc,
+                                   "{\"ports\":%u,\"published\":%u,"
+                                   "\"no_frame\":%u,\"free\":%u,"
+                                   "\"full_bytes\":%u,\"delta_bytes\":%u,"
+                                   "\"subscribers\":[",
+                                   (uint32_t)dsmr_p1_port_count(),
+                                   stats.published, stats.no_frame, stats.free,
+                                   stats.full_bytes, stats.delta_bytes);
+    const char *sep = "";
+    STRUCT_SECTION_FOREACH(dsmr_p1_subscriber, sub) {
+        if (ret < 0) {
+            break;
+        }
+        ret = http_encoder_appendf(
+            &enc,
+            "%s{\"name\":\"%s\",\"port\":%d,\"delivered\":%u,"
+            "\"dropped\":%u}",
+            sep, sub->name, sub->port, (uint32_t)atomic_get(&sub->delivered),
+            (uint32_t)atomic_get(&sub->dropped));
+        sep = ",";
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "]}");
+    }
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = resource_handle_bus_stats_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+static void resource_handle_bus_stats_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static int resource_handle_rx_stats(const struct server_request *req,
+                                    struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct dsmr_p1_rx_stats stats;
+    dsmr_p1_get_rx_stats(&stats);
+
+    char *payload = malloc(RX_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = RX_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"received\":%u,\"overflow\":%u,\"framing\":%u,\"crc\":%u,"
+        "\"busy\":%u,\"rx_disabled\":%u,\"gaps\":%u,\"missed\":%u}",
+        stats.received, stats.lost[DSMR_P1_LOSS_OVERFLOW],
+        stats.lost[DSMR_P1_LOSS_FRAMING], stats.lost[DSMR_P1_LOSS_CRC],
+        stats.lost[DSMR_P1_LOSS_BUSY], stats.lost[DSMR_P1_LOSS_RX_DISABLED],
+        stats.gaps, stats.missed);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = resource_handle_rx_stats_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+static void resource_handle_rx_stats_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+#ifdef CONFIG_DSMR_P1_LATENCY
+static int resource_handle_latency_stats(const struct server_request *req,
+                                         struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    char *payload = malloc(LATENCY_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = LATENCY_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(&enc, "{\"stages\":[");
+    for (int i = 0; i < DSMR_P1_LATENCY_STAGE_COUNT && ret == 0; i++) {
+        struct dsmr_p1_latency_histogram histogram;
+        dsmr_p1_latency_get(i, &histogram);
+        ret = http_encoder_appendf(
+            &enc, "%s{\"name\":\"%s\",\"count\":%u,\"max_us\":%u,"
+                  "\"buckets\":[",
+            i ? "," : "", dsmr_p1_latency_stage_name(i), histogram.count,
+            histogram.max_us);
+        for (size_t b = 0; b < DSMR_P1_LATENCY_BUCKETS && ret == 0; b++) {
+            ret = http_encoder_appendf(&enc, "%s%u", b ? "," : "",
+                                       histogram.buckets[b]);
+        }
+        if (ret == 0) {
+            ret = http_encoder_appendf(&enc, "]}");
+        }
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, "]}");
+    }
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = resource_handle_latency_stats_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+static void resource_handle_latency_stats_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
 }
+#endif
 
 static int resource_handle_version(const struct server_request *req,
                                    struct server_response *res) {
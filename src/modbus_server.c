@@ -0,0 +1,446 @@
+/**
+ * @file modbus_server.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Modbus TCP server exposing the parsed telegram as registers
+ *
+ * PV inverters and battery controllers poll the grid power over Modbus TCP
+ * for zero-export control. The addresses are fixed, so the registers list the
+ * fields of the schema they hold, at the resolution of the meter. The register
+ * map is encoded in wire order once per telegram, so a request is answered
+ * with a bounded copy out of it. The server runs on its own thread above the
+ * HTTP server so HTTP load does not add to the response time.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "modbus_server.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/errno_private.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define MODBUS_MAX_CLIENTS CONFIG_APP_MODBUS_MAX_CLIENTS
+#define MODBUS_MBAP_LEN 7 // header up to and including the unit id
+#define MODBUS_ADU_MAX_LEN 260
+#define MODBUS_MAX_READ 125 // registers per read request
+#define MODBUS_STATS_MAX_LEN 128
+
+enum {
+    MODBUS_FC_READ_HOLDING_REGISTERS = 0x03,
+    MODBUS_FC_READ_INPUT_REGISTERS = 0x04,
+};
+
+enum {
+    MODBUS_EXC_ILLEGAL_FUNCTION = 0x01,
+    MODBUS_EXC_ILLEGAL_DATA_ADDRESS = 0x02,
+    MODBUS_EXC_ILLEGAL_DATA_VALUE = 0x03,
+};
+
+#define REGISTER_FIELD(name, nr_regs)                                          \
+    {MODBUS_REG_##name, nr_regs, DSMR_P1_FIELD_##name},
+
+// Clients are configured with the addresses of the table in the header
+BUILD_ASSERT(MODBUS_REG_POWER_FAILURES == 26 && MODBUS_REG_TIMESTAMP == 30 &&
+                 MODBUS_NR_REGISTERS == 34,
+             "the register map moved");
+
+enum {
+    POLL_LISTEN,
+    POLL_CLIENTS,
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct register_field {
+    enum modbus_register reg;
+    uint8_t nr_regs; // 1 or 2
+    enum dsmr_p1_field field;
+};
+
+struct client {
+    int fd;
+    size_t len;
+    uint8_t buf[MODBUS_ADU_MAX_LEN];
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void modbus_thread(void);
+static int setup_listen_socket(void);
+static void accept_client(int listen_fd);
+static void close_client(struct client *client);
+static void receive_client(struct client *client);
+static int handle_request(struct client *client, size_t len);
+static size_t read_registers(const uint8_t *req, size_t req_len,
+                             uint8_t *pdu);
+static void modbus_server_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(modbus_server, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(modbus_server_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+K_THREAD_DEFINE(modbus_server, CONFIG_APP_MODBUS_STACK_SIZE, modbus_thread,
+                NULL, NULL, NULL, CONFIG_APP_MODBUS_THREAD_PRIORITY, 0, 0);
+
+static const struct register_field register_fields[] = {
+    MODBUS_FIELD_REGISTERS(REGISTER_FIELD)};
+
+// Protects the registers and the statistics
+static K_MUTEX_DEFINE(modbus_mu);
+static uint8_t registers[MODBUS_NR_REGISTERS * 2]; // big endian
+static uint32_t sequence;
+static struct modbus_server_stats stats;
+
+// Only used from the Modbus thread
+static struct client clients[MODBUS_MAX_CLIENTS];
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void modbus_server_update(int64_t timestamp,
+                          const struct dsmr_p1_telegram *t) {
+    uint8_t map[sizeof(registers)] = {0};
+
+    for (size_t i = 0; i < ARRAY_SIZE(register_fields); i++) {
+        const struct register_field *r = &register_fields[i];
+        const int64_t value = dsmr_p1_field_value(t, r->field);
+
+        if (r->nr_regs == 2) {
+            sys_put_be32(value, &map[r->reg * 2]);
+        } else {
+            sys_put_be16(value, &map[r->reg * 2]);
+        }
+    }
+    const int64_t net =
+        dsmr_p1_field_value(t, DSMR_P1_FIELD_POWER_DELIVERED) -
+        dsmr_p1_field_value(t, DSMR_P1_FIELD_POWER_RECEIVED);
+    sys_put_be32(net, &map[MODBUS_REG_POWER_NET * 2]);
+    sys_put_be64(timestamp, &map[MODBUS_REG_TIMESTAMP * 2]);
+
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    // Skip 0 on wrap around, it marks a map without a telegram
+    sequence = sequence == UINT32_MAX ? 1 : sequence + 1;
+    sys_put_be32(sequence, &map[MODBUS_REG_SEQUENCE * 2]);
+    memcpy(registers, map, sizeof(registers));
+    k_mutex_unlock(&modbus_mu);
+}
+
+void modbus_server_get_stats(struct modbus_server_stats *out) {
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&modbus_mu);
+}
+
+int modbus_server_handle_stats_request(const struct server_request *req,
+                                       struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct modbus_server_stats s;
+    modbus_server_get_stats(&s);
+
+    char *payload = malloc(MODBUS_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = MODBUS_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"nr_clients\":%u,\"requests\":%u,\"exceptions\":%u,"
+        "\"max_request_us\":%u}",
+        s.nr_clients, s.requests, s.exceptions, s.max_request_us);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = modbus_server_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void modbus_thread(void) {
+    int ret;
+    struct zsock_pollfd fds[POLL_CLIENTS + MODBUS_MAX_CLIENTS];
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        clients[i].fd = -1;
+    }
+
+    int listen_fd = setup_listen_socket();
+    if (listen_fd < 0) {
+        return;
+    }
+    LOG_INF("listening on port %d", CONFIG_APP_MODBUS_PORT);
+
+    while (true) {
+        fds[POLL_LISTEN].fd = listen_fd;
+        fds[POLL_LISTEN].events = ZSOCK_POLLIN;
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            fds[POLL_CLIENTS + i].fd = clients[i].fd;
+            fds[POLL_CLIENTS + i].events = ZSOCK_POLLIN;
+            fds[POLL_CLIENTS + i].revents = 0;
+        }
+
+        ret = zsock_poll(fds, ARRAY_SIZE(fds), -1);
+        if (ret < 0) {
+            LOG_ERR("poll failed: %d", -*z_errno());
+            k_msleep(100);
+            continue;
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            struct client *client = &clients[i];
+            const short revents = fds[POLL_CLIENTS + i].revents;
+            if (client->fd < 0) {
+                continue;
+            }
+            if (revents & ZSOCK_POLLIN) {
+                receive_client(client);
+            } else if (revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP)) {
+                close_client(client);
+            }
+        }
+        if (fds[POLL_LISTEN].revents & ZSOCK_POLLIN) {
+            accept_client(listen_fd);
+        }
+    }
+}
+
+static int setup_listen_socket(void) {
+    int ret;
+    struct sockaddr_in addr = {
+        .sin_port = htons(CONFIG_APP_MODBUS_PORT),
+        .sin_family = AF_INET,
+    };
+
+    int fd = zsock_socket(addr.sin_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        ret = -*z_errno();
+        LOG_ERR("could not get socket: %d", ret);
+        return ret;
+    }
+
+    ret = zsock_bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret) {
+        ret = -*z_errno();
+        LOG_ERR("could not bind to socket: %d", ret);
+        goto close;
+    }
+
+    ret = zsock_listen(fd, MODBUS_MAX_CLIENTS);
+    if (ret) {
+        ret = -*z_errno();
+        LOG_ERR("could not listen to socket: %d", ret);
+        goto close;
+    }
+
+    return fd;
+
+close:
+    (void)zsock_close(fd);
+    return ret;
+}
+
+static void accept_client(int listen_fd) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = zsock_accept(listen_fd, (struct sockaddr *)&addr, &addrlen);
+    if (fd < 0) {
+        LOG_WRN("could not accept client: %d", -*z_errno());
+        return;
+    }
+
+    struct client *client = NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        if (clients[i].fd < 0) {
+            client = &clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        LOG_WRN("too many clients");
+        (void)zsock_close(fd);
+        return;
+    }
+
+    // Responses are single small segments, do not hold them back
+    int one = 1;
+    (void)zsock_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    client->fd = fd;
+    client->len = 0;
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    stats.nr_clients++;
+    k_mutex_unlock(&modbus_mu);
+    LOG_INF("client connected");
+}
+
+static void close_client(struct client *client) {
+    (void)zsock_close(client->fd);
+    client->fd = -1;
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    stats.nr_clients--;
+    k_mutex_unlock(&modbus_mu);
+    LOG_INF("client disconnected");
+}
+
+static void receive_client(struct client *client) {
+    ssize_t ret = zsock_recv(client->fd, &client->buf[client->len],
+                             sizeof(client->buf) - client->len,
+                             ZSOCK_MSG_DONTWAIT);
+    if (ret == 0 || (ret < 0 && *z_errno() != EAGAIN)) {
+        close_client(client);
+        return;
+    }
+    if (ret < 0) {
+        return;
+    }
+    client->len += ret;
+
+    // Clients may pipeline requests, answer every complete one
+    while (client->len >= MODBUS_MBAP_LEN) {
+        const uint16_t protocol = sys_get_be16(&client->buf[2]);
+        const uint16_t length = sys_get_be16(&client->buf[4]);
+        if (protocol != 0 || length < 2 ||
+            length > sizeof(client->buf) - (MODBUS_MBAP_LEN - 1)) {
+            LOG_WRN("invalid request header");
+            close_client(client);
+            return;
+        }
+
+        const size_t frame_len = MODBUS_MBAP_LEN - 1 + length;
+        if (client->len < frame_len) {
+            return;
+        }
+        if (handle_request(client, frame_len) < 0) {
+            close_client(client);
+            return;
+        }
+        client->len -= frame_len;
+        memmove(client->buf, &client->buf[frame_len], client->len);
+    }
+}
+
+static int handle_request(struct client *client, size_t len) {
+    const uint32_t start = k_cycle_get_32();
+    uint8_t res[MODBUS_ADU_MAX_LEN];
+
+    // Transaction id, protocol id and unit id are echoed
+    memcpy(res, client->buf, MODBUS_MBAP_LEN);
+    const size_t pdu_len =
+        read_registers(&client->buf[MODBUS_MBAP_LEN], len - MODBUS_MBAP_LEN,
+                       &res[MODBUS_MBAP_LEN]);
+    sys_put_be16(pdu_len + 1, &res[4]);
+
+    const size_t res_len = MODBUS_MBAP_LEN + pdu_len;
+    ssize_t ret = zsock_send(client->fd, res, res_len, ZSOCK_MSG_DONTWAIT);
+    if (ret < 0 || (size_t)ret != res_len) {
+        // A client not reading its responses is not worth blocking for
+        LOG_WRN("could not send response: %d", ret < 0 ? -*z_errno() : 0);
+        return -EIO;
+    }
+
+    const uint32_t us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    stats.requests++;
+    stats.exceptions += res[MODBUS_MBAP_LEN] & 0x80 ? 1 : 0;
+    stats.max_request_us = MAX(stats.max_request_us, us);
+    k_mutex_unlock(&modbus_mu);
+    return 0;
+}
+
+/* Answer a request PDU, returns the length of the response PDU */
+static size_t read_registers(const uint8_t *req, size_t req_len,
+                             uint8_t *pdu) {
+    const uint8_t function = req[0];
+    uint8_t exception;
+
+    if (function != MODBUS_FC_READ_HOLDING_REGISTERS &&
+        function != MODBUS_FC_READ_INPUT_REGISTERS) {
+        exception = MODBUS_EXC_ILLEGAL_FUNCTION;
+        goto exception;
+    }
+
+    const uint16_t address = req_len == 5 ? sys_get_be16(&req[1]) : 0;
+    const uint16_t count = req_len == 5 ? sys_get_be16(&req[3]) : 0;
+    if (count == 0 || count > MODBUS_MAX_READ) {
+        exception = MODBUS_EXC_ILLEGAL_DATA_VALUE;
+        goto exception;
+    }
+    if (address + count > MODBUS_NR_REGISTERS) {
+        exception = MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+        goto exception;
+    }
+
+    pdu[0] = function;
+    pdu[1] = count * 2;
+    k_mutex_lock(&modbus_mu, K_FOREVER);
+    memcpy(&pdu[2], &registers[address * 2], count * 2);
+    k_mutex_unlock(&modbus_mu);
+    return 2 + count * 2;
+
+exception:
+    pdu[0] = function | 0x80;
+    pdu[1] = exception;
+    return 2;
+}
+
+static void modbus_server_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    modbus_server_update(dsmr_p1_frame_time(frame), &frame->telegram);
+}
@@ -0,0 +1,133 @@
+/**
+ * @file modbus_server.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Modbus TCP server exposing the parsed telegram as registers
+ *
+ * The same read-only map is served as holding registers (function 0x03) and
+ * input registers (function 0x04), for any unit id. 32-bit values take two
+ * registers with the high word first, 64-bit values four.
+ *
+ * | Address | Regs | Type | Unit  | Value                                    |
+ * |---------|------|------|-------|------------------------------------------|
+ * |       0 |    2 | s32  | W     | net power, import positive               |
+ * |       2 |    2 | u32  | W     | power delivered (import)                 |
+ * |       4 |    2 | u32  | W     | power received (export)                  |
+ * |       6 |    1 | u16  | 0.1 V | voltage L1                               |
+ * |       7 |    1 | u16  | 0.1 V | voltage L2                               |
+ * |       8 |    1 | u16  | 0.1 V | voltage L3                               |
+ * |       9 |    1 | u16  | A     | current L1                               |
+ * |      10 |    1 | u16  | A     | current L2                               |
+ * |      11 |    1 | u16  | A     | current L3                               |
+ * |      12 |    2 | u32  | Wh    | energy delivered tariff 1                |
+ * |      14 |    2 | u32  | Wh    | energy delivered tariff 2                |
+ * |      16 |    2 | u32  | Wh    | energy received tariff 1                 |
+ * |      18 |    2 | u32  | Wh    | energy received tariff 2                 |
+ * |      20 |    1 | u16  |       | tariff indicator                         |
+ * |      21 |    1 | u16  |       | DSMR version                             |
+ * |      22 |    2 | u32  | W     | average demand of the current quarter    |
+ * |      24 |    2 | u32  | W     | maximum demand of this month             |
+ * |      26 |    2 | u32  |       | number of power failures                 |
+ * |      28 |    2 | u32  |       | telegram sequence number, 0 before the   |
+ * |         |      |      |       | first telegram                           |
+ * |      30 |    4 | s64  | s     | telegram timestamp, unix time            |
+ */
+
+#ifndef __MODBUS_SERVER_H__
+#define __MODBUS_SERVER_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// The registers of the fields of the schema in address order after
+// MODBUS_REG_POWER_NET, by the name of the field and the number of registers
+#define MODBUS_FIELD_REGISTERS(X)                                              \
+    X(POWER_DELIVERED, 2)                                                      \
+    X(POWER_RECEIVED, 2)                                                       \
+    X(L1_VOLTAGE, 1)                                                           \
+    X(L2_VOLTAGE, 1)                                                           \
+    X(L3_VOLTAGE, 1)                                                           \
+    X(L1_CURRENT, 1)                                                           \
+    X(L2_CURRENT, 1)                                                           \
+    X(L3_CURRENT, 1)                                                           \
+    X(ENERGY_DELIVERED_T1, 2)                                                  \
+    X(ENERGY_DELIVERED_T2, 2)                                                  \
+    X(ENERGY_RECEIVED_T1, 2)                                                   \
+    X(ENERGY_RECEIVED_T2, 2)                                                   \
+    X(TARIFF_INDICATOR, 1)                                                     \
+    X(VERSION, 1)                                                              \
+    X(AVERAGE_DEMAND, 2)                                                       \
+    X(MAXIMUM_DEMAND, 2)                                                       \
+    X(POWER_FAILURES, 2)
+
+#define MODBUS_LAYOUT_REGISTER(name, nr_regs) uint16_t name[nr_regs];
+#define MODBUS_ENUM_REGISTER(name, nr_regs)                                    \
+    MODBUS_REG_##name = offsetof(struct modbus_layout, name) / 2,
+
+// The addresses follow from the number of registers of the ones before
+struct modbus_layout {
+    uint16_t POWER_NET[2];
+    MODBUS_FIELD_REGISTERS(MODBUS_LAYOUT_REGISTER)
+    uint16_t SEQUENCE[2];
+    uint16_t TIMESTAMP[4];
+};
+
+enum modbus_register {
+    MODBUS_REG_POWER_NET = offsetof(struct modbus_layout, POWER_NET) / 2,
+    MODBUS_FIELD_REGISTERS(MODBUS_ENUM_REGISTER)
+    MODBUS_REG_SEQUENCE = offsetof(struct modbus_layout, SEQUENCE) / 2,
+    MODBUS_REG_TIMESTAMP = offsetof(struct modbus_layout, TIMESTAMP) / 2,
+    MODBUS_NR_REGISTERS = sizeof(struct modbus_layout) / 2,
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct modbus_server_stats {
+    uint32_t nr_clients;
+    uint32_t requests;       // requests answered
+    uint32_t exceptions;     // requests answered with an exception
+    uint32_t max_request_us; // longest time from request to response
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Refresh the register map from a parsed telegram
+ *
+ * The whole map is replaced at once, a read never mixes two telegrams.
+ *
+ * @param timestamp Time of the telegram in seconds
+ * @param telegram parsed telegram
+ */
+void modbus_server_update(int64_t timestamp,
+                          const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Get the statistics of the Modbus server
+ */
+void modbus_server_get_stats(struct modbus_server_stats *stats);
+
+/**
+ * HTTP resource serving the Modbus server statistics as JSON
+ */
+int modbus_server_handle_stats_request(const struct server_request *req,
+                                       struct server_response *res);
+
+#endif // __MODBUS_SERVER_H__
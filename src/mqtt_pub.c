@@ -0,0 +1,836 @@
+/**
+ * @file mqtt_pub.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief MQTT publisher of telegram fields
+ *
+ * Every numeric field of DSMR_P1_SCHEMA in a unit of power, energy, voltage
+ * or current is published retained on a topic named by its key below
+ * CONFIG_APP_MQTT_TOPIC_PREFIX, in the unit sent by the meter, with Home
+ * Assistant discovery configs sent once per boot. A field is only published
+ * when it moved more than the
+ * deadband of its kind, no sooner than CONFIG_APP_MQTT_MIN_INTERVAL and at
+ * least every CONFIG_APP_MQTT_MAX_INTERVAL seconds. The average demand of every
+ * completed quarter and every new monthly peak are published as they happen.
+ *
+ * Values are queued from the telegram callback into a bounded RAM queue which
+ * is drained by the MQTT thread, so values are kept during broker outages
+ * until the queue overflows and the oldest values are dropped. The client uses
+ * a custom transport which collects all publishes of one drain into a single
+ * TCP write.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "mqtt_pub.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/app_version.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/errno_private.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define MQTT_PUB_TOPIC_MAX_LEN 96
+#define MQTT_PUB_VALUE_MAX_LEN DSMR_P1_FIELD_FORMAT_MAX_LEN
+#define MQTT_PUB_TITLE_MAX_LEN 32
+#define MQTT_PUB_DISCOVERY_MAX_LEN 512
+#define MQTT_PUB_STATS_MAX_LEN 384
+#define MQTT_PUB_CONNECT_TIMEOUT_MS 5000
+#define MQTT_PUB_BUF_SIZE 256
+
+#define MQTT_PUB_STATUS_TOPIC CONFIG_APP_MQTT_TOPIC_PREFIX "/status"
+
+#define UTF8_LITERAL(literal)                                                  \
+    {.utf8 = (const uint8_t *)(literal), .size = sizeof(literal) - 1}
+
+enum field_kind {
+    FIELD_KIND_POWER,
+    FIELD_KIND_ENERGY,
+    FIELD_KIND_VOLTAGE,
+    FIELD_KIND_CURRENT,
+    FIELD_KIND_COUNT,
+};
+
+// The fields of the schema, numbered by enum dsmr_p1_field, come first
+enum field_id {
+    FIELD_SCHEMA_COUNT = DSMR_P1_FIELD_COUNT,
+    FIELD_DEMAND_QUARTER = FIELD_SCHEMA_COUNT,
+    FIELD_DEMAND_MONTH_PEAK,
+    FIELD_COUNT,
+};
+
+BUILD_ASSERT(FIELD_COUNT <= UINT8_MAX, "field ids must fit the queue records");
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct field_kind_info {
+    const char *unit; // as in the schema
+    const char *device_class;
+    const char *state_class;
+    int64_t deadband; // at the resolution of the meter
+};
+
+struct field {
+    const char *name;
+    const char *title; // NULL to derive it from the name
+    enum field_kind kind;
+    uint32_t scale;
+};
+
+struct field_state {
+    bool valid;
+    int64_t value;
+    int64_t timestamp;
+};
+
+struct queue_record_header {
+    uint8_t field;
+    uint8_t len;
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void mqtt_pub_thread(void);
+static int broker_connect(void);
+static void broker_abort(void);
+static void mqtt_evt_handler(struct mqtt_client *client,
+                             const struct mqtt_evt *evt);
+static int publish(const char *topic, const char *payload, size_t len);
+static int publish_discovery(void);
+static int publish_queue(void);
+static void queue_value(enum field_id id, const struct field *field,
+                        int64_t value);
+static bool field_get(enum field_id id, struct field *field);
+static void field_title(const struct field *field, char *buf, size_t len);
+static int send_all(const uint8_t *data, size_t len);
+static int batch_append(const uint8_t *data, size_t len);
+static int batch_flush(void);
+static void wake(void);
+static void mqtt_pub_handle_request_on_done(int err, void *user_data);
+
+/*
+ * Transport used by the MQTT library when CONFIG_MQTT_LIB_CUSTOM_TRANSPORT is
+ * enabled
+ */
+int mqtt_client_custom_transport_connect(struct mqtt_client *client);
+int mqtt_client_custom_transport_write(struct mqtt_client *client,
+                                       const uint8_t *data, uint32_t datalen);
+int mqtt_client_custom_transport_write_msg(struct mqtt_client *client,
+                                           const struct msghdr *message);
+int mqtt_client_custom_transport_read(struct mqtt_client *client,
+                                      uint8_t *data, uint32_t buflen,
+                                      bool shall_block);
+int mqtt_client_custom_transport_disconnect(struct mqtt_client *client);
+static void telegram_subscriber_cb(const struct dsmr_p1_frame *frame,
+                                   void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(mqtt_pub, CONFIG_APP_LOG_LEVEL);
+
+// Pushing may be slow, keep it off the P1 receive thread
+DSMR_P1_SUBSCRIBER_DEFINE(mqtt_pub_subscriber, CONFIG_APP_MAIN_METER,
+                          telegram_subscriber_cb, NULL, 1, 2048,
+                          CONFIG_APP_MQTT_THREAD_PRIORITY);
+
+K_THREAD_DEFINE(mqtt_pub, CONFIG_APP_MQTT_STACK_SIZE, mqtt_pub_thread, NULL,
+                NULL, NULL, CONFIG_APP_MQTT_THREAD_PRIORITY, 0, 0);
+
+static const struct field_kind_info kinds[FIELD_KIND_COUNT] = {
+    [FIELD_KIND_POWER] = {"kW", "power", "measurement",
+                          CONFIG_APP_MQTT_DEADBAND_POWER},
+    [FIELD_KIND_ENERGY] = {"kWh", "energy", "total_increasing",
+                           CONFIG_APP_MQTT_DEADBAND_ENERGY},
+    [FIELD_KIND_VOLTAGE] = {"V", "voltage", "measurement",
+                            CONFIG_APP_MQTT_DEADBAND_VOLTAGE},
+    [FIELD_KIND_CURRENT] = {"A", "current", "measurement",
+                            CONFIG_APP_MQTT_DEADBAND_CURRENT},
+};
+
+// Published besides the schema, the demand is tracked in W
+static const struct field demand_fields[] = {
+    [FIELD_DEMAND_QUARTER - FIELD_SCHEMA_COUNT] = {"demand_quarter",
+                                                    "Demand last quarter",
+                                                    FIELD_KIND_POWER, 1000},
+    [FIELD_DEMAND_MONTH_PEAK - FIELD_SCHEMA_COUNT] = {"demand_month_peak",
+                                                       "Monthly peak demand",
+                                                       FIELD_KIND_POWER, 1000},
+};
+
+// Protects the queue, the field states and the statistics
+static K_MUTEX_DEFINE(queue_mu);
+RING_BUF_DECLARE(queue, CONFIG_APP_MQTT_QUEUE_SIZE);
+static uint32_t queue_head_seq; // sequence number of the oldest record
+static struct field_state field_states[FIELD_COUNT];
+static struct mqtt_pub_stats stats;
+
+// Written on update to wake the thread out of poll
+static int wake_fds[2] = {-1, -1};
+
+// Only used from the MQTT thread
+static struct mqtt_client client;
+static struct sockaddr_storage broker;
+static uint8_t rx_buf[MQTT_PUB_BUF_SIZE];
+static uint8_t tx_buf[MQTT_PUB_BUF_SIZE];
+static int broker_fd = -1;
+static bool connected;
+static bool discovery_sent;
+
+static uint8_t batch_buf[CONFIG_APP_MQTT_BATCH_SIZE];
+static size_t batch_len;
+static bool batching;
+// Records of the queue being published, at least the largest record
+static uint8_t peek_buf[MAX(CONFIG_APP_MQTT_BATCH_SIZE,
+                            sizeof(struct queue_record_header) +
+                                MQTT_PUB_VALUE_MAX_LEN)];
+
+static struct mqtt_utf8 will_message = UTF8_LITERAL("offline");
+static struct mqtt_topic will_topic = {
+    .topic = UTF8_LITERAL(MQTT_PUB_STATUS_TOPIC),
+    .qos = MQTT_QOS_0_AT_MOST_ONCE,
+};
+static struct mqtt_utf8 user_name = UTF8_LITERAL(CONFIG_APP_MQTT_USERNAME);
+static struct mqtt_utf8 password = UTF8_LITERAL(CONFIG_APP_MQTT_PASSWORD);
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void mqtt_pub_update(int64_t timestamp,
+                     const struct dsmr_p1_telegram *telegram) {
+    const uint32_t start = k_cycle_get_32();
+    bool queued = false;
+
+    k_mutex_lock(&queue_mu, K_FOREVER);
+    for (enum field_id id = 0; id < FIELD_SCHEMA_COUNT; id++) {
+        struct field_state *state = &field_states[id];
+        struct field field;
+
+        if (!field_get(id, &field)) {
+            continue;
+        }
+        const int64_t value = dsmr_p1_field_value(telegram, id);
+        if (state->valid) {
+            const int64_t elapsed = timestamp - state->timestamp;
+            const int64_t delta = value - state->value;
+            const bool moved =
+                (delta < 0 ? -delta : delta) > kinds[field.kind].deadband;
+            if (elapsed < CONFIG_APP_MQTT_MIN_INTERVAL ||
+                (!moved && elapsed < CONFIG_APP_MQTT_MAX_INTERVAL)) {
+                stats.suppressed++;
+                continue;
+            }
+        }
+
+        state->valid = true;
+        state->value = value;
+        state->timestamp = timestamp;
+        queue_value(id, &field, value);
+        queued = true;
+    }
+    stats.updates++;
+    stats.update_cycles += k_cycle_get_32() - start;
+    k_mutex_unlock(&queue_mu);
+
+    if (queued) {
+        wake();
+    }
+}
+
+void mqtt_pub_demand(uint32_t changes, const struct demand_state *state) {
+    if (!(changes & (DEMAND_CHANGE_QUARTER | DEMAND_CHANGE_MONTH_PEAK))) {
+        return;
+    }
+
+    // Every change is an event of its own, not subject to the deadband
+    k_mutex_lock(&queue_mu, K_FOREVER);
+    if (changes & DEMAND_CHANGE_QUARTER) {
+        queue_value(FIELD_DEMAND_QUARTER,
+                    &demand_fields[FIELD_DEMAND_QUARTER - FIELD_SCHEMA_COUNT],
+                    (int64_t)(state->last.demand * 1000.0f + 0.5f));
+    }
+    if (changes & DEMAND_CHANGE_MONTH_PEAK) {
+        queue_value(
+            FIELD_DEMAND_MONTH_PEAK,
+            &demand_fields[FIELD_DEMAND_MONTH_PEAK - FIELD_SCHEMA_COUNT],
+            (int64_t)(state->current_month.peak.demand * 1000.0f + 0.5f));
+    }
+    k_mutex_unlock(&queue_mu);
+
+    wake();
+}
+
+void mqtt_pub_get_stats(struct mqtt_pub_stats *out) {
+    k_mutex_lock(&queue_mu, K_FOREVER);
+    *out = stats;
+    out->queued_bytes = ring_buf_size_get(&queue);
+    k_mutex_unlock(&queue_mu);
+}
+
+int mqtt_pub_handle_stats_request(const struct server_request *req,
+                                  struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct mqtt_pub_stats s;
+    mqtt_pub_get_stats(&s);
+
+    char *payload = malloc(MQTT_PUB_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = MQTT_PUB_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"connected\":%s,\"connects\":%u,\"published\":%u,"
+        "\"suppressed\":%u,\"dropped\":%u,\"batches\":%u,"
+        "\"queued_bytes\":%u,\"updates\":%u,\"update_ns\":%llu,"
+        "\"publish_ns\":%llu}",
+        s.connected ? "true" : "false", s.connects, s.published, s.suppressed,
+        s.dropped, s.batches, s.queued_bytes, s.updates,
+        s.updates ? k_cyc_to_ns_floor64(s.update_cycles / s.updates) : 0,
+        s.published ? k_cyc_to_ns_floor64(s.publish_cycles / s.published)
+                    : 0);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = mqtt_pub_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Custom Transport
+ *****************************************************************************/
+
+int mqtt_client_custom_transport_connect(struct mqtt_client *client) {
+    int ret;
+
+    int fd = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        return -*z_errno();
+    }
+
+    ret = zsock_connect(fd, (struct sockaddr *)client->broker,
+                        sizeof(struct sockaddr_in));
+    if (ret < 0) {
+        ret = -*z_errno();
+        (void)zsock_close(fd);
+        return ret;
+    }
+
+    broker_fd = fd;
+    batch_len = 0;
+    return 0;
+}
+
+int mqtt_client_custom_transport_write(struct mqtt_client *client,
+                                       const uint8_t *data, uint32_t datalen) {
+    ARG_UNUSED(client);
+    return batch_append(data, datalen);
+}
+
+int mqtt_client_custom_transport_write_msg(struct mqtt_client *client,
+                                           const struct msghdr *message) {
+    ARG_UNUSED(client);
+    int ret = 0;
+
+    size_t len = 0;
+    for (size_t i = 0; i < message->msg_iovlen; i++) {
+        len += message->msg_iov[i].iov_len;
+    }
+    // Keep a message in one write when it would not fit behind the batch
+    if (batch_len + len > sizeof(batch_buf)) {
+        ret = batch_flush();
+    }
+    for (size_t i = 0; ret == 0 && i < message->msg_iovlen; i++) {
+        ret = batch_append(message->msg_iov[i].iov_base,
+                           message->msg_iov[i].iov_len);
+    }
+    return ret;
+}
+
+int mqtt_client_custom_transport_read(struct mqtt_client *client,
+                                      uint8_t *data, uint32_t buflen,
+                                      bool shall_block) {
+    ARG_UNUSED(client);
+
+    ssize_t ret = zsock_recv(broker_fd, data, buflen,
+                             shall_block ? 0 : ZSOCK_MSG_DONTWAIT);
+    if (ret < 0) {
+        return -*z_errno();
+    }
+    return ret;
+}
+
+int mqtt_client_custom_transport_disconnect(struct mqtt_client *client) {
+    ARG_UNUSED(client);
+
+    int ret = zsock_close(broker_fd);
+    broker_fd = -1;
+    batch_len = 0;
+    return ret;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void mqtt_pub_thread(void) {
+    int ret;
+
+    if (strlen(CONFIG_APP_MQTT_BROKER_HOST) == 0) {
+        LOG_WRN("no broker configured");
+        return;
+    }
+
+    ret = zsock_socketpair(AF_UNIX, SOCK_STREAM, 0, wake_fds);
+    if (ret < 0) {
+        LOG_ERR("could not create wake socket pair: %d", -*z_errno());
+        return;
+    }
+
+    while (true) {
+        if (!connected) {
+            ret = broker_connect();
+            if (ret < 0) {
+                k_sleep(K_SECONDS(CONFIG_APP_MQTT_RECONNECT_INTERVAL));
+                continue;
+            }
+            if (!discovery_sent && publish_discovery() == 0) {
+                discovery_sent = true;
+            }
+        }
+
+        ret = publish_queue();
+        if (ret < 0) {
+            LOG_WRN("could not publish: %d", ret);
+            broker_abort();
+            continue;
+        }
+
+        struct zsock_pollfd fds[] = {
+            {.fd = broker_fd, .events = ZSOCK_POLLIN},
+            {.fd = wake_fds[0], .events = ZSOCK_POLLIN},
+        };
+        ret = zsock_poll(fds, ARRAY_SIZE(fds), mqtt_keepalive_time_left(&client));
+        if (ret < 0) {
+            LOG_ERR("poll failed: %d", -*z_errno());
+            broker_abort();
+            continue;
+        }
+
+        if (fds[1].revents & ZSOCK_POLLIN) {
+            uint8_t drain[8];
+            (void)zsock_recv(wake_fds[0], drain, sizeof(drain),
+                             ZSOCK_MSG_DONTWAIT);
+        }
+        if (fds[0].revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP | ZSOCK_POLLNVAL)) {
+            broker_abort();
+            continue;
+        }
+        if (fds[0].revents & ZSOCK_POLLIN) {
+            ret = mqtt_input(&client);
+            if (ret < 0) {
+                broker_abort();
+                continue;
+            }
+        }
+
+        ret = mqtt_live(&client);
+        if (ret < 0 && ret != -EAGAIN) {
+            broker_abort();
+        }
+    }
+}
+
+static int broker_connect(void) {
+    int ret;
+    struct zsock_addrinfo *ai;
+    const struct zsock_addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+
+    ret = zsock_getaddrinfo(CONFIG_APP_MQTT_BROKER_HOST,
+                            STRINGIFY(CONFIG_APP_MQTT_BROKER_PORT), &hints,
+                            &ai);
+    if (ret) {
+        LOG_WRN("could not resolve broker: %d", ret);
+        return -EHOSTUNREACH;
+    }
+    memcpy(&broker, ai->ai_addr, MIN(ai->ai_addrlen, sizeof(broker)));
+    zsock_freeaddrinfo(ai);
+
+    mqtt_client_init(&client);
+    client.broker = &broker;
+    client.evt_cb = mqtt_evt_handler;
+    client.client_id.utf8 = (const uint8_t *)CONFIG_APP_MQTT_CLIENT_ID;
+    client.client_id.size = strlen(CONFIG_APP_MQTT_CLIENT_ID);
+    client.user_name = user_name.size ? &user_name : NULL;
+    client.password = password.size ? &password : NULL;
+    client.protocol_version = MQTT_VERSION_3_1_1;
+    client.keepalive = CONFIG_APP_MQTT_KEEPALIVE;
+    client.will_topic = &will_topic;
+    client.will_message = &will_message;
+    client.will_retain = 1U;
+    client.rx_buf = rx_buf;
+    client.rx_buf_size = sizeof(rx_buf);
+    client.tx_buf = tx_buf;
+    client.tx_buf_size = sizeof(tx_buf);
+    client.transport.type = MQTT_TRANSPORT_CUSTOM;
+
+    ret = mqtt_connect(&client);
+    if (ret < 0) {
+        LOG_WRN("could not connect to broker: %d", ret);
+        return ret;
+    }
+
+    struct zsock_pollfd fd = {.fd = broker_fd, .events = ZSOCK_POLLIN};
+    ret = zsock_poll(&fd, 1, MQTT_PUB_CONNECT_TIMEOUT_MS);
+    if (ret > 0) {
+        (void)mqtt_input(&client);
+    }
+    if (!connected) {
+        LOG_WRN("broker did not accept connection");
+        broker_abort();
+        return -ECONNREFUSED;
+    }
+
+    k_mutex_lock(&queue_mu, K_FOREVER);
+    stats.connects++;
+    k_mutex_unlock(&queue_mu);
+
+    return publish(MQTT_PUB_STATUS_TOPIC, "online", strlen("online"));
+}
+
+static void broker_abort(void) {
+    if (broker_fd >= 0) {
+        (void)mqtt_abort(&client);
+    }
+    connected = false;
+    batching = false;
+}
+
+static void mqtt_evt_handler(struct mqtt_client *client,
+                             const struct mqtt_evt *evt) {
+    ARG_UNUSED(client);
+
+    switch (evt->type) {
+    case MQTT_EVT_CONNACK:
+        if (evt->result != 0) {
+            LOG_WRN("connection refused: %d", evt->result);
+            break;
+        }
+        LOG_INF("connected to broker");
+        connected = true;
+        break;
+    case MQTT_EVT_DISCONNECT:
+        LOG_INF("disconnected from broker: %d", evt->result);
+        connected = false;
+        break;
+    default:
+        break;
+    }
+
+    k_mutex_lock(&queue_mu, K_FOREVER);
+    stats.connected = connected;
+    k_mutex_unlock(&queue_mu);
+}
+
+static int publish(const char *topic, const char *payload, size_t len) {
+    const struct mqtt_publish_param param = {
+        .message.topic.topic.utf8 = (const uint8_t *)topic,
+        .message.topic.topic.size = strlen(topic),
+        .message.topic.qos = MQTT_QOS_0_AT_MOST_ONCE,
+        .message.payload.data = (uint8_t *)payload,
+        .message.payload.len = len,
+        .retain_flag = 1U,
+    };
+    return mqtt_publish(&client, &param);
+}
+
+static int publish_discovery(void) {
+    int ret = 0;
+    char topic[MQTT_PUB_TOPIC_MAX_LEN];
+    char title[MQTT_PUB_TITLE_MAX_LEN];
+
+    char *payload = malloc(MQTT_PUB_DISCOVERY_MAX_LEN);
+    if (!payload) {
+        return -ENOMEM;
+    }
+
+    batching = true;
+    for (enum field_id id = 0; ret == 0 && id < FIELD_COUNT; id++) {
+        struct field field;
+        http_encoder_ctx_t enc = {
+            .buf = payload,
+            .len = MQTT_PUB_DISCOVERY_MAX_LEN,
+        };
+
+        if (!field_get(id, &field)) {
+            continue;
+        }
+        const struct field_kind_info *kind = &kinds[field.kind];
+        field_title(&field, title, sizeof(title));
+        (void)snprintf(topic, sizeof(topic), "%s/sensor/%s/%s/config",
+                       CONFIG_APP_MQTT_DISCOVERY_PREFIX,
+                       CONFIG_APP_MQTT_CLIENT_ID, field.name);
+        ret = http_encoder_appendf(
+            &enc,
+            "{\"name\":\"%s\",\"unique_id\":\"%s_%s\","
+            "\"state_topic\":\"%s/%s\",\"availability_topic\":\"%s\","
+            "\"unit_of_measurement\":\"%s\",\"device_class\":\"%s\","
+            "\"state_class\":\"%s\",\"device\":{\"identifiers\":[\"%s\"],"
+            "\"name\":\"P1 DSMR\",\"sw_version\":\"%s\"}}",
+            title, CONFIG_APP_MQTT_CLIENT_ID, field.name,
+            CONFIG_APP_MQTT_TOPIC_PREFIX, field.name, MQTT_PUB_STATUS_TOPIC,
+            kind->unit, kind->device_class, kind->state_class,
+            CONFIG_APP_MQTT_CLIENT_ID, APP_VERSION_STRING);
+        if (ret == 0) {
+            ret = publish(topic, payload, enc.offs);
+        }
+    }
+    batching = false;
+    if (ret == 0) {
+        ret = batch_flush();
+    }
+
+    free(payload);
+    return ret;
+}
+
+static int publish_queue(void) {
+    int ret = 0;
+    char topic[MQTT_PUB_TOPIC_MAX_LEN];
+    const uint32_t start = k_cycle_get_32();
+    uint32_t published = 0;
+
+    while (ret == 0) {
+        // Publish a copy of the oldest records, they stay queued until the
+        // batch is on the wire so a failed write loses none of them
+        k_mutex_lock(&queue_mu, K_FOREVER);
+        const uint32_t seq = queue_head_seq;
+        const size_t peeked = ring_buf_peek(&queue, peek_buf, sizeof(peek_buf));
+        k_mutex_unlock(&queue_mu);
+        if (peeked == 0) {
+            break;
+        }
+
+        uint32_t nr_records = 0;
+        size_t offset = 0;
+        batching = true;
+        while (offset + sizeof(struct queue_record_header) <= peeked) {
+            struct queue_record_header header;
+            memcpy(&header, &peek_buf[offset], sizeof(header));
+            const size_t record_len = sizeof(header) + header.len;
+            if (offset + record_len > peeked) {
+                break;
+            }
+
+            struct field field;
+            (void)field_get(header.field, &field);
+            (void)snprintf(topic, sizeof(topic), "%s/%s",
+                           CONFIG_APP_MQTT_TOPIC_PREFIX, field.name);
+            ret = publish(topic,
+                          (const char *)&peek_buf[offset + sizeof(header)],
+                          header.len);
+            if (ret < 0) {
+                break;
+            }
+            offset += record_len;
+            nr_records++;
+        }
+        batching = false;
+        if (ret == 0) {
+            ret = batch_flush();
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        // Remove the published records, unless the producer evicted them
+        // meanwhile
+        k_mutex_lock(&queue_mu, K_FOREVER);
+        while (queue_head_seq - seq < nr_records) {
+            struct queue_record_header header;
+            (void)ring_buf_get(&queue, (uint8_t *)&header, sizeof(header));
+            (void)ring_buf_get(&queue, NULL, header.len);
+            queue_head_seq++;
+        }
+        k_mutex_unlock(&queue_mu);
+        published += nr_records;
+    }
+
+    if (published) {
+        k_mutex_lock(&queue_mu, K_FOREVER);
+        stats.published += published;
+        stats.publish_cycles += k_cycle_get_32() - start;
+        k_mutex_unlock(&queue_mu);
+    }
+    return ret;
+}
+
+/* Must be called with queue_mu held */
+static void queue_value(enum field_id id, const struct field *field,
+                        int64_t value) {
+    struct queue_record_header header = {.field = id};
+    char buf[MQTT_PUB_VALUE_MAX_LEN];
+
+    const int len = dsmr_p1_field_format(buf, sizeof(buf), value, field->scale);
+    header.len = MAX(len, 0);
+    const size_t record_len = sizeof(header) + header.len;
+
+    // Drop the oldest records to make room
+    while (ring_buf_space_get(&queue) < record_len) {
+        struct queue_record_header oldest;
+        (void)ring_buf_get(&queue, (uint8_t *)&oldest, sizeof(oldest));
+        (void)ring_buf_get(&queue, NULL, oldest.len);
+        queue_head_seq++;
+        stats.dropped++;
+    }
+
+    (void)ring_buf_put(&queue, (const uint8_t *)&header, sizeof(header));
+    (void)ring_buf_put(&queue, (const uint8_t *)buf, header.len);
+}
+
+/* Describe a field, false when it is not published */
+static bool field_get(enum field_id id, struct field *field) {
+    if (id >= FIELD_SCHEMA_COUNT) {
+        *field = demand_fields[id - FIELD_SCHEMA_COUNT];
+        return true;
+    }
+
+    const struct dsmr_p1_field_info *info = &dsmr_p1_fields[id];
+    if (info->type != DSMR_P1_TYPE_NUMBER) {
+        return false;
+    }
+    for (enum field_kind kind = 0; kind < FIELD_KIND_COUNT; kind++) {
+        if (strcmp(info->unit, kinds[kind].unit) == 0) {
+            *field = (struct field){
+                .name = info->key,
+                .kind = kind,
+                .scale = info->scale,
+            };
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The title of a field, e.g. "L1 voltage" for l1_voltage */
+static void field_title(const struct field *field, char *buf, size_t len) {
+    if (field->title) {
+        (void)snprintf(buf, len, "%s", field->title);
+        return;
+    }
+
+    size_t i = 0;
+    for (; field->name[i] != '\0' && i < len - 1; i++) {
+        buf[i] = field->name[i] == '_' ? ' ' : field->name[i];
+    }
+    buf[i] = '\0';
+    buf[0] = toupper((unsigned char)buf[0]);
+}
+
+static int send_all(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = zsock_send(broker_fd, data, len, 0);
+        if (ret < 0) {
+            return -*z_errno();
+        }
+        data += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/* Collect writes while batching, anything else goes out directly */
+static int batch_append(const uint8_t *data, size_t len) {
+    int ret;
+
+    if (batch_len + len > sizeof(batch_buf)) {
+        ret = batch_flush();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (len > sizeof(batch_buf)) {
+        return send_all(data, len);
+    }
+
+    memcpy(&batch_buf[batch_len], data, len);
+    batch_len += len;
+    return batching ? 0 : batch_flush();
+}
+
+static int batch_flush(void) {
+    if (batch_len == 0) {
+        return 0;
+    }
+
+    int ret = send_all(batch_buf, batch_len);
+    batch_len = 0;
+    if (ret == 0) {
+        k_mutex_lock(&queue_mu, K_FOREVER);
+        stats.batches++;
+        k_mutex_unlock(&queue_mu);
+    }
+    return ret;
+}
+
+static void wake(void) {
+    if (wake_fds[1] >= 0) {
+        (void)zsock_send(wake_fds[1], &(uint8_t){0}, 1, ZSOCK_MSG_DONTWAIT);
+    }
+}
+
+static void mqtt_pub_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_subscriber_cb(const struct dsmr_p1_frame *frame,
+                                   void *user_data) {
+    ARG_UNUSED(user_data);
+    mqtt_pub_update(dsmr_p1_frame_time(frame), &frame->telegram);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file mqtt_pub.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief MQTT publisher of telegram fields
+ *
+ */
+
+#ifndef __MQTT_PUB_H__
+#define __MQTT_PUB_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "demand.h"
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct mqtt_pub_stats {
+    bool connected;
+    uint32_t connects;
+    uint32_t published;    // field values published
+    uint32_t suppressed;   // field values filtered by deadband or interval
+    uint32_t dropped;      // field values evicted from a full queue
+    uint32_t batches;      // TCP writes to the broker
+    uint32_t queued_bytes; // bytes currently waiting in the queue
+    uint64_t update_cycles;
+    uint64_t publish_cycles;
+    uint32_t updates;
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Queue the fields of a telegram which changed beyond their deadband, or whose
+ * maximum interval expired, for publishing
+ *
+ * @param timestamp Time of the telegram in seconds
+ */
+void mqtt_pub_update(int64_t timestamp,
+                     const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Queue the demand of a completed quarter and a new monthly peak for
+ * publishing
+ *
+ * @param changes DEMAND_CHANGE_* bits as passed to the demand callback
+ * @param state demand state after the change
+ */
+void mqtt_pub_demand(uint32_t changes, const struct demand_state *state);
+
+/**
+ * Get the statistics of the MQTT publisher
+ */
+void mqtt_pub_get_stats(struct mqtt_pub_stats *stats);
+
+/**
+ * HTTP resource serving the MQTT publisher statistics as JSON
+ */
+int mqtt_pub_handle_stats_request(const struct server_request *req,
+                                  struct server_response *res);
+
+#endif // __MQTT_PUB_H__
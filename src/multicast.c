@@ -0,0 +1,234 @@
+/**
+ * @file multicast.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief UDP multicast of every telegram
+ *
+ * Consumers on the LAN receive every telegram without any connection state on
+ * the device. Each variant is sent as a single datagram gathered from a
+ * prebuilt header and the published telegram, only the sequence number in
+ * the header is updated per telegram.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "multicast.h"
+#include "http.h"
+#include "telegram_cbor.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/latency.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/errno_private.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define MULTICAST_STATS_MAX_LEN 192
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int setup_socket(void);
+static int send_datagram(uint8_t *header, const void *payload, size_t len);
+static void multicast_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(multicast, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(multicast_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+// Only used from the telegram callback
+static int fd = -1;
+static struct sockaddr_in group;
+static uint32_t sequence;
+static uint8_t raw_header[MULTICAST_HEADER_LEN] = {
+    'P', '1', MULTICAST_HEADER_VERSION, MULTICAST_TYPE_RAW,
+};
+static uint8_t cbor_header[MULTICAST_HEADER_LEN] = {
+    'P', '1', MULTICAST_HEADER_VERSION, MULTICAST_TYPE_CBOR,
+};
+static uint8_t cbor_buf[TELEGRAM_CBOR_MAX_LEN];
+
+// Protects the statistics
+static K_MUTEX_DEFINE(multicast_mu);
+static struct multicast_stats stats;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void multicast_publish(const struct dsmr_p1_frame *frame) {
+    if (fd < 0 && setup_socket() < 0) {
+        return;
+    }
+
+    sequence++;
+    uint32_t sent = 0;
+    uint32_t failed = 0;
+
+    if (IS_ENABLED(CONFIG_APP_MULTICAST_RAW)) {
+        if (send_datagram(raw_header, frame->data, frame->len) < 0) {
+            failed++;
+        } else {
+            sent++;
+        }
+    }
+    if (IS_ENABLED(CONFIG_APP_MULTICAST_CBOR)) {
+        int ret = telegram_cbor_encode(&frame->telegram, cbor_buf,
+                                       sizeof(cbor_buf));
+        if (ret < 0 || send_datagram(cbor_header, cbor_buf, ret) < 0) {
+            failed++;
+        } else {
+            sent++;
+        }
+    }
+
+    // Publishing the next frame waits for the listener to return
+    if (sent) {
+        (void)dsmr_p1_latency_record_since(DSMR_P1_LATENCY_MULTICAST,
+                                           frame->rx_cycles);
+    }
+    const uint32_t latency_us =
+        k_cyc_to_us_floor32(k_cycle_get_32() - frame->rx_cycles);
+
+    k_mutex_lock(&multicast_mu, K_FOREVER);
+    stats.sequence = sequence;
+    stats.datagrams += sent;
+    stats.failed += failed;
+    stats.last_latency_us = latency_us;
+    stats.max_latency_us = MAX(stats.max_latency_us, latency_us);
+    stats.total_latency_us += latency_us;
+    k_mutex_unlock(&multicast_mu);
+}
+
+void multicast_get_stats(struct multicast_stats *out) {
+    k_mutex_lock(&multicast_mu, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&multicast_mu);
+}
+
+int multicast_handle_stats_request(const struct server_request *req,
+                                   struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct multicast_stats s;
+    multicast_get_stats(&s);
+
+    char *payload = malloc(MULTICAST_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = MULTICAST_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"sequence\":%u,\"datagrams\":%u,\"failed\":%u,"
+        "\"last_latency_us\":%u,\"max_latency_us\":%u,"
+        "\"avg_latency_us\":%llu}",
+        s.sequence, s.datagrams, s.failed, s.last_latency_us,
+        s.max_latency_us, s.sequence ? s.total_latency_us / s.sequence : 0);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = multicast_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static int setup_socket(void) {
+    int ret;
+
+    group.sin_family = AF_INET;
+    group.sin_port = htons(CONFIG_APP_MULTICAST_PORT);
+    ret = zsock_inet_pton(AF_INET, CONFIG_APP_MULTICAST_GROUP,
+                          &group.sin_addr);
+    if (ret != 1 || !net_ipv4_is_addr_mcast(&group.sin_addr)) {
+        LOG_ERR("invalid multicast group: %s", CONFIG_APP_MULTICAST_GROUP);
+        return -EINVAL;
+    }
+
+    fd = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        ret = -*z_errno();
+        LOG_ERR("could not get socket: %d", ret);
+        return ret;
+    }
+
+    LOG_INF("sending to %s:%d", CONFIG_APP_MULTICAST_GROUP,
+            CONFIG_APP_MULTICAST_PORT);
+    return 0;
+}
+
+static int send_datagram(uint8_t *header, const void *payload, size_t len) {
+    sys_put_be32(sequence, &header[4]);
+
+    struct iovec iov[] = {
+        {.iov_base = header, .iov_len = MULTICAST_HEADER_LEN},
+        {.iov_base = (void *)payload, .iov_len = len},
+    };
+    struct msghdr msg = {
+        .msg_name = &group,
+        .msg_namelen = sizeof(group),
+        .msg_iov = iov,
+        .msg_iovlen = ARRAY_SIZE(iov),
+    };
+
+    // Never hold up the telegram callback, a datagram may be lost anyway
+    ssize_t ret = zsock_sendmsg(fd, &msg, ZSOCK_MSG_DONTWAIT);
+    if (ret < 0) {
+        ret = -*z_errno();
+        LOG_DBG("could not send datagram: %d", ret);
+        return ret;
+    }
+    return 0;
+}
+
+static void multicast_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    multicast_publish(frame);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file multicast.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief UDP multicast of every telegram
+ *
+ * Every datagram starts with an 8 byte header followed by the payload:
+ *
+ * | Offset | Size | Value                                          |
+ * |--------|------|------------------------------------------------|
+ * |      0 |    2 | magic "P1"                                     |
+ * |      2 |    1 | header version, 1                              |
+ * |      3 |    1 | payload type, see enum multicast_type          |
+ * |      4 |    4 | sequence number of the telegram, big endian    |
+ *
+ * Both variants of a telegram carry the same sequence number, a receiver
+ * detects loss from a gap in the sequence numbers of one type.
+ */
+
+#ifndef __MULTICAST_H__
+#define __MULTICAST_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/bus.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define MULTICAST_HEADER_LEN 8
+#define MULTICAST_HEADER_VERSION 1
+
+enum multicast_type {
+    MULTICAST_TYPE_RAW = 0,  // validated raw telegram
+    MULTICAST_TYPE_CBOR = 1, // parsed telegram as defined by telegram.cddl
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct multicast_stats {
+    uint32_t sequence;        // sequence number of the last telegram
+    uint32_t datagrams;       // datagrams handed to the network stack
+    uint32_t failed;          // datagrams which could not be sent
+    uint32_t last_latency_us; // end of the telegram to the last datagram sent
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Send a telegram to the multicast group
+ *
+ * Called from the bus listener, the datagrams are sent from here without
+ * copying the raw telegram or allocating.
+ *
+ * @param frame frame holding the validated raw and parsed telegram
+ */
+void multicast_publish(const struct dsmr_p1_frame *frame);
+
+/**
+ * Get the statistics of the multicast sender
+ */
+void multicast_get_stats(struct multicast_stats *stats);
+
+/**
+ * HTTP resource serving the multicast statistics as JSON
+ */
+int multicast_handle_stats_request(const struct server_request *req,
+                                   struct server_response *res);
+
+#endif // __MULTICAST_H__
@@ -0,0 +1,389 @@
+/**
+ * @file passthrough.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Raw TCP telegram passthrough for multiple subscribers
+ *
+ * Tools such as DSMR-reader or the Home Assistant DSMR integration connect to
+ * a raw TCP port that emits the P1 stream. All subscribers are served by their
+ * own thread with non-blocking sends, so neither a slow subscriber nor the HTTP
+ * server can hold up the others.
+ *
+ * Every subscriber holds a reference to the bus frame it is sending, so a
+ * telegram is never copied and is always sent whole. The latest frame is
+ * referenced as well while there are subscribers, which is where a subscriber
+ * goes on once it has finished its telegram.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "passthrough.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/errno_private.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define PASSTHROUGH_MAX_CLIENTS CONFIG_APP_PASSTHROUGH_MAX_CLIENTS
+#define PASSTHROUGH_STATS_MAX_LEN 128
+
+enum {
+    POLL_LISTEN,
+    POLL_WAKE,
+    POLL_CLIENTS,
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct client {
+    int fd;
+    uint32_t generation;               // generation of the last telegram
+    const struct dsmr_p1_frame *frame; // telegram being sent, if any
+    size_t sent;
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void passthrough_thread(void);
+static int setup_listen_socket(void);
+static void accept_client(int listen_fd);
+static void close_client(struct client *client);
+static void drain_client(struct client *client);
+static void send_client(struct client *client);
+static bool next_telegram(struct client *client);
+static void passthrough_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(passthrough, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(passthrough_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+K_THREAD_DEFINE(passthrough, CONFIG_APP_PASSTHROUGH_STACK_SIZE,
+                passthrough_thread, NULL, NULL, NULL,
+                CONFIG_APP_PASSTHROUGH_THREAD_PRIORITY, 0, 0);
+
+// Protects the latest frame, its generation and the statistics, the clients
+// are only touched by the passthrough thread
+static struct k_spinlock lock;
+static const struct dsmr_p1_frame *latest;
+static uint32_t generation;
+static struct passthrough_stats stats;
+static struct client clients[PASSTHROUGH_MAX_CLIENTS];
+
+// Written on publish to wake the thread out of poll
+static int wake_fds[2] = {-1, -1};
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void passthrough_publish(const struct dsmr_p1_frame *frame) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    const struct dsmr_p1_frame *old = latest;
+    // Keep the frame out of the pool only when there is someone to send it to
+    latest = stats.nr_clients > 0 ? frame : NULL;
+    if (latest) {
+        dsmr_p1_frame_ref(latest);
+    }
+    generation++;
+    stats.telegrams++;
+    k_spin_unlock(&lock, key);
+
+    if (old) {
+        dsmr_p1_frame_unref(old);
+    }
+    if (wake_fds[1] >= 0) {
+        (void)zsock_send(wake_fds[1], &(uint8_t){0}, 1, ZSOCK_MSG_DONTWAIT);
+    }
+}
+
+void passthrough_get_stats(struct passthrough_stats *out) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+int passthrough_handle_stats_request(const struct server_request *req,
+                                     struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct passthrough_stats s;
+    passthrough_get_stats(&s);
+
+    char *payload = malloc(PASSTHROUGH_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = PASSTHROUGH_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc, "{\"nr_clients\":%u,\"telegrams\":%u,\"dropped_telegrams\":%u}",
+        s.nr_clients, s.telegrams, s.dropped_telegrams);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = passthrough_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void passthrough_thread(void) {
+    int ret;
+    struct zsock_pollfd fds[POLL_CLIENTS + PASSTHROUGH_MAX_CLIENTS];
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        clients[i].fd = -1;
+    }
+
+    ret = zsock_socketpair(AF_UNIX, SOCK_STREAM, 0, wake_fds);
+    if (ret < 0) {
+        LOG_ERR("could not create wake socket pair: %d", -*z_errno());
+        return;
+    }
+
+    int listen_fd = setup_listen_socket();
+    if (listen_fd < 0) {
+        return;
+    }
+    LOG_INF("listening on port %d", CONFIG_APP_PASSTHROUGH_PORT);
+
+    while (true) {
+        fds[POLL_LISTEN].fd = listen_fd;
+        fds[POLL_LISTEN].events = ZSOCK_POLLIN;
+        fds[POLL_WAKE].fd = wake_fds[0];
+        fds[POLL_WAKE].events = ZSOCK_POLLIN;
+
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        const uint32_t current = generation;
+        k_spin_unlock(&lock, key);
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            struct client *client = &clients[i];
+            const bool pending =
+                client->frame != NULL || client->generation != current;
+            fds[POLL_CLIENTS + i].fd = client->fd;
+            fds[POLL_CLIENTS + i].events =
+                ZSOCK_POLLIN | (pending ? ZSOCK_POLLOUT : 0);
+            fds[POLL_CLIENTS + i].revents = 0;
+        }
+
+        ret = zsock_poll(fds, ARRAY_SIZE(fds), -1);
+        if (ret < 0) {
+            LOG_ERR("poll failed: %d", -*z_errno());
+            k_msleep(100);
+            continue;
+        }
+
+        if (fds[POLL_WAKE].revents & ZSOCK_POLLIN) {
+            uint8_t drain[8];
+            (void)zsock_recv(wake_fds[0], drain, sizeof(drain),
+                             ZSOCK_MSG_DONTWAIT);
+        }
+        if (fds[POLL_LISTEN].revents & ZSOCK_POLLIN) {
+            accept_client(listen_fd);
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            struct client *client = &clients[i];
+            const short revents = fds[POLL_CLIENTS + i].revents;
+            if (client->fd < 0 || client->fd != fds[POLL_CLIENTS + i].fd) {
+                continue;
+            }
+            if (revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP)) {
+                close_client(client);
+                continue;
+            }
+            if (revents & ZSOCK_POLLIN) {
+                drain_client(client);
+            }
+            if (client->fd >= 0) {
+                send_client(client);
+            }
+        }
+    }
+}
+
+static int setup_listen_socket(void) {
+    int ret;
+    struct sockaddr_in addr = {
+        .sin_port = htons(CONFIG_APP_PASSTHROUGH_PORT),
+        .sin_family = AF_INET,
+    };
+
+    int fd = zsock_socket(addr.sin_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        ret = -*z_errno();
+        LOG_ERR("could not get socket: %d", ret);
+        return ret;
+    }
+
+    ret = zsock_bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret) {
+        ret = -*z_errno();
+        LOG_ERR("could not bind to socket: %d", ret);
+        goto close;
+    }
+
+    ret = zsock_listen(fd, PASSTHROUGH_MAX_CLIENTS);
+    if (ret) {
+        ret = -*z_errno();
+        LOG_ERR("could not listen to socket: %d", ret);
+        goto close;
+    }
+
+    return fd;
+
+close:
+    (void)zsock_close(fd);
+    return ret;
+}
+
+static void accept_client(int listen_fd) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = zsock_accept(listen_fd, (struct sockaddr *)&addr, &addrlen);
+    if (fd < 0) {
+        LOG_WRN("could not accept client: %d", -*z_errno());
+        return;
+    }
+
+    struct client *client = NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        if (clients[i].fd < 0) {
+            client = &clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        LOG_WRN("too many clients");
+        (void)zsock_close(fd);
+        return;
+    }
+
+    // All I/O uses MSG_DONTWAIT, start with the next whole telegram
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    client->fd = fd;
+    client->generation = generation;
+    client->frame = NULL;
+    stats.nr_clients++;
+    k_spin_unlock(&lock, key);
+    LOG_INF("client connected");
+}
+
+static void close_client(struct client *client) {
+    (void)zsock_close(client->fd);
+    client->fd = -1;
+    if (client->frame) {
+        dsmr_p1_frame_unref(client->frame);
+        client->frame = NULL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    stats.nr_clients--;
+    k_spin_unlock(&lock, key);
+    LOG_INF("client disconnected");
+}
+
+/* Subscribers have nothing to say, discard anything they send */
+static void drain_client(struct client *client) {
+    uint8_t buf[32];
+    ssize_t ret = zsock_recv(client->fd, buf, sizeof(buf), ZSOCK_MSG_DONTWAIT);
+    if (ret == 0 || (ret < 0 && *z_errno() != EAGAIN)) {
+        close_client(client);
+    }
+}
+
+static void send_client(struct client *client) {
+    if (!client->frame && !next_telegram(client)) {
+        return;
+    }
+
+    const struct dsmr_p1_frame *frame = client->frame;
+    ssize_t ret = zsock_send(client->fd, &frame->data[client->sent],
+                             frame->len - client->sent, ZSOCK_MSG_DONTWAIT);
+    if (ret < 0) {
+        if (*z_errno() != EAGAIN) {
+            close_client(client);
+        }
+        return;
+    }
+    client->sent += ret;
+    if (client->sent >= frame->len) {
+        client->frame = NULL;
+        dsmr_p1_frame_unref(frame);
+    }
+}
+
+/*
+ * Move a client which has finished its telegram on to the latest one
+ *
+ * @return whether the client has a telegram to send
+ */
+static bool next_telegram(struct client *client) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (latest && client->generation != generation) {
+        // Slow subscriber, the telegrams published while it was still
+        // sending are skipped whole
+        stats.dropped_telegrams += generation - client->generation - 1;
+        dsmr_p1_frame_ref(latest);
+        client->frame = latest;
+        client->generation = generation;
+        client->sent = 0;
+    }
+    k_spin_unlock(&lock, key);
+    return client->frame != NULL;
+}
+
+static void passthrough_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    passthrough_publish(frame);
+}
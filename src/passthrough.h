@@ -0,0 +1,60 @@
+/**
+ * @file passthrough.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Raw TCP telegram passthrough for multiple subscribers
+ *
+ */
+
+#ifndef __PASSTHROUGH_H__
+#define __PASSTHROUGH_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/bus.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct passthrough_stats {
+    uint32_t nr_clients;
+    uint32_t telegrams;         // telegrams published
+    uint32_t dropped_telegrams; // telegrams a slow client had to skip
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Publish a validated raw telegram to all connected subscribers
+ *
+ * The frame becomes the latest telegram without copying. A subscriber finishes
+ * the telegram it is sending before it moves on to the latest one, the
+ * telegrams published in between are skipped whole.
+ *
+ * @param frame frame holding the validated raw telegram
+ */
+void passthrough_publish(const struct dsmr_p1_frame *frame);
+
+/**
+ * Get the statistics of the passthrough port
+ */
+void passthrough_get_stats(struct passthrough_stats *stats);
+
+/**
+ * HTTP resource serving the passthrough statistics as JSON
+ */
+int passthrough_handle_stats_request(const struct server_request *req,
+                                     struct server_response *res);
+
+#endif // __PASSTHROUGH_H__
@@ -0,0 +1,432 @@
+/**
+ * @file rollup.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Incremental multi-resolution aggregates of parsed telegrams
+ *
+ * Each resolution keeps a ring buffer of fixed length buckets. A telegram
+ * either updates the newest bucket or opens a new one, so every update is
+ * O(1) per field and resolution and nothing is ever rescanned.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "rollup.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define ROLLUP_RESPONSE_MAX_LEN 6144
+#define ROLLUP_RESPONSE_DEFAULT_SLOTS 16
+#define ROLLUP_PARAM_MAX_LEN 24
+
+#define FIELD_NAME(name, key, ...) [ROLLUP_FIELD_##name] = #key,
+#define SCHEMA_VALUE(field)                                                    \
+    dsmr_p1_field_value(telegram, DSMR_P1_FIELD_##field)
+#define READ_FIELD(name, key, ...)                                             \
+    values[ROLLUP_FIELD_##name] =                                              \
+        (double)(FOR_EACH(SCHEMA_VALUE, (+), __VA_ARGS__)) /                   \
+        dsmr_p1_fields[UTIL_CAT(DSMR_P1_FIELD_, GET_ARG_N(1, __VA_ARGS__))]    \
+            .scale;
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct rollup_response_ctx {
+    http_encoder_ctx_t encoder;
+    uint32_t fields; // bitmap of enum rollup_field
+    size_t nr_slots;
+    bool truncated;
+};
+
+struct rollup_ring {
+    const char *name;
+    uint32_t period;
+    struct rollup_slot *slots;
+    size_t size;
+    size_t head; // index of the newest slot
+    size_t len;
+    // The newest slot was restored complete, it is not updated or reported
+    // as closed again
+    bool head_closed;
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static bool ring_update(struct rollup_ring *ring, uint32_t timestamp,
+                        const double *values, struct rollup_slot *closed);
+static void slot_open(struct rollup_slot *slot,
+                      const struct rollup_slot *prev, uint32_t start,
+                      uint32_t period, const double *values);
+static void read_fields(const struct dsmr_p1_telegram *telegram,
+                        double *values);
+static void encode_slot(const struct rollup_slot *slot, void *user_data);
+static void rollup_handle_request_on_done(int err, void *user_data);
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data);
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(rollup, CONFIG_APP_LOG_LEVEL);
+
+DSMR_P1_LISTENER_DEFINE(rollup_listener, CONFIG_APP_MAIN_METER,
+                        telegram_listener_cb, NULL);
+
+static const char *const field_names[ROLLUP_FIELD_COUNT] = {
+    ROLLUP_FIELDS(FIELD_NAME)};
+
+static struct rollup_slot slots_1m[CONFIG_APP_ROLLUP_1M_SLOTS];
+static struct rollup_slot slots_15m[CONFIG_APP_ROLLUP_15M_SLOTS];
+static struct rollup_slot slots_1h[CONFIG_APP_ROLLUP_1H_SLOTS];
+static struct rollup_slot slots_1d[CONFIG_APP_ROLLUP_1D_SLOTS];
+
+#define ROLLUP_RING(_name, _period, _slots)                                    \
+    {                                                                          \
+        .name = _name, .period = _period, .slots = _slots,                     \
+        .size = ARRAY_SIZE(_slots),                                            \
+    }
+
+static struct rollup_ring rings[ROLLUP_RES_COUNT] = {
+    [ROLLUP_RES_1M] = ROLLUP_RING("1m", 60, slots_1m),
+    [ROLLUP_RES_15M] = ROLLUP_RING("15m", 15 * 60, slots_15m),
+    [ROLLUP_RES_1H] = ROLLUP_RING("1h", 60 * 60, slots_1h),
+    [ROLLUP_RES_1D] = ROLLUP_RING("1d", 24 * 60 * 60, slots_1d),
+};
+
+static K_MUTEX_DEFINE(rollup_mu);
+
+static rollup_slot_closed_cb_t user_cb;
+static void *user_data;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void rollup_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram) {
+    if (timestamp < 0 || timestamp > UINT32_MAX) {
+        LOG_WRN("timestamp out of range: %lld", timestamp);
+        return;
+    }
+
+    double values[ROLLUP_FIELD_COUNT];
+    read_fields(telegram, values);
+
+    struct rollup_slot closed[ROLLUP_RES_COUNT];
+    uint32_t closed_bitmap = 0;
+
+    k_mutex_lock(&rollup_mu, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(rings); i++) {
+        if (ring_update(&rings[i], (uint32_t)timestamp, values, &closed[i])) {
+            closed_bitmap |= BIT(i);
+        }
+    }
+    k_mutex_unlock(&rollup_mu);
+
+    for (size_t i = 0; user_cb && i < ARRAY_SIZE(rings); i++) {
+        if (closed_bitmap & BIT(i)) {
+            user_cb(i, &closed[i], user_data);
+        }
+    }
+}
+
+int rollup_set_callback(rollup_slot_closed_cb_t a_cb, void *a_user_data) {
+    k_mutex_lock(&rollup_mu, K_FOREVER);
+    user_cb = a_cb;
+    user_data = a_user_data;
+    k_mutex_unlock(&rollup_mu);
+    return 0;
+}
+
+int rollup_restore(enum rollup_resolution res, const struct rollup_slot *slot) {
+    if (res >= ROLLUP_RES_COUNT || slot == NULL) {
+        return -EINVAL;
+    }
+
+    int ret = 0;
+    k_mutex_lock(&rollup_mu, K_FOREVER);
+    struct rollup_ring *ring = &rings[res];
+    if (ring->len > 0 && slot->start <= ring->slots[ring->head].start) {
+        ret = -EALREADY;
+    } else {
+        if (ring->len > 0) {
+            ring->head = (ring->head + 1) % ring->size;
+        }
+        ring->len = MIN(ring->len + 1, ring->size);
+        ring->slots[ring->head] = *slot;
+        ring->head_closed = true;
+    }
+    k_mutex_unlock(&rollup_mu);
+    return ret;
+}
+
+int rollup_foreach(enum rollup_resolution res, size_t max_slots,
+                   rollup_slot_cb_t cb, void *user_data) {
+    if (res >= ROLLUP_RES_COUNT || cb == NULL) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&rollup_mu, K_FOREVER);
+    const struct rollup_ring *ring = &rings[res];
+    size_t n = MIN(max_slots, ring->len);
+    for (size_t i = 0; i < n; i++) {
+        size_t idx = (ring->head + ring->size - i) % ring->size;
+        cb(&ring->slots[idx], user_data);
+    }
+    k_mutex_unlock(&rollup_mu);
+
+    return n;
+}
+
+uint32_t rollup_period(enum rollup_resolution res) {
+    if (res >= ROLLUP_RES_COUNT) {
+        return 0;
+    }
+    return rings[res].period;
+}
+
+const char *rollup_resolution_name(enum rollup_resolution res) {
+    if (res >= ROLLUP_RES_COUNT) {
+        return NULL;
+    }
+    return rings[res].name;
+}
+
+const char *rollup_field_name(enum rollup_field field) {
+    if (field >= ROLLUP_FIELD_COUNT) {
+        return NULL;
+    }
+    return field_names[field];
+}
+
+int rollup_resolution_from_name(const char *name) {
+    for (size_t i = 0; i < ARRAY_SIZE(rings); i++) {
+        if (strcmp(name, rings[i].name) == 0) {
+            return i;
+        }
+    }
+    return -ENOENT;
+}
+
+int rollup_field_from_name(const char *name) {
+    for (size_t i = 0; i < ARRAY_SIZE(field_names); i++) {
+        if (strcmp(name, field_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -ENOENT;
+}
+
+int rollup_handle_request(const struct server_request *req,
+                          struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    char param[ROLLUP_PARAM_MAX_LEN];
+    int resolution = ROLLUP_RES_1M;
+    if (server_request_get_query_param(req, "res", param, sizeof(param)) >=
+        0) {
+        resolution = rollup_resolution_from_name(param);
+    }
+    uint32_t fields = BIT_MASK(ROLLUP_FIELD_COUNT);
+    if (server_request_get_query_param(req, "field", param, sizeof(param)) >=
+        0) {
+        int field = rollup_field_from_name(param);
+        fields = field < 0 ? 0 : BIT(field);
+    }
+    size_t max_slots = ROLLUP_RESPONSE_DEFAULT_SLOTS;
+    if (server_request_get_query_param(req, "n", param, sizeof(param)) >= 0) {
+        max_slots = strtoul(param, NULL, 10);
+    }
+    if (resolution < 0 || fields == 0) {
+        res->status = HTTP_400_BAD_REQUEST;
+        return 0;
+    }
+
+    struct rollup_response_ctx *ctx =
+        malloc(sizeof(*ctx) + ROLLUP_RESPONSE_MAX_LEN);
+    if (!ctx) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->encoder.buf = (char *)(ctx + 1);
+    ctx->encoder.len = ROLLUP_RESPONSE_MAX_LEN;
+    ctx->fields = fields;
+
+    http_encoder_ctx_t *enc = &ctx->encoder;
+    (void)http_encoder_appendf(enc, "{\"res\":\"%s\",\"period\":%u,\"fields\":[",
+                               rollup_resolution_name(resolution),
+                               rollup_period(resolution));
+    const char *sep = "";
+    for (size_t i = 0; i < ROLLUP_FIELD_COUNT; i++) {
+        if (fields & BIT(i)) {
+            (void)http_encoder_appendf(enc, "%s\"%s\"", sep,
+                                       rollup_field_name(i));
+            sep = ",";
+        }
+    }
+    (void)http_encoder_appendf(enc, "],\"slots\":[");
+    (void)rollup_foreach(resolution, max_slots, encode_slot, ctx);
+    int ret = http_encoder_appendf(enc, "],\"truncated\":%s}",
+                                   ctx->truncated ? "true" : "false");
+    if (ret < 0) {
+        free(ctx);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = enc->buf;
+    res->body_len = enc->offs;
+    res->on_done = rollup_handle_request_on_done;
+    res->user_data = ctx;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static bool ring_update(struct rollup_ring *ring, uint32_t timestamp,
+                        const double *values, struct rollup_slot *closed) {
+    uint32_t start = timestamp - (timestamp % ring->period);
+    struct rollup_slot *slot = &ring->slots[ring->head];
+    bool slot_closed = false;
+
+    if (ring->len == 0) {
+        slot_open(slot, NULL, start, ring->period, values);
+        ring->len = 1;
+    } else if (start > slot->start) {
+        struct rollup_slot *prev = slot;
+        if (!ring->head_closed) {
+            *closed = *prev;
+            slot_closed = true;
+        }
+        ring->head_closed = false;
+        ring->head = (ring->head + 1) % ring->size;
+        ring->len = MIN(ring->len + 1, ring->size);
+        slot = &ring->slots[ring->head];
+        slot_open(slot, prev, start, ring->period, values);
+    } else if (start < slot->start || ring->head_closed) {
+        // Clock stepped back or the slot was completed before a reboot, keep
+        // the history monotonic
+        LOG_DBG("dropping sample of a completed %s slot", ring->name);
+        return false;
+    }
+
+    slot->count++;
+    for (size_t i = 0; i < ROLLUP_FIELD_COUNT; i++) {
+        struct rollup_value *v = &slot->values[i];
+        const float value = (float)values[i];
+        v->min = MIN(v->min, value);
+        v->max = MAX(v->max, value);
+        v->sum += values[i];
+        v->last = values[i];
+    }
+    return slot_closed;
+}
+
+static void slot_open(struct rollup_slot *slot,
+                      const struct rollup_slot *prev, uint32_t start,
+                      uint32_t period, const double *values) {
+    // Only chain the counters when there is no gap, otherwise the delta of
+    // this slot would include energy of the missing slots
+    const bool contiguous = prev != NULL && prev->start + period == start;
+
+    slot->start = start;
+    slot->count = 0;
+    for (size_t i = 0; i < ROLLUP_FIELD_COUNT; i++) {
+        struct rollup_value *v = &slot->values[i];
+        v->min = (float)values[i];
+        v->max = (float)values[i];
+        v->sum = 0;
+        v->first = contiguous ? prev->values[i].last : values[i];
+        v->last = values[i];
+    }
+}
+
+/* Summed at the resolution of the meter, in the unit of the schema */
+static void read_fields(const struct dsmr_p1_telegram *telegram,
+                        double *values) {
+    ROLLUP_FIELDS(READ_FIELD)
+}
+
+static void encode_slot(const struct rollup_slot *slot, void *user_data) {
+    struct rollup_response_ctx *ctx = user_data;
+    http_encoder_ctx_t *enc = &ctx->encoder;
+
+    // Leave room for the closing of the document
+    const size_t reserved = 32;
+    if (ctx->truncated || enc->len - enc->offs < reserved) {
+        ctx->truncated = true;
+        return;
+    }
+    enc->len -= reserved;
+
+    const size_t slot_offs = enc->offs;
+    int ret = http_encoder_appendf(enc, "%s{\"start\":%u,\"count\":%u,\"values\":[",
+                                   ctx->nr_slots ? "," : "", slot->start,
+                                   slot->count);
+    const char *sep = "";
+    for (size_t i = 0; ret == 0 && i < ROLLUP_FIELD_COUNT; i++) {
+        if (!(ctx->fields & BIT(i))) {
+            continue;
+        }
+        // Report in W and Wh so the response is free of float formatting
+        const struct rollup_value *v = &slot->values[i];
+        const double avg = slot->count ? v->sum / slot->count : 0;
+        ret = http_encoder_appendf(
+            enc, "%s[%lld,%lld,%lld,%lld,%lld]", sep,
+            (long long)(v->min * 1000.0), (long long)(v->max * 1000.0),
+            (long long)(avg * 1000.0), (long long)(v->last * 1000.0),
+            (long long)((v->last - v->first) * 1000.0));
+        sep = ",";
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(enc, "]}");
+    }
+
+    enc->len += reserved;
+    if (ret < 0) {
+        enc->offs = slot_offs;
+        enc->buf[enc->offs] = '\0';
+        ctx->truncated = true;
+        return;
+    }
+    ctx->nr_slots++;
+}
+
+static void rollup_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_listener_cb(const struct dsmr_p1_frame *frame,
+                                 void *user_data) {
+    ARG_UNUSED(user_data);
+    rollup_update(dsmr_p1_frame_time(frame), &frame->telegram);
+}
@@ -0,0 +1,168 @@
+/**
+ * @file rollup.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Incremental multi-resolution aggregates of parsed telegrams
+ *
+ */
+
+#ifndef __ROLLUP_H__
+#define __ROLLUP_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// The aggregated fields by their name, the key in the responses and the
+// fields of DSMR_P1_SCHEMA summed into them, which share a unit. Changing the
+// list changes the size of struct rollup_slot, the history skips batches
+// stored with records of another size.
+#define ROLLUP_FIELDS(X)                                                       \
+    X(POWER_DELIVERED, power_delivered, POWER_DELIVERED)                       \
+    X(POWER_RECEIVED, power_received, POWER_RECEIVED)                          \
+    X(ENERGY_DELIVERED, energy_delivered, ENERGY_DELIVERED_T1,                 \
+      ENERGY_DELIVERED_T2)                                                     \
+    X(ENERGY_RECEIVED, energy_received, ENERGY_RECEIVED_T1,                    \
+      ENERGY_RECEIVED_T2)
+
+#define ROLLUP_ENUM_FIELD(name, key, ...) ROLLUP_FIELD_##name,
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+enum rollup_resolution {
+    ROLLUP_RES_1M,
+    ROLLUP_RES_15M,
+    ROLLUP_RES_1H,
+    ROLLUP_RES_1D,
+    ROLLUP_RES_COUNT,
+};
+
+// In the unit of the schema, e.g. kW
+enum rollup_field {
+    ROLLUP_FIELDS(ROLLUP_ENUM_FIELD)
+    ROLLUP_FIELD_COUNT,
+};
+
+struct rollup_value {
+    float min;
+    float max;
+    double sum;
+    double first; // last value of the previous slot when contiguous
+    double last;
+};
+
+struct rollup_slot {
+    uint32_t start; // unix timestamp of the start of the bucket
+    uint32_t count;
+    struct rollup_value values[ROLLUP_FIELD_COUNT];
+};
+
+typedef void (*rollup_slot_cb_t)(const struct rollup_slot *slot,
+                                 void *user_data);
+
+typedef void (*rollup_slot_closed_cb_t)(enum rollup_resolution res,
+                                        const struct rollup_slot *slot,
+                                        void *user_data);
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Add a telegram to every resolution in constant time
+ *
+ * @param timestamp unix timestamp the telegram was sampled at
+ * @param telegram parsed telegram
+ */
+void rollup_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Set the callback that is called with every slot that is completed. Called
+ * from the thread that calls rollup_update.
+ */
+int rollup_set_callback(rollup_slot_closed_cb_t cb, void *user_data);
+
+/**
+ * Append a previously completed slot, e.g. restored from flash
+ *
+ * The slot is not reported to the callback again. Telegrams within it are
+ * dropped, the next newer telegram opens a new slot.
+ *
+ * @param res resolution of the slot
+ * @param slot slot to append, must be newer than the newest slot
+ * @return 0 on success, -EALREADY if the slot is not newer than the newest slot
+ */
+int rollup_restore(enum rollup_resolution res, const struct rollup_slot *slot);
+
+/**
+ * Call cb for the slots of a resolution, newest first
+ *
+ * The rollups are locked for the duration of the iteration so cb should not
+ * block.
+ *
+ * @param res resolution to iterate
+ * @param max_slots maximum number of slots to visit
+ * @param cb callback called for each slot
+ * @param user_data passed into cb
+ * @return number of slots visited or negative errno
+ */
+int rollup_foreach(enum rollup_resolution res, size_t max_slots,
+                   rollup_slot_cb_t cb, void *user_data);
+
+/**
+ * Get the length of a bucket of a resolution in seconds
+ */
+uint32_t rollup_period(enum rollup_resolution res);
+
+/**
+ * Get the name of a resolution, e.g. "15m"
+ */
+const char *rollup_resolution_name(enum rollup_resolution res);
+
+/**
+ * Get the name of a field, e.g. "power_delivered"
+ */
+const char *rollup_field_name(enum rollup_field field);
+
+/**
+ * Look up a resolution by name
+ *
+ * @return resolution or negative errno if the name is unknown
+ */
+int rollup_resolution_from_name(const char *name);
+
+/**
+ * Look up a field by name
+ *
+ * @return field or negative errno if the name is unknown
+ */
+int rollup_field_from_name(const char *name);
+
+/**
+ * HTTP resource serving the rollups as JSON
+ *
+ * Query parameters:
+ *  - res: resolution, one of 1m, 15m, 1h or 1d (default 1m)
+ *  - field: only report this field (default all)
+ *  - n: maximum number of slots, newest first
+ *
+ * Every slot reports [min, max, avg, last, delta] per field in W or Wh.
+ */
+int rollup_handle_request(const struct server_request *req,
+                          struct server_response *res);
+
+#endif // __ROLLUP_H__
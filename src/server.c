@@ -10,12 +10,17 @@
 
 #include "server.h"
 #include "http.h"
+#include "trace.h"
 #include "zephyr/net/http/status.h"
+#include <ctype.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <zephyr/kernel.h>
 #include <zephyr/net/http/method.h>
 #include <zephyr/net/http/parser.h>
+#include <zephyr/net/http/parser_url.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/wifi_credentials.h>
@@ -47,11 +52,15 @@ static void handle_client(int fd, const struct sockaddr_in addr,
                           const socklen_t addrlen);
 
 static int handle_url_cb(struct http_parser *, const char *at, size_t length);
+static int handle_header_field_cb(struct http_parser *, const char *at,
+                                  size_t length);
+static int handle_header_value_cb(struct http_parser *, const char *at,
+                                  size_t length);
 static int handle_body_cb(struct http_parser *, const char *at, size_t length);
 static void route_request(const struct server_request *req,
                           struct server_response *res);
-static int serialize_response(const struct server_response *res, uint8_t *buf,
-                              size_t len);
+static int send_all(int fd, const uint8_t *buf, size_t len);
+static int send_body_stream(int fd, const struct server_response *res);
 static void serialize_response_append_header(uint64_t key, uint64_t value,
                                              void *cookie);
 static enum http_status errno_to_http_status(int err);
@@ -64,7 +73,7 @@ LOG_MODULE_REGISTER(server, CONFIG_APP_LOG_LEVEL);
 
 static int server_fd = -1;
 static uint8_t rx_buf[16384] = {0};
-static uint8_t tx_buf[8192] = {0};
+static uint8_t tx_buf[CONFIG_APP_SERVER_TX_BUF_SIZE] = {0};
 
 BUILD_ASSERT(
     sizeof(tx_buf) > sizeof(http_insufficient_storage),
@@ -73,6 +82,7 @@ BUILD_ASSERT(
 K_SEM_DEFINE(server_run_sem, 0, 1);
 K_THREAD_DEFINE(http_server, 8192, server_thread, NULL, NULL, NULL, 2, 0, 0);
 struct server_request request;
+static bool header_is_accept;
 
 SYS_HASHMAP_DEFINE_STATIC(resource_map);
 
@@ -112,6 +122,97 @@ int server_remove_resource(char *uri) {
     return 0;
 }
 
+int server_request_get_query_param(const struct server_request *req,
+                                   const char *key, char *value,
+                                   size_t value_len) {
+    size_t key_len = strlen(key);
+    const char *param = req->query;
+
+    while (*param != '\0') {
+        const char *end = strchr(param, '&');
+        size_t param_len = end ? (size_t)(end - param) : strlen(param);
+
+        if (param_len > key_len && strncmp(param, key, key_len) == 0 &&
+            param[key_len] == '=') {
+            size_t len = param_len - key_len - 1;
+            if (len >= value_len) {
+                return -E2BIG;
+            }
+            memcpy(value, &param[key_len + 1], len);
+            value[len] = '\0';
+            return len;
+        }
+
+        if (!end) {
+            break;
+        }
+        param = end + 1;
+    }
+
+    return -ENOENT;
+}
+
+int server_url_decode(const char *in, char *out, size_t out_len) {
+    size_t len = 0;
+
+    while (*in != '\0') {
+        char c = *in++;
+        if (c == '%') {
+            if (!isxdigit((unsigned char)in[0]) ||
+                !isxdigit((unsigned char)in[1])) {
+                return -EINVAL;
+            }
+            const char hex[3] = {in[0], in[1], '\0'};
+            c = (char)strtoul(hex, NULL, 16);
+            if (c == '\0') {
+                return -EINVAL;
+            }
+            in += 2;
+        }
+        if (len + 1 >= out_len) {
+            return -E2BIG;
+        }
+        out[len++] = c;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+int server_serialize_response(const struct server_response *res, uint8_t *buf,
+                              size_t len) {
+    http_encoder_ctx_t ctx = {};
+    int ret = http_encoder_init(&ctx, buf, len, res->status);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (!sys_hashmap_is_empty(&res->headers)) {
+        sys_hashmap_foreach(&res->headers, serialize_response_append_header,
+                            &ctx);
+    }
+
+    if (res->body_read) {
+        ret = http_encoder_set_body_marker(&ctx);
+        return ret < 0 ? ret : ctx.offs;
+    }
+
+    if (!res->body || !res->body_len) {
+        return ctx.offs;
+    }
+
+    ret = http_encoder_set_body_marker(&ctx);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = http_encoder_append(&ctx, res->body, res->body_len);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return ctx.offs;
+}
+
 /******************************************************************************
  * Local Function Implementation
  *****************************************************************************/
@@ -196,7 +297,9 @@ static void handle_client(int fd, const struct sockaddr_in addr,
                           const socklen_t addrlen) {
     int ret;
     memset(rx_buf, 0, sizeof(rx_buf));
+    TRACE_BEGIN("http_recv", fd);
     ret = zsock_recv(fd, rx_buf, sizeof(rx_buf), 0);
+    TRACE_END("http_recv", ret);
     if (ret < 0) {
         ret = -*z_errno();
         LOG_ERR("could not receive from client: %d", ret);
@@ -216,11 +319,15 @@ static void handle_client(int fd, const struct sockaddr_in addr,
     struct http_parser parser = {};
     struct http_parser_settings settings = {
         .on_url = handle_url_cb,
+        .on_header_field = handle_header_field_cb,
+        .on_header_value = handle_header_value_cb,
         .on_body = handle_body_cb,
     };
+    TRACE_BEGIN("http_parse", rx_len);
     http_parser_init(&parser, HTTP_REQUEST);
     http_parser_execute(&parser, &settings, rx_buf, rx_len);
     request.method = parser.method;
+    TRACE_END("http_parse", parser.method);
 
     LOG_DBG("%d http request on %s", parser.method, request.url);
     LOG_HEXDUMP_DBG(request.body, request.body_len, "request body");
@@ -230,16 +337,30 @@ static void handle_client(int fd, const struct sockaddr_in addr,
 
     struct server_response response = {};
     response.headers = headers_map;
+    TRACE_BEGIN("http_route", request.method);
     route_request(&request, &response);
-    ret = serialize_response(&response, tx_buf, sizeof(tx_buf));
+    TRACE_END("http_route", response.status);
+    TRACE_BEGIN("http_serialize", response.body_len);
+    ret = server_serialize_response(&response, tx_buf, sizeof(tx_buf));
+    TRACE_END("http_serialize", ret);
     if (ret < 0) {
         LOG_ERR("failed to serialize response: %d", ret);
-        return;
+        (void)send_all(fd, (const uint8_t *)http_insufficient_storage,
+                       sizeof(http_insufficient_storage) - 1);
+        goto done;
     }
 
     size_t tx_len = ret;
     LOG_HEXDUMP_DBG(tx_buf, tx_len, "response:");
-    zsock_send(fd, tx_buf, tx_len, 0);
+    TRACE_BEGIN("http_send", tx_len);
+    ret = send_all(fd, tx_buf, tx_len);
+    if (ret == 0 && response.body_read) {
+        ret = send_body_stream(fd, &response);
+    }
+    TRACE_END("http_send", ret);
+
+done:
+    // The handler may hold resources until now, such as a frame of the bus
     if (response.on_done) {
         response.on_done(ret, response.user_data);
     }
@@ -248,10 +369,45 @@ static void handle_client(int fd, const struct sockaddr_in addr,
 static int handle_url_cb(struct http_parser *parser, const char *at,
                          size_t length) {
     ARG_UNUSED(parser);
-    if (length >= sizeof(request.url)) {
+    struct http_parser_url url = {};
+    http_parser_url_init(&url);
+    if (http_parser_parse_url(at, length, 0, &url) != 0 ||
+        !(url.field_set & BIT(UF_PATH))) {
+        return -EINVAL;
+    }
+
+    const uint16_t path_len = url.field_data[UF_PATH].len;
+    if (path_len >= sizeof(request.url)) {
         return -E2BIG;
     }
-    memcpy(request.url, at, length);
+    memcpy(request.url, &at[url.field_data[UF_PATH].off], path_len);
+
+    if (url.field_set & BIT(UF_QUERY)) {
+        const uint16_t query_len = url.field_data[UF_QUERY].len;
+        if (query_len >= sizeof(request.query)) {
+            return -E2BIG;
+        }
+        memcpy(request.query, &at[url.field_data[UF_QUERY].off], query_len);
+    }
+    return 0;
+}
+
+static int handle_header_field_cb(struct http_parser *parser, const char *at,
+                                  size_t length) {
+    ARG_UNUSED(parser);
+    header_is_accept = length == strlen("Accept") &&
+                       strncasecmp(at, "Accept", length) == 0;
+    return 0;
+}
+
+static int handle_header_value_cb(struct http_parser *parser, const char *at,
+                                  size_t length) {
+    ARG_UNUSED(parser);
+    if (header_is_accept) {
+        const size_t len = MIN(length, sizeof(request.accept) - 1);
+        memcpy(request.accept, at, len);
+        request.accept[len] = '\0';
+    }
     return 0;
 }
 
@@ -270,8 +426,18 @@ static void route_request(const struct server_request *req,
     LOG_DBG("uri: %s, key: %llu", req->url, key);
     server_resource_cb_t resource_cb;
     if (!sys_hashmap_get(&resource_map, key, (uint64_t *)&resource_cb)) {
-        res->status = HTTP_404_NOT_FOUND;
-        return;
+        // Fall back to the resource of the parent, registered with a
+        // trailing '/'. The root is left out as it serves the index.
+        const char *parent = strrchr(req->url, '/');
+        if (!parent || parent == req->url) {
+            res->status = HTTP_404_NOT_FOUND;
+            return;
+        }
+        key = (uint64_t)sys_hash32(req->url, parent - req->url + 1);
+        if (!sys_hashmap_get(&resource_map, key, (uint64_t *)&resource_cb)) {
+            res->status = HTTP_404_NOT_FOUND;
+            return;
+        }
     }
 
     int ret = resource_cb(req, res);
@@ -283,34 +449,33 @@ static void route_request(const struct server_request *req,
     }
 }
 
-static int serialize_response(const struct server_response *res, uint8_t *buf,
-                              size_t len) {
-    http_encoder_ctx_t ctx = {};
-    int ret = http_encoder_init(&ctx, buf, len, res->status);
-    if (ret < 0) {
-        return ret;
-    }
 
-    if (!sys_hashmap_is_empty(&res->headers)) {
-        sys_hashmap_foreach(&res->headers, serialize_response_append_header,
-                            &ctx);
-    }
-
-    if (!res->body || !res->body_len) {
-        return ctx.offs;
-    }
-
-    ret = http_encoder_set_body_marker(&ctx);
-    if (ret < 0) {
-        return ret;
+static int send_all(int fd, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t ret = zsock_send(fd, buf, len, 0);
+        if (ret < 0) {
+            ret = -*z_errno();
+            LOG_WRN("could not send to client: %d", (int)ret);
+            return ret;
+        }
+        buf += ret;
+        len -= ret;
     }
+    return 0;
+}
 
-    ret = http_encoder_append(&ctx, res->body, res->body_len);
-    if (ret < 0) {
-        return ret;
+/* The body has no length, it is delimited by closing the connection */
+static int send_body_stream(int fd, const struct server_response *res) {
+    while (true) {
+        ssize_t len = res->body_read(tx_buf, sizeof(tx_buf), res->user_data);
+        if (len <= 0) {
+            return len;
+        }
+        int ret = send_all(fd, tx_buf, len);
+        if (ret < 0) {
+            return ret;
+        }
     }
-
-    return ctx.offs;
 }
 
 static void serialize_response_append_header(uint64_t key, uint64_t value,
@@ -13,6 +13,7 @@
 
 #include "zephyr/sys/hash_map.h"
 #include <stddef.h>
+#include <sys/types.h>
 #include <zephyr/net/http/method.h>
 #include <zephyr/net/http/status.h>
 
@@ -21,6 +22,8 @@
  *****************************************************************************/
 
 #define SERVER_URL_MAX_LEN 128
+#define SERVER_QUERY_MAX_LEN 128
+#define SERVER_ACCEPT_MAX_LEN 64
 
 /******************************************************************************
  * Types
@@ -28,6 +31,8 @@
 
 struct server_request {
     char url[SERVER_URL_MAX_LEN];
+    char query[SERVER_QUERY_MAX_LEN];
+    char accept[SERVER_ACCEPT_MAX_LEN]; // value of the Accept header
     enum http_method method;
     const char *body;
     size_t body_len;
@@ -38,6 +43,9 @@ struct server_response {
     struct sys_hashmap headers;
     char *body;
     size_t body_len;
+    // Streams the body when set, called until it returns <= 0. Used instead
+    // of body for responses that do not fit the transmit buffer.
+    ssize_t (*body_read)(char *buf, size_t len, void *user_data);
     void (*on_done)(int err, void *user_data);
     void *user_data; // Data to be passed into callbacks
 };
@@ -59,8 +67,53 @@ void server_start(void);
  */
 void server_stop(void);
 
+/**
+ * Add a resource
+ *
+ * A uri ending in '/', other than the root, also serves every path directly
+ * below it that has no resource of its own, the handler finds the path in
+ * the url of the request.
+ */
 int server_add_resource(char *uri, server_resource_cb_t cb);
 
 int server_remove_resource(char *uri);
 
+/**
+ * Get the value of a query parameter of a request
+ *
+ * @param req request to search the query string of
+ * @param key name of the parameter
+ * @param value buffer the null terminated value is copied into
+ * @param value_len size of the value buffer
+ * @return length of the value, -ENOENT if the parameter is not present or
+ * -E2BIG if the value does not fit in the buffer
+ */
+int server_request_get_query_param(const struct server_request *req,
+                                   const char *key, char *value,
+                                   size_t value_len);
+
+/**
+ * Decode the percent escapes of a url segment, such as %3A for ':'
+ *
+ * @param in null terminated segment
+ * @param out buffer the null terminated result is written to
+ * @param out_len size of the out buffer
+ * @return length of the result, -EINVAL on a malformed escape or -E2BIG if
+ * the result does not fit in the buffer
+ */
+int server_url_decode(const char *in, char *out, size_t out_len);
+
+/**
+ * Serialize the status line, the headers and the body of a response
+ *
+ * A streamed body is not included, the output then ends at the body marker.
+ *
+ * @param res response to serialize
+ * @param buf output buffer
+ * @param len size of buf
+ * @return length of the output or -ENOMEM
+ */
+int server_serialize_response(const struct server_response *res, uint8_t *buf,
+                              size_t len);
+
 #endif // __SERVER_H__
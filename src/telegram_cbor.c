@@ -0,0 +1,103 @@
+/**
+ * @file telegram_cbor.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief CBOR encoding of parsed telegrams
+ *
+ * Maps struct dsmr_p1_telegram onto the types generated from telegram.cddl,
+ * a member for every row of the schema.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "telegram_cbor.h"
+
+#include <telegram_decode.h>
+#include <telegram_encode.h>
+#include <telegram_types.h>
+
+#include <dsmr_p1/diff.h>
+
+#include <errno.h>
+#include <string.h>
+#include <zcbor_common.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Member of the generated struct from a row of the schema, a number at the
+// resolution of the meter or the bytes of a string
+#define TO_CBOR_NUMBER(name, key)                                              \
+    in.key = dsmr_p1_field_value(t, DSMR_P1_FIELD_##name);
+#define TO_CBOR_HEX TO_CBOR_NUMBER
+#define TO_CBOR_TIMESTAMP TO_CBOR_NUMBER
+#define TO_CBOR_STRING(name, key)                                              \
+    in.key.value = (const uint8_t *)t->key;                                    \
+    in.key.len = strnlen(t->key, sizeof(t->key));
+#define TO_CBOR(name, key, obis, ctype, type, unit, scale)                     \
+    TO_CBOR_##type(name, key)
+
+#define FROM_CBOR_NUMBER(name, key)                                            \
+    dsmr_p1_field_set(t, DSMR_P1_FIELD_##name, out.key);
+#define FROM_CBOR_HEX FROM_CBOR_NUMBER
+#define FROM_CBOR_TIMESTAMP FROM_CBOR_NUMBER
+#define FROM_CBOR_STRING(name, key)                                            \
+    memcpy(t->key, out.key.value, MIN(out.key.len, sizeof(t->key) - 1));
+#define FROM_CBOR(name, key, obis, ctype, type, unit, scale)                   \
+    FROM_CBOR_##type(name, key)
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static int zcbor_to_errno(int err);
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+int telegram_cbor_encode(const struct dsmr_p1_telegram *t, uint8_t *buf,
+                         size_t len) {
+    size_t encoded_len;
+    struct p1_telegram in;
+
+    DSMR_P1_SCHEMA(TO_CBOR)
+
+    int ret = cbor_encode_p1_telegram(buf, len, &in, &encoded_len);
+    if (ret != ZCBOR_SUCCESS) {
+        return zcbor_to_errno(ret);
+    }
+    return encoded_len;
+}
+
+int telegram_cbor_decode(const uint8_t *buf, size_t len,
+                         struct dsmr_p1_telegram *t) {
+    struct p1_telegram out;
+
+    int ret = cbor_decode_p1_telegram(buf, len, &out, NULL);
+    if (ret != ZCBOR_SUCCESS) {
+        return zcbor_to_errno(ret);
+    }
+
+    memset(t, 0, sizeof(*t));
+    DSMR_P1_SCHEMA(FROM_CBOR)
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static int zcbor_to_errno(int err) {
+    switch (err) {
+    case ZCBOR_ERR_NO_PAYLOAD:
+        return -ENOMEM;
+    default:
+        return -EBADMSG;
+    }
+}
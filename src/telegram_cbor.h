@@ -0,0 +1,60 @@
+/**
+ * @file telegram_cbor.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief CBOR encoding of parsed telegrams
+ *
+ * The encoding is defined by telegram.cddl, expanded from DSMR_P1_SCHEMA at
+ * build time, the encoder and decoder are generated from it by zcbor.
+ */
+
+#ifndef __TELEGRAM_CBOR_H__
+#define __TELEGRAM_CBOR_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/schema.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Upper bound of an encoded telegram: the array header, a 64-bit integer per
+// field and the string header and bytes of the equipment id
+#define TELEGRAM_CBOR_MAX_LEN                                                  \
+    (3 + 9 * DSMR_P1_FIELD_COUNT + 2 + DSMR_P1_EQUIPMENT_ID_MAX_LEN)
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Encode a parsed telegram as CBOR
+ *
+ * @param telegram telegram to encode
+ * @param buf output buffer, TELEGRAM_CBOR_MAX_LEN is always enough
+ * @param len size of buf
+ * @return length of the encoding or negative errno
+ */
+int telegram_cbor_encode(const struct dsmr_p1_telegram *telegram, uint8_t *buf,
+                         size_t len);
+
+/**
+ * Decode a CBOR encoded telegram
+ *
+ * @param buf encoded telegram
+ * @param len length of buf
+ * @param telegram decoded telegram
+ * @return 0 or negative errno
+ */
+int telegram_cbor_decode(const uint8_t *buf, size_t len,
+                         struct dsmr_p1_telegram *telegram);
+
+#endif // __TELEGRAM_CBOR_H__
@@ -0,0 +1,39 @@
+/**
+ * @file trace.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Named spans of the HTTP server and the main loop in the trace
+ *
+ * With CONFIG_APP_TRACING every span is a pair of named events, arg0 is 0 at
+ * the begin and 1 at the end and arg1 is given per span, like the spans of
+ * the dsmr_p1 receive path. The names are at most 20 characters, the longest
+ * a CTF named event holds.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include <zephyr/sys/util.h>
+
+#ifdef CONFIG_APP_TRACING
+#include <zephyr/tracing/tracing.h>
+#endif
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#ifdef CONFIG_APP_TRACING
+#define TRACE_BEGIN(name, arg) sys_trace_named_event(name, 0, (arg))
+#define TRACE_END(name, arg) sys_trace_named_event(name, 1, (arg))
+#else
+#define TRACE_BEGIN(name, arg) ARG_UNUSED(arg)
+#define TRACE_END(name, arg) ARG_UNUSED(arg)
+#endif
+
+#endif // __TRACE_H__
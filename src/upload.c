@@ -0,0 +1,593 @@
+/**
+ * @file upload.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Store-and-forward uploader of telegrams in Influx line protocol
+ *
+ * A line carries every numeric field of DSMR_P1_SCHEMA under its key, in the
+ * unit sent by the meter, tagged with the equipment id.
+ * Telegrams are appended as lines to one of two fixed batch buffers while the
+ * other one is being uploaded. Every CONFIG_APP_UPLOAD_INTERVAL seconds, or
+ * once the batch is full, the upload thread POSTs the batch to the configured
+ * endpoint. Batches which could not be posted are spilled to the
+ * upload_partition as ZMS entries and replayed oldest first once the endpoint
+ * is reachable again, new batches are spilled behind the backlog to keep the
+ * order.
+ */
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "upload.h"
+#include "http.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/schema.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/zms.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/errno_private.h>
+#include <zephyr/sys/util.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define UPLOAD_PARTITION upload_partition
+
+#define UPLOAD_MAGIC 0x55504C44U // "UPLD"
+#define UPLOAD_ID_BASE 0x2000U
+#define UPLOAD_MAX_SPILLED CONFIG_APP_UPLOAD_MAX_SPILLED
+#define UPLOAD_BATCH_SIZE CONFIG_APP_UPLOAD_BATCH_SIZE
+// Measurement, tag, key and value of every field and the timestamp
+#define UPLOAD_LINE_MAX_LEN                                                    \
+    (96 + DSMR_P1_EQUIPMENT_ID_MAX_LEN + DSMR_P1_FIELD_COUNT * 48)
+#define UPLOAD_HEADER_MAX_LEN 384
+#define UPLOAD_RESPONSE_MAX_LEN 64
+#define UPLOAD_TIMEOUT_MS 5000
+#define UPLOAD_STATS_MAX_LEN 384
+// Data ATE, close ATE, empty ATE, gc done ATE and one for a delete, as
+// reserved by zms_write()
+#define ZMS_SECTOR_OVERHEAD (5 * 16)
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct upload_batch {
+    size_t len;
+    char data[UPLOAD_BATCH_SIZE];
+};
+
+struct spill_header {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t len;
+    uint32_t crc; // crc32 of the data
+};
+
+struct spill_entry {
+    struct spill_header header;
+    char data[UPLOAD_BATCH_SIZE];
+};
+
+/******************************************************************************
+ * Local Function Prototypes
+ *****************************************************************************/
+
+static void upload_thread(void);
+static int spill_init(void);
+static int spill_write(const struct upload_batch *batch);
+static int spill_read(uint32_t seq, struct spill_entry *out);
+static void replay(void);
+static int post(const char *data, size_t len);
+static int connect_endpoint(void);
+static int send_all(int fd, const void *data, size_t len);
+static size_t format_line(int64_t timestamp,
+                          const struct dsmr_p1_telegram *telegram, char *buf,
+                          size_t len);
+static void upload_handle_request_on_done(int err, void *user_data);
+static void telegram_subscriber_cb(const struct dsmr_p1_frame *frame,
+                                   void *user_data);
+
+static inline uint32_t spill_id(uint32_t seq) {
+    return UPLOAD_ID_BASE + (seq % UPLOAD_MAX_SPILLED);
+}
+
+/******************************************************************************
+ * Private Variables
+ *****************************************************************************/
+
+LOG_MODULE_REGISTER(upload, CONFIG_APP_LOG_LEVEL);
+
+// Pushing may be slow, keep it off the P1 receive thread
+DSMR_P1_SUBSCRIBER_DEFINE(upload_subscriber, CONFIG_APP_MAIN_METER,
+                          telegram_subscriber_cb, NULL, 1, 2048,
+                          CONFIG_APP_UPLOAD_THREAD_PRIORITY);
+
+K_THREAD_DEFINE(upload, CONFIG_APP_UPLOAD_STACK_SIZE, upload_thread, NULL,
+                NULL, NULL, CONFIG_APP_UPLOAD_THREAD_PRIORITY, 0, 0);
+
+static K_SEM_DEFINE(batch_full_sem, 0, 1);
+
+// Protects the batches and the statistics
+static K_MUTEX_DEFINE(upload_mu);
+static struct upload_batch batches[2];
+static size_t fill;   // index of the batch being filled
+static bool sending;  // the other batch is owned by the upload thread
+static int64_t last_line;
+static struct upload_stats stats;
+
+// Only used from the upload thread
+static struct zms_fs fs;
+static bool fs_mounted;
+static uint32_t spill_oldest;
+static uint32_t spill_next;
+static struct spill_entry entry;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+void upload_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram) {
+    // Too large for the stack of the subscriber, the only caller
+    static char line[UPLOAD_LINE_MAX_LEN];
+
+    if (last_line != 0 &&
+        timestamp - last_line < CONFIG_APP_UPLOAD_SAMPLE_INTERVAL) {
+        return;
+    }
+    last_line = timestamp;
+
+    const uint32_t start = k_cycle_get_32();
+    size_t len = format_line(timestamp, telegram, line, sizeof(line));
+    if (len == 0) {
+        return;
+    }
+
+    bool full = false;
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    struct upload_batch *batch = &batches[fill];
+    if (batch->len + len > sizeof(batch->data)) {
+        if (sending) {
+            // Both batches are in use, the upload thread is behind
+            stats.dropped_lines++;
+            k_mutex_unlock(&upload_mu);
+            return;
+        }
+        // Hand the full batch to the upload thread and start the other one
+        sending = true;
+        full = true;
+        fill ^= 1;
+        batch = &batches[fill];
+        batch->len = 0;
+    }
+    memcpy(&batch->data[batch->len], line, len);
+    batch->len += len;
+    stats.lines++;
+    stats.append_cycles += k_cycle_get_32() - start;
+    k_mutex_unlock(&upload_mu);
+
+    if (full) {
+        k_sem_give(&batch_full_sem);
+    }
+}
+
+void upload_get_stats(struct upload_stats *out) {
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&upload_mu);
+}
+
+int upload_handle_stats_request(const struct server_request *req,
+                                struct server_response *res) {
+    if (req->method != HTTP_GET) {
+        res->status = HTTP_405_METHOD_NOT_ALLOWED;
+        return 0;
+    }
+
+    struct upload_stats s;
+    upload_get_stats(&s);
+
+    char *payload = malloc(UPLOAD_STATS_MAX_LEN);
+    if (!payload) {
+        LOG_ERR("failed to allocate response");
+        return -ENOMEM;
+    }
+    http_encoder_ctx_t enc = {
+        .buf = payload,
+        .len = UPLOAD_STATS_MAX_LEN,
+    };
+    int ret = http_encoder_appendf(
+        &enc,
+        "{\"lines\":%u,\"dropped_lines\":%u,\"posts\":%u,"
+        "\"failed_posts\":%u,\"bytes_posted\":%llu,\"bytes_per_s\":%llu,"
+        "\"line_ns\":%llu,\"spilled\":%u,\"dropped_batches\":%u,"
+        "\"catch_up_ms\":%u,\"catch_up_batches\":%u}",
+        s.lines, s.dropped_lines, s.posts, s.failed_posts, s.bytes_posted,
+        s.post_ms ? s.bytes_posted * 1000 / s.post_ms : 0,
+        s.lines ? k_cyc_to_ns_floor64(s.append_cycles / s.lines) : 0,
+        s.spilled, s.dropped_batches, s.catch_up_ms, s.catch_up_batches);
+    if (ret < 0) {
+        free(payload);
+        return ret;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"application/json", NULL);
+    res->body = payload;
+    res->body_len = enc.offs;
+    res->on_done = upload_handle_request_on_done;
+    res->user_data = payload;
+    return 0;
+}
+
+/******************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+static void upload_thread(void) {
+    int ret;
+
+    if (strlen(CONFIG_APP_UPLOAD_HOST) == 0) {
+        LOG_WRN("no upload endpoint configured");
+        return;
+    }
+
+    ret = spill_init();
+    if (ret < 0) {
+        LOG_WRN("spilling to flash not available: %d", ret);
+    }
+
+    while (true) {
+        (void)k_sem_take(&batch_full_sem,
+                         K_SECONDS(CONFIG_APP_UPLOAD_INTERVAL));
+
+        k_mutex_lock(&upload_mu, K_FOREVER);
+        if (!sending && batches[fill].len > 0) {
+            // Interval expired, take the partial batch
+            sending = true;
+            fill ^= 1;
+            batches[fill].len = 0;
+        }
+        struct upload_batch *batch = sending ? &batches[fill ^ 1] : NULL;
+        k_mutex_unlock(&upload_mu);
+
+        // Older batches go first
+        replay();
+
+        if (batch) {
+            ret = -EAGAIN;
+            if (spill_next == spill_oldest) {
+                ret = post(batch->data, batch->len);
+            }
+            if (ret < 0 && spill_write(batch) < 0) {
+                LOG_WRN("dropping batch of %u bytes", (unsigned)batch->len);
+            }
+
+            k_mutex_lock(&upload_mu, K_FOREVER);
+            sending = false;
+            k_mutex_unlock(&upload_mu);
+        }
+    }
+}
+
+static int spill_init(void) {
+    int ret;
+    struct flash_pages_info info;
+    struct spill_header header;
+    bool found = false;
+
+    fs.flash_device = FIXED_PARTITION_DEVICE(UPLOAD_PARTITION);
+    if (!device_is_ready(fs.flash_device)) {
+        return -ENODEV;
+    }
+    fs.offset = FIXED_PARTITION_OFFSET(UPLOAD_PARTITION);
+    ret = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+    if (ret < 0) {
+        return ret;
+    }
+    fs.sector_size = info.size;
+    fs.sector_count = FIXED_PARTITION_SIZE(UPLOAD_PARTITION) / info.size;
+    if (sizeof(struct spill_entry) > info.size - ZMS_SECTOR_OVERHEAD) {
+        // zms_write() would reject every full batch
+        LOG_ERR("batch of %u bytes does not fit a sector of %u bytes",
+                UPLOAD_BATCH_SIZE, (unsigned)info.size);
+        return -EFBIG;
+    }
+
+    ret = zms_mount(&fs);
+    if (ret < 0) {
+        return ret;
+    }
+    fs_mounted = true;
+
+    // Find the backlog left before a reset by reading only the headers
+    for (uint32_t i = 0; i < UPLOAD_MAX_SPILLED; i++) {
+        ssize_t rc = zms_read(&fs, UPLOAD_ID_BASE + i, &header, sizeof(header));
+        if (rc != sizeof(header) || header.magic != UPLOAD_MAGIC ||
+            spill_id(header.seq) != UPLOAD_ID_BASE + i) {
+            continue;
+        }
+        if (!found || (int32_t)(header.seq - spill_oldest) < 0) {
+            spill_oldest = header.seq;
+        }
+        if (!found || (int32_t)(header.seq + 1 - spill_next) > 0) {
+            spill_next = header.seq + 1;
+        }
+        found = true;
+    }
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    stats.spilled = spill_next - spill_oldest;
+    k_mutex_unlock(&upload_mu);
+    if (found) {
+        LOG_INF("%u spilled batches to replay", spill_next - spill_oldest);
+    }
+    return 0;
+}
+
+static int spill_write(const struct upload_batch *batch) {
+    if (!fs_mounted) {
+        return -ENODEV;
+    }
+
+    entry.header.magic = UPLOAD_MAGIC;
+    entry.header.seq = spill_next;
+    entry.header.len = batch->len;
+    entry.header.crc = crc32_ieee((const uint8_t *)batch->data, batch->len);
+    memcpy(entry.data, batch->data, batch->len);
+
+    ssize_t rc = zms_write(&fs, spill_id(spill_next), &entry,
+                           sizeof(entry.header) + batch->len);
+    if (rc < 0) {
+        LOG_ERR("could not spill batch %u: %d", spill_next, (int)rc);
+        return rc;
+    }
+
+    spill_next++;
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    if (spill_next - spill_oldest > UPLOAD_MAX_SPILLED) {
+        // The ID of the oldest batch was just reused
+        spill_oldest++;
+        stats.dropped_batches++;
+    }
+    stats.spilled = spill_next - spill_oldest;
+    k_mutex_unlock(&upload_mu);
+    return 0;
+}
+
+static int spill_read(uint32_t seq, struct spill_entry *out) {
+    ssize_t rc = zms_read(&fs, spill_id(seq), out, sizeof(*out));
+    if (rc < (ssize_t)sizeof(out->header)) {
+        return rc < 0 ? rc : -ENOENT;
+    }
+    if (out->header.magic != UPLOAD_MAGIC || out->header.seq != seq ||
+        out->header.len > sizeof(out->data) ||
+        rc != sizeof(out->header) + out->header.len) {
+        return -ENOENT;
+    }
+    if (crc32_ieee((const uint8_t *)out->data, out->header.len) !=
+        out->header.crc) {
+        LOG_WRN("spilled batch %u has a bad crc", seq);
+        return -EILSEQ;
+    }
+    return 0;
+}
+
+/* Post the spilled batches oldest first until one fails */
+static void replay(void) {
+    if (!fs_mounted || spill_next == spill_oldest) {
+        return;
+    }
+
+    const int64_t start = k_uptime_get();
+    uint32_t nr_batches = 0;
+    while (spill_next != spill_oldest) {
+        int ret = spill_read(spill_oldest, &entry);
+        if (ret == 0) {
+            ret = post(entry.data, entry.header.len);
+            if (ret < 0) {
+                return;
+            }
+            nr_batches++;
+        }
+        // Posted or unreadable, either way it is done
+        (void)zms_delete(&fs, spill_id(spill_oldest));
+        k_mutex_lock(&upload_mu, K_FOREVER);
+        spill_oldest++;
+        stats.spilled = spill_next - spill_oldest;
+        k_mutex_unlock(&upload_mu);
+    }
+
+    const int64_t duration = k_uptime_get() - start;
+    LOG_INF("replayed %u batches in %lld ms", nr_batches, duration);
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    stats.catch_up_ms = duration;
+    stats.catch_up_batches = nr_batches;
+    k_mutex_unlock(&upload_mu);
+}
+
+static int post(const char *data, size_t len) {
+    int ret;
+    char buf[MAX(UPLOAD_HEADER_MAX_LEN, UPLOAD_RESPONSE_MAX_LEN)];
+    const int64_t start = k_uptime_get();
+
+    int fd = connect_endpoint();
+    if (fd < 0) {
+        ret = fd;
+        goto out;
+    }
+
+    ret = snprintf(buf, sizeof(buf),
+                   "POST %s HTTP/1.1\r\n"
+                   "Host: %s\r\n"
+                   "Content-Type: text/plain; charset=utf-8\r\n"
+                   "Content-Length: %u\r\n"
+                   "%s%s%s"
+                   "Connection: close\r\n\r\n",
+                   CONFIG_APP_UPLOAD_PATH, CONFIG_APP_UPLOAD_HOST,
+                   (unsigned)len,
+                   strlen(CONFIG_APP_UPLOAD_TOKEN) ? "Authorization: Token " : "",
+                   CONFIG_APP_UPLOAD_TOKEN,
+                   strlen(CONFIG_APP_UPLOAD_TOKEN) ? "\r\n" : "");
+    if (ret < 0 || ret >= sizeof(buf)) {
+        ret = -ENOMEM;
+        goto close;
+    }
+
+    ret = send_all(fd, buf, ret);
+    if (ret == 0) {
+        ret = send_all(fd, data, len);
+    }
+    if (ret < 0) {
+        goto close;
+    }
+
+    // Only the status line matters, e.g. "HTTP/1.1 204 No Content"
+    ssize_t n = zsock_recv(fd, buf, sizeof(buf) - 1, 0);
+    if (n < 0) {
+        ret = -*z_errno();
+        goto close;
+    }
+    buf[n] = '\0';
+    const char *status = strchr(buf, ' ');
+    if (!status || status[1] != '2') {
+        LOG_WRN("upload rejected: %.*s", (int)strcspn(buf, "\r\n"), buf);
+        ret = -EBADMSG;
+        goto close;
+    }
+    ret = 0;
+
+close:
+    (void)zsock_close(fd);
+out:
+    k_mutex_lock(&upload_mu, K_FOREVER);
+    if (ret == 0) {
+        stats.posts++;
+        stats.bytes_posted += len;
+        stats.post_ms += k_uptime_get() - start;
+    } else {
+        stats.failed_posts++;
+    }
+    k_mutex_unlock(&upload_mu);
+    return ret;
+}
+
+static int connect_endpoint(void) {
+    int ret;
+    struct zsock_addrinfo *ai;
+    const struct zsock_addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+
+    ret = zsock_getaddrinfo(CONFIG_APP_UPLOAD_HOST,
+                            STRINGIFY(CONFIG_APP_UPLOAD_PORT), &hints, &ai);
+    if (ret) {
+        LOG_WRN("could not resolve upload host: %d", ret);
+        return -EHOSTUNREACH;
+    }
+
+    int fd = zsock_socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+        ret = -*z_errno();
+        goto free;
+    }
+
+    const struct timeval timeout = {
+        .tv_sec = UPLOAD_TIMEOUT_MS / 1000,
+        .tv_usec = (UPLOAD_TIMEOUT_MS % 1000) * 1000,
+    };
+    (void)zsock_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout));
+    (void)zsock_setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                           sizeof(timeout));
+
+    ret = zsock_connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if (ret < 0) {
+        ret = -*z_errno();
+        (void)zsock_close(fd);
+        goto free;
+    }
+    ret = fd;
+
+free:
+    zsock_freeaddrinfo(ai);
+    return ret;
+}
+
+static int send_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+
+    while (len > 0) {
+        ssize_t ret = zsock_send(fd, p, len, 0);
+        if (ret < 0) {
+            return -*z_errno();
+        }
+        p += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/* Fractional values as decimals, counts as integers */
+static size_t format_line(int64_t timestamp,
+                          const struct dsmr_p1_telegram *telegram, char *buf,
+                          size_t len) {
+    http_encoder_ctx_t enc = {
+        .buf = buf,
+        .len = len,
+    };
+    char value[DSMR_P1_FIELD_FORMAT_MAX_LEN];
+    char sep = ' ';
+    int ret = http_encoder_appendf(&enc, "%s", CONFIG_APP_UPLOAD_MEASUREMENT);
+
+    // Tag values may not contain unescaped spaces, commas or equal signs
+    if (ret == 0 && telegram->equipment_id[0] != '\0' &&
+        strpbrk(telegram->equipment_id, " ,=") == NULL) {
+        ret = http_encoder_appendf(&enc, ",meter=%s", telegram->equipment_id);
+    }
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT && ret == 0; field++) {
+        const struct dsmr_p1_field_info *info = &dsmr_p1_fields[field];
+        if (info->type != DSMR_P1_TYPE_NUMBER) {
+            continue;
+        }
+        ret = dsmr_p1_field_format(value, sizeof(value),
+                                   dsmr_p1_field_value(telegram, field),
+                                   info->scale);
+        if (ret >= 0) {
+            ret = http_encoder_appendf(&enc, "%c%s=%s%s", sep, info->key,
+                                       value, info->scale > 1 ? "" : "i");
+        }
+        sep = ',';
+    }
+    if (ret == 0) {
+        ret = http_encoder_appendf(&enc, " %lld\n", timestamp);
+    }
+    return ret < 0 ? 0 : enc.offs;
+}
+
+static void upload_handle_request_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+    free(user_data);
+}
+
+static void telegram_subscriber_cb(const struct dsmr_p1_frame *frame,
+                                   void *user_data) {
+    ARG_UNUSED(user_data);
+    upload_update(dsmr_p1_frame_time(frame), &frame->telegram);
+}
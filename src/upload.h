@@ -0,0 +1,66 @@
+/**
+ * @file upload.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Store-and-forward uploader of telegrams in Influx line protocol
+ *
+ */
+
+#ifndef __UPLOAD_H__
+#define __UPLOAD_H__
+
+/******************************************************************************
+ * Includes
+ *****************************************************************************/
+
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdint.h>
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct upload_stats {
+    uint32_t lines;           // lines appended to a batch
+    uint32_t dropped_lines;   // lines dropped as no batch was free
+    uint32_t posts;           // successful POSTs
+    uint32_t failed_posts;    // failed POSTs
+    uint64_t bytes_posted;    // bytes of line protocol posted
+    uint64_t post_ms;         // total time spent in successful POSTs
+    uint64_t append_cycles;   // total cycles spent appending lines
+    uint32_t spilled;         // batches currently spilled to flash
+    uint32_t dropped_batches; // spilled batches overwritten before replay
+    uint32_t catch_up_ms;     // duration of the last backlog replay
+    uint32_t catch_up_batches;
+};
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+/**
+ * Append a telegram to the batch being filled as a line of line protocol
+ *
+ * Only one line is appended per CONFIG_APP_UPLOAD_SAMPLE_INTERVAL seconds.
+ * Not reentrant, it is called from the subscriber of the uploader.
+ *
+ * @param timestamp Time of the telegram in seconds
+ */
+void upload_update(int64_t timestamp, const struct dsmr_p1_telegram *telegram);
+
+/**
+ * Get the statistics of the uploader
+ */
+void upload_get_stats(struct upload_stats *stats);
+
+/**
+ * HTTP resource serving the uploader statistics as JSON
+ */
+int upload_handle_stats_request(const struct server_request *req,
+                                struct server_response *res);
+
+#endif // __UPLOAD_H__
@@ -0,0 +1,146 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Round trip of the CBOR encoding of parsed telegrams
+ *
+ * Every telegram of the host corpus is parsed, encoded as CBOR and decoded
+ * again, directly and through the /api/v1/telegram resource asked for
+ * application/cbor. The decoded telegram has to hold every field of
+ * DSMR_P1_SCHEMA at the resolution of the meter, compared field by field.
+ */
+
+#include "api.h"
+#include "telegram_cbor.h"
+
+#include <dsmr_p1/diff.h>
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/schema.h>
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/http/method.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define NR_CORPUS 5
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const uint8_t dsmr22[] = {
+#include "dsmr22.txt.inc"
+};
+static const uint8_t dsmr42[] = {
+#include "dsmr42.txt.inc"
+};
+static const uint8_t dsmr50[] = {
+#include "dsmr50.txt.inc"
+};
+static const uint8_t dsmr50_be[] = {
+#include "dsmr50_be.txt.inc"
+};
+static const uint8_t dsmr50_mbus[] = {
+#include "dsmr50_mbus.txt.inc"
+};
+
+static const struct {
+    const char *name;
+    const uint8_t *data;
+    size_t len;
+} corpus[NR_CORPUS] = {
+    {"dsmr22", dsmr22, sizeof(dsmr22)},
+    {"dsmr42", dsmr42, sizeof(dsmr42)},
+    {"dsmr50", dsmr50, sizeof(dsmr50)},
+    {"dsmr50_be", dsmr50_be, sizeof(dsmr50_be)},
+    {"dsmr50_mbus", dsmr50_mbus, sizeof(dsmr50_mbus)},
+};
+
+static uint8_t cbor_buf[TELEGRAM_CBOR_MAX_LEN];
+
+SYS_HASHMAP_DEFINE_STATIC(headers);
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// Every field of the schema, numbers at the resolution of the meter
+static void assert_fields_equal(const struct dsmr_p1_telegram *expected,
+                                const struct dsmr_p1_telegram *actual,
+                                const char *name) {
+    for (int field = 0; field < DSMR_P1_FIELD_COUNT; field++) {
+        const struct dsmr_p1_field_info *info = &dsmr_p1_fields[field];
+
+        if (info->type == DSMR_P1_TYPE_STRING) {
+            zassert_str_equal(dsmr_p1_field_string(actual, field),
+                              dsmr_p1_field_string(expected, field), "%s: %s",
+                              name, info->key);
+            continue;
+        }
+        zassert_equal(dsmr_p1_field_value(actual, field),
+                      dsmr_p1_field_value(expected, field), "%s: %s", name,
+                      info->key);
+    }
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(api, test_cbor_round_trip) {
+    for (size_t i = 0; i < NR_CORPUS; i++) {
+        const struct dsmr_p1_telegram t =
+            dsmr_p1_parse_telegram(corpus[i].data, corpus[i].len);
+        struct dsmr_p1_telegram decoded;
+
+        const int len = telegram_cbor_encode(&t, cbor_buf, sizeof(cbor_buf));
+        zassert_true(len > 0, "%s: %d", corpus[i].name, len);
+        zassert_ok(telegram_cbor_decode(cbor_buf, len, &decoded), "%s",
+                   corpus[i].name);
+        assert_fields_equal(&t, &decoded, corpus[i].name);
+    }
+}
+
+ZTEST(api, test_served_cbor) {
+    const struct server_request req = {
+        .method = HTTP_GET,
+        .accept = "application/cbor",
+    };
+
+    for (size_t i = 0; i < NR_CORPUS; i++) {
+        const struct dsmr_p1_telegram t =
+            dsmr_p1_parse_telegram(corpus[i].data, corpus[i].len);
+        struct server_response res = {.headers = headers};
+        struct dsmr_p1_telegram decoded;
+
+        api_update(0, &t);
+        zassert_ok(api_handle_telegram_request(&req, &res));
+        zassert_equal(res.status, HTTP_200_OK);
+        zassert_ok(telegram_cbor_decode((const uint8_t *)res.body,
+                                        res.body_len, &decoded),
+                   "%s", corpus[i].name);
+        assert_fields_equal(&t, &decoded, corpus[i].name);
+        res.on_done(0, res.user_data);
+        sys_hashmap_clear(&res.headers, NULL, NULL);
+    }
+}
+
+ZTEST(api, test_truncated_cbor) {
+    const struct dsmr_p1_telegram t =
+        dsmr_p1_parse_telegram(dsmr50, sizeof(dsmr50));
+    struct dsmr_p1_telegram decoded;
+
+    const int len = telegram_cbor_encode(&t, cbor_buf, sizeof(cbor_buf));
+    zassert_true(len > 0, "%d", len);
+    zassert_true(telegram_cbor_decode(cbor_buf, len - 1, &decoded) < 0);
+}
+
+ZTEST_SUITE(api, NULL, NULL, NULL, NULL, NULL);
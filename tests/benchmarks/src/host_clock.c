@@ -0,0 +1,20 @@
+/**
+ * @file host_clock.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Monotonic clock of the host, built into the runner of native_sim
+ *
+ * Code runs in no simulated time on native_sim, so the kernel clocks do not
+ * move while a kernel is timed.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t bench_host_clock_ns(void) {
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
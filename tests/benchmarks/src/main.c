@@ -0,0 +1,364 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Benchmarks of the hot path functions
+ *
+ * Every kernel is checked for a sane result and then timed
+ * CONFIG_BENCH_ITERATIONS times over a fixed DSMR 5 telegram, on buffers
+ * prepared before timing so a sample is the cost of the call alone:
+ *
+ * - crc: CRC of the telegram
+ * - index: OBIS index of the telegram
+ * - parse: schema parse of the indexed telegram
+ * - telegram: index and parse together
+ * - lookup: one M-Bus reading of an indexed ESMR 5 telegram with two M-Bus
+ *   channels, as /obis/ serves it
+ * - mbus_telegram: index and parse of that telegram, the cost of the value
+ *   without the index of the frame
+ * - timestamp: parse of a telegram holding only a timestamp
+ * - cbor: CBOR encoding of the parsed telegram
+ * - telegram_json: JSON encoding of the parsed telegram as /api/v1/telegram
+ *   serves it, to hold the bytes and cycles of cbor against
+ * - json: JSON encoding of a structure shaped like the /config response
+ * - http: serialization of a response carrying the raw telegram
+ *
+ * A sample is the number of cycles of the timing counter spent in one call,
+ * on native_sim the nanoseconds of the host clock, which count as cycles of a
+ * 1 GHz counter. The samples of a kernel are sorted for the median, which
+ * keeps an interrupt hitting a single call from skewing it. The result is
+ * printed as a line
+ *
+ *   BENCH {"kernel":"crc","bytes":..,"counter_hz":..,"min_cycles":..,
+ *          "median_cycles":..,"max_cycles":..,"bytes_per_kcycle":..,
+ *          "median_ns":..}
+ *
+ * with the bytes per 1000 cycles of the median, which twister records into
+ * recording.csv of the build directory.
+ */
+
+#include "api.h"
+#include "http.h"
+#include "server.h"
+#include "telegram_cbor.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/data/json.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/http/status.h>
+#include <zephyr/net/wifi.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#ifndef CONFIG_ARCH_POSIX
+#include <zephyr/timing/timing.h>
+#endif
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define BENCH_ITERATIONS CONFIG_BENCH_ITERATIONS
+#define BENCH_JSON_MAX_LEN 256
+#define BENCH_HTTP_MAX_LEN 2048
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+// Same shape as the /config response
+struct bench_wifi_config {
+    char ssid[WIFI_SSID_MAX_LEN];
+    char psk[WIFI_PSK_MAX_LEN];
+};
+
+struct bench_config {
+    struct bench_wifi_config wifi;
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const uint8_t corpus[] = {
+#include "dsmr50.txt.inc"
+};
+
+static const uint8_t mbus_corpus[] = {
+#include "dsmr50_mbus.txt.inc"
+};
+
+static const char timestamp_telegram[] = "/BENCH\r\n"
+                                         "\r\n"
+                                         "0-0:1.0.0(260101000000W)\r\n"
+                                         "!0000\r\n";
+
+static const struct json_obj_descr wifi_config_descr[] = {
+    JSON_OBJ_DESCR_PRIM(struct bench_wifi_config, ssid, JSON_TOK_STRING_BUF),
+    JSON_OBJ_DESCR_PRIM(struct bench_wifi_config, psk, JSON_TOK_STRING_BUF),
+};
+
+static const struct json_obj_descr config_descr[] = {
+    JSON_OBJ_DESCR_OBJECT(struct bench_config, wifi, wifi_config_descr),
+};
+
+static size_t crc_len;
+static struct dsmr_p1_index obis_index;
+static struct dsmr_p1_index mbus_index;
+static struct dsmr_p1_telegram telegram;
+static struct bench_config config = {
+    .wifi = {.ssid = "benchmark-network", .psk = "benchmark-passphrase"},
+};
+static uint8_t cbor_buf[TELEGRAM_CBOR_MAX_LEN];
+static char json_buf[BENCH_JSON_MAX_LEN];
+static char telegram_json_buf[API_JSON_MAX_LEN];
+static uint8_t http_buf[BENCH_HTTP_MAX_LEN];
+static struct server_response http_res;
+SYS_HASHMAP_DEFINE_STATIC(http_headers);
+static uint32_t samples[BENCH_ITERATIONS];
+
+// Keeps the compiler from dropping the work being timed
+static volatile uint32_t sink;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+#ifdef CONFIG_ARCH_POSIX
+
+// See host_clock.c
+uint64_t bench_host_clock_ns(void);
+
+static uint32_t time_call(void (*run)(void)) {
+    const uint64_t start = bench_host_clock_ns();
+    run();
+    return (uint32_t)(bench_host_clock_ns() - start);
+}
+
+static uint64_t counter_hz(void) { return NSEC_PER_SEC; }
+
+#else
+
+static uint32_t time_call(void (*run)(void)) {
+    timing_t start = timing_counter_get();
+    run();
+    timing_t end = timing_counter_get();
+    return (uint32_t)timing_cycles_get(&start, &end);
+}
+
+static uint64_t counter_hz(void) { return timing_freq_get(); }
+
+#endif
+
+static int compare_cycles(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench(const char *name, void (*run)(void), size_t bytes) {
+    k_sched_lock();
+    for (size_t i = 0; i < BENCH_ITERATIONS; i++) {
+        samples[i] = time_call(run);
+    }
+    k_sched_unlock();
+
+    qsort(samples, BENCH_ITERATIONS, sizeof(samples[0]), compare_cycles);
+    const uint32_t median = samples[BENCH_ITERATIONS / 2];
+    const uint64_t hz = counter_hz();
+    printk("BENCH {\"kernel\":\"%s\",\"bytes\":%u,\"counter_hz\":%llu,"
+           "\"min_cycles\":%u,\"median_cycles\":%u,\"max_cycles\":%u,"
+           "\"bytes_per_kcycle\":%u,\"median_ns\":%llu}\n",
+           name, (uint32_t)bytes, hz, samples[0], median,
+           samples[BENCH_ITERATIONS - 1],
+           median ? (uint32_t)(bytes * 1000ULL / median) : 0,
+           hz ? median * (uint64_t)NSEC_PER_SEC / hz : 0);
+}
+
+static void kernel_crc(void) { sink += dsmr_p1_crc(corpus, crc_len); }
+
+static void kernel_index(void) {
+    sink += dsmr_p1_index_build(corpus, sizeof(corpus), &obis_index);
+}
+
+static void kernel_parse(void) {
+    sink += dsmr_p1_parse_index(corpus, &obis_index).power_failures;
+}
+
+static void kernel_telegram(void) {
+    sink += dsmr_p1_parse_telegram(corpus, sizeof(corpus)).power_failures;
+}
+
+static void kernel_lookup(void) {
+    const uint8_t *value;
+    size_t value_len;
+
+    sink += dsmr_p1_index_lookup(&mbus_index, mbus_corpus, "0-2:24.2.1",
+                                 &value, &value_len);
+    sink += value_len;
+}
+
+static void kernel_mbus_telegram(void) {
+    sink += dsmr_p1_parse_telegram(mbus_corpus, sizeof(mbus_corpus))
+                .power_failures;
+}
+
+static void kernel_timestamp(void) {
+    sink += (uint32_t)dsmr_p1_parse_telegram(
+                (const uint8_t *)timestamp_telegram,
+                sizeof(timestamp_telegram) - 1)
+                .timestamp;
+}
+
+static void kernel_cbor(void) {
+    sink += telegram_cbor_encode(&telegram, cbor_buf, sizeof(cbor_buf));
+}
+
+static void kernel_telegram_json(void) {
+    sink += api_encode_json(&telegram, telegram_json_buf,
+                            sizeof(telegram_json_buf));
+}
+
+static void kernel_json(void) {
+    sink += json_obj_encode_buf(config_descr, ARRAY_SIZE(config_descr),
+                                &config, json_buf, sizeof(json_buf));
+}
+
+static void kernel_http(void) {
+    sink += server_serialize_response(&http_res, http_buf, sizeof(http_buf));
+}
+
+// Inputs of the kernels
+static void *suite_setup(void) {
+    const uint8_t *bang = memchr(corpus, '!', sizeof(corpus));
+
+    zassert_not_null(bang);
+    crc_len = (size_t)(bang - corpus) + 1;
+    zassert_ok(dsmr_p1_index_build(corpus, sizeof(corpus), &obis_index));
+    telegram = dsmr_p1_parse_index(corpus, &obis_index);
+    zassert_ok(
+        dsmr_p1_index_build(mbus_corpus, sizeof(mbus_corpus), &mbus_index));
+
+    sys_hashmap_insert(&http_headers, (uint64_t)"Content-Type",
+                       (uint64_t)"text/plain", NULL);
+    http_res = (struct server_response){
+        .status = HTTP_200_OK,
+        .headers = http_headers,
+        .body = (char *)corpus,
+        .body_len = sizeof(corpus),
+    };
+
+#ifndef CONFIG_ARCH_POSIX
+    timing_init();
+    timing_start();
+#endif
+    return NULL;
+}
+
+static void suite_teardown(void *fixture) {
+    ARG_UNUSED(fixture);
+#ifndef CONFIG_ARCH_POSIX
+    timing_stop();
+#endif
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(benchmarks, test_crc) {
+    const uint16_t crc = strtoul((const char *)&corpus[crc_len], NULL, 16);
+
+    zassert_equal(dsmr_p1_crc(corpus, crc_len), crc);
+    bench("crc", kernel_crc, crc_len);
+}
+
+ZTEST(benchmarks, test_index) {
+    zassert_ok(dsmr_p1_index_build(corpus, sizeof(corpus), &obis_index));
+    zassert_true(obis_index.count > 0);
+    bench("index", kernel_index, sizeof(corpus));
+}
+
+ZTEST(benchmarks, test_parse) {
+    const struct dsmr_p1_telegram t = dsmr_p1_parse_index(corpus, &obis_index);
+
+    zassert_equal(t.power_failures, 4);
+    zassert_within(t.power_delivered, 1.193, 0.0005);
+    bench("parse", kernel_parse, sizeof(corpus));
+}
+
+ZTEST(benchmarks, test_telegram) {
+    const struct dsmr_p1_telegram t =
+        dsmr_p1_parse_telegram(corpus, sizeof(corpus));
+
+    zassert_equal(t.power_failures, 4);
+    zassert_within(t.power_delivered, 1.193, 0.0005);
+    bench("telegram", kernel_telegram, sizeof(corpus));
+}
+
+ZTEST(benchmarks, test_lookup) {
+    const uint8_t *value;
+    size_t value_len;
+
+    zassert_ok(dsmr_p1_index_lookup(&mbus_index, mbus_corpus, "0-2:24.2.1",
+                                    &value, &value_len));
+    zassert_mem_equal(value, "02302.507*m3", value_len);
+    bench("lookup", kernel_lookup, value_len);
+}
+
+ZTEST(benchmarks, test_mbus_telegram) {
+    const struct dsmr_p1_telegram t =
+        dsmr_p1_parse_telegram(mbus_corpus, sizeof(mbus_corpus));
+
+    zassert_equal(t.power_failures, 3);
+    zassert_within(t.power_delivered, 0.423, 0.0005);
+    bench("mbus_telegram", kernel_mbus_telegram, sizeof(mbus_corpus));
+}
+
+ZTEST(benchmarks, test_timestamp) {
+    const struct dsmr_p1_telegram t = dsmr_p1_parse_telegram(
+        (const uint8_t *)timestamp_telegram, sizeof(timestamp_telegram) - 1);
+
+    zassert_not_equal(t.timestamp, 0);
+    bench("timestamp", kernel_timestamp, sizeof(timestamp_telegram) - 1);
+}
+
+ZTEST(benchmarks, test_cbor) {
+    const int len = telegram_cbor_encode(&telegram, cbor_buf, sizeof(cbor_buf));
+
+    zassert_true(len > 0, "%d", len);
+    bench("cbor", kernel_cbor, len);
+}
+
+ZTEST(benchmarks, test_telegram_json) {
+    const int len = api_encode_json(&telegram, telegram_json_buf,
+                                    sizeof(telegram_json_buf));
+
+    zassert_true(len > 0, "%d", len);
+    zassert_not_null(strstr(telegram_json_buf, "\"power_failures\":"));
+    bench("telegram_json", kernel_telegram_json, len);
+}
+
+ZTEST(benchmarks, test_json) {
+    zassert_ok(json_obj_encode_buf(config_descr, ARRAY_SIZE(config_descr),
+                                   &config, json_buf, sizeof(json_buf)));
+    zassert_not_null(strstr(json_buf, "\"benchmark-network\""));
+    bench("json", kernel_json, strlen(json_buf));
+}
+
+ZTEST(benchmarks, test_http) {
+    const int len =
+        server_serialize_response(&http_res, http_buf, sizeof(http_buf));
+
+    zassert_true(len > (int)sizeof(corpus), "%d", len);
+    zassert_mem_equal(http_buf, "HTTP/1.1 200", 12);
+    bench("http", kernel_http, len);
+}
+
+ZTEST_SUITE(benchmarks, NULL, suite_setup, NULL, NULL, suite_teardown);
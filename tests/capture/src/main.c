@@ -0,0 +1,209 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Round trip of the capture log
+ *
+ * Every telegram of the host corpus is appended a few times with a changing
+ * power value, so the log holds keyframes, copied lines, changed lines and
+ * trailers. A DSMR 5 telegram with its CRC in lowercase is appended as well,
+ * which the meter is free to send. Streaming the log back through the
+ * /capture resource has to return every telegram byte for byte. The size of
+ * the log is printed as
+ *
+ *   CAPTURE {"telegrams":..,"raw_bytes":..,"encoded_bytes":..,
+ *            "ratio_permille":..}
+ */
+
+#include "capture.h"
+#include "server.h"
+
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/http/method.h>
+#include <zephyr/sys/hash_map.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define NR_VARIANTS 10 // appended per corpus telegram
+#define NR_CORPUS 5
+#define NR_SENT (NR_CORPUS * NR_VARIANTS + 2)
+
+#define POWER_CODE "1-0:1.7.0("
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct telegram_buf {
+    uint8_t data[DSMR_P1_TELEGRAM_MAX_SIZE + 1]; // terminated for searching
+    size_t len;
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const uint8_t dsmr22[] = {
+#include "dsmr22.txt.inc"
+};
+static const uint8_t dsmr42[] = {
+#include "dsmr42.txt.inc"
+};
+static const uint8_t dsmr50[] = {
+#include "dsmr50.txt.inc"
+};
+static const uint8_t dsmr50_be[] = {
+#include "dsmr50_be.txt.inc"
+};
+static const uint8_t dsmr50_mbus[] = {
+#include "dsmr50_mbus.txt.inc"
+};
+
+static const struct {
+    const uint8_t *data;
+    size_t len;
+} corpus[NR_CORPUS] = {
+    {dsmr22, sizeof(dsmr22)},
+    {dsmr42, sizeof(dsmr42)},
+    {dsmr50, sizeof(dsmr50)},
+    {dsmr50_be, sizeof(dsmr50_be)},
+    {dsmr50_mbus, sizeof(dsmr50_mbus)},
+};
+
+// In the order appended
+static struct telegram_buf sent[NR_SENT];
+static size_t nr_sent;
+
+// One more byte than a telegram, decoding the trailer terminates it
+static char read_buf[DSMR_P1_TELEGRAM_MAX_SIZE + 1];
+
+SYS_HASHMAP_DEFINE_STATIC(headers);
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// Recalculate the CRC of a telegram that carries one, as the meter sends it
+static void update_crc(struct telegram_buf *t) {
+    if (t->len < DSMR_P1_TRAILER_LEN ||
+        t->data[t->len - DSMR_P1_TRAILER_LEN] != '!') {
+        return;
+    }
+    const size_t crc_len = t->len - DSMR_P1_TRAILER_LEN + 1;
+    char crc[5];
+
+    snprintf(crc, sizeof(crc), "%04X", dsmr_p1_crc(t->data, crc_len));
+    memcpy(&t->data[crc_len], crc, 4);
+}
+
+// The telegram with the last digit of the power delivered set to n
+static void variant(struct telegram_buf *t, const uint8_t *data, size_t len,
+                    size_t n) {
+    zassert_true(len < sizeof(t->data));
+    memcpy(t->data, data, len);
+    t->data[len] = '\0';
+    t->len = len;
+
+    char *power = strstr((char *)t->data, POWER_CODE);
+    zassert_not_null(power);
+    char *unit = strchr(power, '*');
+    zassert_not_null(unit);
+    unit[-1] = '0' + n % 10;
+    update_crc(t);
+}
+
+// Write the letters of the CRC in lowercase, false when it has none
+static bool lowercase_crc(struct telegram_buf *t) {
+    bool letters = false;
+
+    for (size_t i = t->len - DSMR_P1_TRAILER_LEN + 1; i < t->len - 2; i++) {
+        if (isalpha(t->data[i])) {
+            t->data[i] = tolower(t->data[i]);
+            letters = true;
+        }
+    }
+    return letters;
+}
+
+static void append(const struct telegram_buf *t) {
+    zassert_true(nr_sent < NR_SENT);
+    zassert_ok(capture_append(t->data, t->len));
+    sent[nr_sent++] = *t;
+}
+
+static void *suite_setup(void) {
+    static struct telegram_buf t;
+
+    for (size_t i = 0; i < NR_CORPUS; i++) {
+        for (size_t n = 0; n < NR_VARIANTS; n++) {
+            variant(&t, corpus[i].data, corpus[i].len, n);
+            append(&t);
+        }
+    }
+
+    // A following telegram is encoded against the lowercase one
+    bool lowercase = false;
+    size_t n;
+    for (n = 0; n < NR_VARIANTS && !lowercase; n++) {
+        variant(&t, dsmr50, sizeof(dsmr50), n);
+        lowercase = lowercase_crc(&t);
+    }
+    zassert_true(lowercase, "no CRC with letters");
+    append(&t);
+    variant(&t, dsmr50, sizeof(dsmr50), n);
+    append(&t);
+    return NULL;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(capture, test_round_trip) {
+    const struct server_request req = {.method = HTTP_GET};
+    struct server_response res = {.headers = headers};
+    size_t i = 0;
+    ssize_t ret;
+
+    zassert_ok(capture_handle_request(&req, &res));
+    zassert_equal(res.status, HTTP_200_OK);
+    zassert_not_null(res.body_read);
+
+    while ((ret = res.body_read(read_buf, sizeof(read_buf), res.user_data)) >
+           0) {
+        zassert_true(i < nr_sent, "more telegrams than appended");
+        zassert_equal(ret, sent[i].len, "length of telegram %zu", i);
+        zassert_equal(memcmp(read_buf, sent[i].data, sent[i].len), 0,
+                      "telegram %zu differs", i);
+        i++;
+    }
+    res.on_done(0, res.user_data);
+
+    zassert_equal(ret, 0);
+    zassert_equal(i, nr_sent);
+}
+
+ZTEST(capture, test_ratio) {
+    struct capture_stats stats;
+
+    capture_get_stats(&stats);
+    zassert_equal(stats.nr_telegrams, nr_sent);
+    zassert_true(stats.encoded_bytes < stats.raw_bytes);
+    printk("CAPTURE {\"telegrams\":%u,\"raw_bytes\":%llu,"
+           "\"encoded_bytes\":%llu,\"ratio_permille\":%llu}\n",
+           stats.nr_telegrams, stats.raw_bytes, stats.encoded_bytes,
+           stats.encoded_bytes * 1000 / stats.raw_bytes);
+}
+
+ZTEST_SUITE(capture, NULL, suite_setup, NULL, NULL, NULL);
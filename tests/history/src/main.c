@@ -0,0 +1,267 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Tests of the rollup history on the flash simulator
+ *
+ * A reboot is simulated by clearing the state of the history and the rollups
+ * and running the history initialisation again, which mounts the partition
+ * and restores the rollups from it. A power loss is simulated by the flash
+ * simulator ignoring the writes beyond a threshold.
+ */
+
+#include "history.c"
+
+#include "rollup_test.h"
+
+#include <zephyr/stats/stats.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Midnight UTC, 2023-11-15
+#define T0 1700006400U
+
+#define MAX_RECORDS 256
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct starts {
+    uint32_t start[MAX_RECORDS];
+    size_t len;
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static uint32_t *flash_write_calls;
+static uint32_t *flash_max_write_calls;
+static double energy;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+static int find_stat(struct stats_hdr *hdr, void *arg, const char *name,
+                     uint16_t off) {
+    struct {
+        const char *name;
+        uint32_t **stat;
+    } *find = arg;
+
+    if (strcmp(name, find->name) == 0) {
+        *find->stat = (uint32_t *)((uint8_t *)hdr + off);
+    }
+    return 0;
+}
+
+static void reboot(void) {
+    struct k_work_sync sync;
+
+    (void)k_work_cancel_delayable_sync(&periodic_flush_work, &sync);
+    (void)k_work_cancel_sync(&flush_work, &sync);
+
+    memset(&fs, 0, sizeof(fs));
+    memset(&batch, 0, sizeof(batch));
+    batch_stored = false;
+    batch_dirty = false;
+    oldest_seq = 0;
+    nr_batches = 0;
+    budget_day = 0;
+    bytes_today = 0;
+    dropped_records = 0;
+    rollup_test_reset();
+
+    zassert_ok(history_init());
+}
+
+// A telegram every step seconds in [from, to)
+static void feed(uint32_t from, uint32_t to, uint32_t step) {
+    for (uint32_t t = from; t < to; t += step) {
+        struct dsmr_p1_telegram telegram = {0};
+
+        energy += 0.001;
+        telegram.power_delivered = (float)(t % 7200) / 1000;
+        telegram.energy_delivered_t1 = energy;
+        rollup_update(t, &telegram);
+        // Let the flush of a full batch run like it would between telegrams
+        k_yield();
+    }
+}
+
+static bool collect_cb(const struct history_record *record, void *user_data) {
+    struct starts *starts = user_data;
+
+    zassert_true(starts->len < MAX_RECORDS);
+    starts->start[starts->len++] = record->slot.start;
+    return true;
+}
+
+// Read the records of a resolution and check every slot is stored once
+static size_t read_unique(enum rollup_resolution res, struct starts *starts) {
+    starts->len = 0;
+    const int ret = history_read(res, 0, UINT32_MAX, collect_cb, starts);
+    zassert_equal(ret, starts->len);
+    for (size_t i = 1; i < starts->len; i++) {
+        zassert_true(starts->start[i] > starts->start[i - 1],
+                     "%s slot %u stored twice or out of order",
+                     rollup_resolution_name(res), starts->start[i]);
+    }
+    return starts->len;
+}
+
+static void newest_slot_cb(const struct rollup_slot *slot, void *user_data) {
+    *(struct rollup_slot *)user_data = *slot;
+}
+
+static void *suite_setup(void) {
+    struct stats_hdr *stats = stats_group_find("flash_sim_stats");
+    struct stats_hdr *thresholds = stats_group_find("flash_sim_thresholds");
+    struct {
+        const char *name;
+        uint32_t **stat;
+    } find;
+
+    zassert_not_null(stats);
+    zassert_not_null(thresholds);
+    find.name = "flash_write_calls";
+    find.stat = &flash_write_calls;
+    stats_walk(stats, find_stat, &find);
+    find.name = "max_write_calls";
+    find.stat = &flash_max_write_calls;
+    stats_walk(thresholds, find_stat, &find);
+    zassert_not_null(flash_write_calls);
+    zassert_not_null(flash_max_write_calls);
+    return NULL;
+}
+
+static void before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    *flash_max_write_calls = 0;
+    zassert_ok(flash_erase(FIXED_PARTITION_DEVICE(HISTORY_PARTITION),
+                           FIXED_PARTITION_OFFSET(HISTORY_PARTITION),
+                           FIXED_PARTITION_SIZE(HISTORY_PARTITION)));
+    reboot();
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(history, test_restore_does_not_repeat_slots) {
+    struct starts starts;
+    struct rollup_slot newest;
+
+    // Four quarters and the first hour complete
+    feed(T0, T0 + 3600 + 1, 10);
+    zassert_ok(history_flush());
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), 4);
+    zassert_equal(read_unique(ROLLUP_RES_1H, &starts), 1);
+
+    reboot();
+    zassert_equal(rollup_foreach(ROLLUP_RES_15M, 1, newest_slot_cb, &newest),
+                  1);
+    zassert_equal(newest.start, T0 + 2700);
+    const uint32_t count = newest.count;
+
+    // Late telegrams of a restored slot are dropped
+    feed(T0 + 3000, T0 + 3001, 1);
+    zassert_equal(rollup_foreach(ROLLUP_RES_15M, 1, newest_slot_cb, &newest),
+                  1);
+    zassert_equal(newest.start, T0 + 2700);
+    zassert_equal(newest.count, count);
+
+    // The first live telegram opens a slot without closing the restored one
+    feed(T0 + 3610, T0 + 4500, 10);
+    zassert_ok(history_flush());
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), 4);
+    zassert_equal(read_unique(ROLLUP_RES_1H, &starts), 1);
+
+    feed(T0 + 4500, T0 + 4501, 1);
+    zassert_ok(history_flush());
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), 5);
+    zassert_equal(starts.start[4], T0 + 3600);
+
+    // The new slots follow on the restored ones
+    zassert_equal(rollup_foreach(ROLLUP_RES_15M, 3, newest_slot_cb, &newest),
+                  3);
+    zassert_equal(newest.start, T0 + 2700);
+}
+
+ZTEST(history, test_power_loss_and_replay) {
+    struct starts starts;
+    struct history_stats stats;
+
+    // Several full batches and a partial one
+    feed(T0, T0 + 4 * 3600 + 1, 60);
+    zassert_ok(history_flush());
+    history_get_stats(&stats);
+    zassert_true(stats.nr_batches > 1);
+    zassert_equal(stats.dropped_records, 0);
+    const size_t quarters = read_unique(ROLLUP_RES_15M, &starts);
+    const size_t hours = read_unique(ROLLUP_RES_1H, &starts);
+    zassert_equal(quarters, 16);
+    zassert_equal(hours, 4);
+
+    // Power is lost while the batch holding the next slots is written, the
+    // data of the entry lands but not its allocation table entry
+    feed(T0 + 4 * 3600 + 1, T0 + 5 * 3600, 60);
+    *flash_max_write_calls = *flash_write_calls + 2;
+    (void)history_flush();
+    *flash_max_write_calls = 0;
+
+    reboot();
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), quarters);
+    zassert_equal(read_unique(ROLLUP_RES_1H, &starts), hours);
+
+    // The meter goes on where the power came back, the slots lost with the
+    // write stay lost and nothing is stored twice
+    feed(T0 + 6 * 3600, T0 + 8 * 3600 + 1, 60);
+    zassert_ok(history_flush());
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), quarters + 8);
+    zassert_equal(read_unique(ROLLUP_RES_1H, &starts), hours + 2);
+    zassert_equal(starts.start[hours], T0 + 6 * 3600);
+
+    // And all of it survives a clean reboot
+    reboot();
+    zassert_equal(read_unique(ROLLUP_RES_15M, &starts), quarters + 8);
+    zassert_equal(read_unique(ROLLUP_RES_1H, &starts), hours + 2);
+}
+
+ZTEST(history, test_write_budget_survives_reboot) {
+    struct history_stats before;
+    struct history_stats after;
+    int ret = 0;
+
+    // Rewrite a partial batch every quarter until the day is spent
+    uint32_t t = T0;
+    for (; ret == 0 && t < T0 + 12 * 3600; t += 900) {
+        feed(t, t + 900, 60);
+        ret = history_flush();
+    }
+    zassert_equal(ret, -EDQUOT);
+    history_get_stats(&before);
+    zassert_true(before.bytes_today > 0);
+    const size_t refused = batch_len(&batch);
+
+    reboot();
+    history_get_stats(&after);
+    zassert_equal(after.bytes_today, before.bytes_today);
+    zassert_false(budget_allows(refused));
+
+    // The budget starts over with the first slot of the next day of the
+    // meter, not with the uptime
+    feed(T0 + 24 * 3600, T0 + 24 * 3600 + 901, 60);
+    zassert_ok(history_flush());
+    history_get_stats(&after);
+    zassert_true(after.bytes_today < before.bytes_today);
+}
+
+ZTEST_SUITE(history, NULL, suite_setup, before, NULL, NULL);
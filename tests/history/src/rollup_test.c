@@ -0,0 +1,26 @@
+/**
+ * @file rollup_test.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief The rollups built into their own translation unit of the tests
+ *
+ * Kept apart from the history so each keeps its own log module, and gives
+ * the tests a way to empty the rings like a reboot does.
+ */
+
+#include "rollup.c"
+
+#include "rollup_test.h"
+
+void rollup_test_reset(void) {
+    k_mutex_lock(&rollup_mu, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(rings); i++) {
+        rings[i].head = 0;
+        rings[i].len = 0;
+        rings[i].head_closed = false;
+    }
+    user_cb = NULL;
+    user_data = NULL;
+    k_mutex_unlock(&rollup_mu);
+}
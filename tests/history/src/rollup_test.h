@@ -0,0 +1,18 @@
+/**
+ * @file rollup_test.h
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Test hooks of the rollups
+ *
+ */
+
+#ifndef __ROLLUP_TEST_H__
+#define __ROLLUP_TEST_H__
+
+/**
+ * Empty every ring and clear the slot closed callback, as after a reboot
+ */
+void rollup_test_reset(void);
+
+#endif // __ROLLUP_TEST_H__
@@ -0,0 +1,238 @@
+/**
+ * @file test_rollup.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief The rollup aggregates against a brute-force reference
+ *
+ * A seeded stream of telegrams, with jitter, outages and the clock of the
+ * meter stepping back, is fed through the rollups. Every slot they report,
+ * closed or still in the rings, is recomputed from scratch over all samples
+ * of the stream and has to match exactly.
+ */
+
+#include "rollup.h"
+#include "rollup_test.h"
+
+#include <dsmr_p1/diff.h>
+
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define T0 1700006417U
+#define SAMPLES 12000
+#define SEED 0x2545F491U
+
+static const size_t ring_sizes[ROLLUP_RES_COUNT] = {
+    [ROLLUP_RES_1M] = CONFIG_APP_ROLLUP_1M_SLOTS,
+    [ROLLUP_RES_15M] = CONFIG_APP_ROLLUP_15M_SLOTS,
+    [ROLLUP_RES_1H] = CONFIG_APP_ROLLUP_1H_SLOTS,
+    [ROLLUP_RES_1D] = CONFIG_APP_ROLLUP_1D_SLOTS,
+};
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct sample {
+    uint32_t t;
+    double values[ROLLUP_FIELD_COUNT];
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static struct sample samples[SAMPLES];
+static size_t nr_samples;
+static size_t nr_closed[ROLLUP_RES_COUNT];
+static uint32_t rand_state;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+static uint32_t next_rand(void) {
+    // xorshift32, the stream is the same on every run
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+/*
+ * Aggregate the slot of a resolution starting at start over every sample,
+ * applying the rules of the rollups: a sample of a slot older than the newest
+ * one is dropped, and a slot continues the counters of the previous slot only
+ * when there is no gap in between.
+ *
+ * @return number of slots of the resolution, up to and including the newest
+ */
+static size_t ref_slot(enum rollup_resolution res, uint32_t start,
+                       struct rollup_slot *out) {
+    const uint32_t period = rollup_period(res);
+    bool have_head = false;
+    uint32_t head = 0;
+    size_t nr_slots = 0;
+    bool have_prev = false;
+    uint32_t prev_start = 0;
+    const double *prev_last = NULL;
+    const double *last = NULL;
+
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < nr_samples; i++) {
+        const struct sample *s = &samples[i];
+        const uint32_t slot = s->t - s->t % period;
+
+        if (have_head && slot < head) {
+            continue;
+        }
+        if (!have_head || slot > head) {
+            nr_slots++;
+            if (have_head && head < start) {
+                have_prev = true;
+                prev_start = head;
+                prev_last = last;
+            }
+            head = slot;
+            have_head = true;
+        }
+        last = s->values;
+        if (slot != start) {
+            continue;
+        }
+
+        if (out->count == 0) {
+            const bool contiguous =
+                have_prev && prev_start + period == start;
+            out->start = start;
+            for (size_t f = 0; f < ROLLUP_FIELD_COUNT; f++) {
+                struct rollup_value *v = &out->values[f];
+                v->min = (float)s->values[f];
+                v->max = (float)s->values[f];
+                v->first = contiguous ? prev_last[f] : s->values[f];
+            }
+        }
+        out->count++;
+        for (size_t f = 0; f < ROLLUP_FIELD_COUNT; f++) {
+            struct rollup_value *v = &out->values[f];
+            v->min = MIN(v->min, (float)s->values[f]);
+            v->max = MAX(v->max, (float)s->values[f]);
+            v->sum += s->values[f];
+            v->last = s->values[f];
+        }
+    }
+    return nr_slots;
+}
+
+static void check_slot(enum rollup_resolution res,
+                       const struct rollup_slot *slot) {
+    struct rollup_slot expected;
+
+    (void)ref_slot(res, slot->start, &expected);
+    zassert_equal(slot->start, expected.start, "%s slot %u",
+                  rollup_resolution_name(res), slot->start);
+    zassert_equal(slot->count, expected.count, "%s slot %u",
+                  rollup_resolution_name(res), slot->start);
+    for (size_t f = 0; f < ROLLUP_FIELD_COUNT; f++) {
+        const struct rollup_value *v = &slot->values[f];
+        const struct rollup_value *e = &expected.values[f];
+        zassert_true(v->min == e->min && v->max == e->max &&
+                         v->sum == e->sum && v->first == e->first &&
+                         v->last == e->last,
+                     "%s slot %u %s", rollup_resolution_name(res),
+                     slot->start, rollup_field_name(f));
+    }
+}
+
+static void closed_cb(enum rollup_resolution res,
+                      const struct rollup_slot *slot, void *user_data) {
+    ARG_UNUSED(user_data);
+    nr_closed[res]++;
+    check_slot(res, slot);
+}
+
+static void ring_slot_cb(const struct rollup_slot *slot, void *user_data) {
+    check_slot(*(enum rollup_resolution *)user_data, slot);
+}
+
+static void before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    rollup_test_reset();
+    nr_samples = 0;
+    memset(nr_closed, 0, sizeof(nr_closed));
+    rand_state = SEED;
+    zassert_ok(rollup_set_callback(closed_cb, NULL));
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(rollup, test_aggregates_match_reference) {
+    long double delivered = 1234.5L;
+    long double received = 56.7L;
+    uint32_t t = T0;
+
+    for (size_t i = 0; i < SAMPLES; i++) {
+        const uint32_t r = next_rand();
+        struct dsmr_p1_telegram telegram = {0};
+        struct sample *s = &samples[nr_samples++];
+
+        if (r % 1000 == 0) {
+            // Outage of up to three hours
+            t += 600 + r % (3 * 3600);
+        } else if (r % 997 == 0) {
+            // The clock of the meter steps back
+            t -= r % 300;
+        } else {
+            t += 1 + r % 30;
+        }
+        telegram.power_delivered = (float)(r % 4000) / 1000;
+        telegram.power_received = (float)((r >> 12) % 2000) / 1000;
+        delivered += telegram.power_delivered / 3600.0L;
+        received += telegram.power_received / 3600.0L;
+        telegram.energy_delivered_t1 = delivered * 0.6L;
+        telegram.energy_delivered_t2 = delivered * 0.4L;
+        telegram.energy_received_t2 = received;
+
+        // Converted like the rollups read the telegram, at the resolution
+        // of the meter
+        const int64_t energy_delivered =
+            dsmr_p1_field_value(&telegram, DSMR_P1_FIELD_ENERGY_DELIVERED_T1) +
+            dsmr_p1_field_value(&telegram, DSMR_P1_FIELD_ENERGY_DELIVERED_T2);
+        const int64_t energy_received =
+            dsmr_p1_field_value(&telegram, DSMR_P1_FIELD_ENERGY_RECEIVED_T1) +
+            dsmr_p1_field_value(&telegram, DSMR_P1_FIELD_ENERGY_RECEIVED_T2);
+        s->t = t;
+        s->values[ROLLUP_FIELD_POWER_DELIVERED] = (double)(r % 4000) / 1000;
+        s->values[ROLLUP_FIELD_POWER_RECEIVED] =
+            (double)((r >> 12) % 2000) / 1000;
+        s->values[ROLLUP_FIELD_ENERGY_DELIVERED] =
+            (double)energy_delivered / 1000;
+        s->values[ROLLUP_FIELD_ENERGY_RECEIVED] =
+            (double)energy_received / 1000;
+        rollup_update(t, &telegram);
+    }
+
+    for (enum rollup_resolution res = 0; res < ROLLUP_RES_COUNT; res++) {
+        struct rollup_slot newest;
+        const size_t nr_slots = ref_slot(res, 0, &newest);
+
+        // Every slot but the open one was reported closed once
+        zassert_true(nr_slots > 1, "%s", rollup_resolution_name(res));
+        zassert_equal(nr_closed[res], nr_slots - 1, "%s",
+                      rollup_resolution_name(res));
+        // And the rings hold the newest of them
+        zassert_equal(rollup_foreach(res, SIZE_MAX, ring_slot_cb, &res),
+                      MIN(nr_slots, ring_sizes[res]), "%s",
+                      rollup_resolution_name(res));
+    }
+}
+
+ZTEST_SUITE(rollup, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,130 @@
+"""HTTP load test of the firmware on native_sim, run by the twister pytest
+harness of testcase.yaml in the root of the repository:
+
+    west twister -T . -p native_sim --tag load
+
+Twister starts the firmware as the dut, built with CONFIG_APP_DEBUG_THREADS.
+The P1 port on its uart1 pty is fed by scripts/p1_sim.py, then
+scripts/http_load.py runs against the HTTP server on the zeth TAP interface
+and gates on its thresholds. Afterwards /debug/threads is probed for the
+stack high-water mark of every thread and the peak of the malloc heap, which
+are gated as well. The JSON summary is written to http_load.json in the build
+directory.
+
+The zeth interface has to be set up on the host beforehand with net-setup.sh
+of the Zephyr net-tools, the test is skipped without it.
+"""
+
+import json
+import logging
+import os
+import re
+import subprocess
+import sys
+import time
+import urllib.error
+import urllib.request
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+logger = logging.getLogger(__name__)
+
+SCRIPTS = Path(__file__).resolve().parents[2] / "scripts"
+URL = "http://192.0.2.1"
+PTY_RE = re.compile(r"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+
+# Thresholds of the gate, loose enough for a loaded CI host
+CONCURRENCY = 4
+DURATION_S = 20
+MAX_ERROR_RATE = 0.0
+MAX_P99_MS = 250
+MIN_RPS = 20
+MAX_STACK_PERMILLE = 900  # of the stack of any thread
+MAX_HEAP_PERMILLE = 750  # of the malloc heap
+
+pytestmark = pytest.mark.skipif(
+    not os.path.exists("/sys/class/net/zeth"),
+    reason="no zeth interface, run net-setup.sh first",
+)
+
+
+def wait_for_telegram(timeout: float) -> None:
+    """Wait until /data serves a telegram rather than 503."""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            with urllib.request.urlopen(URL + "/data", timeout=2) as res:
+                if res.status == 200:
+                    return
+        except (urllib.error.URLError, OSError):
+            pass
+        time.sleep(0.5)
+    pytest.fail("the firmware did not serve a telegram on /data")
+
+
+def peak_usage(threads: dict) -> dict:
+    """The highest stack use of any thread and the peak of the heap."""
+    assert "threads" in threads, f"/debug/threads failed: {threads}"
+    stacks = [
+        {"name": t["name"], "used": t["stack_used"], "size": t["stack_size"],
+         "permille": t["stack_used"] * 1000 // t["stack_size"]}
+        for t in threads["threads"] if t["stack_size"]
+    ]
+    heap = threads["heap"]
+    assert heap, "no heap statistics on /debug/threads"
+    heap_size = heap["free"] + heap["allocated"]
+    return {
+        "stack": max(stacks, key=lambda s: s["permille"]),
+        "heap": {"max_allocated": heap["max_allocated"], "size": heap_size,
+                 "permille": heap["max_allocated"] * 1000 // heap_size},
+    }
+
+
+@pytest.fixture
+def p1_sim(dut: DeviceAdapter):
+    lines = dut.readlines_until(regex=PTY_RE.pattern, timeout=10)
+    pty = PTY_RE.search("\n".join(lines)).group(1)
+    proc = subprocess.Popen(
+        [sys.executable, str(SCRIPTS / "p1_sim.py"), "--device", pty,
+         "--rate", "1"],
+    )
+    yield proc
+    proc.kill()
+    proc.wait()
+
+
+def test_http_load(dut: DeviceAdapter, p1_sim):
+    wait_for_telegram(timeout=30)
+    result = subprocess.run(
+        [sys.executable, str(SCRIPTS / "http_load.py"), URL,
+         "--concurrency", str(CONCURRENCY),
+         "--duration", str(DURATION_S),
+         "--keep-alive",
+         "--endpoint", "GET:/",
+         "--endpoint", "GET:/data",
+         "--endpoint", "GET:/api/v1/telegram",
+         "--endpoint", "GET:/metrics",
+         "--endpoint", "GET:/config",
+         "--probe", "/bus/stats",
+         "--probe", "/debug/threads",
+         "--max-error-rate", str(MAX_ERROR_RATE),
+         "--max-p99", str(MAX_P99_MS),
+         "--min-rps", str(MIN_RPS)],
+        capture_output=True,
+        text=True,
+        timeout=DURATION_S + 60,
+    )
+    logger.info(result.stdout)
+    summary = json.loads(result.stdout)
+    summary["peak"] = peak_usage(summary["probes"]["/debug/threads"])
+    logger.info(json.dumps(summary["peak"]))
+    out = Path(dut.device_config.build_dir) / "http_load.json"
+    out.write_text(json.dumps(summary, indent=2))
+
+    assert result.returncode == 0, f"thresholds exceeded: {summary['failed']}"
+    assert summary["peak"]["stack"]["permille"] <= MAX_STACK_PERMILLE, \
+        summary["peak"]
+    assert summary["peak"]["heap"]["permille"] <= MAX_HEAP_PERMILLE, \
+        summary["peak"]
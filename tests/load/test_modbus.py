@@ -0,0 +1,216 @@
+"""Modbus TCP test of the firmware on native_sim, run by the twister pytest
+harness of testcase.yaml in the root of the repository:
+
+    west twister -T . -p native_sim --tag modbus
+
+Twister starts the firmware built with the Modbus server. The P1 port on its
+uart1 pty is fed a telegram of scripts/p1_sim.py with the values of the map
+pinned, then the test reads the whole map as holding and as input registers
+and checks every register against the telegram. The round trip time of
+single register reads is measured from the host and gated together with
+the longest response time the firmware reports on /modbus/stats. The JSON
+summary is written to modbus.json in the build directory.
+
+The zeth interface has to be set up on the host beforehand with net-setup.sh
+of the Zephyr net-tools, the test is skipped without it.
+"""
+
+import argparse
+import json
+import logging
+import os
+import re
+import socket
+import struct
+import sys
+import time
+import urllib.request
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+import p1_sim  # noqa: E402
+
+logger = logging.getLogger(__name__)
+
+HOST = "192.0.2.1"
+URL = f"http://{HOST}"
+MODBUS_PORT = 502
+PTY_RE = re.compile(r"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+
+# Thresholds of the gate, loose enough for a loaded CI host
+NR_READS = 1000
+MAX_P99_MS = 5
+MAX_REQUEST_US = 5000
+
+# The lines of the telegram the register map is checked against
+PINNED = {
+    "1-0:1.7.0": "01.234*kW",
+    "1-0:2.7.0": "00.000*kW",
+    "1-0:32.7.0": "230.1*V",
+    "1-0:52.7.0": "229.8*V",
+    "1-0:72.7.0": "231.0*V",
+    "1-0:31.7.0": "002*A",
+    "1-0:51.7.0": "001*A",
+    "1-0:71.7.0": "003*A",
+    "1-0:1.8.1": "001234.567*kWh",
+    "1-0:1.8.2": "002345.678*kWh",
+    "1-0:2.8.1": "000012.345*kWh",
+    "1-0:2.8.2": "000023.456*kWh",
+    "0-0:96.14.0": "0002",
+    "0-0:96.7.21": "00007",
+}
+
+# Address, format and value of the registers of modbus_server.h, the
+# demand lines are not in a DSMR 5 telegram
+EXPECTED = [
+    (0, ">i", 1234),  # net power
+    (2, ">I", 1234),  # power delivered
+    (4, ">I", 0),  # power received
+    (6, ">H", 2301),  # voltage L1
+    (7, ">H", 2298),  # voltage L2
+    (8, ">H", 2310),  # voltage L3
+    (9, ">H", 2),  # current L1
+    (10, ">H", 1),  # current L2
+    (11, ">H", 3),  # current L3
+    (12, ">I", 1234567),  # energy delivered tariff 1
+    (14, ">I", 2345678),  # energy delivered tariff 2
+    (16, ">I", 12345),  # energy received tariff 1
+    (18, ">I", 23456),  # energy received tariff 2
+    (20, ">H", 2),  # tariff indicator
+    (21, ">H", 0x50),  # DSMR version
+    (22, ">I", 0),  # average demand
+    (24, ">I", 0),  # maximum demand
+    (26, ">I", 7),  # power failures
+]
+REG_SEQUENCE = 28
+REG_TIMESTAMP = 30
+NR_REGISTERS = 34
+
+pytestmark = pytest.mark.skipif(
+    not os.path.exists("/sys/class/net/zeth"),
+    reason="no zeth interface, run net-setup.sh first",
+)
+
+
+class Client:
+    """Just enough of a Modbus TCP client for reading registers."""
+
+    def __init__(self, host: str, port: int) -> None:
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.transaction = 0
+
+    def close(self) -> None:
+        self.sock.close()
+
+    def recv_exactly(self, n: int) -> bytes:
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("the server closed the connection")
+            data += chunk
+        return data
+
+    def read(self, function: int, address: int, count: int) -> bytes:
+        """Return the register bytes, raise on an exception response."""
+        self.transaction = (self.transaction + 1) & 0xFFFF
+        self.sock.sendall(struct.pack(">HHHBBHH", self.transaction, 0, 6, 1,
+                                      function, address, count))
+        transaction, protocol, length = struct.unpack(
+            ">HHH", self.recv_exactly(6))
+        pdu = self.recv_exactly(length)
+        assert transaction == self.transaction and protocol == 0
+        if pdu[1] & 0x80:
+            raise ValueError(f"exception {pdu[2]} for {function:#x}")
+        assert pdu[1] == function and pdu[2] == 2 * count
+        return pdu[3:]
+
+
+def get_json(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as res:
+        return json.load(res)
+
+
+@pytest.fixture
+def p1_port(dut: DeviceAdapter):
+    lines = dut.readlines_until(regex=PTY_RE.pattern, timeout=10)
+    pty = PTY_RE.search("\n".join(lines)).group(1)
+    with open(pty, "wb", buffering=0) as port:
+        yield port
+
+
+@pytest.fixture
+def client():
+    deadline = time.monotonic() + 30
+    while True:
+        try:
+            client = Client(HOST, MODBUS_PORT)
+            break
+        except OSError:
+            if time.monotonic() > deadline:
+                pytest.fail("the Modbus server did not accept a connection")
+            time.sleep(0.5)
+    yield client
+    client.close()
+
+
+def feed(port, client: Client) -> p1_sim.Meter:
+    """Send the pinned telegram until the map holds it."""
+    args = argparse.Namespace(
+        seed=1, dsmr="50", phases=3, mbus=1,
+        set=[f"{code}={value}" for code, value in PINNED.items()],
+    )
+    meter = p1_sim.Meter(args)
+    deadline = time.monotonic() + 30
+    while time.monotonic() < deadline:
+        port.write(meter.step())
+        time.sleep(1)
+        regs = client.read(0x03, 0, NR_REGISTERS)
+        if struct.unpack_from(">I", regs, REG_SEQUENCE * 2)[0] > 0:
+            return meter
+    pytest.fail("the register map was not updated from a telegram")
+
+
+def test_modbus(dut: DeviceAdapter, p1_port, client: Client):
+    meter = feed(p1_port, client)
+
+    for function in (0x03, 0x04):
+        regs = client.read(function, 0, NR_REGISTERS)
+        for address, fmt, value in EXPECTED:
+            got = struct.unpack_from(fmt, regs, address * 2)[0]
+            assert got == value, f"{function:#x} register {address}"
+        timestamp = struct.unpack_from(">q", regs, REG_TIMESTAMP * 2)[0]
+        assert timestamp == meter.timestamp
+
+    with pytest.raises(ValueError, match="exception 2"):
+        client.read(0x03, NR_REGISTERS - 1, 2)
+    with pytest.raises(ValueError, match="exception 1"):
+        client.read(0x06, 0, 1)
+
+    latencies = []
+    for n in range(NR_READS):
+        function = 0x03 if n % 2 else 0x04
+        start = time.perf_counter()
+        client.read(function, n % NR_REGISTERS, 1)
+        latencies.append((time.perf_counter() - start) * 1000)
+    stats = get_json(URL + "/modbus/stats")
+
+    result = {
+        "reads": NR_READS,
+        "latency_p50_ms": p1_sim.percentile(latencies, 50),
+        "latency_p99_ms": p1_sim.percentile(latencies, 99),
+        "latency_max_ms": max(latencies),
+        "max_request_us": stats["max_request_us"],
+        "exceptions": stats["exceptions"],
+    }
+    logger.info(json.dumps(result))
+    out = Path(dut.device_config.build_dir) / "modbus.json"
+    out.write_text(json.dumps(result, indent=2))
+
+    assert result["latency_p99_ms"] <= MAX_P99_MS, result
+    assert result["max_request_us"] <= MAX_REQUEST_US, result
+    assert result["exceptions"] == 2, result
@@ -0,0 +1,182 @@
+"""MQTT publish rate test of the firmware on native_sim, run by the twister
+pytest harness of testcase.yaml in the root of the repository:
+
+    west twister -T . -p native_sim --tag mqtt
+
+Twister starts the firmware built with the MQTT publisher against a broker
+on the host end of the zeth TAP interface. The test is that broker, it
+accepts the connection and timestamps every PUBLISH. The P1 port on the
+uart1 pty is fed with telegrams of the household model of scripts/p1_sim.py
+at 1 Hz and at 100 Hz, and the published values per second, the TCP writes
+per second and the telegram to PUBLISH latency of power_delivered are
+measured for both. The JSON summary is written to mqtt_rate.json in the
+build directory.
+
+The zeth interface has to be set up on the host beforehand with net-setup.sh
+of the Zephyr net-tools, the test is skipped without it.
+"""
+
+import argparse
+import json
+import logging
+import os
+import re
+import socket
+import sys
+import threading
+import time
+import urllib.request
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+import p1_sim  # noqa: E402
+
+logger = logging.getLogger(__name__)
+
+URL = "http://192.0.2.1"
+BROKER_PORT = 1883
+TOPIC = b"p1-dsmr/power_delivered"
+PTY_RE = re.compile(r"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+
+# Thresholds of the gate, loose enough for a loaded CI host
+DURATION_S = 10
+MAX_P99_MS = {1: 100, 100: 250}
+MAX_DROPPED = 0
+
+pytestmark = pytest.mark.skipif(
+    not os.path.exists("/sys/class/net/zeth"),
+    reason="no zeth interface, run net-setup.sh first",
+)
+
+
+class Broker(threading.Thread):
+    """Just enough of an MQTT 3.1.1 broker for QoS 0 publishers."""
+
+    def __init__(self) -> None:
+        super().__init__(daemon=True)
+        self.server = socket.create_server(("", BROKER_PORT), reuse_port=True)
+        self.publishes = []
+        self.connected = threading.Event()
+
+    @staticmethod
+    def read_packet(conn: socket.socket, stream: bytearray):
+        """Return the type and body of the next packet, None when closed."""
+        while True:
+            if len(stream) >= 2:
+                length, shift, pos = 0, 0, 1
+                while pos < len(stream):
+                    byte = stream[pos]
+                    length |= (byte & 0x7F) << shift
+                    shift += 7
+                    pos += 1
+                    if not byte & 0x80:
+                        break
+                else:
+                    pos = -1
+                if pos > 0 and len(stream) >= pos + length:
+                    kind = stream[0] >> 4
+                    body = bytes(stream[pos:pos + length])
+                    del stream[:pos + length]
+                    return kind, body
+            data = conn.recv(4096)
+            if not data:
+                return None
+            stream += data
+
+    def run(self) -> None:
+        while True:
+            conn, _ = self.server.accept()
+            stream = bytearray()
+            while True:
+                packet = self.read_packet(conn, stream)
+                if packet is None:
+                    break
+                kind, body = packet
+                now = time.monotonic()
+                if kind == 1:  # CONNECT
+                    conn.sendall(b"\x20\x02\x00\x00")
+                    self.connected.set()
+                elif kind == 3:  # PUBLISH, QoS 0 has no packet identifier
+                    topic_len = int.from_bytes(body[:2], "big")
+                    topic = body[2:2 + topic_len]
+                    self.publishes.append((now, topic, body[2 + topic_len:]))
+                elif kind == 12:  # PINGREQ
+                    conn.sendall(b"\xd0\x00")
+            conn.close()
+
+
+def get_json(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as res:
+        return json.load(res)
+
+
+@pytest.fixture
+def broker():
+    broker = Broker()
+    broker.start()
+    yield broker
+    broker.server.close()
+
+
+@pytest.fixture
+def p1_port(dut: DeviceAdapter):
+    lines = dut.readlines_until(regex=PTY_RE.pattern, timeout=10)
+    pty = PTY_RE.search("\n".join(lines)).group(1)
+    with open(pty, "wb", buffering=0) as port:
+        yield port
+
+
+def run_rate(port, broker: Broker, rate: int) -> dict:
+    """Feed telegrams at rate per second and measure what is published."""
+    args = argparse.Namespace(seed=rate, dsmr="50", phases=3, mbus=1, set=[])
+    meter = p1_sim.Meter(args)
+    sent = {}
+    before = get_json(URL + "/mqtt/stats")
+    first = len(broker.publishes)
+
+    start = time.monotonic()
+    for n in range(DURATION_S * rate):
+        telegram = meter.step()
+        delivered = re.search(rb"1-0:1\.7\.0\((\d+\.\d+)\*kW\)", telegram)
+        time.sleep(max(0.0, start + n / rate - time.monotonic()))
+        port.write(telegram)
+        sent[float(delivered.group(1))] = time.monotonic()
+    time.sleep(2)
+    after = get_json(URL + "/mqtt/stats")
+
+    latencies = []
+    for at, topic, payload in broker.publishes[first:]:
+        sent_at = sent.pop(float(payload), None) if topic == TOPIC else None
+        if sent_at is not None:
+            latencies.append((at - sent_at) * 1000)
+    latencies.sort()
+
+    published = after["published"] - before["published"]
+    return {
+        "rate": rate,
+        "published_per_s": published / DURATION_S,
+        "writes_per_s": (after["batches"] - before["batches"]) / DURATION_S,
+        "dropped": after["dropped"] - before["dropped"],
+        "suppressed": after["suppressed"] - before["suppressed"],
+        "publish_ns": after["publish_ns"],
+        "latency_samples": len(latencies),
+        "latency_p50_ms": p1_sim.percentile(latencies, 50),
+        "latency_p99_ms": p1_sim.percentile(latencies, 99),
+    }
+
+
+def test_mqtt_rate(dut: DeviceAdapter, broker: Broker, p1_port):
+    assert broker.connected.wait(30), "the firmware did not connect"
+    results = [run_rate(p1_port, broker, rate) for rate in (1, 100)]
+    for result in results:
+        logger.info(json.dumps(result))
+    out = Path(dut.device_config.build_dir) / "mqtt_rate.json"
+    out.write_text(json.dumps(results, indent=2))
+
+    for result in results:
+        assert result["latency_samples"] > 0
+        assert result["dropped"] <= MAX_DROPPED, result
+        assert result["latency_p99_ms"] <= MAX_P99_MS[result["rate"]], result
@@ -0,0 +1,164 @@
+"""UDP multicast latency test of the firmware on native_sim, run by the twister
+pytest harness of testcase.yaml in the root of the repository:
+
+    west twister -T . -p native_sim --tag multicast
+
+Twister starts the firmware built with the multicast sender and the latency
+histograms. The test joins the group on the host end of the zeth TAP
+interface and feeds the P1 port on the uart1 pty with telegrams of
+scripts/p1_sim.py at 1 Hz. Every raw datagram has to carry the telegram as
+sent, with the sequence numbers of both types counting up without a gap.
+The end of the trailer to datagram sent latency of the multicast stage of
+/stats over those telegrams is gated on its p99 and written to multicast.json
+in the build directory together with the counters of /multicast/stats. The
+histogram has power of two buckets, the percentiles are their upper bounds.
+
+The zeth interface has to be set up on the host beforehand with net-setup.sh
+of the Zephyr net-tools, the test is skipped without it.
+"""
+
+import argparse
+import json
+import logging
+import os
+import re
+import socket
+import struct
+import sys
+import time
+import urllib.request
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+import p1_sim  # noqa: E402
+
+logger = logging.getLogger(__name__)
+
+URL = "http://192.0.2.1"
+HOST_ADDR = "192.0.2.2"
+GROUP = "239.255.49.49"
+GROUP_PORT = 4949
+PTY_RE = re.compile(r"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+
+# Header of multicast.h
+HEADER = struct.Struct(">2sBBI")
+TYPE_RAW = 0
+TYPE_CBOR = 1
+
+# Thresholds of the gate, loose enough for a loaded CI host
+NR_TELEGRAMS = 20
+MAX_P99_US = 4096
+
+pytestmark = pytest.mark.skipif(
+    not os.path.exists("/sys/class/net/zeth"),
+    reason="no zeth interface, run net-setup.sh first",
+)
+
+
+def get_json(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as res:
+        return json.load(res)
+
+
+def stage(stats: dict, name: str) -> dict:
+    return next(s for s in stats["stages"] if s["name"] == name)
+
+
+def bucket_percentile(histogram: dict, pct: float) -> int:
+    """Upper bound in us of the bucket holding the percentile."""
+    rank = histogram["count"] * pct / 100
+    seen = 0
+    for i, count in enumerate(histogram["buckets"]):
+        seen += count
+        if count and seen >= rank:
+            return 1 << i
+    return 0
+
+
+@pytest.fixture
+def p1_port(dut: DeviceAdapter):
+    lines = dut.readlines_until(regex=PTY_RE.pattern, timeout=10)
+    pty = PTY_RE.search("\n".join(lines)).group(1)
+    with open(pty, "wb", buffering=0) as port:
+        yield port
+
+
+@pytest.fixture
+def group():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", GROUP_PORT))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP,
+                    socket.inet_aton(GROUP) + socket.inet_aton(HOST_ADDR))
+    sock.settimeout(5)
+    yield sock
+    sock.close()
+
+
+def receive(group: socket.socket, sequence: int) -> dict:
+    """Return the payloads by type of the telegram with a sequence number."""
+    payloads = {}
+    while len(payloads) < 2:
+        data = group.recv(65536)
+        magic, version, kind, seq = HEADER.unpack_from(data)
+        assert magic == b"P1" and version == 1, data[:HEADER.size]
+        if seq == sequence:
+            payloads[kind] = data[HEADER.size:]
+    return payloads
+
+
+def test_multicast(dut: DeviceAdapter, p1_port, group: socket.socket):
+    args = argparse.Namespace(seed=1, dsmr="50", phases=3, mbus=1, set=[])
+    meter = p1_sim.Meter(args)
+
+    # Wait for the first telegram to get through, the network comes up late
+    deadline = time.monotonic() + 30
+    while True:
+        telegram = meter.step()
+        p1_port.write(telegram)
+        try:
+            data = group.recv(65536)
+            break
+        except socket.timeout:
+            if time.monotonic() > deadline:
+                pytest.fail("no datagram from the firmware")
+    first = HEADER.unpack_from(data)[3]
+    time.sleep(1)
+    before = stage(get_json(URL + "/stats"), "multicast")
+
+    for n in range(1, NR_TELEGRAMS + 1):
+        telegram = meter.step()
+        p1_port.write(telegram)
+        payloads = receive(group, first + n)
+        assert payloads[TYPE_RAW] == telegram, f"telegram {n}"
+        assert payloads[TYPE_CBOR], f"telegram {n}"
+        time.sleep(1)
+
+    histogram = stage(get_json(URL + "/stats"), "multicast")
+    stats = get_json(URL + "/multicast/stats")
+    histogram["buckets"] = [
+        after - prior
+        for after, prior in zip(histogram["buckets"], before["buckets"])
+    ]
+    histogram["count"] -= before["count"]
+
+    result = {
+        "telegrams": NR_TELEGRAMS,
+        "recorded": histogram["count"],
+        "latency_p50_us": bucket_percentile(histogram, 50),
+        "latency_p99_us": bucket_percentile(histogram, 99),
+        "latency_max_us": bucket_percentile(histogram, 100),
+        "avg_latency_us": stats["avg_latency_us"],
+        "datagrams": stats["datagrams"],
+        "failed": stats["failed"],
+    }
+    logger.info(json.dumps(result))
+    out = Path(dut.device_config.build_dir) / "multicast.json"
+    out.write_text(json.dumps(result, indent=2))
+
+    assert result["recorded"] == NR_TELEGRAMS, result
+    assert result["failed"] == 0, result
+    assert result["latency_p99_us"] <= MAX_P99_US, result
@@ -0,0 +1,210 @@
+"""Upload throughput and catch-up test of the firmware on native_sim, run by
+the twister pytest harness of testcase.yaml in the root of the repository:
+
+    west twister -T . -p native_sim --tag upload
+
+Twister starts the firmware built with the uploader pointed at the host end
+of the zeth TAP interface. The test is that endpoint, an HTTP sink which
+counts the bytes and lines of every POST it accepts. The P1 port on the
+uart1 pty is fed with telegrams of scripts/p1_sim.py at 10 Hz, each one a
+line as the sample interval is a second of telegram time.
+
+First the sink accepts every POST, which measures the bytes per second
+received and the cost of appending a telegram on the device. Then it answers
+503 while telegrams keep coming, so the batches are spilled to flash, and
+accepts again, which measures the time to replay the backlog. Every line has
+to arrive exactly once. The JSON summary is written to upload.json in the
+build directory.
+
+The zeth interface has to be set up on the host beforehand with net-setup.sh
+of the Zephyr net-tools, the test is skipped without it.
+"""
+
+import argparse
+import json
+import logging
+import os
+import re
+import sys
+import threading
+import time
+import urllib.request
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+
+import pytest
+from twister_harness import DeviceAdapter
+
+sys.path.insert(0, str(Path(__file__).resolve().parents[2] / "scripts"))
+import p1_sim  # noqa: E402
+
+logger = logging.getLogger(__name__)
+
+URL = "http://192.0.2.1"
+SINK_PORT = 8086
+PTY_RE = re.compile(r"uart_1 connected to pseudotty: (/dev/pts/\d+)")
+
+RATE = 10
+NR_ONLINE = 100   # telegrams fed while the sink accepts
+NR_OFFLINE = 100  # telegrams fed while the sink answers 503
+
+# Thresholds of the gate, loose enough for a loaded CI host
+MIN_BYTES_PER_S = 2000
+MAX_CATCH_UP_MS = 10000
+TIMEOUT_S = 30
+
+pytestmark = pytest.mark.skipif(
+    not os.path.exists("/sys/class/net/zeth"),
+    reason="no zeth interface, run net-setup.sh first",
+)
+
+
+class Sink(ThreadingHTTPServer):
+    """Influx write endpoint which only counts what it accepts."""
+
+    def __init__(self) -> None:
+        super().__init__(("", SINK_PORT), SinkHandler)
+        self.up = True
+        self.lock = threading.Lock()
+        self.posts = []  # time, bytes and lines of every accepted POST
+        self.timestamps = []  # of every line accepted
+        self.rejected = 0
+
+    def totals(self) -> tuple:
+        with self.lock:
+            return (sum(p[1] for p in self.posts),
+                    sum(p[2] for p in self.posts))
+
+
+class SinkHandler(BaseHTTPRequestHandler):
+    def do_POST(self) -> None:
+        body = self.rfile.read(int(self.headers["Content-Length"]))
+        sink = self.server
+        with sink.lock:
+            if sink.up:
+                lines = body.splitlines()
+                sink.posts.append((time.monotonic(), len(body), len(lines)))
+                sink.timestamps += [line.rsplit(b" ", 1)[1] for line in lines]
+            else:
+                sink.rejected += 1
+        self.send_response(204 if sink.up else 503)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, format, *args) -> None:
+        pass
+
+
+def get_json(url: str) -> dict:
+    with urllib.request.urlopen(url, timeout=5) as res:
+        return json.load(res)
+
+
+def wait_for(predicate, what: str) -> float:
+    """Poll until predicate holds, return the time it first held."""
+    deadline = time.monotonic() + TIMEOUT_S
+    while not predicate():
+        if time.monotonic() > deadline:
+            pytest.fail(f"timed out waiting for {what}")
+        time.sleep(0.1)
+    return time.monotonic()
+
+
+@pytest.fixture
+def sink():
+    sink = Sink()
+    thread = threading.Thread(target=sink.serve_forever, daemon=True)
+    thread.start()
+    yield sink
+    sink.shutdown()
+    sink.server_close()
+
+
+@pytest.fixture
+def p1_port(dut: DeviceAdapter):
+    lines = dut.readlines_until(regex=PTY_RE.pattern, timeout=10)
+    pty = PTY_RE.search("\n".join(lines)).group(1)
+    with open(pty, "wb", buffering=0) as port:
+        yield port
+
+
+def feed(port, meter: p1_sim.Meter, count: int) -> None:
+    start = time.monotonic()
+    for n in range(count):
+        time.sleep(max(0.0, start + n / RATE - time.monotonic()))
+        port.write(meter.step())
+
+
+def test_upload(dut: DeviceAdapter, sink: Sink, p1_port):
+    args = argparse.Namespace(seed=1, dsmr="50", phases=3, mbus=1, set=[])
+    meter = p1_sim.Meter(args)
+
+    # The network comes up after the P1 port, wait for the first line
+    feed(p1_port, meter, 1)
+    wait_for(lambda: get_json(URL + "/upload/stats")["lines"] > 0,
+             "the first line")
+    stats = get_json(URL + "/upload/stats")
+    wait_for(lambda: sink.totals()[1] == stats["lines"], "the first POST")
+
+    # Online, every batch is posted once full or the interval expires
+    before = sink.totals()
+    start = time.monotonic()
+    feed(p1_port, meter, NR_ONLINE)
+    time.sleep(1)
+    stats = get_json(URL + "/upload/stats")
+    end = wait_for(lambda: sink.totals()[1] == stats["lines"], "the lines")
+    after = sink.totals()
+    online = {
+        "lines": after[1] - before[1],
+        "bytes": after[0] - before[0],
+        "bytes_per_s": round((after[0] - before[0]) / (end - start)),
+        "bytes_per_line": round((after[0] - before[0]) /
+                                (after[1] - before[1])),
+        "line_ns": stats["line_ns"],
+        "post_bytes_per_s": stats["bytes_per_s"],
+    }
+
+    # Offline, the batches are spilled to flash
+    sink.up = False
+    feed(p1_port, meter, NR_OFFLINE)
+    wait_for(lambda: sink.rejected > 0 and
+             get_json(URL + "/upload/stats")["spilled"] > 0, "a spill")
+    spilled = get_json(URL + "/upload/stats")["spilled"]
+    posts_before = len(sink.posts)
+
+    # Back online, the backlog is replayed oldest first
+    sink.up = True
+    wait_for(lambda: get_json(URL + "/upload/stats")["spilled"] == 0,
+             "the backlog to be replayed")
+    stats = get_json(URL + "/upload/stats")
+    wait_for(lambda: sink.totals()[1] == stats["lines"], "every line")
+    replayed = sink.posts[posts_before:]
+    replay_s = replayed[-1][0] - replayed[0][0]
+    offline = {
+        "lines": NR_OFFLINE,
+        "spilled_batches": spilled,
+        "catch_up_batches": stats["catch_up_batches"],
+        "catch_up_ms": stats["catch_up_ms"],
+        "sink_catch_up_ms": round(replay_s * 1000),
+        "replay_bytes_per_s": round(sum(p[1] for p in replayed[1:]) /
+                                    replay_s) if replay_s else None,
+    }
+
+    result = {
+        "online": online,
+        "offline": offline,
+        "dropped_lines": stats["dropped_lines"],
+        "dropped_batches": stats["dropped_batches"],
+    }
+    logger.info(json.dumps(result))
+    out = Path(dut.device_config.build_dir) / "upload.json"
+    out.write_text(json.dumps(result, indent=2))
+
+    assert online["lines"] == NR_ONLINE, result
+    assert len(sink.timestamps) == stats["lines"], result
+    assert len(set(sink.timestamps)) == len(sink.timestamps), result
+    assert result["dropped_lines"] == 0, result
+    assert result["dropped_batches"] == 0, result
+    assert online["bytes_per_s"] >= MIN_BYTES_PER_S, result
+    assert offline["catch_up_batches"] > 0, result
+    assert offline["catch_up_ms"] <= MAX_CATCH_UP_MS, result
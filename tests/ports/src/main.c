@@ -0,0 +1,213 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Tests of two P1 ports receiving at the same time
+ *
+ * The ports are dsmr,p1 nodes on emulated UARTs. The telegrams are put into
+ * their receive FIFOs in small chunks, alternating between the ports, so the
+ * bytes of both reach the receive interrupts interleaved like they would
+ * from two meters.
+ */
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define NR_PORTS 2
+#define CHUNK_LEN 16
+#define RX_TIMEOUT K_SECONDS(1)
+
+// The UART of the port with the given index
+#define PORT_UART(idx) DEVICE_DT_GET(DT_BUS(DT_INST(idx, dsmr_p1)))
+
+BUILD_ASSERT(DSMR_P1_NUM_PORTS == NR_PORTS);
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct received {
+    int port;
+    float power_delivered;
+    char equipment_id[DSMR_P1_EQUIPMENT_ID_MAX_LEN];
+};
+
+struct telegram_buf {
+    char data[DSMR_P1_TELEGRAM_MAX_SIZE];
+    size_t len;
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const struct device *const uarts[NR_PORTS] = {PORT_UART(0),
+                                                     PORT_UART(1)};
+
+K_MSGQ_DEFINE(any_msgq, sizeof(struct received), 8, 4);
+K_MSGQ_DEFINE(port_1_msgq, sizeof(struct received), 8, 4);
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+static void listener_cb(const struct dsmr_p1_frame *frame, void *user_data) {
+    struct k_msgq *msgq = user_data;
+    struct received r = {
+        .port = frame->port,
+        .power_delivered = frame->telegram.power_delivered,
+    };
+
+    strcpy(r.equipment_id, frame->telegram.equipment_id);
+    (void)k_msgq_put(msgq, &r, K_NO_WAIT);
+}
+
+DSMR_P1_LISTENER_DEFINE(any_listener, DSMR_P1_PORT_ANY, listener_cb,
+                        &any_msgq);
+DSMR_P1_LISTENER_DEFINE(port_1_listener, 1, listener_cb, &port_1_msgq);
+
+// A DSMR 5 telegram with a valid CRC, or a wrong one when corrupt
+static void build(struct telegram_buf *t, const char *id, const char *power,
+                  bool corrupt) {
+    int len = snprintf(t->data, sizeof(t->data),
+                       "/TST5\\2PORTS\r\n"
+                       "\r\n"
+                       "1-3:0.2.8(50)\r\n"
+                       "0-0:1.0.0(261018120000S)\r\n"
+                       "0-0:96.1.1(%s)\r\n"
+                       "1-0:1.7.0(%s*kW)\r\n"
+                       "!",
+                       id, power);
+    uint16_t crc = dsmr_p1_crc((const uint8_t *)t->data, len);
+
+    if (corrupt) {
+        crc ^= 0x0001;
+    }
+    len += snprintf(&t->data[len], sizeof(t->data) - len, "%04X\r\n", crc);
+    t->len = len;
+}
+
+// Feed the telegrams of both ports a chunk at a time, alternating
+static void feed(const struct telegram_buf *t0, const struct telegram_buf *t1) {
+    const struct telegram_buf *t[NR_PORTS] = {t0, t1};
+    size_t offset[NR_PORTS] = {0};
+
+    while (offset[0] < t[0]->len || offset[1] < t[1]->len) {
+        for (size_t i = 0; i < NR_PORTS; i++) {
+            const size_t len = MIN(CHUNK_LEN, t[i]->len - offset[i]);
+            if (len == 0) {
+                continue;
+            }
+            zassert_equal(uart_emul_put_rx_data(
+                              uarts[i], (const uint8_t *)&t[i]->data[offset[i]],
+                              len),
+                          len);
+            offset[i] += len;
+            // Let the emulated interrupt drain the FIFO
+            k_sleep(K_MSEC(1));
+        }
+    }
+}
+
+static void expect(struct k_msgq *msgq, int port, const char *id,
+                   float power) {
+    struct received r;
+
+    zassert_ok(k_msgq_get(msgq, &r, RX_TIMEOUT), "no telegram of port %d",
+               port);
+    zassert_equal(r.port, port);
+    zassert_str_equal(r.equipment_id, id);
+    zassert_within(r.power_delivered, power, 0.0005f);
+}
+
+static void *suite_setup(void) {
+    for (size_t i = 0; i < NR_PORTS; i++) {
+        zassert_true(device_is_ready(uarts[i]));
+    }
+    zassert_equal(dsmr_p1_port_count(), NR_PORTS);
+    zassert_ok(dsmr_p1_enable());
+    return NULL;
+}
+
+static void before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    k_msgq_purge(&any_msgq);
+    k_msgq_purge(&port_1_msgq);
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(ports, test_interleaved_telegrams_stay_apart) {
+    struct telegram_buf t0;
+    struct telegram_buf t1;
+
+    build(&t0, "4D455445523030", "01.111", false);
+    build(&t1, "4D455445523031", "02.222", false);
+    feed(&t0, &t1);
+
+    // Port 0 finishes first as it is fed first
+    expect(&any_msgq, 0, "4D455445523030", 1.111f);
+    expect(&any_msgq, 1, "4D455445523031", 2.222f);
+    zassert_equal(k_msgq_num_used_get(&any_msgq), 0);
+}
+
+ZTEST(ports, test_listener_of_one_port) {
+    struct telegram_buf t0;
+    struct telegram_buf t1;
+
+    build(&t0, "4D455445523030", "00.500", false);
+    build(&t1, "4D455445523031", "00.750", false);
+    for (size_t i = 0; i < 3; i++) {
+        feed(&t0, &t1);
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        expect(&port_1_msgq, 1, "4D455445523031", 0.750f);
+    }
+    zassert_equal(k_msgq_num_used_get(&port_1_msgq), 0);
+    zassert_equal(k_msgq_num_used_get(&any_msgq), 6);
+}
+
+ZTEST(ports, test_corrupt_telegram_on_one_port) {
+    struct telegram_buf t0;
+    struct telegram_buf t1;
+    struct dsmr_p1_rx_stats before;
+    struct dsmr_p1_rx_stats after;
+
+    dsmr_p1_get_rx_stats(&before);
+    build(&t0, "4D455445523030", "03.333", false);
+    build(&t1, "4D455445523031", "04.444", true);
+    feed(&t0, &t1);
+
+    expect(&any_msgq, 0, "4D455445523030", 3.333f);
+    zassert_equal(k_msgq_get(&port_1_msgq, &(struct received){0}, RX_TIMEOUT),
+                  -EAGAIN);
+    dsmr_p1_get_rx_stats(&after);
+    zassert_equal(after.received, before.received + 1);
+    zassert_equal(after.lost[DSMR_P1_LOSS_CRC],
+                  before.lost[DSMR_P1_LOSS_CRC] + 1);
+
+    // The port goes on with the next telegram
+    build(&t1, "4D455445523031", "04.444", false);
+    feed(&t0, &t1);
+    expect(&port_1_msgq, 1, "4D455445523031", 4.444f);
+}
+
+ZTEST_SUITE(ports, NULL, suite_setup, before, NULL, NULL);
@@ -0,0 +1,208 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Tests of the sensor driver of the P1 ports
+ *
+ * The port is a dsmr,p1 node on an emulated UART, a telegram put into its
+ * receive FIFO is read back through the fetch and get calls, the data ready
+ * trigger and an RTIO read with the decoder of the driver.
+ */
+
+#include <dsmr_p1/dsmr_p1.h>
+#include <dsmr_p1/sensor.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define P1_NODE DT_INST(0, dsmr_p1)
+#define CHUNK_LEN 64
+#define RX_TIMEOUT K_SECONDS(1)
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const struct device *const uart = DEVICE_DT_GET(DT_BUS(P1_NODE));
+static const struct device *const sensor = DEVICE_DT_GET(P1_NODE);
+
+static const struct sensor_trigger data_ready = {
+    .type = SENSOR_TRIG_DATA_READY,
+    .chan = SENSOR_CHAN_ALL,
+};
+
+static K_SEM_DEFINE(data_ready_sem, 0, 1);
+
+SENSOR_DT_READ_IODEV(p1_iodev, P1_NODE, {SENSOR_CHAN_POWER, 0},
+                     {SENSOR_CHAN_VOLTAGE, 2}, {SENSOR_CHAN_CURRENT, 1},
+                     {DSMR_P1_CHAN_ENERGY_DELIVERED, 1});
+RTIO_DEFINE(p1_rtio, 1, 1);
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+static void data_ready_handler(const struct device *dev,
+                               const struct sensor_trigger *trigger) {
+    if (dev == sensor && trigger == &data_ready) {
+        k_sem_give(&data_ready_sem);
+    }
+}
+
+// Put a DSMR 5 telegram with the given power delivered into the FIFO
+static void feed(const char *power) {
+    char buf[DSMR_P1_TELEGRAM_MAX_SIZE];
+    int len = snprintf(buf, sizeof(buf),
+                       "/TST5\\2SENSOR\r\n"
+                       "\r\n"
+                       "1-3:0.2.8(50)\r\n"
+                       "0-0:1.0.0(261018120000S)\r\n"
+                       "1-0:1.8.1(001234.567*kWh)\r\n"
+                       "1-0:1.8.2(002345.678*kWh)\r\n"
+                       "1-0:2.8.1(000012.345*kWh)\r\n"
+                       "1-0:2.8.2(000023.456*kWh)\r\n"
+                       "1-0:1.7.0(%s*kW)\r\n"
+                       "1-0:2.7.0(00.250*kW)\r\n"
+                       "1-0:32.7.0(230.1*V)\r\n"
+                       "1-0:52.7.0(231.2*V)\r\n"
+                       "1-0:72.7.0(229.9*V)\r\n"
+                       "1-0:31.7.0(001*A)\r\n"
+                       "1-0:51.7.0(002*A)\r\n"
+                       "1-0:71.7.0(003*A)\r\n"
+                       "!",
+                       power);
+    const uint16_t crc = dsmr_p1_crc((const uint8_t *)buf, len);
+
+    len += snprintf(&buf[len], sizeof(buf) - len, "%04X\r\n", crc);
+    for (int offset = 0; offset < len;) {
+        offset += uart_emul_put_rx_data(uart, (const uint8_t *)&buf[offset],
+                                        MIN(CHUNK_LEN, len - offset));
+        // Let the emulated interrupt drain the FIFO
+        k_sleep(K_MSEC(1));
+    }
+}
+
+static double channel_value(enum sensor_channel chan) {
+    struct sensor_value val;
+
+    zassert_ok(sensor_channel_get(sensor, chan, &val));
+    return sensor_value_to_double(&val);
+}
+
+static double decode_value(const uint8_t *buf, enum sensor_channel chan,
+                           uint16_t idx) {
+    const struct sensor_decoder_api *decoder;
+    const struct sensor_chan_spec spec = {.chan_type = chan, .chan_idx = idx};
+    struct sensor_q31_data data;
+    uint32_t fit = 0;
+
+    zassert_ok(sensor_get_decoder(sensor, &decoder));
+    zassert_equal(decoder->decode(buf, spec, &fit, 1, &data), 1);
+    zassert_equal(data.header.reading_count, 1);
+    return (double)data.readings[0].value * (1LL << data.shift) /
+           (1LL << 31);
+}
+
+static void *suite_setup(void) {
+    zassert_true(device_is_ready(uart));
+    zassert_true(device_is_ready(sensor));
+    zassert_ok(sensor_trigger_set(sensor, &data_ready, data_ready_handler));
+    zassert_ok(dsmr_p1_enable());
+
+    // Nothing is served before the first telegram of the port
+    zassert_equal(sensor_sample_fetch(sensor), -ENODATA);
+
+    feed("01.193");
+    zassert_ok(k_sem_take(&data_ready_sem, RX_TIMEOUT));
+    return NULL;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(sensor, test_fetch_and_get) {
+    zassert_ok(sensor_sample_fetch(sensor));
+    zassert_within(channel_value(SENSOR_CHAN_POWER), 1193.0, 0.01);
+    zassert_within(channel_value(DSMR_P1_CHAN_POWER_RECEIVED), 250.0, 0.01);
+    zassert_within(channel_value(SENSOR_CHAN_VOLTAGE), 230.1, 0.01);
+    zassert_within(channel_value(SENSOR_CHAN_CURRENT), 1.0, 0.01);
+    zassert_within(channel_value(DSMR_P1_CHAN_ENERGY_DELIVERED), 1234.567,
+                   0.01);
+    zassert_within(channel_value(DSMR_P1_CHAN_ENERGY_RECEIVED), 12.345, 0.01);
+}
+
+ZTEST(sensor, test_trigger_and_fetch_follow_telegrams) {
+    zassert_ok(sensor_sample_fetch(sensor));
+    feed("02.500");
+    zassert_ok(k_sem_take(&data_ready_sem, RX_TIMEOUT));
+
+    // The fetched sample stays until the next fetch
+    zassert_within(channel_value(SENSOR_CHAN_POWER), 1193.0, 0.01);
+    zassert_ok(sensor_sample_fetch(sensor));
+    zassert_within(channel_value(SENSOR_CHAN_POWER), 2500.0, 0.01);
+
+    feed("01.193");
+    zassert_ok(k_sem_take(&data_ready_sem, RX_TIMEOUT));
+}
+
+ZTEST(sensor, test_read_and_decode) {
+    uint8_t buf[128];
+
+    zassert_ok(sensor_read(&p1_iodev, &p1_rtio, buf, sizeof(buf)));
+    zassert_within(decode_value(buf, SENSOR_CHAN_POWER, 0), 1193.0, 0.01);
+    zassert_within(decode_value(buf, SENSOR_CHAN_VOLTAGE, 1), 231.2, 0.01);
+    zassert_within(decode_value(buf, SENSOR_CHAN_VOLTAGE, 2), 229.9, 0.01);
+    zassert_within(decode_value(buf, SENSOR_CHAN_CURRENT, 2), 3.0, 0.01);
+    zassert_within(decode_value(buf, DSMR_P1_CHAN_ENERGY_DELIVERED, 1),
+                   2345.678, 0.01);
+    zassert_within(decode_value(buf, DSMR_P1_CHAN_ENERGY_RECEIVED, 1), 23.456,
+                   0.01);
+}
+
+ZTEST(sensor, test_unsupported_channels) {
+    const struct sensor_decoder_api *decoder;
+    struct sensor_value val;
+    const struct sensor_chan_spec voltage_4 = {
+        .chan_type = SENSOR_CHAN_VOLTAGE,
+        .chan_idx = 3,
+    };
+    const struct sensor_chan_spec energy_3 = {
+        .chan_type = DSMR_P1_CHAN_ENERGY_DELIVERED,
+        .chan_idx = 2,
+    };
+    const struct sensor_chan_spec current_3 = {
+        .chan_type = SENSOR_CHAN_CURRENT,
+        .chan_idx = 2,
+    };
+    uint16_t frames;
+
+    zassert_equal(sensor_sample_fetch_chan(sensor, SENSOR_CHAN_ACCEL_X),
+                  -ENOTSUP);
+    zassert_equal(sensor_channel_get(sensor, SENSOR_CHAN_ACCEL_X, &val),
+                  -ENOTSUP);
+
+    // Three phases and two tariffs
+    zassert_ok(sensor_get_decoder(sensor, &decoder));
+    zassert_equal(decoder->get_frame_count(NULL, voltage_4, &frames),
+                  -ENOTSUP);
+    zassert_equal(decoder->get_frame_count(NULL, energy_3, &frames),
+                  -ENOTSUP);
+    zassert_ok(decoder->get_frame_count(NULL, current_3, &frames));
+    zassert_equal(frames, 1);
+}
+
+ZTEST_SUITE(sensor, NULL, suite_setup, NULL, NULL, NULL);
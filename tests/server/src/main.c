@@ -0,0 +1,252 @@
+/**
+ * @file main.c
+ * @author Theis <theismejnertsen@gmail.com>
+ * @date 2026-10-18
+ *
+ * @brief Tests of the frames of the bus held by HTTP responses
+ *
+ * A P1 port on an emulated UART receives the telegrams, the last one is kept
+ * like the app does and /data serves it with a reference held until the
+ * response is done. The tests are clients of the server on the loopback
+ * interface and check that the free frames of the pool return to what they
+ * were before the request, also when the response does not fit the transmit
+ * buffer.
+ */
+
+#include "server.h"
+
+#include <dsmr_p1/bus.h>
+#include <dsmr_p1/dsmr_p1.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define CHUNK_LEN 16
+#define RX_TIMEOUT K_SECONDS(1)
+#define RESPONSE_MAX_LEN 2048
+// Every request of a test, a leaked frame per request empties the pool
+#define NR_REQUESTS (2 * CONFIG_DSMR_P1_BUS_FRAMES)
+
+#define PORT_UART DEVICE_DT_GET(DT_BUS(DT_INST(0, dsmr_p1)))
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+struct telegram_buf {
+    char data[DSMR_P1_TELEGRAM_MAX_SIZE];
+    size_t len;
+};
+
+/******************************************************************************
+ * Local Variables
+ *****************************************************************************/
+
+static const struct device *const uart = PORT_UART;
+
+K_MUTEX_DEFINE(last_mu);
+K_SEM_DEFINE(received_sem, 0, 1);
+static const struct dsmr_p1_frame *last_frame;
+
+static char response[RESPONSE_MAX_LEN];
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+
+// Keep the last telegram like the app does for /data
+static void listener_cb(const struct dsmr_p1_frame *frame, void *user_data) {
+    ARG_UNUSED(user_data);
+
+    dsmr_p1_frame_ref(frame);
+    k_mutex_lock(&last_mu, K_FOREVER);
+    const struct dsmr_p1_frame *old = last_frame;
+    last_frame = frame;
+    k_mutex_unlock(&last_mu);
+    if (old) {
+        dsmr_p1_frame_unref(old);
+    }
+    k_sem_give(&received_sem);
+}
+
+DSMR_P1_LISTENER_DEFINE(last_listener, 0, listener_cb, NULL);
+
+static void data_on_done(int err, void *user_data) {
+    ARG_UNUSED(err);
+
+    dsmr_p1_frame_unref(user_data);
+}
+
+static int handle_data(const struct server_request *req,
+                       struct server_response *res) {
+    ARG_UNUSED(req);
+
+    k_mutex_lock(&last_mu, K_FOREVER);
+    const struct dsmr_p1_frame *frame = last_frame;
+    if (frame) {
+        dsmr_p1_frame_ref(frame);
+    }
+    k_mutex_unlock(&last_mu);
+
+    if (!frame) {
+        res->status = HTTP_503_SERVICE_UNAVAILABLE;
+        return 0;
+    }
+
+    res->status = HTTP_200_OK;
+    sys_hashmap_insert(&res->headers, (uint64_t)"Content-Type",
+                       (uint64_t)"text/plain", NULL);
+    res->body = (char *)frame->data;
+    res->body_len = frame->len;
+    res->on_done = data_on_done;
+    res->user_data = (void *)frame;
+    return 0;
+}
+
+// A DSMR 5 telegram with a valid CRC, with the lines of all three phases
+// when long
+static void build(struct telegram_buf *t, bool long_telegram) {
+    int len = snprintf(t->data, sizeof(t->data),
+                       "/TST5\\2SERVER\r\n"
+                       "\r\n"
+                       "1-3:0.2.8(50)\r\n"
+                       "0-0:1.0.0(261018120000S)\r\n"
+                       "0-0:96.1.1(4D455445523030)\r\n"
+                       "1-0:1.7.0(01.234*kW)\r\n");
+
+    if (long_telegram) {
+        len += snprintf(&t->data[len], sizeof(t->data) - len,
+                        "1-0:32.7.0(230.1*V)\r\n"
+                        "1-0:52.7.0(230.2*V)\r\n"
+                        "1-0:72.7.0(230.3*V)\r\n"
+                        "1-0:31.7.0(001*A)\r\n"
+                        "1-0:51.7.0(002*A)\r\n"
+                        "1-0:71.7.0(003*A)\r\n"
+                        "1-0:21.7.0(00.411*kW)\r\n"
+                        "1-0:41.7.0(00.412*kW)\r\n"
+                        "1-0:61.7.0(00.413*kW)\r\n"
+                        "1-0:22.7.0(00.000*kW)\r\n"
+                        "1-0:42.7.0(00.000*kW)\r\n"
+                        "1-0:62.7.0(00.000*kW)\r\n");
+    }
+    len += snprintf(&t->data[len], sizeof(t->data) - len, "!");
+    const uint16_t crc = dsmr_p1_crc((const uint8_t *)t->data, len);
+    len += snprintf(&t->data[len], sizeof(t->data) - len, "%04X\r\n", crc);
+    t->len = len;
+}
+
+// Feed a telegram a chunk at a time and wait for it on the bus
+static void receive(const struct telegram_buf *t) {
+    for (size_t offset = 0; offset < t->len; offset += CHUNK_LEN) {
+        const size_t len = MIN(CHUNK_LEN, t->len - offset);
+        zassert_equal(uart_emul_put_rx_data(
+                          uart, (const uint8_t *)&t->data[offset], len),
+                      len);
+        // Let the emulated interrupt drain the FIFO
+        k_sleep(K_MSEC(1));
+    }
+    zassert_ok(k_sem_take(&received_sem, RX_TIMEOUT), "no telegram");
+    // Let the receive thread return the frames it published
+    k_sleep(K_MSEC(10));
+}
+
+static uint32_t free_frames(void) {
+    struct dsmr_p1_bus_stats stats;
+
+    dsmr_p1_bus_get_stats(&stats);
+    return stats.free;
+}
+
+// GET /data and read the response until the server closes the connection,
+// which it does after the response is done
+static int get_data(void) {
+    static const char req[] = "GET /data HTTP/1.1\r\nHost: test\r\n\r\n";
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(80),
+    };
+    size_t len = 0;
+    int ret;
+
+    zassert_equal(zsock_inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr), 1);
+    const int fd = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    zassert_true(fd >= 0, "socket: %d", errno);
+    zassert_ok(zsock_connect(fd, (struct sockaddr *)&addr, sizeof(addr)),
+               "connect: %d", errno);
+    zassert_equal(zsock_send(fd, req, sizeof(req) - 1, 0), sizeof(req) - 1);
+
+    while (len < sizeof(response) - 1) {
+        ret = zsock_recv(fd, &response[len], sizeof(response) - 1 - len, 0);
+        if (ret <= 0) {
+            break;
+        }
+        len += ret;
+    }
+    response[len] = '\0';
+    (void)zsock_close(fd);
+
+    int status = 0;
+    zassert_equal(sscanf(response, "HTTP/1.1 %d", &status), 1,
+                  "no status line in: %s", response);
+    return status;
+}
+
+static void *suite_setup(void) {
+    zassert_true(device_is_ready(uart));
+    zassert_ok(server_add_resource("/data", handle_data));
+    zassert_ok(dsmr_p1_enable());
+    server_start();
+    return NULL;
+}
+
+/******************************************************************************
+ * Tests
+ *****************************************************************************/
+
+ZTEST(server, test_response_releases_frame) {
+    struct telegram_buf t;
+
+    build(&t, false);
+    receive(&t);
+    const uint32_t baseline = free_frames();
+
+    for (size_t i = 0; i < NR_REQUESTS; i++) {
+        zassert_equal(get_data(), HTTP_200_OK);
+        zassert_not_null(strstr(response, "1-0:1.7.0(01.234*kW)"));
+        zassert_equal(free_frames(), baseline, "frame leaked by request %zu",
+                      i);
+    }
+}
+
+ZTEST(server, test_unserializable_response_releases_frame) {
+    struct telegram_buf t;
+
+    build(&t, true);
+    zassert_true(t.len > CONFIG_APP_SERVER_TX_BUF_SIZE);
+    receive(&t);
+    const uint32_t baseline = free_frames();
+
+    for (size_t i = 0; i < NR_REQUESTS; i++) {
+        zassert_equal(get_data(), HTTP_507_INSUFFICIENT_STORAGE);
+        zassert_equal(free_frames(), baseline, "frame leaked by request %zu",
+                      i);
+    }
+
+    // The pool still has room for the next telegram
+    build(&t, false);
+    receive(&t);
+    zassert_equal(get_data(), HTTP_200_OK);
+}
+
+ZTEST_SUITE(server, NULL, suite_setup, NULL, NULL, NULL);